@@ -0,0 +1,122 @@
+/**
+  ******************************************************************************
+  * @file    ahrs.h
+  * @brief   This file contains the definitions of the attitude and heading
+  *          reference system: a quaternion integrated on every gyro sample,
+  *          corrected toward the accelerometer and magnetometer at a lower
+  *          rate by a Mahony or a Madgwick filter.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AHRS_H__
+#define __AHRS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "imu.h"
+#include "timing.h"
+
+/* Exported constants --------------------------------------------------------*/
+/** Gyro samples per accelerometer and magnetometer correction: 250 Hz at
+  * the 2 kHz loop rate. The accelerometer is averaged over them */
+#define AHRS_CORRECTION_DECIM     8U
+
+/** Mahony proportional gain, rad/s per unit of direction error, about a
+  * 1 s time constant */
+#define AHRS_MAHONY_KP            1.0f
+
+/** Madgwick gain: rate of the normalized gradient step, rad/s of
+  * quaternion, the body rate correction being twice it */
+#define AHRS_MADGWICK_BETA        0.05f
+
+/** Integral gain of both filters, 1/s^2 (Madgwick's zeta), learning the
+  * gyro bias */
+#define AHRS_KI                   0.05f
+
+/** Settling after the attitude is set from the accelerometer and after the
+  * first field: the gains are this many times larger for AHRS_SETTLE_S and
+  * the integral is held */
+#define AHRS_SETTLE_GAIN          10.0f
+#define AHRS_SETTLE_S             3.0f
+
+/** Corrections a field is used by, 100 ms: the magnetometer is slower */
+#define AHRS_MAG_USES             25U
+
+/** The accelerometer only corrects while its norm is within this of 1 g,
+  * away from it the vehicle accelerates */
+#define AHRS_ACCEL_GATE_G         0.15f
+
+/** A gap between gyro samples longer than this restarts the integration
+  * at the next sample */
+#define AHRS_MAX_GAP_US           20000U
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Correction filter.
+  */
+typedef enum
+{
+  AHRS_METHOD_MAHONY = 0U,  /*!< Proportional integral feedback of the error */
+  AHRS_METHOD_MADGWICK      /*!< Normalized gradient descent step            */
+} Ahrs_MethodTypeDef;
+
+/**
+  * @brief  AHRS statistics.
+  */
+typedef struct
+{
+  uint32_t updates;                /*!< Gyro samples integrated                */
+  uint32_t corrections;            /*!< Corrections run                        */
+  uint32_t accel_rejected;         /*!< Corrections without the accelerometer  */
+  uint32_t mag_used;               /*!< Corrections with the magnetometer      */
+  uint32_t gaps;                   /*!< Integration restarts                   */
+  Timing_PerfTypeDef update_cycles;     /*!< Cost of the gyro integration      */
+  Timing_PerfTypeDef correction_cycles; /*!< Cost of the corrections           */
+} Ahrs_StatsTypeDef;
+
+/**
+  * @brief  AHRS instance. The quaternion rotates the IMU axes into the earth
+  *         axes, z up.
+  */
+typedef struct
+{
+  uint8_t method;                  /*!< @ref Ahrs_MethodTypeDef                */
+  uint8_t aligned;                 /*!< Attitude set from the accelerometer    */
+  uint8_t started;                 /*!< last_timestamp is valid                */
+  uint8_t mag_uses;                /*!< Corrections left for mag, 0 when stale */
+  uint8_t mag_seen;                /*!< A field was used since the alignment   */
+  float gyro_scale;                /*!< rad/s per gyro count                   */
+  float accel_scale;               /*!< g per accelerometer count              */
+  float seconds_per_cycle;         /*!< Timestamp unit                         */
+  uint32_t max_gap_cycles;         /*!< AHRS_MAX_GAP_US in cycles              */
+  uint64_t last_timestamp;         /*!< Time of the last gyro sample           */
+  float q[4];                      /*!< Attitude, w x y z                      */
+  float correction[3];             /*!< Rate added to the gyro, rad/s          */
+  float integral[3];               /*!< Integral of the error, minus the bias  */
+  float accel_sum[3];              /*!< Accelerometer since the last correction */
+  float correction_dt;             /*!< Time since the last correction         */
+  float settle;                    /*!< Settling time left, s                  */
+  uint32_t count;                  /*!< Gyro samples since the last correction */
+  float mag[3];                    /*!< Latest field direction                 */
+  Ahrs_StatsTypeDef stats;         /*!< AHRS statistics                        */
+} Ahrs_HandleTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern Ahrs_HandleTypeDef hahrs;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void Ahrs_Init(Ahrs_HandleTypeDef *ahrs, Ahrs_MethodTypeDef method, float gyro_dps_per_count,
+               float accel_g_per_count);
+void Ahrs_Update(Ahrs_HandleTypeDef *ahrs, const IMU_LoopSampleTypeDef *sample);
+void Ahrs_UpdateMag(Ahrs_HandleTypeDef *ahrs, const float field[3]);
+void Ahrs_Euler(const Ahrs_HandleTypeDef *ahrs, float euler[3]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AHRS_H__ */
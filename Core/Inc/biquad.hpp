@@ -0,0 +1,477 @@
+/**
+  ******************************************************************************
+  * @file    biquad.hpp
+  * @brief   This file provides the biquad filter library: PT1, PT2, low pass
+  *          and notch designs, and a bank of cascaded sections filtering
+  *          several axes at once.
+  *
+  *          The designs are constexpr, so a fixed filter chain is computed
+  *          by the compiler and lands in flash as plain coefficients; the
+  *          same functions retune a section at run time. They use their own
+  *          sin, cos and sqrt, the std ones not being constexpr.
+  *
+  *          A BiquadBank keeps the state of all its axes side by side per
+  *          section (structure of arrays), and runs the transposed direct
+  *          form II: per section and axis 5 multiplies and 4 adds with the
+  *          coefficients held in registers across the axes.
+  *
+  *          BiquadBankQ15 is the fixed point variant for int16 samples, on
+  *          the dual 16-bit multiply accumulates of the Cortex-M4 DSP
+  *          extension.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __BIQUAD_HPP__
+#define __BIQUAD_HPP__
+
+/* Includes ------------------------------------------------------------------*/
+#include <cstdint>
+#include "fast_math.h"
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Coefficients of one section, a0 normalized to 1:
+  *         H(z) = (b0 + b1 z^-1 + b2 z^-2) / (1 + a1 z^-1 + a2 z^-2).
+  *         The default is a pass through.
+  */
+struct BiquadCoeffs
+{
+  float b0 = 1.0f;
+  float b1 = 0.0f;
+  float b2 = 0.0f;
+  float a1 = 0.0f;
+  float a2 = 0.0f;
+};
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Sine by its series after reduction to [-pi, pi], usable in
+  *         constant expressions. About 1e-12 accurate.
+  */
+constexpr double BiquadSin(double x)
+{
+  constexpr double kPi = 3.14159265358979323846;
+  double term = 0.0;
+  double sum = 0.0;
+
+  while (x > kPi)
+  {
+    x -= 2.0 * kPi;
+  }
+  while (x < -kPi)
+  {
+    x += 2.0 * kPi;
+  }
+  term = x;
+  sum = x;
+  for (int n = 1; n < 14; n++)
+  {
+    term *= -(x * x) / (double)((2 * n) * ((2 * n) + 1));
+    sum += term;
+  }
+  return sum;
+}
+
+/**
+  * @brief  Cosine, see BiquadSin().
+  */
+constexpr double BiquadCos(double x)
+{
+  return BiquadSin(x + 1.57079632679489661923);
+}
+
+/**
+  * @brief  Square root by Newton iterations, usable in constant expressions.
+  */
+constexpr double BiquadSqrt(double x)
+{
+  double r = (x > 1.0) ? x : 1.0;
+
+  if (x <= 0.0)
+  {
+    return 0.0;
+  }
+  for (int n = 0; n < 64; n++)
+  {
+    r = 0.5 * (r + (x / r));
+  }
+  return r;
+}
+
+/**
+  * @brief  Pole p of the one pole low pass (1 - p) / (1 - p z^-1) whose
+  *         squared gain is gain2 at the normalized frequency w. Exact at
+  *         any cutoff, unlike k = dt / (RC + dt) which falls short of the
+  *         corner as it nears the Nyquist frequency.
+  */
+constexpr double BiquadPole(double w, double gain2)
+{
+  double b = (1.0 - (gain2 * BiquadCos(w))) / (1.0 - gain2);
+
+  return b - BiquadSqrt((b * b) - 1.0);
+}
+
+/**
+  * @brief  First order low pass y += k (x - y), -3 dB at the corner.
+  * @param  cutoff_hz Corner frequency
+  * @param  sample_hz Sample rate
+  */
+constexpr BiquadCoeffs BiquadPt1(float cutoff_hz, float sample_hz)
+{
+  double w = 2.0 * 3.14159265358979323846 * (double)cutoff_hz / (double)sample_hz;
+  double p = BiquadPole(w, 0.5);
+  BiquadCoeffs c;
+
+  c.b0 = (float)(1.0 - p);
+  c.b1 = 0.0f;
+  c.b2 = 0.0f;
+  c.a1 = (float)(-p);
+  c.a2 = 0.0f;
+  return c;
+}
+
+/**
+  * @brief  Two identical PT1 in one section, each -1.5 dB at the corner so
+  *         the pair is -3 dB there.
+  * @param  cutoff_hz Corner frequency of the pair
+  * @param  sample_hz Sample rate
+  */
+constexpr BiquadCoeffs BiquadPt2(float cutoff_hz, float sample_hz)
+{
+  double w = 2.0 * 3.14159265358979323846 * (double)cutoff_hz / (double)sample_hz;
+  double p = BiquadPole(w, 0.70710678118654752);
+  BiquadCoeffs c;
+
+  c.b0 = (float)((1.0 - p) * (1.0 - p));
+  c.b1 = 0.0f;
+  c.b2 = 0.0f;
+  c.a1 = (float)(-2.0 * p);
+  c.a2 = (float)(p * p);
+  return c;
+}
+
+/**
+  * @brief  Second order low pass, bilinear transform (RBJ cookbook).
+  * @param  cutoff_hz Corner frequency
+  * @param  sample_hz Sample rate
+  * @param  q Quality factor, 0.7071 for Butterworth
+  */
+constexpr BiquadCoeffs BiquadLowpass(float cutoff_hz, float sample_hz, float q)
+{
+  double w0 = 2.0 * 3.14159265358979323846 * (double)cutoff_hz / (double)sample_hz;
+  double cs = BiquadCos(w0);
+  double alpha = BiquadSin(w0) / (2.0 * (double)q);
+  double a0 = 1.0 + alpha;
+  BiquadCoeffs c;
+
+  c.b0 = (float)(((1.0 - cs) * 0.5) / a0);
+  c.b1 = (float)((1.0 - cs) / a0);
+  c.b2 = c.b0;
+  c.a1 = (float)((-2.0 * cs) / a0);
+  c.a2 = (float)((1.0 - alpha) / a0);
+  return c;
+}
+
+/**
+  * @brief  Notch from the cosine and sine of its normalized center, the
+  *         part shared by the compile time and run time designs.
+  * @param  cs cos(w0)
+  * @param  sn sin(w0)
+  * @param  q Quality factor, center over -3 dB bandwidth
+  */
+constexpr BiquadCoeffs BiquadNotchSinCos(double cs, double sn, double q)
+{
+  double alpha = sn / (2.0 * q);
+  double a0 = 1.0 + alpha;
+  BiquadCoeffs c;
+
+  c.b0 = (float)(1.0 / a0);
+  c.b1 = (float)((-2.0 * cs) / a0);
+  c.b2 = c.b0;
+  c.a1 = c.b1;
+  c.a2 = (float)((1.0 - alpha) / a0);
+  return c;
+}
+
+/**
+  * @brief  Notch, bilinear transform (RBJ cookbook), unit gain away from the
+  *         center.
+  * @param  center_hz Rejected frequency
+  * @param  sample_hz Sample rate
+  * @param  q Quality factor, center over -3 dB bandwidth
+  */
+constexpr BiquadCoeffs BiquadNotch(float center_hz, float sample_hz, float q)
+{
+  double w0 = 2.0 * 3.14159265358979323846 * (double)center_hz / (double)sample_hz;
+
+  return BiquadNotchSinCos(BiquadCos(w0), BiquadSin(w0), (double)q);
+}
+
+/**
+  * @brief  Notch designed in single precision with the fast sine and
+  *         cosine, for retuning in the loop: BiquadNotch() goes through
+  *         double arithmetic, in software on the Cortex-M4.
+  * @param  center_hz Rejected frequency
+  * @param  sample_hz Sample rate
+  * @param  q Quality factor, center over -3 dB bandwidth
+  */
+inline BiquadCoeffs BiquadNotchTune(float center_hz, float sample_hz, float q)
+{
+  float w0 = 6.28318530718f * center_hz / sample_hz;
+  float sn = 0.0f;
+  float cs = 0.0f;
+  float alpha;
+  float a0;
+  BiquadCoeffs c;
+
+  FastMath_SinCos(w0, &sn, &cs);
+  alpha = sn / (2.0f * q);
+  a0 = 1.0f / (1.0f + alpha);
+
+  c.b0 = a0;
+  c.b1 = -2.0f * cs * a0;
+  c.b2 = c.b0;
+  c.a1 = c.b1;
+  c.a2 = (1.0f - alpha) * a0;
+  return c;
+}
+
+/**
+  * @brief  Stages cascaded sections applied to Axes channels. The state of
+  *         the axes of a section is contiguous.
+  */
+template <uint32_t Stages, uint32_t Axes = 3U>
+class BiquadBank
+{
+  static_assert(Stages != 0U, "BiquadBank needs a section");
+
+public:
+  constexpr BiquadBank() = default;
+
+  /**
+    * @brief  Bank with its coefficients, constant initialized when they are
+    *         constant expressions.
+    */
+  constexpr explicit BiquadBank(const BiquadCoeffs (&coeffs)[Stages])
+  {
+    for (uint32_t s = 0U; s < Stages; s++)
+    {
+      coeffs_[s] = coeffs[s];
+    }
+  }
+
+  /**
+    * @brief  Retune a section, its state is kept so the output stays
+    *         continuous while the coefficients move.
+    */
+  void SetStage(uint32_t stage, const BiquadCoeffs &coeffs)
+  {
+    coeffs_[stage] = coeffs;
+  }
+
+  /**
+    * @brief  Clear the state of every section.
+    */
+  void Reset()
+  {
+    for (uint32_t s = 0U; s < Stages; s++)
+    {
+      for (uint32_t a = 0U; a < Axes; a++)
+      {
+        z1_[s][a] = 0.0f;
+        z2_[s][a] = 0.0f;
+      }
+    }
+  }
+
+  /**
+    * @brief  Filter one sample of every axis in place.
+    */
+  void Apply(float *x)
+  {
+    for (uint32_t s = 0U; s < Stages; s++)
+    {
+      const float b0 = coeffs_[s].b0;
+      const float b1 = coeffs_[s].b1;
+      const float b2 = coeffs_[s].b2;
+      const float a1 = coeffs_[s].a1;
+      const float a2 = coeffs_[s].a2;
+      float *z1 = z1_[s];
+      float *z2 = z2_[s];
+
+      for (uint32_t a = 0U; a < Axes; a++)
+      {
+        const float in = x[a];
+        const float out = (b0 * in) + z1[a];
+
+        z1[a] = ((b1 * in) - (a1 * out)) + z2[a];
+        z2[a] = (b2 * in) - (a2 * out);
+        x[a] = out;
+      }
+    }
+  }
+
+  /**
+    * @brief  Coefficients of a section.
+    */
+  const BiquadCoeffs &Stage(uint32_t stage) const
+  {
+    return coeffs_[stage];
+  }
+
+private:
+  BiquadCoeffs coeffs_[Stages] {};         /*!< Per section coefficients    */
+  float z1_[Stages][Axes] {};              /*!< First state, per section    */
+  float z2_[Stages][Axes] {};              /*!< Second state, per section   */
+};
+
+/**
+  * @brief  Coefficients of one section in Q14 (range [-2, 2)) packed for the
+  *         dual 16-bit multiply accumulates: the feedback terms are stored
+  *         negated so every product is added.
+  */
+struct BiquadQ15Coeffs
+{
+  int16_t b0 = 16384;
+  uint32_t b12 = 0U;                       /*!< b1 low half, b2 high half   */
+  uint32_t a12 = 0U;                       /*!< -a1 low half, -a2 high half */
+};
+
+/**
+  * @brief  Round a coefficient to Q14, saturated.
+  */
+constexpr int16_t BiquadQ14(float value)
+{
+  float scaled = value * 16384.0f;
+  int32_t q = (int32_t)(scaled + ((scaled >= 0.0f) ? 0.5f : -0.5f));
+
+  return (int16_t)((q > 32767) ? 32767 : ((q < -32768) ? -32768 : q));
+}
+
+/**
+  * @brief  Two 16-bit values in one word, first in the low half.
+  */
+constexpr uint32_t BiquadPack(int16_t low, int16_t high)
+{
+  return (uint32_t)(uint16_t)low | ((uint32_t)(uint16_t)high << 16);
+}
+
+/**
+  * @brief  Fixed point form of a section.
+  */
+constexpr BiquadQ15Coeffs BiquadToQ15(const BiquadCoeffs &c)
+{
+  BiquadQ15Coeffs q;
+
+  q.b0 = BiquadQ14(c.b0);
+  q.b12 = BiquadPack(BiquadQ14(c.b1), BiquadQ14(c.b2));
+  q.a12 = BiquadPack(BiquadQ14(-c.a1), BiquadQ14(-c.a2));
+  return q;
+}
+
+/**
+  * @brief  acc + x.low * c.low + x.high * c.high, the SMLALD instruction on
+  *         the Cortex-M4, the same arithmetic elsewhere.
+  */
+inline int64_t BiquadDualMac(uint32_t x, uint32_t c, int64_t acc)
+{
+#if defined(__ARM_FEATURE_DSP)
+  return (int64_t)__SMLALD(x, c, (uint64_t)acc);
+#else
+  return acc + ((int64_t)(int16_t)(uint16_t)x * (int16_t)(uint16_t)c)
+         + ((int64_t)(int16_t)(uint16_t)(x >> 16) * (int16_t)(uint16_t)(c >> 16));
+#endif
+}
+
+/**
+  * @brief  Saturate to 16 bits, the SSAT instruction on the Cortex-M4.
+  */
+inline int16_t BiquadSat16(int32_t value)
+{
+#if defined(__ARM_FEATURE_DSP)
+  return (int16_t)__SSAT(value, 16);
+#else
+  return (int16_t)((value > 32767) ? 32767 : ((value < -32768) ? -32768 : value));
+#endif
+}
+
+/**
+  * @brief  Fixed point counterpart of BiquadBank on int16 samples, direct
+  *         form I as CMSIS-DSP arm_biquad_cascade_df1_q15: the two previous
+  *         inputs and the two previous outputs of a section are kept as
+  *         packed pairs, so a section is one multiply and two dual multiply
+  *         accumulates into 64 bits, then a rounding shift and a saturation.
+  *         The outputs fed back are the saturated 16-bit ones, so the
+  *         results are the same on the target and on the host.
+  */
+template <uint32_t Stages, uint32_t Axes = 3U>
+class BiquadBankQ15
+{
+  static_assert(Stages != 0U, "BiquadBankQ15 needs a section");
+
+public:
+  constexpr BiquadBankQ15() = default;
+
+  /**
+    * @brief  Bank with the fixed point form of float coefficients, constant
+    *         initialized when they are constant expressions.
+    */
+  constexpr explicit BiquadBankQ15(const BiquadCoeffs (&coeffs)[Stages])
+  {
+    for (uint32_t s = 0U; s < Stages; s++)
+    {
+      coeffs_[s] = BiquadToQ15(coeffs[s]);
+    }
+  }
+
+  /**
+    * @brief  Clear the state of every section.
+    */
+  void Reset()
+  {
+    for (uint32_t s = 0U; s < Stages; s++)
+    {
+      for (uint32_t a = 0U; a < Axes; a++)
+      {
+        x12_[s][a] = 0U;
+        y12_[s][a] = 0U;
+      }
+    }
+  }
+
+  /**
+    * @brief  Filter one sample of every axis in place.
+    */
+  void Apply(int16_t *x)
+  {
+    for (uint32_t s = 0U; s < Stages; s++)
+    {
+      const int32_t b0 = coeffs_[s].b0;
+      const uint32_t b12 = coeffs_[s].b12;
+      const uint32_t a12 = coeffs_[s].a12;
+      uint32_t *x12 = x12_[s];
+      uint32_t *y12 = y12_[s];
+
+      for (uint32_t a = 0U; a < Axes; a++)
+      {
+        const int16_t in = x[a];
+        int64_t acc = (int64_t)(b0 * in);
+        int16_t out;
+
+        acc = BiquadDualMac(x12[a], b12, acc);
+        acc = BiquadDualMac(y12[a], a12, acc);
+        out = BiquadSat16((int32_t)((acc + (1 << 13)) >> 14));
+        x12[a] = (uint32_t)(uint16_t)in | (x12[a] << 16);
+        y12[a] = (uint32_t)(uint16_t)out | (y12[a] << 16);
+        x[a] = out;
+      }
+    }
+  }
+
+private:
+  BiquadQ15Coeffs coeffs_[Stages] {};      /*!< Per section coefficients    */
+  uint32_t x12_[Stages][Axes] {};          /*!< x[n-1] low, x[n-2] high     */
+  uint32_t y12_[Stages][Axes] {};          /*!< y[n-1] low, y[n-2] high     */
+};
+
+#endif /* __BIQUAD_HPP__ */
@@ -0,0 +1,78 @@
+/**
+  ******************************************************************************
+  * @file    decim.h
+  * @brief   This file contains the definitions of the IMU decimation stage:
+  *          an integer CIC decimator with a droop compensator, between the
+  *          high rate IMU sample ring and the control loop.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __DECIM_H__
+#define __DECIM_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "imu.h"
+#include "timing.h"
+
+/* Exported constants --------------------------------------------------------*/
+/** Number of integrator/comb pairs. The accumulators hold ratio^ORDER times
+  * a 16-bit sample, so ratio^ORDER must stay below 2^16 */
+#define DECIM_ORDER           3U
+#define DECIM_MAX_RATIO       16U
+
+/** Channels filtered per sample: gyro X Y Z then accel X Y Z */
+#define DECIM_CHANNELS        6U
+
+/** Ratio of the SPI IMU stream: 8 kHz into a 2 kHz control loop */
+#define DECIM_RATIO           4U
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Decimator statistics. The average cost per input sample is
+  *         (input_cycles.total + output_cycles.total) / inputs.
+  */
+typedef struct
+{
+  uint32_t inputs;                  /*!< Samples fed                           */
+  uint32_t outputs;                 /*!< Samples produced                      */
+  Timing_PerfTypeDef input_cycles;  /*!< Calls that only integrate             */
+  Timing_PerfTypeDef output_cycles; /*!< Calls that also run combs and compensator */
+} Decim_StatsTypeDef;
+
+/**
+  * @brief  Decimator instance.
+  */
+typedef struct
+{
+  uint8_t ratio;                                  /*!< Inputs per output          */
+  uint8_t phase;                                  /*!< Inputs since the last output */
+  uint8_t settle;                                 /*!< Outputs left in the start transient */
+  uint32_t integ[DECIM_ORDER][DECIM_CHANNELS];    /*!< Integrators, wrap around   */
+  uint32_t comb[DECIM_ORDER][DECIM_CHANNELS];     /*!< Comb delay lines           */
+  float history[2][DECIM_CHANNELS];               /*!< Previous two CIC outputs   */
+  float scale;                                    /*!< 1 / ratio^ORDER            */
+  float comp_center;                              /*!< Compensator taps, see Decim_Init() */
+  float comp_side;
+  uint32_t delay_num;                             /*!< Group delay in input periods, */
+  uint32_t delay_den;                             /*!< as a fraction              */
+  uint64_t output_stamp;                          /*!< Input stamp of the last output */
+  Decim_StatsTypeDef stats;                       /*!< Decimator statistics       */
+} Decim_HandleTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern Decim_HandleTypeDef hdecim;
+
+/* Exported functions prototypes ---------------------------------------------*/
+HAL_StatusTypeDef Decim_Init(Decim_HandleTypeDef *dec, uint32_t ratio);
+uint8_t Decim_Process(Decim_HandleTypeDef *dec, const IMU_SampleTypeDef *in, IMU_LoopSampleTypeDef *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DECIM_H__ */
@@ -0,0 +1,143 @@
+/**
+  ******************************************************************************
+  * @file    detect.h
+  * @brief   This file contains the definitions of the boot time sensor
+  *          detection. Candidate devices are probed in one batch of queued
+  *          bus jobs and the resulting hardware manifest is cached in flash,
+  *          so that later boots only verify the devices found before.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __DETECT_H__
+#define __DETECT_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "i2c_bus.h"
+#include "timing.h"
+
+/* Exported constants --------------------------------------------------------*/
+/** Devices a manifest can describe */
+#define DETECT_MAX_DEVICES        8U
+
+/** Probes a detection can run, candidates times buses */
+#define DETECT_MAX_PROBES         32U
+
+/** Flash sector holding the manifest log, kept out of the FLASH region by
+  * STM32F405RGTX_FLASH.ld */
+#define DETECT_FLASH_SECTOR       FLASH_SECTOR_11
+#define DETECT_FLASH_ADDRESS      0x080E0000U
+#define DETECT_FLASH_SIZE         0x00020000U
+
+/** Identifies a manifest record, bump when the record layout changes */
+#define DETECT_MANIFEST_MAGIC     0x4D4E4601U
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Kind of detected device.
+  */
+typedef enum
+{
+  DETECT_DEV_NONE = 0U,
+  DETECT_DEV_MPU6050,       /*!< MPU-6050/6500, ICM-2060x IMU  */
+  DETECT_DEV_BMP280,        /*!< BMP280/BME280 barometer       */
+  DETECT_DEV_MS5611,        /*!< MS5611 barometer              */
+  DETECT_DEV_QMC5883L,      /*!< QMC5883L magnetometer         */
+  DETECT_DEV_HMC5883L,      /*!< HMC5883L magnetometer         */
+  DETECT_DEV_VL53L1X        /*!< VL53L1X time-of-flight ranger */
+} Detect_DeviceKindTypeDef;
+
+/**
+  * @brief  A device found on a bus.
+  */
+typedef struct
+{
+  uint8_t kind;             /*!< @ref Detect_DeviceKindTypeDef        */
+  uint8_t bus;              /*!< Index of the bus given to Detect_Init */
+  uint8_t address;          /*!< 7-bit device address                 */
+  uint8_t id;               /*!< Identification register read back    */
+} Detect_DeviceTypeDef;
+
+/**
+  * @brief  Hardware manifest, also the flash record layout.
+  */
+typedef struct
+{
+  uint32_t magic;                                  /*!< DETECT_MANIFEST_MAGIC   */
+  uint32_t count;                                  /*!< Devices in the manifest */
+  Detect_DeviceTypeDef devices[DETECT_MAX_DEVICES]; /*!< Detected devices       */
+  uint32_t checksum;                               /*!< FNV-1a of the fields above */
+} Detect_ManifestTypeDef;
+
+/**
+  * @brief  One identification read in flight.
+  */
+typedef struct
+{
+  I2C_JobTypeDef job;       /*!< Bus job of the probe             */
+  uint8_t candidate;        /*!< Index in the candidate table     */
+  uint8_t bus;              /*!< Index of the bus probed          */
+  uint8_t value;            /*!< Identification register content */
+} Detect_ProbeTypeDef;
+
+/**
+  * @brief  Detection steps.
+  */
+typedef enum
+{
+  DETECT_STATE_IDLE = 0U,   /*!< Not started                           */
+  DETECT_STATE_VERIFY,      /*!< Probing the devices of the cached manifest */
+  DETECT_STATE_SCAN,        /*!< Probing every candidate on every bus  */
+  DETECT_STATE_DONE         /*!< Manifest available                    */
+} Detect_StateTypeDef;
+
+/**
+  * @brief  Boot report, readable once the detection is done.
+  */
+typedef struct
+{
+  uint8_t from_cache;       /*!< 1 when the cached manifest was confirmed */
+  uint8_t manifest_written; /*!< 1 when a new manifest was stored         */
+  uint8_t sector_erased;    /*!< 1 when the manifest log had to be erased */
+  uint32_t probes;          /*!< Probes put on the bus                   */
+  uint32_t verify_cycles;   /*!< Time spent verifying the cache          */
+  uint32_t scan_cycles;     /*!< Time spent on the full scan             */
+  uint32_t store_cycles;    /*!< Time spent writing the flash            */
+} Detect_ReportTypeDef;
+
+/**
+  * @brief  Detection instance.
+  */
+typedef struct
+{
+  I2C_BusTypeDef *buses[I2C_BUS_MAX];          /*!< Buses to probe              */
+  uint8_t bus_count;                           /*!< Number of buses             */
+  volatile uint8_t state;                      /*!< @ref Detect_StateTypeDef    */
+  uint8_t probe_count;                         /*!< Probes of the current step  */
+  uint8_t submitted;                           /*!< Probes already queued       */
+  uint32_t stamp;                              /*!< DWT stamp of the step start */
+  Detect_ProbeTypeDef probes[DETECT_MAX_PROBES]; /*!< Probes of the current step */
+  const Detect_ManifestTypeDef *cached;        /*!< Manifest found in flash     */
+  Detect_ManifestTypeDef manifest;             /*!< Result of the detection     */
+  Detect_ReportTypeDef report;                 /*!< Boot report                 */
+} Detect_HandleTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern Detect_HandleTypeDef hdetect;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void Detect_Init(Detect_HandleTypeDef *det, I2C_BusTypeDef *const *buses, uint8_t bus_count);
+void Detect_Start(Detect_HandleTypeDef *det);
+HAL_StatusTypeDef Detect_Poll(Detect_HandleTypeDef *det);
+const Detect_DeviceTypeDef *Detect_Find(const Detect_HandleTypeDef *det, Detect_DeviceKindTypeDef kind,
+                                        uint8_t index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DETECT_H__ */
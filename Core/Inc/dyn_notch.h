@@ -0,0 +1,71 @@
+/**
+  ******************************************************************************
+  * @file    dyn_notch.h
+  * @brief   This file contains the C interface of the dynamic notch filter:
+  *          an onboard spectrum analyzer of the gyro finds the motor noise
+  *          peaks of each axis and retunes a notch on each of them.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __DYN_NOTCH_H__
+#define __DYN_NOTCH_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "timing.h"
+
+/* Exported constants --------------------------------------------------------*/
+/** Real FFT length, a power of two from 16 to 1024: 15.6 Hz bins and a
+  * 64 ms window at the 2 kHz loop rate */
+#define DYN_NOTCH_FFT_LEN       128U
+
+/** Notches, and so peaks tracked, per axis */
+#define DYN_NOTCH_PEAKS         3U
+
+/** Band searched for motor noise */
+#define DYN_NOTCH_MIN_HZ        80.0f
+#define DYN_NOTCH_MAX_HZ        600.0f
+
+/** A peak is kept when its power is this many times the median power of
+  * the band: a noise only bin gets there about once in 1000 */
+#define DYN_NOTCH_SNR           10.0f
+
+/** Quality factor of the notches, center over -3 dB bandwidth */
+#define DYN_NOTCH_Q             3.0f
+
+/** Step of a notch center toward its peak on each analysis of its axis,
+  * one analysis every DYN_NOTCH_FFT_LEN / 2 samples */
+#define DYN_NOTCH_TRACK_ALPHA   0.4f
+
+/** Cycle budget of one DynNotch_Poll() call, checked between steps */
+#define DYN_NOTCH_BUDGET_US     10U
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Analyzer state and statistics.
+  */
+typedef struct
+{
+  float center_hz[3][DYN_NOTCH_PEAKS]; /*!< Notch centers per axis, 0 while unused */
+  uint32_t analyses;                   /*!< Spectra computed, all axes            */
+  uint32_t late;                       /*!< Analyses started after their slot     */
+  Timing_PerfTypeDef poll_cycles;      /*!< Cost of the DynNotch_Poll() calls     */
+  Timing_PerfTypeDef apply_cycles;     /*!< Cost of the DynNotch_Apply() calls    */
+} DynNotch_StatsTypeDef;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void DynNotch_Init(float sample_hz);
+void DynNotch_Push(const float gyro[3]);
+void DynNotch_Poll(uint32_t budget_cycles);
+void DynNotch_Apply(float gyro[3]);
+const DynNotch_StatsTypeDef *DynNotch_Stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DYN_NOTCH_H__ */
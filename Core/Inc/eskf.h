@@ -0,0 +1,162 @@
+/**
+  ******************************************************************************
+  * @file    eskf.h
+  * @brief   This file contains the C interface of the navigation filter: an
+  *          error state Kalman filter of the attitude, velocity, position and
+  *          gyro and accelerometer biases, running a fixed time behind the
+  *          IMU so the late measurements are fused at their own time, and
+  *          an output predictor carrying its estimate to the latest sample.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __ESKF_H__
+#define __ESKF_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "imu.h"
+#include "timing.h"
+
+/* Exported constants --------------------------------------------------------*/
+/** Error state: attitude, velocity, position, gyro bias, accelerometer bias,
+  * three components each */
+#define ESKF_STATES               15U
+
+/** Period of the covariance prediction, the IMU being accumulated in
+  * between: 250 Hz */
+#define ESKF_PREDICT_US           4000U
+
+/** Noise densities of the gyro, rad/s/sqrt(Hz), and of the accelerometer,
+  * m/s^2/sqrt(Hz), vibration included */
+#define ESKF_GYRO_NOISE           0.002f
+#define ESKF_ACCEL_NOISE          0.05f
+
+/** Random walks of the biases, rad/s^2/sqrt(Hz) and m/s^3/sqrt(Hz) */
+#define ESKF_GYRO_BIAS_WALK       1e-5f
+#define ESKF_ACCEL_BIAS_WALK      1e-3f
+
+/** Standard deviations of the error state at Eskf_Start(): attitude rad,
+  * velocity m/s, position m, gyro bias rad/s, accelerometer bias m/s^2 */
+#define ESKF_INIT_ATTITUDE        0.05f
+#define ESKF_INIT_VELOCITY        0.5f
+#define ESKF_INIT_POSITION        1.0f
+#define ESKF_INIT_GYRO_BIAS       0.01f
+#define ESKF_INIT_ACCEL_BIAS      0.3f
+
+/** Variance of the barometer height, m^2 */
+#define ESKF_BARO_VARIANCE        0.25f
+
+/** A measurement is rejected when its squared innovation is more than this
+  * many times its variance: 5 standard deviations */
+#define ESKF_GATE                 25.0f
+
+/** Measurement components waiting for fusion, a power of two: they wait
+  * up to ESKF_DELAY_US, 20 barometer heights and 2 GPS fixes of 6
+  * components, twice that for margin */
+#define ESKF_QUEUE_LEN            64U
+
+/** Delay of the filter behind the IMU, the oldest measurement it can fuse
+  * at its own time: GPS fixes come 100 to 200 ms late */
+#define ESKF_DELAY_US             200000U
+
+/** Entries of the horizon ring, one per ESKF_PREDICT_US, a power of two
+  * holding ESKF_DELAY_US and the entries due but not yet taken */
+#define ESKF_HORIZON_LEN          64U
+
+/** Time constant of the output predictor toward the filter, s */
+#define ESKF_OUTPUT_TAU_S         0.25f
+
+/** Cycle budget of one Eskf_Poll() call, checked between steps */
+#define ESKF_BUDGET_US            10U
+
+/** A gap between IMU samples longer than this restarts the integration at
+  * the next sample */
+#define ESKF_MAX_GAP_US           20000U
+
+/** Standard gravity, m/s^2 */
+#define ESKF_GRAVITY              9.80665f
+
+/** Covariance predictions run by Eskf_Bench() on each path */
+#define ESKF_BENCH_RUNS           16U
+
+#if (ESKF_QUEUE_LEN & (ESKF_QUEUE_LEN - 1U)) != 0U
+#error "ESKF_QUEUE_LEN must be a power of two"
+#endif
+
+#if (ESKF_HORIZON_LEN & (ESKF_HORIZON_LEN - 1U)) != 0U
+#error "ESKF_HORIZON_LEN must be a power of two"
+#endif
+
+#if ((ESKF_DELAY_US / ESKF_PREDICT_US) + 4U) > ESKF_HORIZON_LEN
+#error "ESKF_HORIZON_LEN does not hold ESKF_DELAY_US"
+#endif
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Output state, at the latest IMU sample. The quaternion rotates
+  *         the IMU axes into the earth axes, z up, as the AHRS one. Position
+  *         is from the start point. The biases are those of the filter.
+  */
+typedef struct
+{
+  uint8_t started;                 /*!< Eskf_Start() was called                */
+  float q[4];                      /*!< Attitude, w x y z                      */
+  float velocity[3];               /*!< Earth axes, m/s                        */
+  float position[3];               /*!< Earth axes, m                          */
+  float gyro_bias[3];              /*!< rad/s                                  */
+  float accel_bias[3];             /*!< m/s^2                                  */
+} Eskf_StateTypeDef;
+
+/**
+  * @brief  Filter statistics.
+  */
+typedef struct
+{
+  uint32_t predictions;            /*!< Covariance predictions completed       */
+  uint32_t fusions;                /*!< Measurement components fused           */
+  uint32_t rejected;               /*!< Components failing ESKF_GATE           */
+  uint32_t dropped;                /*!< Measurements lost to a full queue      */
+  uint32_t stale;                  /*!< Measurements older than the filter     */
+  uint32_t late;                   /*!< Samples held back, the horizon full    */
+  uint32_t gaps;                   /*!< Integration restarts                   */
+  uint32_t footprint;              /*!< Bytes of covariance, horizon and queue */
+  Timing_PerfTypeDef push_cycles;     /*!< Cost of the Eskf_Push() calls       */
+  Timing_PerfTypeDef queue_cycles;    /*!< Cost of queueing a measurement      */
+  Timing_PerfTypeDef poll_cycles;     /*!< Cost of the Eskf_Poll() calls       */
+  Timing_PerfTypeDef step_cycles;     /*!< Cost of each step                   */
+  Timing_PerfTypeDef predict_cycles;  /*!< Cost of a prediction, all its steps */
+  Timing_PerfTypeDef fuse_cycles;     /*!< Cost of a component, all its steps  */
+} Eskf_StatsTypeDef;
+
+/**
+  * @brief  Result of Eskf_Bench(), per covariance prediction.
+  */
+typedef struct
+{
+  uint32_t sparse_cycles;          /*!< Cycles of the block sparse product     */
+  uint32_t dense_cycles;           /*!< Cycles of the dense F P F'             */
+  float max_error;                 /*!< Largest difference of the two          */
+} Eskf_BenchTypeDef;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void Eskf_Init(float gyro_dps_per_count, float accel_g_per_count);
+void Eskf_Start(const float q[4]);
+void Eskf_Push(const IMU_LoopSampleTypeDef *sample);
+void Eskf_Poll(uint32_t budget_cycles);
+HAL_StatusTypeDef Eskf_FusePosition(uint64_t timestamp, const float position[3], float variance);
+HAL_StatusTypeDef Eskf_FuseVelocity(uint64_t timestamp, const float velocity[3], float variance);
+HAL_StatusTypeDef Eskf_FuseHeight(uint64_t timestamp, float height, float variance);
+const Eskf_StateTypeDef *Eskf_State(void);
+float Eskf_Variance(uint32_t index);
+const Eskf_StatsTypeDef *Eskf_Stats(void);
+void Eskf_Bench(Eskf_BenchTypeDef *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ESKF_H__ */
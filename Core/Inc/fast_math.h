@@ -0,0 +1,308 @@
+/**
+  ******************************************************************************
+  * @file    fast_math.h
+  * @brief   This file contains the single precision fast math kernels:
+  *          sin/cos, atan2, asin, square root, inverse square root, exp and
+  *          log2.
+  *
+  *          newlib-nano evaluates most of libm through double arithmetic,
+  *          in software on the Cortex-M4, and sqrtf() goes through a call
+  *          for errno. These kernels stay in single precision, are inline
+  *          and branch little; they avoid roundf(), fminf() and fmaxf(),
+  *          calls as well on the FPv4. Their worst error over the whole input range
+  *          is given with each one, measured against the double precision
+  *          libm; FastMath_Bench() measures it again on target along with
+  *          the cycle counts of both.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __FAST_MATH_H__
+#define __FAST_MATH_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include <math.h>
+
+/* Exported constants --------------------------------------------------------*/
+#define FAST_MATH_PI            3.14159265358979f
+#define FAST_MATH_HALF_PI       1.57079632679490f
+
+/** Kernels measured by FastMath_Bench(), and inputs per kernel */
+#define FAST_MATH_BENCH_COUNT   8U
+#define FAST_MATH_BENCH_SAMPLES 256U
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Result of the benchmark of one kernel against its libm
+  *         counterpart, per call.
+  */
+typedef struct
+{
+  const char *name;       /*!< Kernel                                        */
+  uint32_t fast_cycles;   /*!< Cycles of the fast kernel                     */
+  uint32_t libm_cycles;   /*!< Cycles of the single precision libm function  */
+  float max_error;        /*!< Worst error against double libm, absolute or
+                               relative as documented for the kernel         */
+} FastMath_BenchTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+/** 2^(j / 16), j = 0..15 */
+extern const float fast_math_exp2_table[16];
+
+/* Exported functions prototypes ---------------------------------------------*/
+void FastMath_Bench(FastMath_BenchTypeDef results[FAST_MATH_BENCH_COUNT]);
+
+/* Exported inline functions -------------------------------------------------*/
+/**
+  * @brief  Round to the nearest integer, halves away from zero. roundf() is
+  *         a call, the Cortex-M4 FPU having no rounding instruction.
+  * @param  x Operand, within the int32_t range
+  * @retval Nearest integer
+  */
+static inline int32_t FastMath_Round(float x)
+{
+  return (int32_t)(x + ((x >= 0.0f) ? 0.5f : -0.5f));
+}
+
+/**
+  * @brief  Square root by the FPU instruction (14 cycles), without the errno
+  *         handling of sqrtf(). Correctly rounded, NaN below 0.
+  * @param  x Operand
+  * @retval sqrt(x)
+  */
+static inline float FastMath_Sqrt(float x)
+{
+#if defined(__ARM_FP)
+  float r;
+
+  __asm ("vsqrt.f32 %0, %1" : "=t" (r) : "t" (x));
+  return r;
+#else
+  return sqrtf(x);
+#endif
+}
+
+/**
+  * @brief  Inverse square root, bit level estimate refined by two Newton
+  *         steps: no division. Relative error below 5e-6 for normal x > 0.
+  * @param  x Operand, > 0
+  * @retval 1 / sqrt(x)
+  */
+static inline float FastMath_InvSqrt(float x)
+{
+  union
+  {
+    float f;
+    uint32_t u;
+  } v;
+  float half = 0.5f * x;
+
+  v.f = x;
+  v.u = 0x5F375A86U - (v.u >> 1);
+  v.f = v.f * (1.5f - (half * v.f * v.f));
+  v.f = v.f * (1.5f - (half * v.f * v.f));
+  return v.f;
+}
+
+/**
+  * @brief  Sine and cosine together. The argument is reduced to a quadrant
+  *         by a three part pi / 2 (Cody and Waite), then minimax polynomials
+  *         on [-pi/4, pi/4]. Absolute error below 2e-7 for |x| < 1e4 rad.
+  * @param  x Angle in rad
+  * @param  s sin(x), may be NULL
+  * @param  c cos(x), may be NULL
+  */
+static inline void FastMath_SinCos(float x, float *s, float *c)
+{
+  int32_t quadrant = FastMath_Round(x * (2.0f / FAST_MATH_PI));
+  float k = (float)quadrant;
+  float r = ((x - (k * 1.5703125f)) - (k * 4.837512969970703125e-4f)) - (k * 7.54978995489188216e-8f);
+  float z = r * r;
+  float sr = r + (r * z * (-1.6666654611e-1f + (z * (8.3321608736e-3f + (z * -1.9515295891e-4f)))));
+  float cr = (1.0f - (0.5f * z)) + (z * z * (4.166664568298827e-2f + (z * (-1.388731625493765e-3f
+                                                                             + (z * 2.443315711809948e-5f)))));
+  float sv = ((quadrant & 1) != 0) ? cr : sr;
+  float cv = ((quadrant & 1) != 0) ? sr : cr;
+
+  if (s != NULL)
+  {
+    *s = ((quadrant & 2) != 0) ? -sv : sv;
+  }
+  if (c != NULL)
+  {
+    *c = (((quadrant + 1) & 2) != 0) ? -cv : cv;
+  }
+}
+
+/**
+  * @brief  Sine, see FastMath_SinCos().
+  */
+static inline float FastMath_Sin(float x)
+{
+  float s;
+
+  FastMath_SinCos(x, &s, NULL);
+  return s;
+}
+
+/**
+  * @brief  Cosine, see FastMath_SinCos().
+  */
+static inline float FastMath_Cos(float x)
+{
+  float c;
+
+  FastMath_SinCos(x, NULL, &c);
+  return c;
+}
+
+/**
+  * @brief  Four quadrant arc tangent. atan of the ratio of the smaller to
+  *         the larger magnitude in [0, 1] by a degree 17 odd polynomial
+  *         (Abramowitz and Stegun 4.4.49), then octant fix up. Absolute error
+  *         below 5e-7 rad, 0 for (0, 0).
+  * @param  y Ordinate
+  * @param  x Abscissa
+  * @retval Angle in rad, [-pi, pi]
+  */
+static inline float FastMath_Atan2(float y, float x)
+{
+  float ax = fabsf(x);
+  float ay = fabsf(y);
+  float hi = (ay > ax) ? ay : ax;
+  float lo = (ay > ax) ? ax : ay;
+  float a;
+  float z;
+  float r;
+
+  if (hi == 0.0f)
+  {
+    return 0.0f;
+  }
+  a = lo / hi;
+  z = a * a;
+  r = 0.0028662257f;
+  r = (r * z) - 0.0161657367f;
+  r = (r * z) + 0.0429096138f;
+  r = (r * z) - 0.0752896400f;
+  r = (r * z) + 0.1065626393f;
+  r = (r * z) - 0.1420889944f;
+  r = (r * z) + 0.1999355085f;
+  r = (r * z) - 0.3333314528f;
+  r = a + (a * z * r);
+  if (ay > ax)
+  {
+    r = FAST_MATH_HALF_PI - r;
+  }
+  if (x < 0.0f)
+  {
+    r = FAST_MATH_PI - r;
+  }
+  return (y < 0.0f) ? -r : r;
+}
+
+/**
+  * @brief  Arc sine, pi / 2 - sqrt(1 - |x|) P(|x|) with a degree 7 P
+  *         (Abramowitz and Stegun 4.4.46). Absolute error below 5e-7 rad.
+  * @param  x Sine, clamped to [-1, 1]
+  * @retval Angle in rad, [-pi/2, pi/2]
+  */
+static inline float FastMath_Asin(float x)
+{
+  float a = fabsf(x);
+  float p = -0.0012624911f;
+  float r;
+
+  if (a > 1.0f)
+  {
+    a = 1.0f;
+  }
+  p = (p * a) + 0.0066700901f;
+  p = (p * a) - 0.0170881256f;
+  p = (p * a) + 0.0308918810f;
+  p = (p * a) - 0.0501743046f;
+  p = (p * a) + 0.0889789874f;
+  p = (p * a) - 0.2145988016f;
+  p = (p * a) + 1.5707963050f;
+  r = FAST_MATH_HALF_PI - (FastMath_Sqrt(1.0f - a) * p);
+  return (x < 0.0f) ? -r : r;
+}
+
+/**
+  * @brief  Exponential, e^x = 2^k 2^(j/16) e^r with the reduction
+  *         x = (16 k + j) ln2/16 + r done in two parts (Cody and Waite),
+  *         2^(j/16) from a 16 entry table and a cubic for e^r, |r| <= ln2/32.
+  *         Relative error below 5e-7. x is clamped to [-87, 88.5]: 0 is
+  *         not reached, nor is the overflow to infinity.
+  * @param  x Exponent
+  * @retval e^x
+  */
+static inline float FastMath_Exp(float x)
+{
+  union
+  {
+    float f;
+    uint32_t u;
+  } scale;
+  float n;
+  float r;
+  float p;
+  int32_t i;
+
+  if (x < -87.0f)
+  {
+    x = -87.0f;
+  }
+  else if (x > 88.5f)
+  {
+    x = 88.5f;
+  }
+  i = FastMath_Round(x * 23.0831206542234f);
+  n = (float)i;
+  r = (x - (n * 0.0433197021484375f)) - (n * 1.9966364561696537e-06f);
+  p = 1.0f + (r * (1.0f + (r * (0.5f + (r * 0.16666667f)))));
+  scale.u = (uint32_t)((i >> 4) + 127) << 23;
+  return scale.f * fast_math_exp2_table[i & 15] * p;
+}
+
+/**
+  * @brief  Base 2 logarithm, exponent from the bits, then the mantissa m in
+  *         [sqrt(1/2), sqrt(2)) by 2 atanh(t) / ln2, t = (m - 1) / (m + 1)
+  *         in [-0.172, 0.172], to the t^7 term. Absolute error below 2e-7,
+  *         plus one ulp of the result from adding the exponent.
+  * @param  x Operand, positive and normal
+  * @retval log2(x)
+  */
+static inline float FastMath_Log2(float x)
+{
+  union
+  {
+    float f;
+    uint32_t u;
+  } v;
+  float e;
+  float t;
+  float z;
+
+  v.f = x;
+  e = (float)((int32_t)(v.u >> 23) - 127);
+  v.u = (v.u & 0x007FFFFFU) | 0x3F800000U;
+  if (v.f > 1.41421356f)
+  {
+    v.f *= 0.5f;
+    e += 1.0f;
+  }
+  t = (v.f - 1.0f) / (v.f + 1.0f);
+  z = t * t;
+  return e + (t * (2.88539008f + (z * (0.961796694f + (z * (0.577078016f + (z * 0.412198583f)))))));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FAST_MATH_H__ */
@@ -0,0 +1,61 @@
+/**
+  ******************************************************************************
+  * @file    gyro_filter.h
+  * @brief   This file contains the C interface of the gyro filter chain run
+  *          on the voted samples at the control loop rate.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __GYRO_FILTER_H__
+#define __GYRO_FILTER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "timing.h"
+#include "spi_imu.h"
+#include "decim.h"
+
+/* Exported constants --------------------------------------------------------*/
+/** Rate of the samples filtered, the decimated SPI IMU rate */
+#define GYRO_FILTER_RATE_HZ       ((float)(SPI_IMU_ODR_HZ / DECIM_RATIO))
+
+/** Fixed low pass sections, designed at compile time: a PT1 against the
+  * broadband noise, then a Butterworth section against motor noise */
+#define GYRO_FILTER_PT1_HZ        250.0f
+#define GYRO_FILTER_LOWPASS_HZ    400.0f
+#define GYRO_FILTER_LOWPASS_Q     0.7071f
+
+/** Define GYRO_FILTER_FIXED to run the fixed sections in Q15 on the rate
+  * rounded to whole sensor counts, instead of in float */
+
+/** Samples of the GyroFilter_Bench() run, built in with GYRO_FILTER_BENCH */
+#define GYRO_FILTER_BENCH_SAMPLES 512U
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Float against fixed point filter chain, per 3-axis sample.
+  */
+typedef struct
+{
+  uint32_t float_cycles;    /*!< Cycles of the float chain                  */
+  uint32_t fixed_cycles;    /*!< Cycles of the Q15 bank alone, on int16     */
+  uint32_t convert_cycles;  /*!< Cycles the float to int16 round trip of
+                                 GYRO_FILTER_FIXED adds to the Q15 bank    */
+  float max_difference;     /*!< Largest output difference, in counts       */
+} GyroFilter_BenchTypeDef;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void GyroFilter_Reset(void);
+void GyroFilter_Apply(float gyro[3]);
+const Timing_PerfTypeDef *GyroFilter_Cycles(void);
+void GyroFilter_Bench(GyroFilter_BenchTypeDef *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __GYRO_FILTER_H__ */
@@ -34,11 +34,14 @@ extern "C" {
 
 extern I2C_HandleTypeDef hi2c1;
 
+extern I2C_HandleTypeDef hi2c2;
+
 /* USER CODE BEGIN Private defines */
 
 /* USER CODE END Private defines */
 
 void MX_I2C1_Init(void);
+void MX_I2C2_Init(void);
 
 /* USER CODE BEGIN Prototypes */
 
@@ -0,0 +1,248 @@
+/**
+  ******************************************************************************
+  * @file    i2c_bus.h
+  * @brief   This file contains the asynchronous I2C transaction engine
+  *          definitions. Register read/write jobs are queued per bus and run
+  *          back to back from the HAL completion callbacks, so the main loop
+  *          never waits on the bus.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __I2C_BUS_H__
+#define __I2C_BUS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "timing.h"
+
+/* Exported constants --------------------------------------------------------*/
+/** Number of jobs a bus can hold waiting, must be a power of two */
+#define I2C_BUS_QUEUE_LEN     16U
+
+/** Number of I2C buses that can be registered with the engine */
+#define I2C_BUS_MAX           2U
+
+/** Entries of a scan list, two segments each are counted in the job phase */
+#define I2C_SCAN_MAX_ENTRIES  127U
+
+/** A job is timed out after BASE + BYTE * size microseconds on the bus */
+#define I2C_BUS_TIMEOUT_BASE_US          500U
+#define I2C_BUS_TIMEOUT_BYTE_US          50U
+
+/** Bus clear: clock pulses sent to a stuck slave and their half period */
+#define I2C_BUS_RECOVERY_PULSES          9U
+#define I2C_BUS_RECOVERY_HALF_PERIOD_US  5U
+
+/** NVIC priority of the highest interrupt using the engine, the I2C1 events,
+  * errors and DMA. The queue lock masks it and the priorities below it, never
+  * the data-ready EXTI and SPI IMU DMA above it, which must not submit jobs */
+#define I2C_BUS_IRQ_PRIORITY             1U
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Life cycle of a job. A job may only be (re)submitted when it is not
+  *         QUEUED nor ACTIVE.
+  */
+typedef enum
+{
+  I2C_JOB_IDLE = 0U,   /*!< Never submitted                              */
+  I2C_JOB_QUEUED,      /*!< Waiting in the bus queue                     */
+  I2C_JOB_ACTIVE,      /*!< Transfer in progress on the bus              */
+  I2C_JOB_DONE,        /*!< Transfer completed successfully              */
+  I2C_JOB_ERROR        /*!< Transfer failed, see I2C_JobTypeDef::error   */
+} I2C_JobStateTypeDef;
+
+/**
+  * @brief  Operation carried by a job.
+  */
+typedef enum
+{
+  I2C_JOB_READ = 0U,   /*!< Read size bytes starting at register reg     */
+  I2C_JOB_WRITE,       /*!< Write size bytes starting at register reg    */
+  I2C_JOB_SCAN,        /*!< Job embedded in an I2C_ScanTypeDef           */
+  I2C_JOB_COMMAND      /*!< Write the reg byte alone, no data            */
+} I2C_JobOpTypeDef;
+
+struct I2C_Job;
+
+/**
+  * @brief  Job completion callback, called from interrupt context once the
+  *         job reached I2C_JOB_DONE or I2C_JOB_ERROR. It may submit new jobs.
+  */
+typedef void (*I2C_JobCallbackTypeDef)(struct I2C_Job *job);
+
+/**
+  * @brief  A register transfer. Jobs are owned by the caller and must stay
+  *         alive until they complete; the bus only queues pointers to them.
+  *         The job, holding the register address, and the data buffer are
+  *         accessed by DMA and must not live in CCMRAM.
+  */
+typedef struct I2C_Job
+{
+  uint8_t address;                     /*!< 7-bit device address                  */
+  uint16_t reg;                        /*!< First register of the transfer        */
+  uint8_t reg_size;                    /*!< I2C_MEMADD_SIZE_8BIT or _16BIT        */
+  uint8_t op;                          /*!< @ref I2C_JobOpTypeDef                 */
+  uint8_t phase;                       /*!< 0: register, 1: data, +2 a scan entry */
+  uint8_t header[2];                   /*!< Register address as sent, MSB first   */
+  uint16_t size;                       /*!< Number of data bytes                  */
+  uint8_t *data;                       /*!< Source or destination buffer          */
+  I2C_JobCallbackTypeDef callback;     /*!< Completion callback, may be NULL      */
+  void *context;                       /*!< Free for the owner of the job         */
+  volatile I2C_JobStateTypeDef state;  /*!< Completion flag                       */
+  uint32_t error;                      /*!< HAL_I2C_ERROR_xxx when state is ERROR */
+  uint32_t start_cycles;               /*!< DWT stamp of the transfer start       */
+  uint32_t cycles;                     /*!< Duration of the transfer on the bus   */
+} I2C_JobTypeDef;
+
+/**
+  * @brief  One register read of a scan list.
+  */
+typedef struct
+{
+  uint8_t address;     /*!< 7-bit device address                         */
+  uint8_t reg;         /*!< First register to read                       */
+  uint16_t size;       /*!< Number of bytes to read                      */
+  uint8_t *data;       /*!< Destination buffer, not in CCMRAM            */
+} I2C_ScanEntryTypeDef;
+
+/**
+  * @brief  Scan list statistics.
+  */
+typedef struct
+{
+  uint32_t sweeps;                 /*!< Completed sweeps                          */
+  uint32_t failed;                 /*!< Sweeps aborted on a bus error             */
+  Timing_PerfTypeDef sweep_cycles; /*!< Bus time from the START to the STOP       */
+} I2C_ScanStatsTypeDef;
+
+/**
+  * @brief  A table of register reads executed as one sweep: one START, a
+  *         repeated start before every segment and one STOP. The scan is
+  *         queued like any job; its embedded job holds the completion flag
+  *         and callback, called once per sweep.
+  */
+typedef struct
+{
+  I2C_JobTypeDef job;                    /*!< Queued job, must stay first        */
+  const I2C_ScanEntryTypeDef *entries;   /*!< Table to execute                   */
+  uint8_t count;                         /*!< Number of entries                  */
+  I2C_ScanStatsTypeDef stats;            /*!< Scan statistics                    */
+} I2C_ScanTypeDef;
+
+/**
+  * @brief  Bus statistics, readable at any time.
+  */
+typedef struct
+{
+  uint32_t submitted;              /*!< Jobs accepted in the queue               */
+  uint32_t completed;              /*!< Jobs finished successfully               */
+  uint32_t failed;                 /*!< Jobs finished in error                   */
+  uint32_t rejected;               /*!< Submissions refused, queue full          */
+  uint32_t queue_peak;             /*!< Largest number of waiting jobs           */
+  uint64_t busy_cycles;            /*!< Core cycles spent with a transfer active */
+  Timing_PerfTypeDef job_cycles;   /*!< Per job bus time                         */
+} I2C_BusStatsTypeDef;
+
+/**
+  * @brief  Steps of the bus recovery state machine, advanced by I2C_Bus_Poll().
+  */
+typedef enum
+{
+  I2C_RECOVERY_IDLE = 0U,  /*!< Bus running normally                       */
+  I2C_RECOVERY_PENDING,    /*!< Fault detected, peripheral to be released  */
+  I2C_RECOVERY_CLOCKING,   /*!< Clocking SCL until the slave releases SDA  */
+  I2C_RECOVERY_STOP,       /*!< Generating a STOP condition by hand        */
+  I2C_RECOVERY_REINIT      /*!< Peripheral to be initialized again         */
+} I2C_RecoveryStateTypeDef;
+
+/**
+  * @brief  Error counters per class and recovery statistics.
+  */
+typedef struct
+{
+  uint32_t berr;                       /*!< Misplaced START/STOP               */
+  uint32_t arlo;                       /*!< Arbitration lost                   */
+  uint32_t af;                         /*!< Acknowledge failure (NACK)         */
+  uint32_t ovr;                        /*!< Overrun/underrun                   */
+  uint32_t dma;                        /*!< DMA transfer error                 */
+  uint32_t timeout;                    /*!< HAL or job watchdog timeout        */
+  uint32_t recoveries;                 /*!< Completed bus recoveries           */
+  uint32_t stuck_slaves;               /*!< Recoveries that found SDA held low */
+  uint32_t reinit_failures;            /*!< HAL_I2C_Init() failures            */
+  Timing_PerfTypeDef recovery_cycles;  /*!< Fault detection to queue restart   */
+} I2C_BusErrorStatsTypeDef;
+
+/**
+  * @brief  One I2C bus and its job queue.
+  */
+typedef struct
+{
+  I2C_HandleTypeDef *hi2c;                     /*!< HAL handle driving the bus  */
+  I2C_JobTypeDef *queue[I2C_BUS_QUEUE_LEN];    /*!< Waiting jobs                */
+  volatile uint32_t head;                      /*!< Next job to start           */
+  volatile uint32_t tail;                      /*!< Next free queue slot        */
+  I2C_JobTypeDef *volatile active;             /*!< Job owning the bus          */
+  uint32_t stall_start;                        /*!< DWT stamp, bus busy while idle */
+  I2C_BusStatsTypeDef stats;                   /*!< Bus statistics              */
+  uint32_t util_busy_cycles;                   /*!< Utilization window state    */
+  uint32_t util_stamp;                         /*!< Utilization window state    */
+  GPIO_TypeDef *scl_port;                      /*!< SCL pin, for bus clear      */
+  uint16_t scl_pin;                            /*!< SCL pin, for bus clear      */
+  GPIO_TypeDef *sda_port;                      /*!< SDA pin, for bus clear      */
+  uint16_t sda_pin;                            /*!< SDA pin, for bus clear      */
+  volatile uint8_t recovery;                   /*!< @ref I2C_RecoveryStateTypeDef */
+  uint8_t recovery_edges;                      /*!< SCL/SDA edges generated     */
+  uint32_t recovery_start;                     /*!< DWT stamp of the fault      */
+  uint32_t recovery_stamp;                     /*!< DWT stamp of the last edge  */
+  I2C_BusErrorStatsTypeDef errors;             /*!< Error statistics            */
+} I2C_BusTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern I2C_BusTypeDef i2c_bus1;
+extern I2C_BusTypeDef i2c_bus2;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void I2C_Bus_Init(I2C_BusTypeDef *bus, I2C_HandleTypeDef *hi2c);
+void I2C_Bus_SetRecoveryPins(I2C_BusTypeDef *bus, GPIO_TypeDef *scl_port, uint16_t scl_pin,
+                             GPIO_TypeDef *sda_port, uint16_t sda_pin);
+void I2C_Bus_Poll(I2C_BusTypeDef *bus);
+HAL_StatusTypeDef I2C_Bus_Submit(I2C_BusTypeDef *bus, I2C_JobTypeDef *job);
+HAL_StatusTypeDef I2C_Bus_Read(I2C_BusTypeDef *bus, I2C_JobTypeDef *job, uint8_t address, uint8_t reg,
+                               uint8_t *data, uint16_t size, I2C_JobCallbackTypeDef callback, void *context);
+HAL_StatusTypeDef I2C_Bus_Write(I2C_BusTypeDef *bus, I2C_JobTypeDef *job, uint8_t address, uint8_t reg,
+                                uint8_t *data, uint16_t size, I2C_JobCallbackTypeDef callback, void *context);
+HAL_StatusTypeDef I2C_Bus_Read16(I2C_BusTypeDef *bus, I2C_JobTypeDef *job, uint8_t address, uint16_t reg,
+                                 uint8_t *data, uint16_t size, I2C_JobCallbackTypeDef callback, void *context);
+HAL_StatusTypeDef I2C_Bus_Write16(I2C_BusTypeDef *bus, I2C_JobTypeDef *job, uint8_t address, uint16_t reg,
+                                  uint8_t *data, uint16_t size, I2C_JobCallbackTypeDef callback, void *context);
+HAL_StatusTypeDef I2C_Bus_Command(I2C_BusTypeDef *bus, I2C_JobTypeDef *job, uint8_t address, uint8_t command,
+                                  I2C_JobCallbackTypeDef callback, void *context);
+void I2C_Scan_Init(I2C_ScanTypeDef *scan, const I2C_ScanEntryTypeDef *entries, uint8_t count,
+                   I2C_JobCallbackTypeDef callback, void *context);
+HAL_StatusTypeDef I2C_Bus_SubmitScan(I2C_BusTypeDef *bus, I2C_ScanTypeDef *scan);
+uint32_t I2C_Bus_Pending(const I2C_BusTypeDef *bus);
+uint32_t I2C_Bus_Utilization(I2C_BusTypeDef *bus);
+void I2C_Bus_ResetStats(I2C_BusTypeDef *bus);
+I2C_BusTypeDef *I2C_Bus_FromHandle(const I2C_HandleTypeDef *hi2c);
+
+/* Exported inline functions -------------------------------------------------*/
+/**
+  * @brief  Check whether a job is still waiting or running.
+  * @param  job Job to check
+  * @retval 1 while the job is queued or active, 0 otherwise
+  */
+static inline uint8_t I2C_Job_IsPending(const I2C_JobTypeDef *job)
+{
+  return (uint8_t)((job->state == I2C_JOB_QUEUED) || (job->state == I2C_JOB_ACTIVE));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __I2C_BUS_H__ */
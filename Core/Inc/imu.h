@@ -0,0 +1,49 @@
+/**
+  ******************************************************************************
+  * @file    imu.h
+  * @brief   This file contains the IMU sample definitions. The samples go
+  *          from the drivers to the main loop through ImuRing and Imu2Ring,
+  *          see sample_ring.h.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __IMU_H__
+#define __IMU_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  One gyro + accelerometer sample in sensor counts.
+  */
+typedef struct
+{
+  uint64_t timestamp;  /*!< Cycle time of the sample, see Timing_Cycles64()     */
+  int16_t gyro[3];     /*!< Angular rate, X Y Z                                  */
+  int16_t accel[3];    /*!< Specific force, X Y Z                                */
+} IMU_SampleTypeDef;
+
+/**
+  * @brief  One sample at the control loop rate, in sensor counts with the
+  *         fractional part gained from filtering kept.
+  */
+typedef struct
+{
+  uint64_t timestamp;  /*!< Cycle time the sample represents, filter delay removed */
+  float gyro[3];       /*!< Angular rate, X Y Z                                  */
+  float accel[3];      /*!< Specific force, X Y Z                                */
+} IMU_LoopSampleTypeDef;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void IMU_ToLoop(const IMU_SampleTypeDef *sample, IMU_LoopSampleTypeDef *loop);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IMU_H__ */
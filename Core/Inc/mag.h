@@ -0,0 +1,119 @@
+/**
+  ******************************************************************************
+  * @file    mag.h
+  * @brief   This file contains the definitions of the QMC5883L/HMC5883L I2C
+  *          magnetometer driver.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __MAG_H__
+#define __MAG_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "i2c_bus.h"
+#include "timing.h"
+
+/* Exported constants --------------------------------------------------------*/
+/** Scheduler rate of the field reads, below the output rate of both parts
+  * (QMC5883L 200 Hz, HMC5883L 75 Hz) */
+#define MAG_RATE_HZ             50U
+
+/** Bus load of one read: the three axes in a single burst */
+#define MAG_READ_TRANSACTIONS   1U
+#define MAG_READ_BYTES          6U
+
+/** Scale of the configured ranges: QMC5883L +-8 G, HMC5883L +-1.3 Ga */
+#define MAG_QMC5883L_GAUSS_PER_LSB  (1.0f / 3000.0f)
+#define MAG_HMC5883L_GAUSS_PER_LSB  (1.0f / 1090.0f)
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Supported parts.
+  */
+typedef enum
+{
+  MAG_PART_QMC5883L = 0U,
+  MAG_PART_HMC5883L
+} Mag_PartIdTypeDef;
+
+/**
+  * @brief  Register map of a supported part.
+  */
+typedef struct
+{
+  const uint8_t (*config)[2];      /*!< Register writes, in order            */
+  uint8_t config_count;            /*!< Number of register writes            */
+  uint8_t data_reg;                /*!< First register of the field burst    */
+  uint8_t big_endian;              /*!< Byte order of the burst              */
+  uint8_t axis[3];                 /*!< Offset of X, Y and Z in the burst    */
+  float gauss_per_lsb;             /*!< Scale of the configured range        */
+} Mag_PartTypeDef;
+
+/**
+  * @brief  Driver state.
+  */
+typedef enum
+{
+  MAG_STATE_CONFIG = 0U,      /*!< Configuration writes to be issued   */
+  MAG_STATE_CONFIG_BUSY,      /*!< Configuration writes in progress    */
+  MAG_STATE_RUN               /*!< Reads, see Mag_Measure()            */
+} Mag_StateTypeDef;
+
+/**
+  * @brief  One field measurement in sensor counts.
+  */
+typedef struct
+{
+  uint64_t timestamp;       /*!< Cycle time the read completed  */
+  int16_t field[3];         /*!< Field, X Y Z                   */
+} Mag_SampleTypeDef;
+
+/**
+  * @brief  Driver statistics.
+  */
+typedef struct
+{
+  uint32_t samples;         /*!< Samples published              */
+  uint32_t bus_errors;      /*!< Failed jobs                    */
+} Mag_StatsTypeDef;
+
+/**
+  * @brief  Driver instance.
+  */
+typedef struct
+{
+  I2C_BusTypeDef *bus;                 /*!< Bus the sensor is on                */
+  const Mag_PartTypeDef *part;         /*!< Register map                        */
+  uint8_t address;                     /*!< 7-bit device address                */
+  volatile uint8_t state;              /*!< @ref Mag_StateTypeDef               */
+  uint8_t config_index;                /*!< Configuration write in progress     */
+  uint8_t failures;                    /*!< Consecutive failed jobs             */
+  uint8_t reg_value;                   /*!< DMA source of register writes       */
+  uint8_t raw[MAG_READ_BYTES];         /*!< Field burst                         */
+  I2C_JobTypeDef job;                  /*!< Bus job, one in flight at a time    */
+  Mag_SampleTypeDef sample;            /*!< Latest measurement                  */
+  volatile uint32_t sequence;          /*!< Incremented on each new sample      */
+  Mag_StatsTypeDef stats;              /*!< Driver statistics                   */
+} Mag_HandleTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern Mag_HandleTypeDef hmag;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void Mag_Init(Mag_HandleTypeDef *dev, I2C_BusTypeDef *bus, uint8_t address, Mag_PartIdTypeDef part);
+void Mag_Poll(Mag_HandleTypeDef *dev);
+I2C_JobTypeDef *Mag_Measure(Mag_HandleTypeDef *dev);
+uint8_t Mag_SweepEntry(Mag_HandleTypeDef *dev, I2C_ScanEntryTypeDef *entry);
+void Mag_SweepDone(Mag_HandleTypeDef *dev, const I2C_JobTypeDef *sweep);
+uint32_t Mag_Read(Mag_HandleTypeDef *dev, Mag_SampleTypeDef *sample);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MAG_H__ */
@@ -0,0 +1,119 @@
+/**
+  ******************************************************************************
+  * @file    mag_cal.h
+  * @brief   This file contains the definitions of the online magnetometer
+  *          calibration: an incremental least-squares ellipsoid fit giving
+  *          the hard-iron offset and the soft-iron matrix.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __MAG_CAL_H__
+#define __MAG_CAL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "timing.h"
+
+/* Exported constants --------------------------------------------------------*/
+/** Parameters of the general ellipsoid model, and the packed lower
+  * triangle of the normal equations augmented with the constant term */
+#define MAG_CAL_PARAMS          9U
+#define MAG_CAL_SUMS            (((MAG_CAL_PARAMS + 1U) * (MAG_CAL_PARAMS + 2U)) / 2U)
+
+/** Samples waiting for the fitter, must be a power of two */
+#define MAG_CAL_QUEUE_LEN       16U
+
+/** Forgetting factor of the accumulated normal equations: about 1000
+  * samples of memory, 20 s at MAG_RATE_HZ, so a new frame is learnt */
+#define MAG_CAL_FORGET          0.999f
+
+/** Weighted samples needed before a fit, and new samples between fits */
+#define MAG_CAL_MIN_SAMPLES     200.0f
+#define MAG_CAL_SOLVE_INTERVAL  50U
+
+/** Smallest standard deviation of the samples along any direction, in
+  * gauss, for a fit to be attempted: a full rotation in a 0.25 G field
+  * gives 0.14 G, a rotation about a single axis gives 0 */
+#define MAG_CAL_MIN_SPREAD      0.08f
+
+/** Acceptance of a fit: field radius range in gauss, largest axis ratio of
+  * the soft-iron ellipsoid and largest RMS residual of the ellipsoid
+  * equation */
+#define MAG_CAL_MIN_RADIUS      0.15f
+#define MAG_CAL_MAX_RADIUS      1.0f
+#define MAG_CAL_MAX_AXIS_RATIO  2.0f
+#define MAG_CAL_MAX_RMS         0.05f
+
+/** Cycle budget of one MagCal_Poll() call, checked between steps */
+#define MAG_CAL_BUDGET_US       20U
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Work item of MagCal_Poll(). Each item is bounded and short.
+  */
+typedef enum
+{
+  MAG_CAL_STEP_ACCUMULATE = 0U, /*!< Fold queued samples into the sums   */
+  MAG_CAL_STEP_RECENTER,        /*!< Coverage check, sums moved to the sample mean */
+  MAG_CAL_STEP_FACTOR,          /*!< Cholesky factor of the sums        */
+  MAG_CAL_STEP_SOLVE,           /*!< Substitutions, ellipsoid center    */
+  MAG_CAL_STEP_EIGEN            /*!< Soft-iron shape, checks, publish   */
+} MagCal_StepTypeDef;
+
+/**
+  * @brief  Calibration statistics.
+  */
+typedef struct
+{
+  uint32_t samples;                /*!< Samples folded into the sums         */
+  uint32_t dropped;                /*!< Samples lost, queue full             */
+  uint32_t fits;                   /*!< Fits accepted                        */
+  uint32_t uncovered;              /*!< Fits skipped, samples too clustered  */
+  uint32_t rejected;               /*!< Fits refused by the checks           */
+  float rms;                       /*!< Residual of the last fit             */
+  Timing_PerfTypeDef poll_cycles;  /*!< Cost of the MagCal_Poll() calls      */
+} MagCal_StatsTypeDef;
+
+/**
+  * @brief  Calibration instance. The published calibration maps a field in
+  *         gauss to W * (field - offset).
+  */
+typedef struct
+{
+  float gauss_per_lsb;                              /*!< Scale of the raw counts   */
+  float queue[MAG_CAL_QUEUE_LEN][3];                /*!< Samples in gauss          */
+  uint32_t head;                                    /*!< Queue write index         */
+  uint32_t tail;                                    /*!< Queue read index          */
+  uint8_t step;                                     /*!< @ref MagCal_StepTypeDef   */
+  uint32_t since_fit;                               /*!< Samples since the last fit */
+  float shift[3];                                   /*!< Origin of the sums in gauss */
+  float sums[MAG_CAL_SUMS];                         /*!< Sum of [phi 1] [phi 1]'   */
+  float chol[(MAG_CAL_PARAMS * (MAG_CAL_PARAMS + 1U)) / 2U]; /*!< Factor of the fit */
+  float theta[MAG_CAL_PARAMS];                      /*!< Ellipsoid coefficients    */
+  float center[3];                                  /*!< Fit in progress, from shift */
+  float shape[3][3];                                /*!< Fit in progress           */
+  uint8_t valid;                                    /*!< A calibration was published */
+  float offset[3];                                  /*!< Hard-iron offset in gauss */
+  float soft[3][3];                                 /*!< Soft-iron correction W    */
+  float radius;                                     /*!< Fitted field strength     */
+  MagCal_StatsTypeDef stats;                        /*!< Calibration statistics    */
+} MagCal_HandleTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern MagCal_HandleTypeDef hmagcal;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void MagCal_Init(MagCal_HandleTypeDef *cal, float gauss_per_lsb);
+void MagCal_Push(MagCal_HandleTypeDef *cal, const int16_t field[3]);
+void MagCal_Poll(MagCal_HandleTypeDef *cal, uint32_t budget_cycles);
+void MagCal_Apply(const MagCal_HandleTypeDef *cal, const int16_t field[3], float out[3]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MAG_CAL_H__ */
@@ -46,7 +46,10 @@ extern "C" {
 
 /* Exported macro ------------------------------------------------------------*/
 /* USER CODE BEGIN EM */
-
+/** Data in the 64 KB core coupled RAM: no wait state and no DMA contention.
+  * The start up code neither copies nor clears it, so its users initialize
+  * it at run time */
+#define CCMRAM __attribute__((section(".ccmram")))
 /* USER CODE END EM */
 
 /* Exported functions prototypes ---------------------------------------------*/
@@ -57,6 +60,22 @@ void Error_Handler(void);
 /* USER CODE END EFP */
 
 /* Private defines -----------------------------------------------------------*/
+#define IMU2_CS_Pin GPIO_PIN_4
+#define IMU2_CS_GPIO_Port GPIOA
+#define IMU2_DRDY_Pin GPIO_PIN_4
+#define IMU2_DRDY_GPIO_Port GPIOC
+#define IMU2_DRDY_EXTI_IRQn EXTI4_IRQn
+#define I2C2_SCL_Pin GPIO_PIN_10
+#define I2C2_SCL_GPIO_Port GPIOB
+#define I2C2_SDA_Pin GPIO_PIN_11
+#define I2C2_SDA_GPIO_Port GPIOB
+#define IMU1_DRDY_Pin GPIO_PIN_5
+#define IMU1_DRDY_GPIO_Port GPIOB
+#define IMU1_DRDY_EXTI_IRQn EXTI9_5_IRQn
+#define I2C1_SCL_Pin GPIO_PIN_8
+#define I2C1_SCL_GPIO_Port GPIOB
+#define I2C1_SDA_Pin GPIO_PIN_9
+#define I2C1_SDA_GPIO_Port GPIOB
 
 /* USER CODE BEGIN Private defines */
 
@@ -0,0 +1,300 @@
+/**
+  ******************************************************************************
+  * @file    matrix.hpp
+  * @brief   This file provides the fixed size single precision matrices of
+  *          the navigation filter.
+  *
+  *          The dimensions are template parameters, so a product of
+  *          mismatched sizes does not compile, every loop bound is a
+  *          constant the compiler can unroll, and nothing is allocated: a
+  *          matrix is its array of R * C floats, row major. Blocks are read
+  *          and written at run time offsets with compile time sizes, for
+  *          the block sparse products of the filter.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __MATRIX_HPP__
+#define __MATRIX_HPP__
+
+/* Includes ------------------------------------------------------------------*/
+#include <cstdint>
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  R x C matrix of floats.
+  */
+template <uint32_t R, uint32_t C>
+class Matrix
+{
+  static_assert((R != 0U) && (C != 0U), "Matrix dimensions must not be 0");
+
+public:
+  static constexpr uint32_t kRows = R;
+  static constexpr uint32_t kCols = C;
+
+  constexpr Matrix() = default;
+
+  /**
+    * @brief  Identity, or its top left part when not square.
+    */
+  static constexpr Matrix Identity()
+  {
+    Matrix m;
+
+    for (uint32_t i = 0U; (i < R) && (i < C); i++)
+    {
+      m.data_[i][i] = 1.0f;
+    }
+    return m;
+  }
+
+  /**
+    * @brief  Diagonal matrix with every diagonal element set to d.
+    */
+  static constexpr Matrix Diagonal(float d)
+  {
+    Matrix m;
+
+    for (uint32_t i = 0U; (i < R) && (i < C); i++)
+    {
+      m.data_[i][i] = d;
+    }
+    return m;
+  }
+
+  float &operator()(uint32_t r, uint32_t c)
+  {
+    return data_[r][c];
+  }
+
+  constexpr float operator()(uint32_t r, uint32_t c) const
+  {
+    return data_[r][c];
+  }
+
+  /**
+    * @brief  Element of a column vector.
+    */
+  float &operator[](uint32_t r)
+  {
+    static_assert(C == 1U, "Indexing by one subscript needs a column vector");
+    return data_[r][0];
+  }
+
+  constexpr float operator[](uint32_t r) const
+  {
+    static_assert(C == 1U, "Indexing by one subscript needs a column vector");
+    return data_[r][0];
+  }
+
+  template <uint32_t K>
+  Matrix<R, K> operator*(const Matrix<C, K> &b) const
+  {
+    Matrix<R, K> m;
+
+    m.SetProduct(*this, b);
+    return m;
+  }
+
+  /**
+    * @brief  Product by the transpose of b, A B', without forming B'.
+    */
+  template <uint32_t K>
+  Matrix<R, K> MulTransposed(const Matrix<K, C> &b) const
+  {
+    Matrix<R, K> m;
+
+    m.SetProductTransposed(*this, b);
+    return m;
+  }
+
+  /**
+    * @brief  Set to the product a b in place, for the matrices too large
+    *         for a temporary on the stack. Neither may be this matrix.
+    */
+  template <uint32_t K>
+  void SetProduct(const Matrix<R, K> &a, const Matrix<K, C> &b)
+  {
+    for (uint32_t i = 0U; i < R; i++)
+    {
+      for (uint32_t j = 0U; j < C; j++)
+      {
+        float sum = 0.0f;
+
+        for (uint32_t k = 0U; k < K; k++)
+        {
+          sum += a(i, k) * b(k, j);
+        }
+        data_[i][j] = sum;
+      }
+    }
+  }
+
+  /**
+    * @brief  Set to a b' in place, see SetProduct().
+    */
+  template <uint32_t K>
+  void SetProductTransposed(const Matrix<R, K> &a, const Matrix<C, K> &b)
+  {
+    for (uint32_t i = 0U; i < R; i++)
+    {
+      for (uint32_t j = 0U; j < C; j++)
+      {
+        float sum = 0.0f;
+
+        for (uint32_t k = 0U; k < K; k++)
+        {
+          sum += a(i, k) * b(j, k);
+        }
+        data_[i][j] = sum;
+      }
+    }
+  }
+
+  Matrix operator*(float s) const
+  {
+    Matrix m;
+
+    for (uint32_t i = 0U; i < R; i++)
+    {
+      for (uint32_t j = 0U; j < C; j++)
+      {
+        m.data_[i][j] = data_[i][j] * s;
+      }
+    }
+    return m;
+  }
+
+  Matrix &operator+=(const Matrix &b)
+  {
+    for (uint32_t i = 0U; i < R; i++)
+    {
+      for (uint32_t j = 0U; j < C; j++)
+      {
+        data_[i][j] += b.data_[i][j];
+      }
+    }
+    return *this;
+  }
+
+  Matrix &operator-=(const Matrix &b)
+  {
+    for (uint32_t i = 0U; i < R; i++)
+    {
+      for (uint32_t j = 0U; j < C; j++)
+      {
+        data_[i][j] -= b.data_[i][j];
+      }
+    }
+    return *this;
+  }
+
+  Matrix operator+(const Matrix &b) const
+  {
+    Matrix m = *this;
+
+    m += b;
+    return m;
+  }
+
+  Matrix operator-(const Matrix &b) const
+  {
+    Matrix m = *this;
+
+    m -= b;
+    return m;
+  }
+
+  Matrix<C, R> Transposed() const
+  {
+    Matrix<C, R> m;
+
+    for (uint32_t i = 0U; i < R; i++)
+    {
+      for (uint32_t j = 0U; j < C; j++)
+      {
+        m(j, i) = data_[i][j];
+      }
+    }
+    return m;
+  }
+
+  /**
+    * @brief  Copy of the BR x BC block at row r, column c.
+    */
+  template <uint32_t BR, uint32_t BC>
+  Matrix<BR, BC> Block(uint32_t r, uint32_t c) const
+  {
+    static_assert((BR <= R) && (BC <= C), "Block larger than the matrix");
+    Matrix<BR, BC> m;
+
+    for (uint32_t i = 0U; i < BR; i++)
+    {
+      for (uint32_t j = 0U; j < BC; j++)
+      {
+        m(i, j) = data_[r + i][c + j];
+      }
+    }
+    return m;
+  }
+
+  /**
+    * @brief  Overwrite the block at row r, column c with b.
+    */
+  template <uint32_t BR, uint32_t BC>
+  void SetBlock(uint32_t r, uint32_t c, const Matrix<BR, BC> &b)
+  {
+    static_assert((BR <= R) && (BC <= C), "Block larger than the matrix");
+
+    for (uint32_t i = 0U; i < BR; i++)
+    {
+      for (uint32_t j = 0U; j < BC; j++)
+      {
+        data_[r + i][c + j] = b(i, j);
+      }
+    }
+  }
+
+  /**
+    * @brief  Set every element to 0.
+    */
+  void SetZero()
+  {
+    for (uint32_t i = 0U; i < R; i++)
+    {
+      for (uint32_t j = 0U; j < C; j++)
+      {
+        data_[i][j] = 0.0f;
+      }
+    }
+  }
+
+private:
+  float data_[R][C] {};
+};
+
+/** Column vector */
+template <uint32_t N>
+using Vector = Matrix<N, 1U>;
+
+using Matrix3 = Matrix<3U, 3U>;
+using Vector3 = Vector<3U>;
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Cross product matrix, [v]x w = v x w.
+  */
+inline Matrix3 Skew(const Vector3 &v)
+{
+  Matrix3 m;
+
+  m(0, 1) = -v[2];
+  m(0, 2) = v[1];
+  m(1, 0) = v[2];
+  m(1, 2) = -v[0];
+  m(2, 0) = -v[1];
+  m(2, 1) = v[0];
+  return m;
+}
+
+#endif /* __MATRIX_HPP__ */
@@ -0,0 +1,229 @@
+/**
+  ******************************************************************************
+  * @file    median.hpp
+  * @brief   This file provides the streaming median window and the Hampel
+  *          outlier filter built on it.
+  *
+  *          The window keeps its samples twice: in arrival order, to know
+  *          the one leaving, and sorted. A new sample takes the slot of the
+  *          leaving one in the sorted copy: both positions are found by
+  *          binary search and only the samples between them move by one, no
+  *          sort. The median is then the middle sample, and the median
+  *          absolute deviation the median of two sorted runs, the
+  *          deviations below and above the median, found by bisection in
+  *          O(log N).
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __MEDIAN_HPP__
+#define __MEDIAN_HPP__
+
+/* Includes ------------------------------------------------------------------*/
+#include <algorithm>
+#include <cstdint>
+#include <math.h>
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Sliding window of the last N samples of type T, N odd.
+  */
+template <typename T, uint32_t N>
+class MedianWindow
+{
+  static_assert((N >= 3U) && ((N & 1U) != 0U), "MedianWindow length must be odd, 3 or more");
+
+public:
+  /**
+    * @brief  Empty the window.
+    */
+  void Reset()
+  {
+    head_ = 0U;
+    count_ = 0U;
+  }
+
+  /**
+    * @brief  Add a sample, the oldest one leaves once the window is full.
+    * @param  x Sample
+    */
+  void Push(T x)
+  {
+    T *end = &sorted_[count_];
+
+    if (count_ < N)
+    {
+      T *slot = std::upper_bound(&sorted_[0], end, x);
+
+      std::copy_backward(slot, end, end + 1);
+      *slot = x;
+      count_++;
+    }
+    else
+    {
+      T old = ring_[head_];
+      T *slot = std::lower_bound(&sorted_[0], end, old);
+
+      if (old < x)
+      {
+        T *last = std::lower_bound(slot + 1, end, x) - 1;
+
+        std::copy(slot + 1, last + 1, slot);
+        *last = x;
+      }
+      else
+      {
+        T *first = std::upper_bound(&sorted_[0], slot, x);
+
+        std::copy_backward(first, slot, slot + 1);
+        *first = x;
+      }
+    }
+    ring_[head_] = x;
+    head_ = (head_ + 1U < N) ? (head_ + 1U) : 0U;
+  }
+
+  /**
+    * @brief  True once N samples were pushed.
+    */
+  bool Full() const
+  {
+    return count_ == N;
+  }
+
+  /**
+    * @brief  Median, the upper one while an even count is held.
+    * @note   The window must not be empty.
+    */
+  T Median() const
+  {
+    return sorted_[count_ / 2U];
+  }
+
+  /**
+    * @brief  Median absolute deviation from the median.
+    * @note   The window must be full.
+    */
+  T Mad() const
+  {
+    const uint32_t c = N / 2U;
+    uint32_t lo = 0U;
+    uint32_t hi = c;
+
+    /* i deviations from below and c - i from above are the c smallest
+     * besides the 0 of the median itself: the largest of them is the MAD */
+    for (;;)
+    {
+      uint32_t i = (lo + hi) / 2U;
+      uint32_t j = c - i;
+
+      if ((i < c) && (j > 0U) && (Above(j - 1U) > Below(i)))
+      {
+        lo = i + 1U;
+      }
+      else if ((i > 0U) && (j < c) && (Below(i - 1U) > Above(j)))
+      {
+        hi = i - 1U;
+      }
+      else if (i == 0U)
+      {
+        return Above(j - 1U);
+      }
+      else if (j == 0U)
+      {
+        return Below(i - 1U);
+      }
+      else
+      {
+        return std::max(Below(i - 1U), Above(j - 1U));
+      }
+    }
+  }
+
+private:
+  /** n-th smallest deviation of the samples below the median */
+  T Below(uint32_t n) const
+  {
+    return sorted_[N / 2U] - sorted_[(N / 2U) - 1U - n];
+  }
+
+  /** n-th smallest deviation of the samples above the median */
+  T Above(uint32_t n) const
+  {
+    return sorted_[(N / 2U) + 1U + n] - sorted_[N / 2U];
+  }
+
+  T sorted_[N] {};                         /*!< Samples, ascending          */
+  T ring_[N] {};                           /*!< Samples, arrival order      */
+  uint32_t head_ = 0U;                     /*!< Slot of the next sample     */
+  uint32_t count_ = 0U;                    /*!< Samples held                */
+};
+
+/**
+  * @brief  Hampel filter: a sample further than threshold robust standard
+  *         deviations, 1.4826 MAD, from the median of the last N samples,
+  *         itself included, is replaced by that median. Up to N / 2
+  *         outliers in a row are removed; a true step passes after N / 2
+  *         samples. Samples pass unchanged until the window is full.
+  */
+template <typename T, uint32_t N>
+class HampelFilter
+{
+public:
+  /**
+    * @param  threshold Limit, in robust standard deviations
+    * @param  min_sigma Floor of the robust standard deviation, so a window
+    *         of equal samples does not reject the quantization steps
+    */
+  constexpr HampelFilter(float threshold, float min_sigma)
+    : threshold_(threshold), min_sigma_(min_sigma)
+  {
+  }
+
+  /**
+    * @brief  Empty the window.
+    */
+  void Reset()
+  {
+    window_.Reset();
+  }
+
+  /**
+    * @brief  Filter one sample in place.
+    * @param  x Sample, replaced by the median when it is an outlier
+    * @retval True when x was replaced
+    */
+  bool Apply(T &x)
+  {
+    window_.Push(x);
+    if (!window_.Full())
+    {
+      return false;
+    }
+
+    T median = window_.Median();
+    float sigma = 1.4826f * (float)window_.Mad();
+
+    sigma = (sigma > min_sigma_) ? sigma : min_sigma_;
+    if (fabsf((float)x - (float)median) <= (threshold_ * sigma))
+    {
+      return false;
+    }
+    x = median;
+    return true;
+  }
+
+  /**
+    * @brief  Window of the filter.
+    */
+  const MedianWindow<T, N> &Window() const
+  {
+    return window_;
+  }
+
+private:
+  MedianWindow<T, N> window_;              /*!< Last N samples              */
+  float threshold_;                        /*!< Robust standard deviations  */
+  float min_sigma_;                        /*!< Floor of the deviation      */
+};
+
+#endif /* __MEDIAN_HPP__ */
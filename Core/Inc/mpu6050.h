@@ -0,0 +1,139 @@
+/**
+  ******************************************************************************
+  * @file    mpu6050.h
+  * @brief   This file contains the definitions of the MPU-6050/ICM-2060x I2C
+  *          IMU driver. The sensor buffers samples in its FIFO at full output
+  *          data rate and the driver drains them in DMA bursts.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __MPU6050_H__
+#define __MPU6050_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "i2c_bus.h"
+#include "imu.h"
+
+/* Exported constants --------------------------------------------------------*/
+/** 7-bit address with AD0 low */
+#define MPU6050_ADDRESS             0x68U
+
+/** Registers */
+#define MPU6050_REG_SMPLRT_DIV      0x19U
+#define MPU6050_REG_CONFIG          0x1AU
+#define MPU6050_REG_GYRO_CONFIG     0x1BU
+#define MPU6050_REG_ACCEL_CONFIG    0x1CU
+#define MPU6050_REG_FIFO_EN         0x23U
+#define MPU6050_REG_INT_PIN_CFG     0x37U
+#define MPU6050_REG_INT_ENABLE      0x38U
+#define MPU6050_REG_USER_CTRL       0x6AU
+#define MPU6050_REG_PWR_MGMT_1      0x6BU
+#define MPU6050_REG_FIFO_COUNTH     0x72U
+#define MPU6050_REG_FIFO_R_W        0x74U
+#define MPU6050_REG_WHO_AM_I        0x75U
+
+/** Data-ready stamps kept to date the FIFO samples, must be a power of two
+  * and cover the FIFO content at drain time */
+#define MPU6050_DRDY_HISTORY        32U
+
+/** Bytes per FIFO sample: accelerometer then gyro, big endian */
+#define MPU6050_FIFO_SAMPLE_SIZE    12U
+
+/** Hardware FIFO size */
+#define MPU6050_FIFO_SIZE           1024U
+
+/** Largest number of samples drained by one burst read */
+#define MPU6050_MAX_BATCH           8U
+
+/** Gyro output rate with DLPF_CFG = 0, divided by 1 + SMPLRT_DIV */
+#define MPU6050_GYRO_RATE_HZ        8000U
+#define MPU6050_SMPLRT_DIV          3U
+#define MPU6050_ODR_HZ              (MPU6050_GYRO_RATE_HZ / (1U + MPU6050_SMPLRT_DIV))
+
+/** Samples accumulated in the FIFO between two drains, and the drain rate */
+#define MPU6050_DRAIN_SAMPLES       4U
+#define MPU6050_DRAIN_HZ            (MPU6050_ODR_HZ / MPU6050_DRAIN_SAMPLES)
+
+/** Bus load of one steady state drain: FIFO count then FIFO burst */
+#define MPU6050_DRAIN_TRANSACTIONS  2U
+#define MPU6050_DRAIN_BYTES         (2U + (MPU6050_DRAIN_SAMPLES * MPU6050_FIFO_SAMPLE_SIZE))
+
+/** Scale of the configured full ranges: +-2000 dps and +-8 g */
+#define MPU6050_GYRO_DPS_PER_LSB    (1.0f / 16.4f)
+#define MPU6050_ACCEL_G_PER_LSB     (1.0f / 4096.0f)
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Driver state.
+  */
+typedef enum
+{
+  MPU6050_STATE_RESET = 0U,   /*!< Device reset to be issued           */
+  MPU6050_STATE_WAIT_RESET,   /*!< Waiting for the device to reboot    */
+  MPU6050_STATE_IDENTIFY,     /*!< WHO_AM_I read in progress           */
+  MPU6050_STATE_CONFIG,       /*!< Configuration writes in progress    */
+  MPU6050_STATE_RUN,          /*!< FIFO running, see MPU6050_Drain()   */
+  MPU6050_STATE_ERROR         /*!< Unknown device or repeated failures */
+} MPU6050_StateTypeDef;
+
+/**
+  * @brief  Driver statistics.
+  */
+typedef struct
+{
+  uint32_t drains;          /*!< FIFO count reads                     */
+  uint32_t bursts;          /*!< FIFO data burst reads                */
+  uint32_t samples;         /*!< Samples pushed to the ring           */
+  uint32_t fifo_overflows;  /*!< FIFO resets after an overflow        */
+  uint32_t bus_errors;      /*!< Failed jobs                          */
+  uint32_t drdy_stamped;    /*!< Samples dated by their data-ready edge */
+  uint32_t nominal_stamped; /*!< Samples dated from the sample period */
+  uint32_t first_sample_ms; /*!< HAL tick of the first sample, boot time */
+} MPU6050_StatsTypeDef;
+
+/**
+  * @brief  Driver instance.
+  */
+typedef struct
+{
+  I2C_BusTypeDef *bus;                 /*!< Bus the sensor is on                */
+  uint8_t address;                     /*!< 7-bit device address                */
+  volatile uint8_t state;              /*!< @ref MPU6050_StateTypeDef           */
+  uint8_t config_index;                /*!< Configuration write in progress     */
+  uint8_t failures;                    /*!< Consecutive failed jobs             */
+  uint8_t whoami;                      /*!< Identification read back            */
+  uint8_t reg_value;                   /*!< DMA source of register writes       */
+  uint8_t count_raw[2];                /*!< FIFO_COUNTH/L                       */
+  uint8_t fifo[MPU6050_MAX_BATCH * MPU6050_FIFO_SAMPLE_SIZE]; /*!< Burst buffer */
+  I2C_JobTypeDef job;                  /*!< Bus job, one in flight at a time    */
+  uint32_t stamp;                      /*!< DWT stamp of the state entry        */
+  uint64_t count_stamp;                /*!< Cycle time the FIFO count refers to */
+  uint32_t period_cycles;              /*!< Measured sample period              */
+  uint16_t fifo_samples;               /*!< Samples in the FIFO at count time   */
+  uint8_t drdy_valid;                  /*!< Data-ready edges match the FIFO     */
+  uint32_t drdy_edge;                  /*!< Edges up to the FIFO count read     */
+  volatile uint32_t drdy_count;        /*!< Data-ready edges seen               */
+  uint64_t drdy_stamps[MPU6050_DRDY_HISTORY]; /*!< Cycle time of the last edges */
+  MPU6050_StatsTypeDef stats;          /*!< Driver statistics                   */
+} MPU6050_HandleTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern MPU6050_HandleTypeDef hmpu6050;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void MPU6050_Init(MPU6050_HandleTypeDef *dev, I2C_BusTypeDef *bus, uint8_t address);
+void MPU6050_Poll(MPU6050_HandleTypeDef *dev);
+I2C_JobTypeDef *MPU6050_Drain(MPU6050_HandleTypeDef *dev);
+void MPU6050_DataReady(MPU6050_HandleTypeDef *dev);
+uint8_t MPU6050_IsKnown(uint8_t whoami);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MPU6050_H__ */
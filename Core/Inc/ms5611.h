@@ -0,0 +1,139 @@
+/**
+  ******************************************************************************
+  * @file    ms5611.h
+  * @brief   This file contains the definitions of the MS5611 I2C barometer
+  *          driver. Conversions are started and collected from scheduler
+  *          slots, the driver never waits for the ADC.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __MS5611_H__
+#define __MS5611_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "i2c_bus.h"
+#include "timing.h"
+
+/* Exported constants --------------------------------------------------------*/
+/** Commands */
+#define MS5611_CMD_RESET            0x1EU
+#define MS5611_CMD_CONVERT_D1       0x40U
+#define MS5611_CMD_CONVERT_D2       0x50U
+#define MS5611_CMD_ADC_READ         0x00U
+#define MS5611_CMD_PROM_READ        0xA0U
+
+/** Oversampling ratio 4096, added to the conversion commands, and the
+  * matching datasheet maximum conversion time */
+#define MS5611_OSR                  0x08U
+#define MS5611_CONVERSION_US        9040U
+
+/** Scheduler slot rate: each slot collects one conversion and starts the
+  * next one, the period has to cover the conversion time */
+#define MS5611_RATE_HZ              100U
+
+/** Pressure conversions run between two temperature conversions, 1 for a
+  * strict alternation */
+#define MS5611_PRESSURE_PER_TEMP    1U
+
+/** Bus load of one slot: ADC read then next conversion command */
+#define MS5611_SLOT_TRANSACTIONS    2U
+#define MS5611_SLOT_BYTES           3U
+
+/** Time given to the device to reload its PROM after a reset */
+#define MS5611_RESET_DELAY_US       3000U
+
+/** Calibration words, factory data and C1..C6 then the CRC word */
+#define MS5611_PROM_WORDS           8U
+
+#if (1000000U / MS5611_RATE_HZ) <= MS5611_CONVERSION_US
+#error "MS5611_RATE_HZ leaves no time for the conversion"
+#endif
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Driver state.
+  */
+typedef enum
+{
+  MS5611_STATE_RESET = 0U,    /*!< Reset command to be issued          */
+  MS5611_STATE_WAIT_RESET,    /*!< Waiting for the PROM reload         */
+  MS5611_STATE_PROM,          /*!< Calibration reads in progress       */
+  MS5611_STATE_RUN,           /*!< Conversions, see MS5611_Convert()   */
+  MS5611_STATE_ERROR          /*!< PROM CRC mismatch                   */
+} MS5611_StateTypeDef;
+
+/**
+  * @brief  One compensated measurement.
+  */
+typedef struct
+{
+  uint64_t timestamp;       /*!< Cycle time of the pressure conversion middle */
+  int32_t pressure;         /*!< Pressure in Pa                              */
+  int32_t temperature;      /*!< Temperature in 0.01 degC                    */
+} MS5611_SampleTypeDef;
+
+/**
+  * @brief  Driver statistics.
+  */
+typedef struct
+{
+  uint32_t conversions;             /*!< ADC results collected              */
+  uint32_t samples;                 /*!< Compensated samples produced       */
+  uint32_t early;                   /*!< Slots left idle, conversion not over */
+  uint32_t not_ready;               /*!< ADC read back 0, conversion redone */
+  uint32_t bus_errors;              /*!< Failed jobs                        */
+  Timing_PerfTypeDef compensate_cycles; /*!< MS5611_Compensate() cost       */
+  Timing_PerfTypeDef isr_cycles;    /*!< Completion callback cost           */
+} MS5611_StatsTypeDef;
+
+/**
+  * @brief  Driver instance.
+  */
+typedef struct
+{
+  I2C_BusTypeDef *bus;                 /*!< Bus the sensor is on                 */
+  uint8_t address;                     /*!< 7-bit device address                 */
+  volatile uint8_t state;              /*!< @ref MS5611_StateTypeDef             */
+  uint8_t prom_index;                  /*!< PROM word being read                 */
+  uint8_t converting;                  /*!< Conversion command in flight or done */
+  uint8_t pressure_count;              /*!< Pressure conversions since the last temperature */
+  uint8_t failures;                    /*!< Consecutive failed jobs              */
+  uint8_t raw[3];                      /*!< PROM word or ADC result, big endian  */
+  uint16_t prom[MS5611_PROM_WORDS];    /*!< Calibration                          */
+  uint32_t d1;                         /*!< Last raw pressure                    */
+  uint32_t d2;                         /*!< Last raw temperature                 */
+  uint64_t d1_stamp;                   /*!< Cycle time d1 was converted at       */
+  uint8_t valid;                       /*!< Bit 0: d1 valid, bit 1: d2 valid     */
+  I2C_JobTypeDef job;                  /*!< Bus job, one in flight at a time     */
+  uint32_t stamp;                      /*!< DWT stamp of the state entry         */
+  uint64_t conversion_stamp;           /*!< Cycle time the conversion started    */
+  MS5611_SampleTypeDef sample;         /*!< Latest compensated measurement       */
+  volatile uint32_t sequence;          /*!< Incremented on each new sample       */
+  MS5611_StatsTypeDef stats;           /*!< Driver statistics                    */
+} MS5611_HandleTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern MS5611_HandleTypeDef hms5611;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void MS5611_Init(MS5611_HandleTypeDef *dev, I2C_BusTypeDef *bus, uint8_t address);
+void MS5611_Poll(MS5611_HandleTypeDef *dev);
+I2C_JobTypeDef *MS5611_Convert(MS5611_HandleTypeDef *dev);
+uint8_t MS5611_SweepEntry(MS5611_HandleTypeDef *dev, I2C_ScanEntryTypeDef *entry);
+void MS5611_SweepDone(MS5611_HandleTypeDef *dev, const I2C_JobTypeDef *sweep);
+uint32_t MS5611_Read(MS5611_HandleTypeDef *dev, MS5611_SampleTypeDef *sample);
+uint8_t MS5611_CheckProm(const uint16_t prom[MS5611_PROM_WORDS]);
+void MS5611_Compensate(const uint16_t prom[MS5611_PROM_WORDS], uint32_t d1, uint32_t d2,
+                       int32_t *pressure, int32_t *temperature);
+float MS5611_Height(int32_t pressure, int32_t reference);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MS5611_H__ */
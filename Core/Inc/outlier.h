@@ -0,0 +1,87 @@
+/**
+  ******************************************************************************
+  * @file    outlier.h
+  * @brief   This file contains the C interface of the outlier rejection of
+  *          the altitude sensors: Hampel filters on the barometer pressure,
+  *          against prop wash spikes, and on the rangefinder distance,
+  *          against dropouts.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __OUTLIER_H__
+#define __OUTLIER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "timing.h"
+#include "ms5611.h"
+#include "vl53l1x.h"
+
+/* Exported constants --------------------------------------------------------*/
+/** Barometer window, odd: 90 ms at MS5611_RATE_HZ, spikes of up to 4
+  * samples removed */
+#define OUTLIER_BARO_WINDOW       9U
+
+/** Barometer limit in robust standard deviations, and floor of that
+  * deviation in Pa, about the conversion noise */
+#define OUTLIER_BARO_THRESHOLD    3.0f
+#define OUTLIER_BARO_MIN_SIGMA    2.0f
+
+/** Rangefinder window, odd: 175 ms at VL53L1X_RANGE_PERIOD_MS, dropouts of
+  * up to 3 ranges removed */
+#define OUTLIER_RANGE_WINDOW      7U
+
+/** Rangefinder limit in robust standard deviations, and floor of that
+  * deviation in mm */
+#define OUTLIER_RANGE_THRESHOLD   3.0f
+#define OUTLIER_RANGE_MIN_SIGMA   10.0f
+
+/** Samples run by Outlier_Bench() */
+#define OUTLIER_BENCH_SAMPLES     1024U
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Statistics of one filtered stream.
+  */
+typedef struct
+{
+  uint32_t samples;               /*!< Samples filtered                       */
+  uint32_t outliers;              /*!< Samples replaced by the median         */
+  Timing_PerfTypeDef cycles;      /*!< Cost of the filter calls               */
+} Outlier_StreamStatsTypeDef;
+
+/**
+  * @brief  Outlier rejection statistics.
+  */
+typedef struct
+{
+  Outlier_StreamStatsTypeDef baro;
+  Outlier_StreamStatsTypeDef range;
+} Outlier_StatsTypeDef;
+
+/**
+  * @brief  Result of Outlier_Bench(), per sample on the barometer window.
+  */
+typedef struct
+{
+  uint32_t window_cycles;         /*!< Cycles of the sorted window            */
+  uint32_t sort_cycles;           /*!< Cycles of a sort of the window copy    */
+  uint32_t mismatches;            /*!< Outputs that differ between the two    */
+} Outlier_BenchTypeDef;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void Outlier_Reset(void);
+uint8_t Outlier_Baro(MS5611_SampleTypeDef *sample);
+uint8_t Outlier_Range(VL53L1X_SampleTypeDef *sample);
+const Outlier_StatsTypeDef *Outlier_Stats(void);
+void Outlier_Bench(Outlier_BenchTypeDef *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __OUTLIER_H__ */
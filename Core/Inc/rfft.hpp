@@ -0,0 +1,167 @@
+/**
+  ******************************************************************************
+  * @file    rfft.hpp
+  * @brief   This file provides the incremental real FFT shared by the gyro
+  *          spectrum analyzers.
+  *
+  *          N real samples are mean removed, Hann windowed and packed, even
+  *          samples as real and odd samples as imaginary parts, into a
+  *          complex FFT of N / 2 points, radix-2 decimation in time. The
+  *          spectrum of the real sequence is then split out bin by bin:
+  *            X[k] = (Z[k] + Z*[M-k]) / 2 - i W^k (Z[k] - Z*[M-k]) / 2.
+  *          Loading, each butterfly stage and the bins are separate calls,
+  *          so a caller can spread one transform over several cycle
+  *          budgets.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __RFFT_HPP__
+#define __RFFT_HPP__
+
+/* Includes ------------------------------------------------------------------*/
+#include <cstdint>
+#include <math.h>
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Real FFT of N samples, N a power of two from 16 to 1024.
+  */
+template <uint32_t N>
+class RealFft
+{
+  static_assert((N >= 16U) && (N <= 1024U) && ((N & (N - 1U)) == 0U),
+                "RealFft length must be a power of two from 16 to 1024");
+
+public:
+  static constexpr uint32_t kHalf = N / 2U;
+
+  /**
+    * @brief  Butterfly stages of a transform.
+    */
+  static constexpr uint32_t Stages()
+  {
+    uint32_t stages = 0U;
+
+    while ((1U << stages) < kHalf)
+    {
+      stages++;
+    }
+    return stages;
+  }
+
+  /**
+    * @brief  Build the window, twiddle and bit reversal tables.
+    */
+  void Init()
+  {
+    window_power_ = 0.0f;
+    for (uint32_t n = 0U; n < N; n++)
+    {
+      window_[n] = 0.5f - (0.5f * cosf((6.28318530718f * (float)n) / (float)N));
+      window_power_ += window_[n] * window_[n];
+    }
+    for (uint32_t n = 0U; n < kHalf; n++)
+    {
+      uint32_t r = 0U;
+
+      cos_[n] = cosf((6.28318530718f * (float)n) / (float)N);
+      sin_[n] = -sinf((6.28318530718f * (float)n) / (float)N);
+      for (uint32_t b = 0U; b < Stages(); b++)
+      {
+        r |= ((n >> b) & 1U) << (Stages() - 1U - b);
+      }
+      reverse_[n] = (uint16_t)r;
+    }
+  }
+
+  /**
+    * @brief  Load a transform from a ring of N samples.
+    * @param  ring Samples, N of them
+    * @param  head Index of the oldest sample
+    */
+  void Load(const float *ring, uint32_t head)
+  {
+    float mean = 0.0f;
+
+    for (uint32_t n = 0U; n < N; n++)
+    {
+      mean += ring[n];
+    }
+    mean *= 1.0f / (float)N;
+
+    for (uint32_t n = 0U; n < kHalf; n++)
+    {
+      uint32_t even = (head + (2U * n)) & (N - 1U);
+      uint32_t odd = (even + 1U) & (N - 1U);
+      uint32_t slot = reverse_[n];
+
+      re_[slot] = (ring[even] - mean) * window_[2U * n];
+      im_[slot] = (ring[odd] - mean) * window_[(2U * n) + 1U];
+    }
+  }
+
+  /**
+    * @brief  One butterfly stage, stages run in order from 0.
+    * @param  stage Stage, 0 for the 2-point butterflies
+    */
+  void Stage(uint32_t stage)
+  {
+    uint32_t half = 1U << stage;
+    uint32_t span = half << 1U;
+    uint32_t stride = N / span;
+
+    for (uint32_t j = 0U; j < half; j++)
+    {
+      float wr = cos_[j * stride];
+      float wi = sin_[j * stride];
+
+      for (uint32_t i = j; i < kHalf; i += span)
+      {
+        uint32_t k = i + half;
+        float tr = (wr * re_[k]) - (wi * im_[k]);
+        float ti = (wr * im_[k]) + (wi * re_[k]);
+
+        re_[k] = re_[i] - tr;
+        im_[k] = im_[i] - ti;
+        re_[i] += tr;
+        im_[i] += ti;
+      }
+    }
+  }
+
+  /**
+    * @brief  Power |X[k]|^2 of a bin once every stage ran.
+    * @param  k Bin, below N / 2
+    */
+  float Power(uint32_t k) const
+  {
+    uint32_t m = (kHalf - k) & (kHalf - 1U);
+    float er = 0.5f * (re_[k] + re_[m]);
+    float ei = 0.5f * (im_[k] - im_[m]);
+    float odd_r = 0.5f * (im_[k] + im_[m]);
+    float odd_i = -0.5f * (re_[k] - re_[m]);
+    float xr = er + ((cos_[k] * odd_r) - (sin_[k] * odd_i));
+    float xi = ei + ((cos_[k] * odd_i) + (sin_[k] * odd_r));
+
+    return (xr * xr) + (xi * xi);
+  }
+
+  /**
+    * @brief  Sum of the squared window, for power spectral densities.
+    */
+  float WindowPower() const
+  {
+    return window_power_;
+  }
+
+private:
+  float window_[N] {};                     /*!< Hann window                 */
+  float cos_[kHalf] {};                    /*!< exp(-2 pi i k / N), real    */
+  float sin_[kHalf] {};                    /*!< exp(-2 pi i k / N), imag    */
+  uint16_t reverse_[kHalf] {};             /*!< Bit reversed slot           */
+  float re_[kHalf] {};                     /*!< Transform in progress, real */
+  float im_[kHalf] {};                     /*!< Transform in progress, imag */
+  float window_power_ = 0.0f;              /*!< Sum of window_^2            */
+};
+
+#endif /* __RFFT_HPP__ */
@@ -0,0 +1,59 @@
+/**
+  ******************************************************************************
+  * @file    sample_ring.h
+  * @brief   This file contains the C interface of the sensor sample rings,
+  *          SpscRing instances (see spsc_ring.hpp) written by the driver
+  *          completion interrupts and read by the main loop.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SAMPLE_RING_H__
+#define __SAMPLE_RING_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "imu.h"
+#include "ms5611.h"
+#include "mag.h"
+
+/* Exported constants --------------------------------------------------------*/
+/** Samples each ring holds, must be powers of two: 32 ms of data at the
+  * 2 kHz I2C IMU rate, 8 ms at the 8 kHz SPI IMU rate, 160 ms at the
+  * scheduler rates of the barometer and magnetometer */
+#define IMU_RING_LEN          64U
+#define BARO_RING_LEN         16U
+#define MAG_RING_LEN          8U
+
+/* Exported macro ------------------------------------------------------------*/
+/**
+  * @brief  Functions of one sample ring. Reserve()/Commit() fill a slot in
+  *         place from the producer interrupt, Front()/Release() read it in
+  *         place from the main loop; Push()/Pop() are the copying forms.
+  *         Reserve() and Front() return NULL when the ring is full or empty,
+  *         Commit() and Release() must then not be called.
+  */
+#define SAMPLE_RING_DECLARE(NAME, TYPE)              \
+  TYPE *NAME##_Reserve(void);                         \
+  void NAME##_Commit(void);                           \
+  const TYPE *NAME##_Front(void);                     \
+  void NAME##_Release(void);                          \
+  uint8_t NAME##_Push(const TYPE *sample);            \
+  uint8_t NAME##_Pop(TYPE *sample);                   \
+  uint32_t NAME##_Count(void);                        \
+  uint32_t NAME##_Overruns(void);
+
+/* Exported functions prototypes ---------------------------------------------*/
+SAMPLE_RING_DECLARE(ImuRing, IMU_SampleTypeDef)
+SAMPLE_RING_DECLARE(Imu2Ring, IMU_SampleTypeDef)
+SAMPLE_RING_DECLARE(BaroRing, MS5611_SampleTypeDef)
+SAMPLE_RING_DECLARE(MagRing, Mag_SampleTypeDef)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SAMPLE_RING_H__ */
@@ -0,0 +1,151 @@
+/**
+  ******************************************************************************
+  * @file    sched.h
+  * @brief   This file contains the definitions of the multi-rate sensor
+  *          scheduler. Sensor tasks declare their rate and bus transfer size;
+  *          the scheduler budgets the bus bandwidth when the tasks are added
+  *          and dispatches them so that slow sensors only use the gaps left
+  *          between the latency critical ones.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SCHED_H__
+#define __SCHED_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "i2c_bus.h"
+#include "timing.h"
+
+/* Exported constants --------------------------------------------------------*/
+/** Number of tasks a scheduler can hold */
+#define SCHED_MAX_TASKS               8U
+
+/** Share of the bus the tasks may reserve, the rest absorbs retries and recoveries */
+#define SCHED_BUDGET_PERMILLE         750U
+
+/** Bit times of one register transaction besides its data bytes: START,
+  * address + W, register, repeated START, address + R, STOP */
+#define SCHED_TRANSACTION_BITS        30U
+
+/** Interrupt and DMA set up time between two transactions */
+#define SCHED_TRANSACTION_GAP_NS      10000U
+
+/** Slack kept between a background task and the next critical task */
+#define SCHED_GAP_MARGIN_US           20U
+
+/** Period of the achieved rate and bus utilization report */
+#define SCHED_REPORT_PERIOD_US        1000000U
+
+/* Exported macros -----------------------------------------------------------*/
+/**
+  * @brief  Bus time of one task activation, a constant expression so that
+  *         static configurations can be checked at build time.
+  * @param  transactions Register transactions per activation
+  * @param  bytes Data bytes per activation, all transactions included
+  * @param  bus_hz Bus clock
+  * @retval Duration in nanoseconds
+  */
+#define SCHED_COST_NS(transactions, bytes, bus_hz)                                          \
+  ((uint32_t)(((((uint64_t)(transactions) * SCHED_TRANSACTION_BITS) + ((uint64_t)(bytes) * 9U)) \
+               * 1000000000U) / (bus_hz)) + ((uint32_t)(transactions) * SCHED_TRANSACTION_GAP_NS))
+
+/**
+  * @brief  Bus share reserved by a task.
+  * @param  rate_hz Activation rate
+  * @param  transactions Register transactions per activation
+  * @param  bytes Data bytes per activation
+  * @param  bus_hz Bus clock
+  * @retval Load in per mille, rounded up
+  */
+#define SCHED_LOAD_PERMILLE(rate_hz, transactions, bytes, bus_hz)                           \
+  ((uint32_t)((((uint64_t)(rate_hz) * SCHED_COST_NS(transactions, bytes, bus_hz)) + 999999U) / 1000000U))
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Dispatch class of a task.
+  */
+typedef enum
+{
+  SCHED_CLASS_CRITICAL = 0U,  /*!< Dispatched as soon as due, latency is tracked */
+  SCHED_CLASS_BACKGROUND      /*!< Dispatched only in gaps between critical tasks */
+} Sched_ClassTypeDef;
+
+/**
+  * @brief  Task body, called from the main loop when the task is dispatched.
+  * @param  context Task context
+  * @retval Job submitted for this activation, whose completion ends the
+  *         activation, or NULL when nothing was put on the bus
+  */
+typedef I2C_JobTypeDef *(*Sched_RunTypeDef)(void *context);
+
+/**
+  * @brief  Task statistics.
+  */
+typedef struct
+{
+  uint32_t runs;                      /*!< Activations that put a job on the bus   */
+  uint32_t idle;                      /*!< Activations with nothing to transfer    */
+  uint32_t deferred;                  /*!< Polls a due task waited for a gap       */
+  uint32_t missed;                    /*!< Periods dropped because the task lagged */
+  uint32_t achieved_mhz;              /*!< Activation rate of the last report, mHz */
+  Timing_PerfTypeDef latency_cycles;  /*!< Due time to completion of the job       */
+} Sched_TaskStatsTypeDef;
+
+/**
+  * @brief  A periodic sensor task.
+  */
+typedef struct
+{
+  Sched_RunTypeDef run;               /*!< Task body                               */
+  void *context;                      /*!< Argument of run                         */
+  uint32_t rate_hz;                   /*!< Requested activation rate               */
+  uint16_t bytes;                     /*!< Data bytes per activation               */
+  uint8_t transactions;               /*!< Register transactions per activation    */
+  uint8_t type;                       /*!< @ref Sched_ClassTypeDef                 */
+  uint32_t load_permille;             /*!< Bus share reserved by the task          */
+  uint32_t cost_cycles;               /*!< Estimated bus time of an activation     */
+  uint32_t period_cycles;             /*!< Activation period                       */
+  uint32_t due;                       /*!< DWT stamp of the next activation        */
+  I2C_JobTypeDef *job;                /*!< Job of the activation in progress       */
+  uint32_t job_due;                   /*!< Due stamp of the activation in progress */
+  uint32_t window_runs;               /*!< Activations in the report window        */
+  Sched_TaskStatsTypeDef stats;       /*!< Task statistics                         */
+} Sched_TaskTypeDef;
+
+/**
+  * @brief  Scheduler of the tasks sharing one bus.
+  */
+typedef struct
+{
+  I2C_BusTypeDef *bus;                     /*!< Bus shared by the tasks            */
+  uint32_t bus_hz;                         /*!< Bus clock used for the budget      */
+  Sched_TaskTypeDef *tasks[SCHED_MAX_TASKS]; /*!< Registered tasks                 */
+  uint8_t count;                           /*!< Number of registered tasks         */
+  uint32_t load_permille;                  /*!< Bus share reserved by all tasks    */
+  uint32_t rejected;                       /*!< Tasks refused, over budget         */
+  uint32_t bus_permille;                   /*!< Bus use measured in the last report */
+  uint32_t window_stamp;                   /*!< DWT stamp of the report window     */
+} Sched_HandleTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern Sched_HandleTypeDef sched_i2c1;
+extern Sched_HandleTypeDef sched_i2c2;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void Sched_Init(Sched_HandleTypeDef *sched, I2C_BusTypeDef *bus, uint32_t bus_hz);
+HAL_StatusTypeDef Sched_AddTask(Sched_HandleTypeDef *sched, Sched_TaskTypeDef *task, uint32_t rate_hz,
+                                uint8_t transactions, uint16_t bytes, Sched_ClassTypeDef type,
+                                Sched_RunTypeDef run, void *context);
+void Sched_Poll(Sched_HandleTypeDef *sched);
+void Sched_ResetStats(Sched_HandleTypeDef *sched);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SCHED_H__ */
@@ -0,0 +1,87 @@
+/**
+  ******************************************************************************
+  * @file    spectrum.h
+  * @brief   This file contains the C interface of the gyro spectrum capture:
+  *          Welch averaged power spectra of each axis, computed onboard and
+  *          handed out as compact frames for filter tuning, in place of the
+  *          raw samples.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SPECTRUM_H__
+#define __SPECTRUM_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "timing.h"
+
+/* Exported constants --------------------------------------------------------*/
+/** Segment length, a power of two from 16 to 1024: 7.8 Hz bins at the
+  * 2 kHz loop rate */
+#define SPECTRUM_FFT_LEN        256U
+
+/** Bins of a frame, DC to one bin below Nyquist */
+#define SPECTRUM_BINS           (SPECTRUM_FFT_LEN / 2U)
+
+/** Segments averaged per frame, 50 % overlapped: 2 s at 2 kHz. The spread of
+  * a noise bin shrinks as the square root of it */
+#define SPECTRUM_AVERAGES       32U
+
+/** Bins accumulated or encoded by one step */
+#define SPECTRUM_BINS_PER_STEP  32U
+
+/** Level of a bin at or below 127 dB under the peak of its frame */
+#define SPECTRUM_LEVEL_FLOOR    255U
+
+/** Cycle budget of one Spectrum_Poll() call, checked between steps */
+#define SPECTRUM_BUDGET_US      10U
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Averaged spectrum of one axis, 140 bytes. The power spectral
+  *         density of bin k, k * bin_hz Hz, is peak_db - level[k] / 2 dB.
+  */
+typedef struct
+{
+  uint16_t sequence;               /*!< Frame set, the 3 axes share it          */
+  uint8_t axis;                    /*!< 0 X, 1 Y, 2 Z                           */
+  uint8_t segments;                /*!< Segments averaged                       */
+  float bin_hz;                    /*!< Bin spacing                             */
+  float peak_db;                   /*!< Highest density, dB of (unit)^2 / Hz    */
+  uint8_t level[SPECTRUM_BINS];    /*!< Half dB steps under peak_db             */
+} Spectrum_FrameTypeDef;
+
+/**
+  * @brief  Receiver of the frames, called from Spectrum_Poll() outside of
+  *         its budget: it should queue the frame, not send it.
+  */
+typedef void (*Spectrum_SinkTypeDef)(const Spectrum_FrameTypeDef *frame, void *context);
+
+/**
+  * @brief  Capture statistics.
+  */
+typedef struct
+{
+  uint32_t segments;               /*!< Segments accumulated, all axes          */
+  uint32_t frames;                 /*!< Frames handed to the sink               */
+  uint32_t late;                   /*!< Segments started after their slot       */
+  Timing_PerfTypeDef poll_cycles;  /*!< Cost of the Spectrum_Poll() calls       */
+} Spectrum_StatsTypeDef;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void Spectrum_Init(float sample_hz, Spectrum_SinkTypeDef sink, void *context);
+void Spectrum_Start(void);
+void Spectrum_Stop(void);
+void Spectrum_Push(const float gyro[3]);
+void Spectrum_Poll(uint32_t budget_cycles);
+const Spectrum_StatsTypeDef *Spectrum_Stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SPECTRUM_H__ */
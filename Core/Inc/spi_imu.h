@@ -0,0 +1,113 @@
+/**
+  ******************************************************************************
+  * @file    spi_imu.h
+  * @brief   This file contains the definitions of the SPI1 IMU driver for
+  *          MPU-6000/ICM-2060x and ICM-42688 class parts. Every data-ready
+  *          edge starts one full-duplex DMA burst of gyro + accelerometer.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SPI_IMU_H__
+#define __SPI_IMU_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "imu.h"
+#include "timing.h"
+
+/* Exported constants --------------------------------------------------------*/
+/** Sensor burst: accelerometer, temperature and gyro, 2 bytes each */
+#define SPI_IMU_BURST_SIZE        14U
+
+/** Output data rate of the gyro */
+#define SPI_IMU_ODR_HZ            8000U
+
+/** SPI1 clock dividers of APB2 (84 MHz): 656 kHz for the register setup,
+  * the MPU-6000 limit being 1 MHz, and 10.5 MHz for the sensor bursts */
+#define SPI_IMU_BR_SETUP          (SPI_CR1_BR_2 | SPI_CR1_BR_1)
+#define SPI_IMU_BR_RUN            SPI_CR1_BR_1
+
+/** Time given to the device to reboot after a reset */
+#define SPI_IMU_RESET_DELAY_US    100000U
+
+/** Scale of the configured full ranges: +-2000 dps and +-8 g */
+#define SPI_IMU_GYRO_DPS_PER_LSB  (1.0f / 16.4f)
+#define SPI_IMU_ACCEL_G_PER_LSB   (1.0f / 4096.0f)
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Driver state.
+  */
+typedef enum
+{
+  SPI_IMU_STATE_IDENTIFY = 0U,  /*!< WHO_AM_I to be read                  */
+  SPI_IMU_STATE_WAIT_RESET,     /*!< Waiting for the device to reboot     */
+  SPI_IMU_STATE_CONFIG,         /*!< Configuration writes to be issued    */
+  SPI_IMU_STATE_RUN,            /*!< Bursts started from data-ready       */
+  SPI_IMU_STATE_ERROR           /*!< No supported device answered         */
+} SPI_IMU_StateTypeDef;
+
+/**
+  * @brief  Register map of a supported part family.
+  */
+typedef struct
+{
+  const uint8_t *whoami;           /*!< Identifiers of the family            */
+  uint8_t whoami_count;            /*!< Number of identifiers                */
+  uint8_t reset_reg;               /*!< Soft reset register                  */
+  uint8_t reset_value;             /*!< Soft reset command                   */
+  const uint8_t (*config)[2];      /*!< Register writes after the reset      */
+  uint8_t config_count;            /*!< Number of register writes            */
+  uint8_t data_reg;                /*!< First register of the sensor burst   */
+  uint8_t accel_offset;            /*!< Accelerometer X in the burst         */
+  uint8_t gyro_offset;             /*!< Gyro X in the burst                  */
+} SPI_IMU_PartTypeDef;
+
+/**
+  * @brief  Driver statistics.
+  */
+typedef struct
+{
+  uint32_t samples;                /*!< Samples pushed to the ring           */
+  uint32_t busy;                   /*!< Data-ready edges dropped, burst busy */
+  uint32_t dma_errors;             /*!< Failed bursts                        */
+  Timing_PerfTypeDef latency_cycles; /*!< Data-ready edge to sample in ring  */
+  Timing_PerfTypeDef isr_cycles;   /*!< CPU time of the EXTI and DMA ISRs    */
+} SPI_IMU_StatsTypeDef;
+
+/**
+  * @brief  Driver instance.
+  */
+typedef struct
+{
+  const SPI_IMU_PartTypeDef *part;         /*!< Detected part family            */
+  volatile uint8_t state;                  /*!< @ref SPI_IMU_StateTypeDef       */
+  volatile uint8_t busy;                   /*!< Burst in progress               */
+  uint8_t whoami;                          /*!< Identification read back        */
+  uint8_t tries;                           /*!< Identification attempts         */
+  uint32_t stamp;                          /*!< DWT stamp of the state entry    */
+  uint64_t drdy_stamp;                     /*!< Cycle time of the burst's edge  */
+  uint8_t tx[SPI_IMU_BURST_SIZE + 1U];     /*!< Register address then dummies   */
+  uint8_t rx[SPI_IMU_BURST_SIZE + 1U];     /*!< Dummy then sensor burst         */
+  SPI_IMU_StatsTypeDef stats;              /*!< Driver statistics               */
+} SPI_IMU_HandleTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern SPI_IMU_HandleTypeDef hspi_imu;
+extern DMA_HandleTypeDef hdma_spi1_rx;
+extern DMA_HandleTypeDef hdma_spi1_tx;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void SPI_IMU_Init(SPI_IMU_HandleTypeDef *dev);
+void SPI_IMU_Poll(SPI_IMU_HandleTypeDef *dev);
+void SPI_IMU_DataReady(SPI_IMU_HandleTypeDef *dev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SPI_IMU_H__ */
@@ -0,0 +1,152 @@
+/**
+  ******************************************************************************
+  * @file    spsc_ring.hpp
+  * @brief   This file provides the typed single producer single consumer
+  *          ring used to hand sensor samples from the driver interrupts to
+  *          the main loop.
+  *
+  *          The producer only writes head and the consumer only writes tail.
+  *          The index stores use release ordering and the loads of the other
+  *          side's index use acquire ordering, so a slot is never read before
+  *          it is filled nor refilled before it is read. On the Cortex-M4
+  *          both compile to a plain access and a DMB: no lock, no critical
+  *          section. Samples are written and read in place through
+  *          Reserve()/Commit() and Front()/Release().
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SPSC_RING_HPP__
+#define __SPSC_RING_HPP__
+
+/* Includes ------------------------------------------------------------------*/
+#include <atomic>
+#include <cstdint>
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Ring of N samples of type T, N must be a power of two. Free
+  *         running 32-bit indexes, the fill level is head - tail.
+  */
+template <typename T, uint32_t N>
+class SpscRing
+{
+  static_assert((N != 0U) && ((N & (N - 1U)) == 0U), "SpscRing length must be a power of two");
+  static_assert(std::atomic<uint32_t>::is_always_lock_free, "SpscRing needs lock-free indexes");
+
+public:
+  constexpr SpscRing() = default;
+  SpscRing(const SpscRing &) = delete;
+  SpscRing &operator=(const SpscRing &) = delete;
+
+  /**
+    * @brief  Slot of the next sample, producer side. The sample is written in
+    *         place then published by Commit().
+    * @retval Slot to fill, nullptr when the ring is full (overrun counted)
+    */
+  T *Reserve()
+  {
+    uint32_t head = head_.load(std::memory_order_relaxed);
+
+    if ((head - tail_.load(std::memory_order_acquire)) >= N)
+    {
+      overruns_.store(overruns_.load(std::memory_order_relaxed) + 1U, std::memory_order_relaxed);
+      return nullptr;
+    }
+    return &buffer_[head & kMask];
+  }
+
+  /**
+    * @brief  Publish the slot returned by the last successful Reserve().
+    */
+  void Commit()
+  {
+    head_.store(head_.load(std::memory_order_relaxed) + 1U, std::memory_order_release);
+  }
+
+  /**
+    * @brief  Oldest sample, consumer side. The slot stays valid until
+    *         Release().
+    * @retval Sample, nullptr when the ring is empty
+    */
+  const T *Front() const
+  {
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+
+    if (tail == head_.load(std::memory_order_acquire))
+    {
+      return nullptr;
+    }
+    return &buffer_[tail & kMask];
+  }
+
+  /**
+    * @brief  Give the slot returned by the last successful Front() back to
+    *         the producer.
+    */
+  void Release()
+  {
+    tail_.store(tail_.load(std::memory_order_relaxed) + 1U, std::memory_order_release);
+  }
+
+  /**
+    * @brief  Copy a sample in, producer side.
+    * @param  sample Sample to copy
+    * @retval true on success, false when the ring is full
+    */
+  bool Push(const T &sample)
+  {
+    T *slot = Reserve();
+
+    if (slot == nullptr)
+    {
+      return false;
+    }
+    *slot = sample;
+    Commit();
+    return true;
+  }
+
+  /**
+    * @brief  Copy the oldest sample out, consumer side.
+    * @param  sample Destination
+    * @retval true when a sample was read, false when the ring is empty
+    */
+  bool Pop(T &sample)
+  {
+    const T *slot = Front();
+
+    if (slot == nullptr)
+    {
+      return false;
+    }
+    sample = *slot;
+    Release();
+    return true;
+  }
+
+  /**
+    * @brief  Number of samples waiting, exact from the consumer side.
+    */
+  uint32_t Count() const
+  {
+    return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_relaxed);
+  }
+
+  /**
+    * @brief  Samples dropped because the ring was full.
+    */
+  uint32_t Overruns() const
+  {
+    return overruns_.load(std::memory_order_relaxed);
+  }
+
+private:
+  static constexpr uint32_t kMask = N - 1U;
+
+  T buffer_[N] {};                         /*!< Sample storage              */
+  std::atomic<uint32_t> head_ {0U};        /*!< Written by the producer     */
+  std::atomic<uint32_t> tail_ {0U};        /*!< Written by the consumer     */
+  std::atomic<uint32_t> overruns_ {0U};    /*!< Written by the producer     */
+};
+
+#endif /* __SPSC_RING_HPP__ */
@@ -0,0 +1,104 @@
+/**
+  ******************************************************************************
+  * @file    timing.h
+  * @brief   This file contains the DWT cycle counter helpers and the cycle
+  *          statistics accumulators used to profile the firmware.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __TIMING_H__
+#define __TIMING_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Cycle count statistics of a repeatedly measured code section.
+  */
+typedef struct
+{
+  uint32_t last;   /*!< Cycles spent by the latest measurement          */
+  uint32_t min;    /*!< Smallest measurement since the last reset       */
+  uint32_t max;    /*!< Largest measurement since the last reset        */
+  uint32_t count;  /*!< Number of measurements since the last reset     */
+  uint64_t total;  /*!< Sum of all measurements, for the average        */
+} Timing_PerfTypeDef;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void Timing_Init(void);
+uint64_t Timing_Cycles64(void);
+void Timing_PerfReset(Timing_PerfTypeDef *perf);
+uint32_t Timing_PerfAverage(const Timing_PerfTypeDef *perf);
+
+/* Exported inline functions -------------------------------------------------*/
+/**
+  * @brief  Read the free running core cycle counter.
+  * @retval Current value of DWT->CYCCNT, wraps every 2^32 core cycles.
+  */
+static inline uint32_t Timing_Cycles(void)
+{
+  return DWT->CYCCNT;
+}
+
+/**
+  * @brief  Convert a cycle count to microseconds at the current core clock.
+  * @param  cycles Number of core cycles
+  * @retval Duration in microseconds
+  */
+static inline uint32_t Timing_CyclesToUs(uint32_t cycles)
+{
+  return cycles / (SystemCoreClock / 1000000U);
+}
+
+/**
+  * @brief  Convert a duration in microseconds to core cycles.
+  * @param  us Duration in microseconds
+  * @retval Number of core cycles
+  */
+static inline uint32_t Timing_UsToCycles(uint32_t us)
+{
+  return us * (SystemCoreClock / 1000000U);
+}
+
+/**
+  * @brief  Convert a cycle count to seconds, for integration steps. Per
+  *         sample loops keep the seconds of one cycle and multiply by it,
+  *         rather than divide on every step.
+  * @param  cycles Number of core cycles
+  * @retval Duration in seconds
+  */
+static inline float Timing_CyclesToSeconds(uint32_t cycles)
+{
+  return (float)cycles / (float)SystemCoreClock;
+}
+
+/**
+  * @brief  Add one measurement to a cycle statistics accumulator.
+  * @param  perf Accumulator to update
+  * @param  cycles Measured duration in core cycles
+  */
+static inline void Timing_PerfAdd(Timing_PerfTypeDef *perf, uint32_t cycles)
+{
+  perf->last = cycles;
+  if ((perf->count == 0U) || (cycles < perf->min))
+  {
+    perf->min = cycles;
+  }
+  if (cycles > perf->max)
+  {
+    perf->max = cycles;
+  }
+  perf->count++;
+  perf->total += cycles;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TIMING_H__ */
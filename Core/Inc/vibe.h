@@ -0,0 +1,74 @@
+/**
+  ******************************************************************************
+  * @file    vibe.h
+  * @brief   This file contains the definitions of the vibration metrics:
+  *          per axis vibration RMS and clipping counters, computed sample by
+  *          sample on the raw accelerometer stream of an IMU.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __VIBE_H__
+#define __VIBE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "imu.h"
+#include "timing.h"
+
+/* Exported constants --------------------------------------------------------*/
+/** Corner of the high pass removing gravity and flight motion: what is
+  * left above it is vibration */
+#define VIBE_HIGHPASS_HZ      5.0f
+
+/** Time constant of the exponential window of the RMS */
+#define VIBE_WINDOW_S         0.5f
+
+/** Raw count magnitude taken as a clipped sample, a few counts inside the
+  * 16-bit rail so a saturated axis is caught whatever its offset */
+#define VIBE_CLIP_COUNTS      32700
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Telemetry and log fields of one IMU, fixed layout.
+  */
+typedef struct
+{
+  float rms[3];         /*!< Vibration RMS in g, X Y Z           */
+  uint32_t clips[3];    /*!< Clipped samples since reset, X Y Z  */
+  uint32_t samples;     /*!< Samples processed since reset       */
+} Vibe_ReportTypeDef;
+
+/**
+  * @brief  Vibration metrics of one IMU stream.
+  */
+typedef struct
+{
+  float g_per_lsb;                 /*!< Accelerometer scale                  */
+  float highpass_alpha;            /*!< Step of the gravity/motion estimate  */
+  float window_alpha;              /*!< Step of the mean square              */
+  uint8_t primed;                  /*!< First sample seen                    */
+  float mean[3];                   /*!< Low passed acceleration, counts      */
+  float power[3];                  /*!< Mean square vibration, counts^2      */
+  uint32_t clips[3];               /*!< Clipped samples per axis             */
+  uint32_t samples;                /*!< Samples processed                    */
+  Timing_PerfTypeDef cycles;       /*!< Cost of the Vibe_Process() calls     */
+} Vibe_HandleTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern Vibe_HandleTypeDef hvibe;
+extern Vibe_HandleTypeDef hvibe2;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void Vibe_Init(Vibe_HandleTypeDef *vibe, float rate_hz, float g_per_lsb);
+void Vibe_Process(Vibe_HandleTypeDef *vibe, const IMU_SampleTypeDef *sample);
+void Vibe_Report(const Vibe_HandleTypeDef *vibe, Vibe_ReportTypeDef *report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VIBE_H__ */
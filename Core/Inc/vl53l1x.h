@@ -0,0 +1,146 @@
+/**
+  ******************************************************************************
+  * @file    vl53l1x.h
+  * @brief   This file contains the definitions of the VL53L1X I2C
+  *          time-of-flight rangefinder driver. The sensor ranges continuously
+  *          and its result-ready flag is polled through the bus engine.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __VL53L1X_H__
+#define __VL53L1X_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "i2c_bus.h"
+#include "timing.h"
+
+/* Exported constants --------------------------------------------------------*/
+/** 7-bit address after power up */
+#define VL53L1X_ADDRESS                 0x29U
+
+/** Registers, 16-bit addresses */
+#define VL53L1X_REG_VHV_LOOP_BOUND      0x0008U
+#define VL53L1X_REG_VHV_INIT            0x000BU
+#define VL53L1X_REG_CONFIG_FIRST        0x002DU
+#define VL53L1X_REG_GPIO_TIO_HV_STATUS  0x0031U
+#define VL53L1X_REG_PHASECAL_TIMEOUT    0x004BU
+#define VL53L1X_REG_TIMEOUT_MACROP_A    0x005EU
+#define VL53L1X_REG_VCSEL_PERIOD_A      0x0060U
+#define VL53L1X_REG_TIMEOUT_MACROP_B    0x0061U
+#define VL53L1X_REG_VCSEL_PERIOD_B      0x0063U
+#define VL53L1X_REG_VALID_PHASE_HIGH    0x0069U
+#define VL53L1X_REG_INTERMEASUREMENT    0x006CU
+#define VL53L1X_REG_WOI_SD0             0x0078U
+#define VL53L1X_REG_INITIAL_PHASE_SD0   0x007AU
+#define VL53L1X_REG_INTERRUPT_CLEAR     0x0086U
+#define VL53L1X_REG_MODE_START          0x0087U
+#define VL53L1X_REG_RESULT              0x0089U
+#define VL53L1X_REG_OSC_CALIBRATE       0x00DEU
+#define VL53L1X_REG_SYSTEM_STATUS       0x00E5U
+#define VL53L1X_REG_MODEL_ID            0x010FU
+
+/** Default configuration block, 0x2D to 0x87 */
+#define VL53L1X_CONFIG_SIZE             91U
+
+/** Result block from RESULT__RANGE_STATUS, the range is at offset 13 */
+#define VL53L1X_RESULT_SIZE             17U
+
+/** Short distance mode (up to 1.3 m) with a 20 ms timing budget, a range
+  * every VL53L1X_RANGE_PERIOD_MS */
+#define VL53L1X_TIMING_BUDGET_MS        20U
+#define VL53L1X_RANGE_PERIOD_MS         25U
+
+/** Rate of the result-ready polls: a range is picked up at most one poll
+  * period after it is available */
+#define VL53L1X_POLL_HZ                 100U
+
+/** Bus load of a poll that finds a range: status read, result read and
+  * interrupt clear, each with a 2-byte register address */
+#define VL53L1X_POLL_TRANSACTIONS       3U
+#define VL53L1X_POLL_BYTES              (1U + VL53L1X_RESULT_SIZE + 1U + 3U)
+
+/** Spacing of the setup jobs issued by VL53L1X_Poll(): boot and first
+  * range status reads, retries after a failed job */
+#define VL53L1X_SETUP_POLL_US           1000U
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  Driver state.
+  */
+typedef enum
+{
+  VL53L1X_STATE_BOOT = 0U,    /*!< Waiting for the firmware to boot     */
+  VL53L1X_STATE_IDENTIFY,     /*!< Model ID read in progress            */
+  VL53L1X_STATE_OSCILLATOR,   /*!< Oscillator calibration read          */
+  VL53L1X_STATE_CONFIG,       /*!< Default configuration block write    */
+  VL53L1X_STATE_VHV_START,    /*!< First ranging started for the VHV    */
+  VL53L1X_STATE_VHV_WAIT,     /*!< Waiting for the first range          */
+  VL53L1X_STATE_SETUP,        /*!< Mode and timing writes               */
+  VL53L1X_STATE_RUN,          /*!< Ranging, see VL53L1X_Range()         */
+  VL53L1X_STATE_ERROR         /*!< Unknown device                       */
+} VL53L1X_StateTypeDef;
+
+/**
+  * @brief  One range measurement.
+  */
+typedef struct
+{
+  uint64_t timestamp;       /*!< Estimated cycle time of the middle of the ranging */
+  uint16_t range_mm;        /*!< Distance in mm                               */
+  uint8_t status;           /*!< Range status, 0 when valid                   */
+  uint8_t valid;            /*!< 1 when the range can be used                 */
+} VL53L1X_SampleTypeDef;
+
+/**
+  * @brief  Driver statistics.
+  */
+typedef struct
+{
+  uint32_t polls;                      /*!< Result-ready polls                  */
+  uint32_t not_ready;                  /*!< Polls that found no new range       */
+  uint32_t samples;                    /*!< Ranges published                    */
+  uint32_t invalid;                    /*!< Ranges published as not valid       */
+  uint32_t bus_errors;                 /*!< Failed jobs                         */
+  Timing_PerfTypeDef sample_bus_cycles; /*!< Bus time per range, polls included */
+} VL53L1X_StatsTypeDef;
+
+/**
+  * @brief  Driver instance.
+  */
+typedef struct
+{
+  I2C_BusTypeDef *bus;                 /*!< Bus the sensor is on                */
+  uint8_t address;                     /*!< 7-bit device address                */
+  volatile uint8_t state;              /*!< @ref VL53L1X_StateTypeDef           */
+  uint8_t setup_index;                 /*!< Setup write in progress             */
+  uint8_t failures;                    /*!< Consecutive failed jobs             */
+  uint8_t buffer[VL53L1X_CONFIG_SIZE]; /*!< DMA buffer of every transfer        */
+  I2C_JobTypeDef job;                  /*!< Bus job, one in flight at a time    */
+  uint32_t stamp;                      /*!< DWT stamp of the state entry        */
+  uint32_t intermeasurement;           /*!< Period in oscillator ticks          */
+  uint64_t ready_stamp;                /*!< Cycle time the range was seen ready */
+  uint32_t bus_cycles;                 /*!< Bus time since the last range       */
+  VL53L1X_SampleTypeDef sample;        /*!< Latest measurement                  */
+  volatile uint32_t sequence;          /*!< Incremented on each new sample      */
+  VL53L1X_StatsTypeDef stats;          /*!< Driver statistics                   */
+} VL53L1X_HandleTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern VL53L1X_HandleTypeDef hvl53l1x;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void VL53L1X_Init(VL53L1X_HandleTypeDef *dev, I2C_BusTypeDef *bus, uint8_t address);
+void VL53L1X_Poll(VL53L1X_HandleTypeDef *dev);
+I2C_JobTypeDef *VL53L1X_Range(VL53L1X_HandleTypeDef *dev);
+uint32_t VL53L1X_Read(VL53L1X_HandleTypeDef *dev, VL53L1X_SampleTypeDef *sample);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VL53L1X_H__ */
@@ -0,0 +1,125 @@
+/**
+  ******************************************************************************
+  * @file    vote.h
+  * @brief   This file contains the definitions of the dual IMU voter: per
+  *          sample health checks, blend or select policy and continuous
+  *          failover between the IMU streams.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __VOTE_H__
+#define __VOTE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "imu.h"
+#include "timing.h"
+
+/* Exported constants --------------------------------------------------------*/
+/** Number of IMU streams voted */
+#define VOTE_IMUS                 2U
+
+/** A stream without a sample for this long is stale. Covers the batching
+  * of the FIFO drains */
+#define VOTE_TIMEOUT_US           5000U
+
+/** Consecutive samples with the three gyro axes repeated that make a
+  * stream stuck, 10 ms at the loop rate */
+#define VOTE_STUCK_SAMPLES        20U
+
+/** Noise estimate: low pass of the squared sample to sample change, in
+  * counts^2. A stream is noisy when its estimate exceeds RATIO times the
+  * other one plus FLOOR; true motion raises both alike */
+#define VOTE_NOISE_ALPHA          0.01f
+#define VOTE_NOISE_RATIO          9.0f
+#define VOTE_NOISE_FLOOR          100.0f
+
+/** Consistency: low pass of the differences of the two streams, and limit
+  * of the gyro one in counts (50 counts = 3 dps at +-2000 dps), released at
+  * half */
+#define VOTE_DIFF_ALPHA           0.02f
+#define VOTE_DIFF_MAX             50.0f
+
+/** Fault free samples before a failed stream is used again, 0.5 s */
+#define VOTE_RECOVER_SAMPLES      1000U
+
+/** Per output decay of the handover offset, about 100 ms at 2 kHz */
+#define VOTE_HANDOVER_DECAY       0.995f
+
+/** Fault flags of a stream */
+#define VOTE_FAULT_STALE          0x01U
+#define VOTE_FAULT_STUCK          0x02U
+#define VOTE_FAULT_NOISY          0x04U
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  How healthy, consistent streams are combined.
+  */
+typedef enum
+{
+  VOTE_POLICY_BLEND = 0U,   /*!< Weighted by the inverse noise estimates */
+  VOTE_POLICY_SELECT        /*!< Primary stream only                     */
+} Vote_PolicyTypeDef;
+
+/**
+  * @brief  State of one IMU stream.
+  */
+typedef struct
+{
+  IMU_LoopSampleTypeDef sample;    /*!< Latest sample                          */
+  uint8_t valid;                   /*!< A sample was received                  */
+  uint8_t fresh;                   /*!< Sample not yet used by an output       */
+  uint8_t faults;                  /*!< VOTE_FAULT_xxx of the last check        */
+  uint16_t stuck;                  /*!< Consecutive repeated samples           */
+  uint32_t healthy;                /*!< Consecutive fault free checks          */
+  uint32_t fault_events;           /*!< Transitions to a faulty state          */
+  float noise;                     /*!< Noise estimate, counts^2               */
+} Vote_ImuTypeDef;
+
+/**
+  * @brief  Voter statistics.
+  */
+typedef struct
+{
+  uint32_t outputs;                /*!< Samples produced                       */
+  uint32_t switches;               /*!< Changes of the primary stream          */
+  uint32_t inconsistencies;        /*!< Entries in the inconsistent state      */
+  uint32_t no_imu;                 /*!< Checks with no usable stream           */
+  Timing_PerfTypeDef cycles;       /*!< Cost of the Vote_Run() calls           */
+} Vote_StatsTypeDef;
+
+/**
+  * @brief  Voter instance.
+  */
+typedef struct
+{
+  uint8_t policy;                  /*!< @ref Vote_PolicyTypeDef                */
+  uint8_t primary;                 /*!< Stream clocking the output             */
+  uint8_t active;                  /*!< Mask of the streams in use             */
+  uint8_t inconsistent;            /*!< Streams disagree, primary only         */
+  Vote_ImuTypeDef imu[VOTE_IMUS];  /*!< Streams                                */
+  float gyro_diff[3];              /*!< Filtered differences, stream 0 minus 1 */
+  float accel_diff[3];
+  float weight[VOTE_IMUS];         /*!< Weights of the last output             */
+  float gyro_offset[3];            /*!< Handover offsets, decaying to zero     */
+  float accel_offset[3];
+  Vote_StatsTypeDef stats;         /*!< Voter statistics                       */
+} Vote_HandleTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern Vote_HandleTypeDef hvote;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void Vote_Init(Vote_HandleTypeDef *vote, Vote_PolicyTypeDef policy);
+void Vote_Push(Vote_HandleTypeDef *vote, uint32_t index, const IMU_LoopSampleTypeDef *sample);
+uint8_t Vote_Run(Vote_HandleTypeDef *vote, uint64_t now, IMU_LoopSampleTypeDef *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VOTE_H__ */
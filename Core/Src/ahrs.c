@@ -0,0 +1,330 @@
+/**
+  ******************************************************************************
+  * @file    ahrs.c
+  * @brief   This file provides the attitude and heading reference system.
+  *
+  *          Every gyro sample is integrated over the time since the previous
+  *          one, taken from the sample timestamps, by the quaternion of the
+  *          rotation w dt to the third order, then brought back to unit norm
+  *          by a Newton step: no division, no square root.
+  *
+  *          Every AHRS_CORRECTION_DECIM samples, the averaged accelerometer
+  *          and the latest magnetometer direction are compared with the
+  *          up and field directions predicted by the attitude. The error is
+  *          the sum of the cross products of each measured direction with
+  *          its prediction, the rotation that would align them: the
+  *          gradient of the Madgwick cost in the body axes. Mahony feeds it
+  *          back proportionally, Madgwick steps at a fixed rate along it,
+  *          and both integrate it into the gyro bias. The resulting rate is
+  *          added to each gyro sample until the next correction. The field reference is rebuilt from the field
+  *          itself, horizontal and vertical components, so the field only
+  *          corrects the heading, whatever its inclination.
+  *
+  *          The instance lives in the core coupled RAM, see CCMRAM.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "ahrs.h"
+#include "fast_math.h"
+
+/* Exported variables --------------------------------------------------------*/
+CCMRAM Ahrs_HandleTypeDef hahrs;
+
+/* Private function prototypes -----------------------------------------------*/
+static void Ahrs_Correct(Ahrs_HandleTypeDef *ahrs);
+static void Ahrs_Align(Ahrs_HandleTypeDef *ahrs, const float up[3]);
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Set the attitude from the measured up direction alone, heading 0:
+  *         the shortest rotation of up onto the earth z axis.
+  * @param  ahrs AHRS instance
+  * @param  up Unit up direction in the IMU axes
+  */
+static void Ahrs_Align(Ahrs_HandleTypeDef *ahrs, const float up[3])
+{
+  float w = 1.0f + up[2];
+  float n;
+
+  if (w < 1e-6f)
+  {
+    /* Upside down, half a turn about x */
+    ahrs->q[0] = 0.0f;
+    ahrs->q[1] = 1.0f;
+    ahrs->q[2] = 0.0f;
+    ahrs->q[3] = 0.0f;
+  }
+  else
+  {
+    n = FastMath_InvSqrt((w * w) + (up[0] * up[0]) + (up[1] * up[1]));
+    ahrs->q[0] = w * n;
+    ahrs->q[1] = up[1] * n;
+    ahrs->q[2] = -up[0] * n;
+    ahrs->q[3] = 0.0f;
+  }
+  ahrs->aligned = 1U;
+  ahrs->mag_seen = 0U;
+  ahrs->settle = AHRS_SETTLE_S;
+}
+
+/**
+  * @brief  Compute the correction rate from the averaged accelerometer and
+  *         the latest field.
+  * @param  ahrs AHRS instance
+  */
+static void Ahrs_Correct(Ahrs_HandleTypeDef *ahrs)
+{
+  const float *q = ahrs->q;
+  float a[3] = { ahrs->accel_sum[0], ahrs->accel_sum[1], ahrs->accel_sum[2] };
+  float e[3] = { 0.0f, 0.0f, 0.0f };
+  float norm2 = (a[0] * a[0]) + (a[1] * a[1]) + (a[2] * a[2]);
+  float scale = ahrs->accel_scale / (float)ahrs->count;
+  float g = FastMath_Sqrt(norm2) * scale;
+  float gain = 1.0f;
+  float ki = AHRS_KI;
+  float inv;
+  uint32_t i;
+
+  ahrs->stats.corrections++;
+  if ((g > (1.0f - AHRS_ACCEL_GATE_G)) && (g < (1.0f + AHRS_ACCEL_GATE_G)))
+  {
+    inv = FastMath_InvSqrt(norm2);
+    a[0] *= inv;
+    a[1] *= inv;
+    a[2] *= inv;
+    if (ahrs->aligned == 0U)
+    {
+      Ahrs_Align(ahrs, a);
+    }
+    /* e = a x v, v the predicted up: third row of the rotation */
+    {
+      float vx = 2.0f * ((q[1] * q[3]) - (q[0] * q[2]));
+      float vy = 2.0f * ((q[0] * q[1]) + (q[2] * q[3]));
+      float vz = (((q[0] * q[0]) - (q[1] * q[1])) - (q[2] * q[2])) + (q[3] * q[3]);
+
+      e[0] = (a[1] * vz) - (a[2] * vy);
+      e[1] = (a[2] * vx) - (a[0] * vz);
+      e[2] = (a[0] * vy) - (a[1] * vx);
+    }
+  }
+  else
+  {
+    ahrs->stats.accel_rejected++;
+  }
+
+  if ((ahrs->mag_uses != 0U) && (ahrs->aligned != 0U))
+  {
+    const float *m = ahrs->mag;
+    float hx;
+    float hy;
+    float bx;
+    float bz;
+    float wx;
+    float wy;
+    float wz;
+
+    /* Field in the earth axes, its reference keeps the horizontal norm and
+     * the vertical part, then back into the IMU axes as w */
+    hx = 2.0f * ((m[0] * (0.5f - (q[2] * q[2]) - (q[3] * q[3]))) + (m[1] * ((q[1] * q[2]) - (q[0] * q[3])))
+                 + (m[2] * ((q[1] * q[3]) + (q[0] * q[2]))));
+    hy = 2.0f * ((m[0] * ((q[1] * q[2]) + (q[0] * q[3]))) + (m[1] * (0.5f - (q[1] * q[1]) - (q[3] * q[3])))
+                 + (m[2] * ((q[2] * q[3]) - (q[0] * q[1]))));
+    bz = 2.0f * ((m[0] * ((q[1] * q[3]) - (q[0] * q[2]))) + (m[1] * ((q[2] * q[3]) + (q[0] * q[1])))
+                 + (m[2] * (0.5f - (q[1] * q[1]) - (q[2] * q[2]))));
+    bx = FastMath_Sqrt((hx * hx) + (hy * hy));
+    wx = 2.0f * ((bx * (0.5f - (q[2] * q[2]) - (q[3] * q[3]))) + (bz * ((q[1] * q[3]) - (q[0] * q[2]))));
+    wy = 2.0f * ((bx * ((q[1] * q[2]) - (q[0] * q[3]))) + (bz * ((q[0] * q[1]) + (q[2] * q[3]))));
+    wz = 2.0f * ((bx * ((q[0] * q[2]) + (q[1] * q[3]))) + (bz * (0.5f - (q[1] * q[1]) - (q[2] * q[2]))));
+
+    e[0] += (m[1] * wz) - (m[2] * wy);
+    e[1] += (m[2] * wx) - (m[0] * wz);
+    e[2] += (m[0] * wy) - (m[1] * wx);
+    ahrs->mag_uses--;
+    ahrs->stats.mag_used++;
+    if (ahrs->mag_seen == 0U)
+    {
+      /* The heading so far is arbitrary */
+      ahrs->mag_seen = 1U;
+      ahrs->settle = AHRS_SETTLE_S;
+    }
+  }
+
+  if (ahrs->settle > 0.0f)
+  {
+    ahrs->settle -= ahrs->correction_dt;
+    gain = AHRS_SETTLE_GAIN;
+    ki = 0.0f;
+  }
+  if (ahrs->method == (uint8_t)AHRS_METHOD_MADGWICK)
+  {
+    norm2 = (e[0] * e[0]) + (e[1] * e[1]) + (e[2] * e[2]);
+    gain *= (norm2 > 1e-12f) ? (2.0f * AHRS_MADGWICK_BETA * FastMath_InvSqrt(norm2)) : 0.0f;
+  }
+  else
+  {
+    gain *= AHRS_MAHONY_KP;
+  }
+  for (i = 0U; i < 3U; i++)
+  {
+    ahrs->integral[i] += ki * ahrs->correction_dt * e[i];
+    ahrs->correction[i] = (gain * e[i]) + ahrs->integral[i];
+  }
+}
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Initialize the instance, level attitude until the first
+  *         accelerometer correction sets it.
+  * @param  ahrs AHRS instance
+  * @param  method Correction filter
+  * @param  gyro_dps_per_count Scale of the gyro counts
+  * @param  accel_g_per_count Scale of the accelerometer counts
+  */
+void Ahrs_Init(Ahrs_HandleTypeDef *ahrs, Ahrs_MethodTypeDef method, float gyro_dps_per_count,
+               float accel_g_per_count)
+{
+  uint32_t i;
+
+  ahrs->method = (uint8_t)method;
+  ahrs->aligned = 0U;
+  ahrs->started = 0U;
+  ahrs->mag_uses = 0U;
+  ahrs->mag_seen = 0U;
+  ahrs->gyro_scale = gyro_dps_per_count * (FAST_MATH_PI / 180.0f);
+  ahrs->accel_scale = accel_g_per_count;
+  ahrs->seconds_per_cycle = Timing_CyclesToSeconds(1U);
+  ahrs->max_gap_cycles = Timing_UsToCycles(AHRS_MAX_GAP_US);
+  ahrs->last_timestamp = 0U;
+  ahrs->q[0] = 1.0f;
+  for (i = 0U; i < 3U; i++)
+  {
+    ahrs->q[i + 1U] = 0.0f;
+    ahrs->correction[i] = 0.0f;
+    ahrs->integral[i] = 0.0f;
+    ahrs->accel_sum[i] = 0.0f;
+    ahrs->mag[i] = 0.0f;
+  }
+  ahrs->correction_dt = 0.0f;
+  ahrs->settle = 0.0f;
+  ahrs->count = 0U;
+  ahrs->stats.updates = 0U;
+  ahrs->stats.corrections = 0U;
+  ahrs->stats.accel_rejected = 0U;
+  ahrs->stats.mag_used = 0U;
+  ahrs->stats.gaps = 0U;
+  Timing_PerfReset(&ahrs->stats.update_cycles);
+  Timing_PerfReset(&ahrs->stats.correction_cycles);
+}
+
+/**
+  * @brief  Integrate one gyro sample, and correct every
+  *         AHRS_CORRECTION_DECIM samples.
+  * @param  ahrs AHRS instance
+  * @param  sample IMU sample at the loop rate, unfiltered
+  */
+void Ahrs_Update(Ahrs_HandleTypeDef *ahrs, const IMU_LoopSampleTypeDef *sample)
+{
+  uint32_t start = Timing_Cycles();
+  uint32_t elapsed = (uint32_t)(sample->timestamp - ahrs->last_timestamp);
+  float *q = ahrs->q;
+  float dt;
+  float h;
+  float vx;
+  float vy;
+  float vz;
+  float d0;
+  float q0;
+  float q1;
+  float q2;
+  float q3;
+
+  ahrs->last_timestamp = sample->timestamp;
+  if ((ahrs->started == 0U) || (elapsed > ahrs->max_gap_cycles))
+  {
+    ahrs->started = 1U;
+    ahrs->stats.gaps++;
+    elapsed = 0U;
+  }
+  dt = (float)elapsed * ahrs->seconds_per_cycle;
+
+  /* Rotation vector of the sample, halved: the quaternion of the rotation
+   * is [1 - |v|^2 / 2, v (1 - |v|^2 / 6)] */
+  h = 0.5f * dt;
+  vx = ((sample->gyro[0] * ahrs->gyro_scale) + ahrs->correction[0]) * h;
+  vy = ((sample->gyro[1] * ahrs->gyro_scale) + ahrs->correction[1]) * h;
+  vz = ((sample->gyro[2] * ahrs->gyro_scale) + ahrs->correction[2]) * h;
+  h = (vx * vx) + (vy * vy) + (vz * vz);
+  d0 = 1.0f - (0.5f * h);
+  h = 1.0f - (h * (1.0f / 6.0f));
+  vx *= h;
+  vy *= h;
+  vz *= h;
+
+  q0 = (q[0] * d0) - (q[1] * vx) - (q[2] * vy) - (q[3] * vz);
+  q1 = (q[0] * vx) + (q[1] * d0) + (q[2] * vz) - (q[3] * vy);
+  q2 = (q[0] * vy) - (q[1] * vz) + (q[2] * d0) + (q[3] * vx);
+  q3 = (q[0] * vz) + (q[1] * vy) - (q[2] * vx) + (q[3] * d0);
+
+  /* Newton step of 1 / sqrt(|q|^2) from 1, the norm being close to it */
+  h = 1.5f - (0.5f * ((q0 * q0) + (q1 * q1) + (q2 * q2) + (q3 * q3)));
+  q[0] = q0 * h;
+  q[1] = q1 * h;
+  q[2] = q2 * h;
+  q[3] = q3 * h;
+  ahrs->stats.updates++;
+
+  ahrs->accel_sum[0] += sample->accel[0];
+  ahrs->accel_sum[1] += sample->accel[1];
+  ahrs->accel_sum[2] += sample->accel[2];
+  ahrs->correction_dt += dt;
+  ahrs->count++;
+  Timing_PerfAdd(&ahrs->stats.update_cycles, Timing_Cycles() - start);
+
+  if (ahrs->count >= AHRS_CORRECTION_DECIM)
+  {
+    start = Timing_Cycles();
+    Ahrs_Correct(ahrs);
+    ahrs->accel_sum[0] = 0.0f;
+    ahrs->accel_sum[1] = 0.0f;
+    ahrs->accel_sum[2] = 0.0f;
+    ahrs->correction_dt = 0.0f;
+    ahrs->count = 0U;
+    Timing_PerfAdd(&ahrs->stats.correction_cycles, Timing_Cycles() - start);
+  }
+}
+
+/**
+  * @brief  Give a new magnetometer field, used by the next AHRS_MAG_USES
+  *         corrections at most.
+  * @param  ahrs AHRS instance
+  * @param  field Calibrated field in the IMU axes, any unit
+  */
+void Ahrs_UpdateMag(Ahrs_HandleTypeDef *ahrs, const float field[3])
+{
+  float norm2 = (field[0] * field[0]) + (field[1] * field[1]) + (field[2] * field[2]);
+  float inv;
+
+  if (norm2 <= 0.0f)
+  {
+    return;
+  }
+  inv = FastMath_InvSqrt(norm2);
+  ahrs->mag[0] = field[0] * inv;
+  ahrs->mag[1] = field[1] * inv;
+  ahrs->mag[2] = field[2] * inv;
+  ahrs->mag_uses = AHRS_MAG_USES;
+}
+
+/**
+  * @brief  Attitude as Euler angles, Z Y X order.
+  * @param  ahrs AHRS instance
+  * @param  euler Roll, pitch and yaw in rad
+  */
+void Ahrs_Euler(const Ahrs_HandleTypeDef *ahrs, float euler[3])
+{
+  const float *q = ahrs->q;
+
+  euler[0] = FastMath_Atan2(2.0f * ((q[0] * q[1]) + (q[2] * q[3])), 1.0f - (2.0f * ((q[1] * q[1]) + (q[2] * q[2]))));
+  euler[1] = FastMath_Asin(2.0f * ((q[0] * q[2]) - (q[3] * q[1])));
+  euler[2] = FastMath_Atan2(2.0f * ((q[0] * q[3]) + (q[1] * q[2])), 1.0f - (2.0f * ((q[2] * q[2]) + (q[3] * q[3]))));
+}
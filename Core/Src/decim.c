@@ -0,0 +1,176 @@
+/**
+  ******************************************************************************
+  * @file    decim.c
+  * @brief   This file provides the IMU decimation stage.
+  *
+  *          Each channel goes through a DECIM_ORDER CIC decimator: the
+  *          integrators run at the input rate, the combs at the output rate,
+  *          for a boxcar of the last ratio samples convolved ORDER times. The
+  *          integer state wraps around modulo 2^32, which the combs undo
+  *          exactly as long as the true output fits in 32 bits.
+  *
+  *          The CIC response falls as sin(pi f) / (ratio sin(pi f / ratio))
+  *          to the power ORDER over the output band. A 3-tap symmetric FIR
+  *          run at the output rate, -a, 1 + 2a, -a, cancels that droop at a
+  *          quarter of the output rate and keeps a unit DC gain.
+  *
+  *          The whole chain is linear phase; its group delay of
+  *          (ORDER (ratio - 1) / 2 + ratio) input periods is removed from the
+  *          output timestamp, using the measured input period.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "decim.h"
+#include <math.h>
+
+/* Private define ------------------------------------------------------------*/
+/** Outputs disturbed by the zero initial state of the combs and compensator */
+#define DECIM_SETTLE_OUTPUTS  (DECIM_ORDER + 2U)
+
+/** Output band frequency, in cycles per output sample, of exact droop
+  * compensation */
+#define DECIM_COMP_FREQ       0.25f
+
+#define DECIM_PI              3.14159265f
+
+/* Exported variables --------------------------------------------------------*/
+Decim_HandleTypeDef hdecim;
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Set up a decimator and clear its state.
+  * @param  dec Decimator instance
+  * @param  ratio Inputs per output, 1 to DECIM_MAX_RATIO
+  * @retval HAL_ERROR when the ratio is out of range
+  */
+HAL_StatusTypeDef Decim_Init(Decim_HandleTypeDef *dec, uint32_t ratio)
+{
+  uint32_t k;
+  uint32_t c;
+  float droop;
+  float a;
+
+  if ((ratio == 0U) || (ratio > DECIM_MAX_RATIO))
+  {
+    return HAL_ERROR;
+  }
+
+  dec->ratio = (uint8_t)ratio;
+  dec->phase = 0U;
+  dec->settle = DECIM_SETTLE_OUTPUTS;
+  for (k = 0U; k < DECIM_ORDER; k++)
+  {
+    for (c = 0U; c < DECIM_CHANNELS; c++)
+    {
+      dec->integ[k][c] = 0U;
+      dec->comb[k][c] = 0U;
+    }
+  }
+  for (c = 0U; c < DECIM_CHANNELS; c++)
+  {
+    dec->history[0][c] = 0.0f;
+    dec->history[1][c] = 0.0f;
+  }
+
+  /* DC gain of the CIC is ratio^ORDER */
+  dec->scale = 1.0f;
+  for (k = 0U; k < DECIM_ORDER; k++)
+  {
+    dec->scale /= (float)ratio;
+  }
+
+  /* Normalized CIC gain at the compensation frequency, the FIR gain there
+   * is 1 + 2a */
+  droop = powf(sinf(DECIM_PI * DECIM_COMP_FREQ) /
+               ((float)ratio * sinf(DECIM_PI * DECIM_COMP_FREQ / (float)ratio)), (float)DECIM_ORDER);
+  a = ((1.0f / droop) - 1.0f) * 0.5f;
+  dec->comp_center = 1.0f + (2.0f * a);
+  dec->comp_side = -a;
+
+  /* Twice the group delay over the ratio input periods of one output */
+  dec->delay_num = (DECIM_ORDER * (ratio - 1U)) + (2U * ratio);
+  dec->delay_den = 2U * ratio;
+  dec->output_stamp = 0U;
+
+  dec->stats.inputs = 0U;
+  dec->stats.outputs = 0U;
+  Timing_PerfReset(&dec->stats.input_cycles);
+  Timing_PerfReset(&dec->stats.output_cycles);
+  return HAL_OK;
+}
+
+/**
+  * @brief  Feed one input sample.
+  * @param  dec Decimator instance
+  * @param  in Input sample
+  * @param  out Destination of the decimated sample
+  * @retval 1 when out was written, 0 otherwise
+  */
+uint8_t Decim_Process(Decim_HandleTypeDef *dec, const IMU_SampleTypeDef *in, IMU_LoopSampleTypeDef *out)
+{
+  uint32_t start = Timing_Cycles();
+  float value[DECIM_CHANNELS];
+  uint32_t x;
+  uint32_t y;
+  uint32_t k;
+  uint32_t c;
+
+  for (c = 0U; c < DECIM_CHANNELS; c++)
+  {
+    x = (uint32_t)(int32_t)((c < 3U) ? in->gyro[c] : in->accel[c - 3U]);
+    for (k = 0U; k < DECIM_ORDER; k++)
+    {
+      dec->integ[k][c] += x;
+      x = dec->integ[k][c];
+    }
+  }
+  dec->stats.inputs++;
+
+  dec->phase++;
+  if (dec->phase < dec->ratio)
+  {
+    Timing_PerfAdd(&dec->stats.input_cycles, Timing_Cycles() - start);
+    return 0U;
+  }
+  dec->phase = 0U;
+
+  for (c = 0U; c < DECIM_CHANNELS; c++)
+  {
+    x = dec->integ[DECIM_ORDER - 1U][c];
+    for (k = 0U; k < DECIM_ORDER; k++)
+    {
+      y = x - dec->comb[k][c];
+      dec->comb[k][c] = x;
+      x = y;
+    }
+    value[c] = (float)(int32_t)x * dec->scale;
+  }
+
+  /* Compensated output, centered on the previous CIC output */
+  for (c = 0U; c < DECIM_CHANNELS; c++)
+  {
+    float v = (dec->comp_center * dec->history[0][c]) + (dec->comp_side * (value[c] + dec->history[1][c]));
+
+    dec->history[1][c] = dec->history[0][c];
+    dec->history[0][c] = value[c];
+    if (c < 3U)
+    {
+      out->gyro[c] = v;
+    }
+    else
+    {
+      out->accel[c - 3U] = v;
+    }
+  }
+  out->timestamp = in->timestamp - (((in->timestamp - dec->output_stamp) * dec->delay_num) / dec->delay_den);
+  dec->output_stamp = in->timestamp;
+
+  Timing_PerfAdd(&dec->stats.output_cycles, Timing_Cycles() - start);
+  if (dec->settle != 0U)
+  {
+    dec->settle--;
+    return 0U;
+  }
+  dec->stats.outputs++;
+  return 1U;
+}
@@ -0,0 +1,494 @@
+/**
+  ******************************************************************************
+  * @file    detect.c
+  * @brief   This file provides the boot time sensor detection.
+  *
+  *          Every candidate of the detection table is an identification
+  *          register read at a possible address. All reads are queued at
+  *          once on the transaction engine; an absent device answers the
+  *          address with a NACK, which fails its job after one byte time
+  *          instead of the retries and timeout of HAL_I2C_IsDeviceReady().
+  *
+  *          The resulting manifest is appended to a record log in flash
+  *          sector 11. On the next boot only the devices of the last record
+  *          are probed; the full scan runs again only if one of them does
+  *          not answer as recorded. The sector is erased, which stalls the
+  *          core for about a second, only once the log is full.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "detect.h"
+#include "mpu6050.h"
+#include <stddef.h>
+#include <string.h>
+
+/* Private typedef -----------------------------------------------------------*/
+/**
+  * @brief  A device that may answer at an address.
+  */
+typedef struct
+{
+  uint8_t kind;                 /*!< @ref Detect_DeviceKindTypeDef           */
+  uint8_t address;              /*!< 7-bit address to probe                  */
+  uint16_t reg;                 /*!< Identification register                 */
+  uint8_t reg_size;             /*!< I2C_MEMADD_SIZE_8BIT or _16BIT          */
+  uint8_t (*match)(uint8_t id); /*!< Identification check, NULL: any answer  */
+} Detect_CandidateTypeDef;
+
+/* Private define ------------------------------------------------------------*/
+#define DETECT_RECORD_SIZE        (sizeof(Detect_ManifestTypeDef))
+#define DETECT_RECORD_COUNT       (DETECT_FLASH_SIZE / DETECT_RECORD_SIZE)
+
+#define DETECT_FNV_OFFSET         2166136261U
+#define DETECT_FNV_PRIME          16777619U
+
+/* Private function prototypes -----------------------------------------------*/
+static uint8_t Detect_IsBmp280(uint8_t id);
+static uint8_t Detect_IsQmc5883l(uint8_t id);
+static uint8_t Detect_IsHmc5883l(uint8_t id);
+static uint8_t Detect_IsVl53l1x(uint8_t id);
+static uint32_t Detect_Checksum(const Detect_ManifestTypeDef *manifest);
+static const Detect_ManifestTypeDef *Detect_ReadLog(uint32_t *free_address);
+static HAL_StatusTypeDef Detect_Store(Detect_HandleTypeDef *det);
+static void Detect_AddProbe(Detect_HandleTypeDef *det, uint8_t candidate, uint8_t bus);
+static void Detect_Submit(Detect_HandleTypeDef *det);
+static uint8_t Detect_Matches(const Detect_ProbeTypeDef *probe);
+static void Detect_StartScan(Detect_HandleTypeDef *det);
+static void Detect_EndVerify(Detect_HandleTypeDef *det);
+static void Detect_EndScan(Detect_HandleTypeDef *det);
+
+/* Exported variables --------------------------------------------------------*/
+Detect_HandleTypeDef hdetect;
+
+/* Private variables ---------------------------------------------------------*/
+/** Candidates in priority order: an address is given to the first match */
+static const Detect_CandidateTypeDef detect_candidates[] =
+{
+  { DETECT_DEV_MPU6050,  0x68U, MPU6050_REG_WHO_AM_I, I2C_MEMADD_SIZE_8BIT,  MPU6050_IsKnown   },
+  { DETECT_DEV_MPU6050,  0x69U, MPU6050_REG_WHO_AM_I, I2C_MEMADD_SIZE_8BIT,  MPU6050_IsKnown   },
+  { DETECT_DEV_BMP280,   0x76U, 0xD0U,                I2C_MEMADD_SIZE_8BIT,  Detect_IsBmp280   },
+  { DETECT_DEV_BMP280,   0x77U, 0xD0U,                I2C_MEMADD_SIZE_8BIT,  Detect_IsBmp280   },
+  { DETECT_DEV_MS5611,   0x76U, 0xA0U,                I2C_MEMADD_SIZE_8BIT,  NULL              }, /* PROM word 0 */
+  { DETECT_DEV_MS5611,   0x77U, 0xA0U,                I2C_MEMADD_SIZE_8BIT,  NULL              },
+  { DETECT_DEV_QMC5883L, 0x0DU, 0x0DU,                I2C_MEMADD_SIZE_8BIT,  Detect_IsQmc5883l },
+  { DETECT_DEV_HMC5883L, 0x1EU, 0x0AU,                I2C_MEMADD_SIZE_8BIT,  Detect_IsHmc5883l },
+  { DETECT_DEV_VL53L1X,  0x29U, 0x010FU,              I2C_MEMADD_SIZE_16BIT, Detect_IsVl53l1x  }, /* Model ID */
+};
+
+#define DETECT_CANDIDATE_COUNT  (sizeof(detect_candidates) / sizeof(detect_candidates[0]))
+
+/* Private functions ---------------------------------------------------------*/
+static uint8_t Detect_IsBmp280(uint8_t id)
+{
+  return (uint8_t)((id == 0x58U) || (id == 0x60U));
+}
+
+static uint8_t Detect_IsQmc5883l(uint8_t id)
+{
+  return (uint8_t)(id == 0xFFU);
+}
+
+static uint8_t Detect_IsHmc5883l(uint8_t id)
+{
+  return (uint8_t)(id == 0x48U);  /* 'H' */
+}
+
+static uint8_t Detect_IsVl53l1x(uint8_t id)
+{
+  return (uint8_t)(id == 0xEAU);
+}
+
+/**
+  * @brief  FNV-1a hash of a manifest, its checksum field excluded.
+  * @param  manifest Manifest to hash
+  * @retval Hash
+  */
+static uint32_t Detect_Checksum(const Detect_ManifestTypeDef *manifest)
+{
+  const uint8_t *bytes = (const uint8_t *)manifest;
+  uint32_t hash = DETECT_FNV_OFFSET;
+  uint32_t i;
+
+  for (i = 0U; i < offsetof(Detect_ManifestTypeDef, checksum); i++)
+  {
+    hash = (hash ^ bytes[i]) * DETECT_FNV_PRIME;
+  }
+  return hash;
+}
+
+/**
+  * @brief  Walk the manifest log.
+  * @param  free_address Set to the first erased record, 0 when the log is full
+  * @retval Last valid record, NULL when there is none
+  */
+static const Detect_ManifestTypeDef *Detect_ReadLog(uint32_t *free_address)
+{
+  const Detect_ManifestTypeDef *last = NULL;
+  uint32_t i;
+
+  *free_address = 0U;
+  for (i = 0U; i < DETECT_RECORD_COUNT; i++)
+  {
+    const Detect_ManifestTypeDef *record =
+      (const Detect_ManifestTypeDef *)(DETECT_FLASH_ADDRESS + (i * DETECT_RECORD_SIZE));
+
+    if (record->magic == 0xFFFFFFFFU)
+    {
+      *free_address = DETECT_FLASH_ADDRESS + (i * DETECT_RECORD_SIZE);
+      break;
+    }
+    if ((record->magic == DETECT_MANIFEST_MAGIC) && (record->count <= DETECT_MAX_DEVICES)
+        && (record->checksum == Detect_Checksum(record)))
+    {
+      last = record;
+    }
+  }
+  return last;
+}
+
+/**
+  * @brief  Append the detected manifest to the log, erasing a full log first.
+  * @param  det Detection instance
+  * @retval HAL status of the flash operations
+  */
+static HAL_StatusTypeDef Detect_Store(Detect_HandleTypeDef *det)
+{
+  const uint32_t *words = (const uint32_t *)&det->manifest;
+  uint32_t start = Timing_Cycles();
+  uint32_t address;
+  uint32_t i;
+  HAL_StatusTypeDef status = HAL_OK;
+
+  det->manifest.magic = DETECT_MANIFEST_MAGIC;
+  det->manifest.checksum = Detect_Checksum(&det->manifest);
+  (void)Detect_ReadLog(&address);
+
+  HAL_FLASH_Unlock();
+  __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR
+                         | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
+  if (address == 0U)
+  {
+    FLASH_EraseInitTypeDef erase = {0};
+    uint32_t sector_error;
+
+    erase.TypeErase = FLASH_TYPEERASE_SECTORS;
+    erase.Sector = DETECT_FLASH_SECTOR;
+    erase.NbSectors = 1U;
+    erase.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+    status = HAL_FLASHEx_Erase(&erase, &sector_error);
+    address = DETECT_FLASH_ADDRESS;
+    det->report.sector_erased = 1U;
+  }
+  for (i = 0U; (status == HAL_OK) && (i < (DETECT_RECORD_SIZE / 4U)); i++)
+  {
+    status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, address + (i * 4U), words[i]);
+  }
+  HAL_FLASH_Lock();
+
+  det->report.manifest_written = (uint8_t)(status == HAL_OK);
+  det->report.store_cycles = Timing_Cycles() - start;
+  return status;
+}
+
+/**
+  * @brief  Append a probe of a candidate on a bus to the current step.
+  * @param  det Detection instance
+  * @param  candidate Index in the candidate table
+  * @param  bus Index of the bus
+  */
+static void Detect_AddProbe(Detect_HandleTypeDef *det, uint8_t candidate, uint8_t bus)
+{
+  Detect_ProbeTypeDef *probe;
+
+  if (det->probe_count >= DETECT_MAX_PROBES)
+  {
+    return;
+  }
+  probe = &det->probes[det->probe_count];
+  probe->candidate = candidate;
+  probe->bus = bus;
+  probe->value = 0U;
+  probe->job.state = I2C_JOB_IDLE;
+  det->probe_count++;
+}
+
+/**
+  * @brief  Queue the probes not submitted yet, without filling the bus queue.
+  * @param  det Detection instance
+  */
+static void Detect_Submit(Detect_HandleTypeDef *det)
+{
+  while (det->submitted < det->probe_count)
+  {
+    Detect_ProbeTypeDef *probe = &det->probes[det->submitted];
+    const Detect_CandidateTypeDef *candidate = &detect_candidates[probe->candidate];
+    I2C_BusTypeDef *bus = det->buses[probe->bus];
+    HAL_StatusTypeDef status;
+
+    if (I2C_Bus_Pending(bus) >= I2C_BUS_QUEUE_LEN)
+    {
+      break;
+    }
+    if (candidate->reg_size == I2C_MEMADD_SIZE_16BIT)
+    {
+      status = I2C_Bus_Read16(bus, &probe->job, candidate->address, candidate->reg, &probe->value, 1U, NULL, NULL);
+    }
+    else
+    {
+      status = I2C_Bus_Read(bus, &probe->job, candidate->address, (uint8_t)candidate->reg, &probe->value, 1U,
+                            NULL, NULL);
+    }
+    if (status != HAL_OK)
+    {
+      break;
+    }
+    det->submitted++;
+    det->report.probes++;
+  }
+}
+
+/**
+  * @brief  Check the answer of a completed probe.
+  * @param  probe Probe to check
+  * @retval 1 when the expected device answered
+  */
+static uint8_t Detect_Matches(const Detect_ProbeTypeDef *probe)
+{
+  const Detect_CandidateTypeDef *candidate = &detect_candidates[probe->candidate];
+
+  if (probe->job.state != I2C_JOB_DONE)
+  {
+    return 0U;
+  }
+  return (uint8_t)((candidate->match == NULL) || (candidate->match(probe->value) != 0U));
+}
+
+/**
+  * @brief  Probe every candidate on every bus.
+  * @param  det Detection instance
+  */
+static void Detect_StartScan(Detect_HandleTypeDef *det)
+{
+  uint8_t bus;
+  uint8_t i;
+
+  det->state = DETECT_STATE_SCAN;
+  det->stamp = Timing_Cycles();
+  det->probe_count = 0U;
+  det->submitted = 0U;
+  for (bus = 0U; bus < det->bus_count; bus++)
+  {
+    for (i = 0U; i < DETECT_CANDIDATE_COUNT; i++)
+    {
+      Detect_AddProbe(det, i, bus);
+    }
+  }
+  Detect_Submit(det);
+}
+
+/**
+  * @brief  All verification probes completed: keep the cached manifest when
+  *         every device answered as recorded, scan again otherwise.
+  * @param  det Detection instance
+  */
+static void Detect_EndVerify(Detect_HandleTypeDef *det)
+{
+  uint8_t i;
+
+  det->report.verify_cycles = Timing_Cycles() - det->stamp;
+  for (i = 0U; i < det->probe_count; i++)
+  {
+    if ((Detect_Matches(&det->probes[i]) == 0U) || (det->probes[i].value != det->cached->devices[i].id))
+    {
+      Detect_StartScan(det);
+      return;
+    }
+  }
+
+  det->manifest = *det->cached;
+  det->report.from_cache = 1U;
+  det->state = DETECT_STATE_DONE;
+}
+
+/**
+  * @brief  All scan probes completed: build the manifest and store it when it
+  *         differs from the cached one.
+  * @param  det Detection instance
+  */
+static void Detect_EndScan(Detect_HandleTypeDef *det)
+{
+  uint8_t i;
+  uint8_t j;
+
+  det->report.scan_cycles = Timing_Cycles() - det->stamp;
+  memset(&det->manifest, 0, sizeof(det->manifest));
+  for (i = 0U; (i < det->probe_count) && (det->manifest.count < DETECT_MAX_DEVICES); i++)
+  {
+    const Detect_ProbeTypeDef *probe = &det->probes[i];
+    const Detect_CandidateTypeDef *candidate = &detect_candidates[probe->candidate];
+    uint8_t taken = 0U;
+
+    if (Detect_Matches(probe) == 0U)
+    {
+      continue;
+    }
+    for (j = 0U; j < det->manifest.count; j++)
+    {
+      if ((det->manifest.devices[j].bus == probe->bus) && (det->manifest.devices[j].address == candidate->address))
+      {
+        taken = 1U;
+      }
+    }
+    if (taken == 0U)
+    {
+      Detect_DeviceTypeDef *device = &det->manifest.devices[det->manifest.count];
+
+      device->kind = candidate->kind;
+      device->bus = probe->bus;
+      device->address = candidate->address;
+      device->id = probe->value;
+      det->manifest.count++;
+    }
+  }
+
+  if ((det->cached == NULL) || (det->cached->count != det->manifest.count)
+      || (memcmp(det->cached->devices, det->manifest.devices, sizeof(det->manifest.devices)) != 0))
+  {
+    (void)Detect_Store(det);
+  }
+  det->state = DETECT_STATE_DONE;
+}
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Bind a detection instance to the buses to probe.
+  * @param  det Detection instance
+  * @param  buses Buses, their index is recorded in the manifest
+  * @param  bus_count Number of buses, at most I2C_BUS_MAX
+  */
+void Detect_Init(Detect_HandleTypeDef *det, I2C_BusTypeDef *const *buses, uint8_t bus_count)
+{
+  uint8_t i;
+
+  memset(det, 0, sizeof(*det));
+  det->bus_count = (bus_count > I2C_BUS_MAX) ? I2C_BUS_MAX : bus_count;
+  for (i = 0U; i < det->bus_count; i++)
+  {
+    det->buses[i] = buses[i];
+  }
+  det->state = DETECT_STATE_IDLE;
+}
+
+/**
+  * @brief  Start the detection: verify the cached manifest when there is a
+  *         usable one, scan every candidate otherwise.
+  * @param  det Detection instance
+  */
+void Detect_Start(Detect_HandleTypeDef *det)
+{
+  uint32_t free_address;
+  uint8_t i;
+  uint8_t j;
+
+  det->cached = Detect_ReadLog(&free_address);
+  if ((det->cached == NULL) || (det->cached->count == 0U))
+  {
+    Detect_StartScan(det);
+    return;
+  }
+
+  det->state = DETECT_STATE_VERIFY;
+  det->stamp = Timing_Cycles();
+  det->probe_count = 0U;
+  det->submitted = 0U;
+  for (i = 0U; i < det->cached->count; i++)
+  {
+    const Detect_DeviceTypeDef *device = &det->cached->devices[i];
+
+    for (j = 0U; j < DETECT_CANDIDATE_COUNT; j++)
+    {
+      if ((detect_candidates[j].kind == device->kind) && (detect_candidates[j].address == device->address))
+      {
+        break;
+      }
+    }
+    if ((j == DETECT_CANDIDATE_COUNT) || (device->bus >= det->bus_count))
+    {
+      /* Record from another firmware or board */
+      Detect_StartScan(det);
+      return;
+    }
+    Detect_AddProbe(det, j, device->bus);
+  }
+  Detect_Submit(det);
+}
+
+/**
+  * @brief  Advance the detection, call from the boot loop with I2C_Bus_Poll().
+  * @param  det Detection instance
+  * @retval HAL_OK once the manifest is available, HAL_BUSY while probing,
+  *         HAL_ERROR when the detection was not started
+  */
+HAL_StatusTypeDef Detect_Poll(Detect_HandleTypeDef *det)
+{
+  uint8_t i;
+
+  switch (det->state)
+  {
+    case DETECT_STATE_DONE:
+      return HAL_OK;
+
+    case DETECT_STATE_VERIFY:
+    case DETECT_STATE_SCAN:
+      Detect_Submit(det);
+      if (det->submitted < det->probe_count)
+      {
+        return HAL_BUSY;
+      }
+      for (i = 0U; i < det->probe_count; i++)
+      {
+        if (I2C_Job_IsPending(&det->probes[i].job))
+        {
+          return HAL_BUSY;
+        }
+      }
+      if (det->state == DETECT_STATE_VERIFY)
+      {
+        Detect_EndVerify(det);
+      }
+      else
+      {
+        Detect_EndScan(det);
+      }
+      return (det->state == DETECT_STATE_DONE) ? HAL_OK : HAL_BUSY;
+
+    default:
+      return HAL_ERROR;
+  }
+}
+
+/**
+  * @brief  Look a device up in the manifest.
+  * @param  det Detection instance, done
+  * @param  kind Kind of device
+  * @param  index Rank among the devices of that kind
+  * @retval Device, NULL when not detected
+  */
+const Detect_DeviceTypeDef *Detect_Find(const Detect_HandleTypeDef *det, Detect_DeviceKindTypeDef kind,
+                                        uint8_t index)
+{
+  uint32_t i;
+
+  for (i = 0U; i < det->manifest.count; i++)
+  {
+    if (det->manifest.devices[i].kind == (uint8_t)kind)
+    {
+      if (index == 0U)
+      {
+        return &det->manifest.devices[i];
+      }
+      index--;
+    }
+  }
+  return NULL;
+}
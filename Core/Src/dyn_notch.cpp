@@ -0,0 +1,368 @@
+/**
+  ******************************************************************************
+  * @file    dyn_notch.cpp
+  * @brief   This file provides the dynamic notch filter.
+  *
+  *          The gyro samples of every axis are kept in a history of
+  *          DYN_NOTCH_FFT_LEN samples. Every half history, each axis in turn
+  *          goes through the windowed real FFT of rfft.hpp.
+  *
+  *          The largest local maxima of the power in the searched band that
+  *          stand DYN_NOTCH_SNR above its median are the peaks: the median is
+  *          the noise floor whatever the peaks, where the mean would be
+  *          raised by the very peaks searched. Their frequency
+  *          is refined by a parabola through the magnitude of the three bins
+  *          around them. Each peak, strongest first, moves the nearest notch
+  *          not yet moved, or takes an unused notch when it is more than
+  *          DYN_NOTCH_CAPTURE_BINS from every notch in use and was already
+  *          seen there by the previous analysis of the axis, so a lone noise
+  *          bin does not start a notch. A notch without a peak keeps its
+  *          frequency.
+  *
+  *          The analysis is split into short steps, a window, one FFT stage,
+  *          the split, the peak search and the retune of one axis, and
+  *          DynNotch_Poll() runs steps until its cycle budget is spent: none
+  *          takes more than a few microseconds at 168 MHz, and the whole
+  *          analysis of the three axes has DYN_NOTCH_FFT_LEN / 2 samples to
+  *          complete.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "dyn_notch.h"
+#include "biquad.hpp"
+#include "rfft.hpp"
+#include <math.h>
+#include <algorithm>
+
+/* Private define ------------------------------------------------------------*/
+#define DYN_NOTCH_HALF          (DYN_NOTCH_FFT_LEN / 2U)
+#define DYN_NOTCH_MASK          (DYN_NOTCH_FFT_LEN - 1U)
+
+/** Distance, in bins, beyond which a peak is a new source rather than a
+  * notch in use that moved */
+#define DYN_NOTCH_CAPTURE_BINS  2.0f
+
+/* Private typedef -----------------------------------------------------------*/
+/**
+  * @brief  Work item of DynNotch_Poll().
+  */
+typedef enum
+{
+  DYN_NOTCH_STEP_IDLE = 0U,   /*!< Waiting for half a history of samples  */
+  DYN_NOTCH_STEP_WINDOW,      /*!< Load of the transform                  */
+  DYN_NOTCH_STEP_FFT,         /*!< One butterfly stage                    */
+  DYN_NOTCH_STEP_SPECTRUM,    /*!< Real split, power of the band bins     */
+  DYN_NOTCH_STEP_PEAKS,       /*!< Peak search and interpolation          */
+  DYN_NOTCH_STEP_TUNE         /*!< Notch tracking and retune              */
+} DynNotch_StepTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static float dyn_notch_rate_hz;
+static float dyn_notch_history[3][DYN_NOTCH_FFT_LEN];
+static uint32_t dyn_notch_head;
+static uint32_t dyn_notch_filled;
+static uint32_t dyn_notch_pending;
+
+/** Analysis in progress */
+static RealFft<DYN_NOTCH_FFT_LEN> dyn_notch_fft;
+static uint8_t dyn_notch_step;
+static uint32_t dyn_notch_axis;
+static uint32_t dyn_notch_stage;
+static float dyn_notch_power[DYN_NOTCH_HALF];
+static uint32_t dyn_notch_min_bin;
+static uint32_t dyn_notch_max_bin;
+static float dyn_notch_floor;
+static float dyn_notch_peak_hz[DYN_NOTCH_PEAKS];
+static uint32_t dyn_notch_peaks;
+
+/** New peak of each axis waiting for confirmation, 0 when none */
+static float dyn_notch_candidate[3];
+
+/** Notches of each axis, pass through until their first peak */
+static BiquadBank<DYN_NOTCH_PEAKS, 1U> dyn_notch_banks[3];
+
+static DynNotch_StatsTypeDef dyn_notch_stats;
+
+/* Private function prototypes -----------------------------------------------*/
+static void DynNotch_Spectrum(void);
+static void DynNotch_Peaks(void);
+static void DynNotch_Tune(void);
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Keep the power of the bins of the band, with a neighbour on each
+  *         side, and its median.
+  */
+static void DynNotch_Spectrum(void)
+{
+  float sorted[DYN_NOTCH_HALF];
+  uint32_t count = 0U;
+  uint32_t k;
+
+  for (k = dyn_notch_min_bin - 1U; k <= (dyn_notch_max_bin + 1U); k++)
+  {
+    dyn_notch_power[k] = dyn_notch_fft.Power(k);
+    if ((k >= dyn_notch_min_bin) && (k <= dyn_notch_max_bin))
+    {
+      sorted[count++] = dyn_notch_power[k];
+    }
+  }
+  std::nth_element(&sorted[0], &sorted[count / 2U], &sorted[count]);
+  dyn_notch_floor = sorted[count / 2U];
+}
+
+/**
+  * @brief  Find the strongest peaks of the band, strongest first.
+  */
+static void DynNotch_Peaks(void)
+{
+  const float *p = dyn_notch_power;
+  float threshold = DYN_NOTCH_SNR * dyn_notch_floor;
+  float level[DYN_NOTCH_PEAKS];
+  uint32_t bin[DYN_NOTCH_PEAKS];
+  uint32_t count = 0U;
+  uint32_t k;
+  uint32_t n;
+
+  for (k = dyn_notch_min_bin; k <= dyn_notch_max_bin; k++)
+  {
+    if ((p[k] <= threshold) || (p[k] <= p[k - 1U]) || (p[k] < p[k + 1U]))
+    {
+      continue;
+    }
+    /* Insertion into the strongest so far */
+    n = (count < DYN_NOTCH_PEAKS) ? count++ : DYN_NOTCH_PEAKS;
+    while ((n > 0U) && (level[n - 1U] < p[k]))
+    {
+      if (n < DYN_NOTCH_PEAKS)
+      {
+        level[n] = level[n - 1U];
+        bin[n] = bin[n - 1U];
+      }
+      n--;
+    }
+    if (n < DYN_NOTCH_PEAKS)
+    {
+      level[n] = p[k];
+      bin[n] = k;
+    }
+  }
+
+  for (n = 0U; n < count; n++)
+  {
+    float a = FastMath_Sqrt(p[bin[n] - 1U]);
+    float b = FastMath_Sqrt(p[bin[n]]);
+    float c = FastMath_Sqrt(p[bin[n] + 1U]);
+    float curve = (a - (2.0f * b)) + c;
+    float offset = (curve < 0.0f) ? ((0.5f * (a - c)) / curve) : 0.0f;
+    float hz = ((float)bin[n] + offset) * (dyn_notch_rate_hz / (float)DYN_NOTCH_FFT_LEN);
+
+    dyn_notch_peak_hz[n] = fminf(fmaxf(hz, DYN_NOTCH_MIN_HZ), DYN_NOTCH_MAX_HZ);
+  }
+  dyn_notch_peaks = count;
+}
+
+/**
+  * @brief  Move the notches of the current axis toward its peaks and retune
+  *         the ones that moved.
+  */
+static void DynNotch_Tune(void)
+{
+  float *center = dyn_notch_stats.center_hz[dyn_notch_axis];
+  float capture = DYN_NOTCH_CAPTURE_BINS * (dyn_notch_rate_hz / (float)DYN_NOTCH_FFT_LEN);
+  float candidate = 0.0f;
+  uint32_t moved = 0U;
+  uint32_t n;
+  uint32_t i;
+
+  for (n = 0U; n < dyn_notch_peaks; n++)
+  {
+    float hz = dyn_notch_peak_hz[n];
+    uint32_t best = DYN_NOTCH_PEAKS;
+    float distance = 0.0f;
+
+    for (i = 0U; i < DYN_NOTCH_PEAKS; i++)
+    {
+      float d = (center[i] > 0.0f) ? fabsf(center[i] - hz) : capture;
+
+      if (((moved & (1U << i)) == 0U) && ((best == DYN_NOTCH_PEAKS) || (d < distance)))
+      {
+        best = i;
+        distance = d;
+      }
+    }
+    if (center[best] > 0.0f)
+    {
+      center[best] += DYN_NOTCH_TRACK_ALPHA * (hz - center[best]);
+    }
+    else if (fabsf(dyn_notch_candidate[dyn_notch_axis] - hz) <= capture)
+    {
+      center[best] = hz;
+    }
+    else
+    {
+      candidate = hz;
+      continue;
+    }
+    moved |= 1U << best;
+    dyn_notch_banks[dyn_notch_axis].SetStage(best, BiquadNotchTune(center[best], dyn_notch_rate_hz, DYN_NOTCH_Q));
+  }
+  dyn_notch_candidate[dyn_notch_axis] = candidate;
+}
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Build the tables and clear the analyzer and the notches.
+  * @param  sample_hz Rate of the pushed samples
+  */
+extern "C" void DynNotch_Init(float sample_hz)
+{
+  float bin_hz = sample_hz / (float)DYN_NOTCH_FFT_LEN;
+  uint32_t n;
+  uint32_t i;
+
+  dyn_notch_fft.Init();
+
+  /* Peaks need a neighbour on each side, within the first half turn */
+  dyn_notch_rate_hz = sample_hz;
+  dyn_notch_min_bin = (uint32_t)ceilf(DYN_NOTCH_MIN_HZ / bin_hz);
+  dyn_notch_max_bin = (uint32_t)(DYN_NOTCH_MAX_HZ / bin_hz);
+  if (dyn_notch_min_bin < 1U)
+  {
+    dyn_notch_min_bin = 1U;
+  }
+  if (dyn_notch_max_bin > (DYN_NOTCH_HALF - 2U))
+  {
+    dyn_notch_max_bin = DYN_NOTCH_HALF - 2U;
+  }
+
+  dyn_notch_head = 0U;
+  dyn_notch_filled = 0U;
+  dyn_notch_pending = 0U;
+  dyn_notch_step = DYN_NOTCH_STEP_IDLE;
+  for (n = 0U; n < 3U; n++)
+  {
+    for (i = 0U; i < DYN_NOTCH_PEAKS; i++)
+    {
+      dyn_notch_banks[n].SetStage(i, BiquadCoeffs());
+      dyn_notch_stats.center_hz[n][i] = 0.0f;
+    }
+    dyn_notch_candidate[n] = 0.0f;
+    dyn_notch_banks[n].Reset();
+  }
+  dyn_notch_stats.analyses = 0U;
+  dyn_notch_stats.late = 0U;
+  Timing_PerfReset(&dyn_notch_stats.poll_cycles);
+  Timing_PerfReset(&dyn_notch_stats.apply_cycles);
+}
+
+/**
+  * @brief  Add a gyro sample to the analyzed history.
+  * @param  gyro Angular rate before any filtering, X Y Z
+  */
+extern "C" void DynNotch_Push(const float gyro[3])
+{
+  dyn_notch_history[0][dyn_notch_head] = gyro[0];
+  dyn_notch_history[1][dyn_notch_head] = gyro[1];
+  dyn_notch_history[2][dyn_notch_head] = gyro[2];
+  dyn_notch_head = (dyn_notch_head + 1U) & DYN_NOTCH_MASK;
+  if (dyn_notch_filled < DYN_NOTCH_FFT_LEN)
+  {
+    dyn_notch_filled++;
+  }
+  else
+  {
+    dyn_notch_pending++;
+  }
+}
+
+/**
+  * @brief  Run analysis steps until the budget is spent or nothing is left.
+  * @param  budget_cycles Cycle budget, checked between steps
+  */
+extern "C" void DynNotch_Poll(uint32_t budget_cycles)
+{
+  uint32_t start = Timing_Cycles();
+
+  do
+  {
+    switch (dyn_notch_step)
+    {
+      case DYN_NOTCH_STEP_IDLE:
+        if (dyn_notch_pending < DYN_NOTCH_HALF)
+        {
+          Timing_PerfAdd(&dyn_notch_stats.poll_cycles, Timing_Cycles() - start);
+          return;
+        }
+        if (dyn_notch_pending >= DYN_NOTCH_FFT_LEN)
+        {
+          dyn_notch_stats.late++;
+        }
+        dyn_notch_pending = 0U;
+        dyn_notch_axis = 0U;
+        dyn_notch_step = DYN_NOTCH_STEP_WINDOW;
+        break;
+
+      case DYN_NOTCH_STEP_WINDOW:
+        dyn_notch_fft.Load(dyn_notch_history[dyn_notch_axis], dyn_notch_head);
+        dyn_notch_stage = 0U;
+        dyn_notch_step = DYN_NOTCH_STEP_FFT;
+        break;
+
+      case DYN_NOTCH_STEP_FFT:
+        dyn_notch_fft.Stage(dyn_notch_stage);
+        dyn_notch_stage++;
+        if (dyn_notch_stage >= dyn_notch_fft.Stages())
+        {
+          dyn_notch_step = DYN_NOTCH_STEP_SPECTRUM;
+        }
+        break;
+
+      case DYN_NOTCH_STEP_SPECTRUM:
+        DynNotch_Spectrum();
+        dyn_notch_step = DYN_NOTCH_STEP_PEAKS;
+        break;
+
+      case DYN_NOTCH_STEP_PEAKS:
+        DynNotch_Peaks();
+        dyn_notch_step = DYN_NOTCH_STEP_TUNE;
+        break;
+
+      case DYN_NOTCH_STEP_TUNE:
+        DynNotch_Tune();
+        dyn_notch_stats.analyses++;
+        dyn_notch_axis++;
+        dyn_notch_step = (dyn_notch_axis < 3U) ? DYN_NOTCH_STEP_WINDOW : DYN_NOTCH_STEP_IDLE;
+        break;
+
+      default:
+        dyn_notch_step = DYN_NOTCH_STEP_IDLE;
+        break;
+    }
+  } while ((Timing_Cycles() - start) < budget_cycles);
+
+  Timing_PerfAdd(&dyn_notch_stats.poll_cycles, Timing_Cycles() - start);
+}
+
+/**
+  * @brief  Filter one gyro sample in place through the notches.
+  * @param  gyro Angular rate, X Y Z
+  */
+extern "C" void DynNotch_Apply(float gyro[3])
+{
+  uint32_t start = Timing_Cycles();
+
+  dyn_notch_banks[0].Apply(&gyro[0]);
+  dyn_notch_banks[1].Apply(&gyro[1]);
+  dyn_notch_banks[2].Apply(&gyro[2]);
+  Timing_PerfAdd(&dyn_notch_stats.apply_cycles, Timing_Cycles() - start);
+}
+
+/**
+  * @brief  Notch centers and analyzer statistics.
+  * @retval Statistics
+  */
+extern "C" const DynNotch_StatsTypeDef *DynNotch_Stats(void)
+{
+  return &dyn_notch_stats;
+}
@@ -0,0 +1,1072 @@
+/**
+  ******************************************************************************
+  * @file    eskf.cpp
+  * @brief   This file provides the navigation filter, an error state Kalman
+  *          filter.
+  *
+  *          The nominal state, attitude quaternion, velocity, position and
+  *          biases, is integrated by Eskf_Push() on every loop sample, the
+  *          attitude as in the AHRS. The filter only estimates the error of
+  *          that state, 15 small quantities about zero, the attitude error
+  *          being a rotation vector in the IMU axes: its transition over a
+  *          period, with w and a the corrected IMU and R the attitude, is
+  *
+  *              | Th  0   0   -dt  0  |   Th = exp(-[w dt]x)
+  *              | V   I   0   0    B  |   V  = -R [a dt]x
+  *          F = | 0   dt  I   0    0  |   B  = -R dt
+  *              | 0   0   0   I    0  |
+  *              | 0   0   0   0    I  |
+  *
+  *          in 3 x 3 blocks, the dt ones times the identity. The prediction
+  *          F P F' + Q is done on these blocks: the last two block rows of
+  *          F P are those of P, the last two of F P F' as well, so only the
+  *          first three block rows of F P are formed, then the upper blocks
+  *          of the first three block rows of F P F', about a seventh of the
+  *          multiplications of the two dense 15 x 15 products.
+  *
+  *          The filter runs ESKF_DELAY_US behind the IMU. Eskf_Push()
+  *          integrates every loop sample into the output predictor, the
+  *          state at the latest sample, and sums the IMU over each
+  *          ESKF_PREDICT_US into the horizon, a ring of ESKF_HORIZON_LEN
+  *          entries that also keep the output state at their end.
+  *          Eskf_Poll() takes the entries once ESKF_DELAY_US old: the nominal
+  *          state of the filter is integrated over the entry, its covariance
+  *          predicted, then the measurements queued in time order are fused
+  *          as the filter passes their timestamp, one component at a time,
+  *          with a gain and a covariance update that need no inversion. A
+  *          GPS fix 150 ms late is so compared with the state of 150 ms ago,
+  *          and nothing is run again. The correction goes into the nominal
+  *          state at once and the error state is back to zero; the small
+  *          rotation of the attitude covariance this implies is neglected.
+  *
+  *          The output predictor follows the filter through a complementary
+  *          feedback of time constant ESKF_OUTPUT_TAU_S, on the difference
+  *          between the filter state and the output state kept in the entry.
+  *          The corrections applied to the output since then are running
+  *          sums kept in each entry too: the stored state is brought up to
+  *          date by their difference rather than by correcting every entry,
+  *          so the feedback costs the same whatever the horizon.
+  *
+  *          The prediction and each fusion are split into steps, a block
+  *          row, a third of the update, and Eskf_Poll() runs steps until its
+  *          cycle budget is spent; Eskf_Push() and the queueing of a
+  *          measurement, at most ESKF_QUEUE_LEN moves, are bounded too. The
+  *          worst cases are the maximum of the statistics. The memory is
+  *          fixed, reported in the statistics: about 10 KB, the covariance,
+  *          the prediction in progress and the horizon in the core coupled
+  *          RAM, see CCMRAM.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "eskf.h"
+#include "fast_math.h"
+#include "matrix.hpp"
+#include <math.h>
+
+/* Private define ------------------------------------------------------------*/
+/** Offsets of the error state components */
+#define ESKF_ATTITUDE           0U
+#define ESKF_VELOCITY           3U
+#define ESKF_POSITION           6U
+#define ESKF_GYRO_BIAS          9U
+#define ESKF_ACCEL_BIAS         12U
+
+/** Block rows and columns of the covariance, and block rows of F P that
+  * differ from P */
+#define ESKF_BLOCKS             5U
+#define ESKF_PRODUCT_BLOCKS     3U
+
+/** Covariance rows updated by one fusion step */
+#define ESKF_FUSE_ROWS          5U
+
+#define ESKF_QUEUE_MASK         (ESKF_QUEUE_LEN - 1U)
+#define ESKF_HORIZON_MASK       (ESKF_HORIZON_LEN - 1U)
+
+/* Private typedef -----------------------------------------------------------*/
+typedef Matrix<ESKF_STATES, ESKF_STATES> EskfCovariance;
+typedef Matrix<3U * ESKF_PRODUCT_BLOCKS, ESKF_STATES> EskfProduct;
+
+/**
+  * @brief  Work item of Eskf_Poll().
+  */
+typedef enum
+{
+  ESKF_STEP_IDLE = 0U,        /*!< Waiting for an entry or a measurement  */
+  ESKF_STEP_TRANSITION,       /*!< Entry integrated, blocks of F, output  */
+  ESKF_STEP_PRODUCT,          /*!< One block row of F P                   */
+  ESKF_STEP_COVARIANCE,       /*!< One block row of F P F'                */
+  ESKF_STEP_NOISE,            /*!< Lower triangle and Q                   */
+  ESKF_STEP_GAIN,             /*!< Gate, gain and correction              */
+  ESKF_STEP_FUSE              /*!< ESKF_FUSE_ROWS rows of the covariance  */
+} Eskf_StepTypeDef;
+
+/**
+  * @brief  Blocks of the error state transition over one period, the other
+  *         blocks of F being 0 or the identity.
+  */
+typedef struct
+{
+  Matrix3 attitude;               /*!< Attitude on itself, Th               */
+  Matrix3 velocity;               /*!< Velocity on attitude, V              */
+  Matrix3 accel_bias;             /*!< Velocity on accelerometer bias, B    */
+  float dt;                       /*!< Period                               */
+} Eskf_TransitionTypeDef;
+
+/**
+  * @brief  One period of the horizon.
+  */
+typedef struct
+{
+  uint64_t timestamp;             /*!< Cycle time of the end of the period  */
+  float dt;                       /*!< Period                               */
+  float angle[3];                 /*!< Gyro integral, biases not removed    */
+  float delta_v[3];               /*!< Accelerometer integral, IMU axes     */
+  float q[4];                     /*!< Output attitude at the end           */
+  float velocity[3];              /*!< Output velocity at the end           */
+  float position[3];              /*!< Output position at the end           */
+  float angle_correction[3];      /*!< Output corrections so far, running sums */
+  float velocity_correction[3];
+  float position_correction[3];
+} Eskf_EntryTypeDef;
+
+/**
+  * @brief  One measured component of the velocity or of the position.
+  */
+typedef struct
+{
+  uint64_t timestamp;             /*!< Cycle time of the measurement        */
+  uint32_t index;                 /*!< Error state component measured       */
+  float value;                    /*!< Measurement                          */
+  float variance;                 /*!< Its variance                         */
+} Eskf_MeasurementTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static float eskf_gyro_scale;
+static float eskf_accel_scale;
+static float eskf_seconds_per_cycle;
+static float eskf_period;
+static uint32_t eskf_max_gap_cycles;
+static uint32_t eskf_delay_cycles;
+static uint8_t eskf_timed;
+static uint64_t eskf_latest;
+
+/** Output predictor, its feedback rate and its corrections so far */
+static Eskf_StateTypeDef eskf_state;
+static float eskf_rate_correction[3];
+static float eskf_angle_correction[3];
+static float eskf_velocity_correction[3];
+static float eskf_position_correction[3];
+
+/** IMU of the period in progress */
+static float eskf_angle[3];
+static float eskf_delta_v[3];
+static float eskf_dt;
+
+/** Horizon, from the oldest period not yet taken by the filter */
+static CCMRAM Eskf_EntryTypeDef eskf_horizon[ESKF_HORIZON_LEN];
+static uint32_t eskf_horizon_head;
+static uint32_t eskf_horizon_tail;
+
+/** Nominal state of the filter and its time */
+static float eskf_q[4];
+static float eskf_velocity[3];
+static float eskf_position[3];
+static uint64_t eskf_time;
+
+/** Covariance and prediction in progress */
+static CCMRAM EskfCovariance eskf_p;
+static CCMRAM EskfProduct eskf_fp;
+static CCMRAM Eskf_TransitionTypeDef eskf_f;
+static uint8_t eskf_step;
+static uint32_t eskf_block;
+static uint32_t eskf_op_cycles;
+
+/** Measurements waiting, and fusion in progress: P H', 1 / (H P H' + r) */
+static Eskf_MeasurementTypeDef eskf_queue[ESKF_QUEUE_LEN];
+static uint32_t eskf_queue_head;
+static uint32_t eskf_queue_tail;
+static float eskf_pht[ESKF_STATES];
+static float eskf_inv_s;
+static uint32_t eskf_row;
+
+static Eskf_StatsTypeDef eskf_stats;
+
+#ifdef ESKF_BENCH
+static EskfCovariance eskf_bench_p;
+static EskfCovariance eskf_bench_sparse;
+static EskfCovariance eskf_bench_dense;
+static EskfCovariance eskf_bench_f;
+static EskfCovariance eskf_bench_fp;
+static EskfProduct eskf_bench_product;
+#endif
+
+/* Private function prototypes -----------------------------------------------*/
+static void Eskf_Rotation(const float q[4], Matrix3 &r);
+static void Eskf_Rotate(float q[4], const float angle[3]);
+static void Eskf_Transition(const float q[4], const float angle[3], const float delta_v[3], float dt,
+                            Eskf_TransitionTypeDef &f);
+static void Eskf_Product(const EskfCovariance &p, const Eskf_TransitionTypeDef &f, EskfProduct &fp,
+                         uint32_t block);
+static void Eskf_Covariance(const EskfProduct &fp, const Eskf_TransitionTypeDef &f, EskfCovariance &p,
+                            uint32_t block);
+static void Eskf_Symmetrize(EskfCovariance &p);
+static void Eskf_Noise(EskfCovariance &p, float dt);
+static void Eskf_ResetCovariance(void);
+static void Eskf_Advance(const Eskf_EntryTypeDef *e);
+static void Eskf_Output(const Eskf_EntryTypeDef *e);
+static uint8_t Eskf_Gain(void);
+static void Eskf_Fuse(uint32_t row);
+static HAL_StatusTypeDef Eskf_Queue(uint64_t timestamp, uint32_t index, const float *value, uint32_t count,
+                                    float variance);
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Block (i, j) of the covariance.
+  */
+static inline Matrix3 Eskf_Block(const EskfCovariance &p, uint32_t i, uint32_t j)
+{
+  return p.Block<3U, 3U>(3U * i, 3U * j);
+}
+
+/**
+  * @brief  Rotation matrix of a unit quaternion.
+  * @param  q Attitude, w x y z
+  * @param  r Matrix rotating the IMU axes into the earth axes
+  */
+static void Eskf_Rotation(const float q[4], Matrix3 &r)
+{
+  float xx = q[1] * q[1];
+  float yy = q[2] * q[2];
+  float zz = q[3] * q[3];
+  float xy = q[1] * q[2];
+  float xz = q[1] * q[3];
+  float yz = q[2] * q[3];
+  float wx = q[0] * q[1];
+  float wy = q[0] * q[2];
+  float wz = q[0] * q[3];
+
+  r(0, 0) = 1.0f - (2.0f * (yy + zz));
+  r(0, 1) = 2.0f * (xy - wz);
+  r(0, 2) = 2.0f * (xz + wy);
+  r(1, 0) = 2.0f * (xy + wz);
+  r(1, 1) = 1.0f - (2.0f * (xx + zz));
+  r(1, 2) = 2.0f * (yz - wx);
+  r(2, 0) = 2.0f * (xz - wy);
+  r(2, 1) = 2.0f * (yz + wx);
+  r(2, 2) = 1.0f - (2.0f * (xx + yy));
+}
+
+/**
+  * @brief  Turn an attitude by a rotation vector in the IMU axes, as in
+  *         Ahrs_Update(): its quaternion to the third order, then a Newton
+  *         step back to unit norm.
+  * @param  q Attitude, w x y z, updated
+  * @param  angle Rotation vector, rad
+  */
+static void Eskf_Rotate(float q[4], const float angle[3])
+{
+  float vx = 0.5f * angle[0];
+  float vy = 0.5f * angle[1];
+  float vz = 0.5f * angle[2];
+  float h = (vx * vx) + (vy * vy) + (vz * vz);
+  float d0 = 1.0f - (0.5f * h);
+  float q0;
+  float q1;
+  float q2;
+  float q3;
+
+  h = 1.0f - (h * (1.0f / 6.0f));
+  vx *= h;
+  vy *= h;
+  vz *= h;
+  q0 = (q[0] * d0) - (q[1] * vx) - (q[2] * vy) - (q[3] * vz);
+  q1 = (q[0] * vx) + (q[1] * d0) + (q[2] * vz) - (q[3] * vy);
+  q2 = (q[0] * vy) - (q[1] * vz) + (q[2] * d0) + (q[3] * vx);
+  q3 = (q[0] * vz) + (q[1] * vy) - (q[2] * vx) + (q[3] * d0);
+  h = 1.5f - (0.5f * ((q0 * q0) + (q1 * q1) + (q2 * q2) + (q3 * q3)));
+  q[0] = q0 * h;
+  q[1] = q1 * h;
+  q[2] = q2 * h;
+  q[3] = q3 * h;
+}
+
+/**
+  * @brief  Blocks of F over a period.
+  * @param  q Attitude at the end of the period
+  * @param  angle Rotation vector of the period, IMU axes
+  * @param  delta_v Velocity change from the specific force, earth axes
+  * @param  dt Period
+  * @param  f Transition
+  */
+static void Eskf_Transition(const float q[4], const float angle[3], const float delta_v[3], float dt,
+                            Eskf_TransitionTypeDef &f)
+{
+  Vector3 phi;
+  Vector3 dv;
+  Matrix3 r;
+  Matrix3 s;
+
+  for (uint32_t i = 0U; i < 3U; i++)
+  {
+    phi[i] = angle[i];
+    dv[i] = delta_v[i];
+  }
+  Eskf_Rotation(q, r);
+  /* exp(-[phi]x) to the second order */
+  s = Skew(phi);
+  f.attitude = (Matrix3::Identity() - s) + ((s * s) * 0.5f);
+
+  /* R [a dt]x = [R a dt]x R */
+  f.velocity = (Skew(dv) * r) * -1.0f;
+  f.accel_bias = r * -dt;
+  f.dt = dt;
+}
+
+/**
+  * @brief  One block row of F P.
+  * @param  p Covariance
+  * @param  f Transition
+  * @param  fp First ESKF_PRODUCT_BLOCKS block rows of F P
+  * @param  block Block row, attitude, velocity or position
+  */
+static void Eskf_Product(const EskfCovariance &p, const Eskf_TransitionTypeDef &f, EskfProduct &fp,
+                         uint32_t block)
+{
+  Matrix3 b;
+
+  for (uint32_t j = 0U; j < ESKF_BLOCKS; j++)
+  {
+    if (block == 0U)
+    {
+      b = (f.attitude * Eskf_Block(p, 0U, j)) - (Eskf_Block(p, 3U, j) * f.dt);
+    }
+    else if (block == 1U)
+    {
+      b = (f.velocity * Eskf_Block(p, 0U, j)) + Eskf_Block(p, 1U, j) + (f.accel_bias * Eskf_Block(p, 4U, j));
+    }
+    else
+    {
+      b = (Eskf_Block(p, 1U, j) * f.dt) + Eskf_Block(p, 2U, j);
+    }
+    fp.SetBlock(3U * block, 3U * j, b);
+  }
+}
+
+/**
+  * @brief  Upper blocks of one block row of F P F', written over P. They
+  *         only depend on the same block row of F P, the blocks of P still
+  *         read by the later rows are below the diagonal.
+  * @param  fp First ESKF_PRODUCT_BLOCKS block rows of F P
+  * @param  f Transition
+  * @param  p Covariance, block row updated above the diagonal
+  * @param  block Block row, attitude, velocity or position
+  */
+static void Eskf_Covariance(const EskfProduct &fp, const Eskf_TransitionTypeDef &f, EskfCovariance &p,
+                            uint32_t block)
+{
+  uint32_t r = 3U * block;
+  Matrix3 a = fp.Block<3U, 3U>(r, 0U);
+  Matrix3 v = fp.Block<3U, 3U>(r, 3U);
+  Matrix3 g = fp.Block<3U, 3U>(r, 9U);
+  Matrix3 b = fp.Block<3U, 3U>(r, 12U);
+
+  if (block == 0U)
+  {
+    p.SetBlock(r, 0U, a.MulTransposed(f.attitude) - (g * f.dt));
+  }
+  if (block <= 1U)
+  {
+    p.SetBlock(r, 3U, a.MulTransposed(f.velocity) + v + b.MulTransposed(f.accel_bias));
+  }
+  p.SetBlock(r, 6U, (v * f.dt) + fp.Block<3U, 3U>(r, 6U));
+  p.SetBlock(r, 9U, g);
+  p.SetBlock(r, 12U, b);
+}
+
+/**
+  * @brief  Copy the upper triangle of the covariance onto the lower one.
+  * @param  p Covariance
+  */
+static void Eskf_Symmetrize(EskfCovariance &p)
+{
+  for (uint32_t i = 1U; i < ESKF_STATES; i++)
+  {
+    for (uint32_t j = 0U; j < i; j++)
+    {
+      p(i, j) = p(j, i);
+    }
+  }
+}
+
+/**
+  * @brief  Add the process noise of a period, diagonal.
+  * @param  p Covariance
+  * @param  dt Period
+  */
+static void Eskf_Noise(EskfCovariance &p, float dt)
+{
+  for (uint32_t i = 0U; i < 3U; i++)
+  {
+    p(ESKF_ATTITUDE + i, ESKF_ATTITUDE + i) += (ESKF_GYRO_NOISE * ESKF_GYRO_NOISE) * dt;
+    p(ESKF_VELOCITY + i, ESKF_VELOCITY + i) += (ESKF_ACCEL_NOISE * ESKF_ACCEL_NOISE) * dt;
+    p(ESKF_GYRO_BIAS + i, ESKF_GYRO_BIAS + i) += (ESKF_GYRO_BIAS_WALK * ESKF_GYRO_BIAS_WALK) * dt;
+    p(ESKF_ACCEL_BIAS + i, ESKF_ACCEL_BIAS + i) += (ESKF_ACCEL_BIAS_WALK * ESKF_ACCEL_BIAS_WALK) * dt;
+  }
+}
+
+/**
+  * @brief  Initial covariance, diagonal.
+  */
+static void Eskf_ResetCovariance(void)
+{
+  eskf_p.SetZero();
+  for (uint32_t i = 0U; i < 3U; i++)
+  {
+    eskf_p(ESKF_ATTITUDE + i, ESKF_ATTITUDE + i) = ESKF_INIT_ATTITUDE * ESKF_INIT_ATTITUDE;
+    eskf_p(ESKF_VELOCITY + i, ESKF_VELOCITY + i) = ESKF_INIT_VELOCITY * ESKF_INIT_VELOCITY;
+    eskf_p(ESKF_POSITION + i, ESKF_POSITION + i) = ESKF_INIT_POSITION * ESKF_INIT_POSITION;
+    eskf_p(ESKF_GYRO_BIAS + i, ESKF_GYRO_BIAS + i) = ESKF_INIT_GYRO_BIAS * ESKF_INIT_GYRO_BIAS;
+    eskf_p(ESKF_ACCEL_BIAS + i, ESKF_ACCEL_BIAS + i) = ESKF_INIT_ACCEL_BIAS * ESKF_INIT_ACCEL_BIAS;
+  }
+}
+
+/**
+  * @brief  Integrate the nominal state of the filter over a period of the
+  *         horizon and set the blocks of F for it.
+  * @param  e Period
+  */
+static void Eskf_Advance(const Eskf_EntryTypeDef *e)
+{
+  Matrix3 r;
+  float angle[3];
+  float dv[3];
+  float m[3];
+  float f[3];
+  float v;
+  uint32_t i;
+
+  for (i = 0U; i < 3U; i++)
+  {
+    angle[i] = e->angle[i] - (eskf_state.gyro_bias[i] * e->dt);
+    dv[i] = e->delta_v[i] - (eskf_state.accel_bias[i] * e->dt);
+  }
+
+  /* Velocity change at the attitude of the middle of the period,
+   * dv + (angle / 2) x dv, in the earth axes */
+  m[0] = dv[0] + (0.5f * ((angle[1] * dv[2]) - (angle[2] * dv[1])));
+  m[1] = dv[1] + (0.5f * ((angle[2] * dv[0]) - (angle[0] * dv[2])));
+  m[2] = dv[2] + (0.5f * ((angle[0] * dv[1]) - (angle[1] * dv[0])));
+  Eskf_Rotation(eskf_q, r);
+  for (i = 0U; i < 3U; i++)
+  {
+    f[i] = (r(i, 0) * m[0]) + (r(i, 1) * m[1]) + (r(i, 2) * m[2]);
+  }
+  for (i = 0U; i < 3U; i++)
+  {
+    v = eskf_velocity[i];
+    eskf_velocity[i] += (i == 2U) ? (f[i] - (ESKF_GRAVITY * e->dt)) : f[i];
+    eskf_position[i] += 0.5f * (v + eskf_velocity[i]) * e->dt;
+  }
+  Eskf_Rotate(eskf_q, angle);
+  Eskf_Transition(eskf_q, angle, f, e->dt, eskf_f);
+  eskf_time = e->timestamp;
+}
+
+/**
+  * @brief  Feed the difference between the filter and the output state of
+  *         the same period back into the output predictor.
+  * @param  e Period the filter is at
+  */
+static void Eskf_Output(const Eskf_EntryTypeDef *e)
+{
+  const float *a = e->q;
+  const float *b = eskf_q;
+  float gain = e->dt * (1.0f / ESKF_OUTPUT_TAU_S);
+  float d[3];
+  float c;
+  uint32_t i;
+
+  /* Rotation vector from the output attitude to the filter one, in the IMU
+   * axes: twice the vector part of conj(a) b, on the shorter way */
+  c = (((a[0] * b[0]) + (a[1] * b[1]) + (a[2] * b[2]) + (a[3] * b[3])) < 0.0f) ? -2.0f : 2.0f;
+  d[0] = c * (((a[0] * b[1]) - (a[1] * b[0])) - ((a[2] * b[3]) - (a[3] * b[2])));
+  d[1] = c * (((a[0] * b[2]) - (a[2] * b[0])) - ((a[3] * b[1]) - (a[1] * b[3])));
+  d[2] = c * (((a[0] * b[3]) - (a[3] * b[0])) - ((a[1] * b[2]) - (a[2] * b[1])));
+
+  for (i = 0U; i < 3U; i++)
+  {
+    /* Errors less the corrections made since the period */
+    eskf_rate_correction[i] = (d[i] - (eskf_angle_correction[i] - e->angle_correction[i]))
+                              * (1.0f / ESKF_OUTPUT_TAU_S);
+    c = eskf_velocity[i] - (e->velocity[i] + (eskf_velocity_correction[i] - e->velocity_correction[i]));
+    c *= gain;
+    eskf_state.velocity[i] += c;
+    eskf_velocity_correction[i] += c;
+    c = eskf_position[i] - (e->position[i] + (eskf_position_correction[i] - e->position_correction[i]));
+    c *= gain;
+    eskf_state.position[i] += c;
+    eskf_position_correction[i] += c;
+  }
+}
+
+/**
+  * @brief  Take the oldest measurement: gate its innovation, keep the gain
+  *         terms for the covariance update and correct the nominal state.
+  * @retval 1 when the measurement is fused, 0 when rejected
+  */
+static uint8_t Eskf_Gain(void)
+{
+  const Eskf_MeasurementTypeDef *m = &eskf_queue[eskf_queue_tail & ESKF_QUEUE_MASK];
+  uint32_t k = m->index;
+  float *x = (k < ESKF_POSITION) ? &eskf_velocity[k - ESKF_VELOCITY] : &eskf_position[k - ESKF_POSITION];
+  float s = eskf_p(k, k) + m->variance;
+  float y = m->value - *x;
+  float angle[3];
+  float n;
+  uint32_t i;
+
+  eskf_queue_tail++;
+  if ((y * y) > (ESKF_GATE * s))
+  {
+    eskf_stats.rejected++;
+    return 0U;
+  }
+  for (i = 0U; i < ESKF_STATES; i++)
+  {
+    eskf_pht[i] = eskf_p(i, k);
+  }
+  eskf_inv_s = 1.0f / s;
+
+  /* Correction dx = P H' y / s into the filter, the output follows */
+  n = y * eskf_inv_s;
+  for (i = 0U; i < 3U; i++)
+  {
+    angle[i] = eskf_pht[ESKF_ATTITUDE + i] * n;
+  }
+  Eskf_Rotate(eskf_q, angle);
+  for (i = 0U; i < 3U; i++)
+  {
+    eskf_velocity[i] += eskf_pht[ESKF_VELOCITY + i] * n;
+    eskf_position[i] += eskf_pht[ESKF_POSITION + i] * n;
+    eskf_state.gyro_bias[i] += eskf_pht[ESKF_GYRO_BIAS + i] * n;
+    eskf_state.accel_bias[i] += eskf_pht[ESKF_ACCEL_BIAS + i] * n;
+  }
+  return 1U;
+}
+
+/**
+  * @brief  P - P H' H P / s on ESKF_FUSE_ROWS rows of the covariance.
+  * @param  row First row
+  */
+static void Eskf_Fuse(uint32_t row)
+{
+  for (uint32_t i = row; i < (row + ESKF_FUSE_ROWS); i++)
+  {
+    float g = eskf_pht[i] * eskf_inv_s;
+
+    for (uint32_t j = 0U; j < ESKF_STATES; j++)
+    {
+      eskf_p(i, j) -= g * eskf_pht[j];
+    }
+  }
+}
+
+/**
+  * @brief  Queue the components of a measurement, all or none, in time
+  *         order.
+  * @param  timestamp Cycle time of the measurement
+  * @param  index Error state component of the first one
+  * @param  value Components
+  * @param  count Number of components
+  * @param  variance Variance of each
+  * @retval HAL_OK, HAL_BUSY when the queue is full, HAL_ERROR when not
+  *         started, the variance is not positive or the filter is past
+  *         the timestamp
+  */
+static HAL_StatusTypeDef Eskf_Queue(uint64_t timestamp, uint32_t index, const float *value, uint32_t count,
+                                    float variance)
+{
+  uint32_t start = Timing_Cycles();
+  Eskf_MeasurementTypeDef *m;
+  uint32_t slot;
+
+  if ((eskf_state.started == 0U) || !(variance > 0.0f))
+  {
+    return HAL_ERROR;
+  }
+  if (timestamp < eskf_time)
+  {
+    eskf_stats.stale++;
+    return HAL_ERROR;
+  }
+  if ((ESKF_QUEUE_LEN - (eskf_queue_head - eskf_queue_tail)) < count)
+  {
+    eskf_stats.dropped++;
+    return HAL_BUSY;
+  }
+  for (uint32_t n = 0U; n < count; n++)
+  {
+    /* Insertion from the newest, usually in place */
+    slot = eskf_queue_head;
+    while ((slot != eskf_queue_tail) && (eskf_queue[(slot - 1U) & ESKF_QUEUE_MASK].timestamp > timestamp))
+    {
+      eskf_queue[slot & ESKF_QUEUE_MASK] = eskf_queue[(slot - 1U) & ESKF_QUEUE_MASK];
+      slot--;
+    }
+    m = &eskf_queue[slot & ESKF_QUEUE_MASK];
+    m->timestamp = timestamp;
+    m->index = index + n;
+    m->value = value[n];
+    m->variance = variance;
+    eskf_queue_head++;
+  }
+  Timing_PerfAdd(&eskf_stats.queue_cycles, Timing_Cycles() - start);
+  return HAL_OK;
+}
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Set the IMU scales and clear the filter, which waits for
+  *         Eskf_Start().
+  * @param  gyro_dps_per_count Scale of the gyro counts
+  * @param  accel_g_per_count Scale of the accelerometer counts
+  */
+extern "C" void Eskf_Init(float gyro_dps_per_count, float accel_g_per_count)
+{
+  eskf_gyro_scale = gyro_dps_per_count * (FAST_MATH_PI / 180.0f);
+  eskf_accel_scale = accel_g_per_count * ESKF_GRAVITY;
+  eskf_seconds_per_cycle = Timing_CyclesToSeconds(1U);
+  eskf_period = (float)ESKF_PREDICT_US * 1e-6f;
+  eskf_max_gap_cycles = Timing_UsToCycles(ESKF_MAX_GAP_US);
+  eskf_delay_cycles = Timing_UsToCycles(ESKF_DELAY_US);
+  eskf_state.started = 0U;
+  eskf_step = ESKF_STEP_IDLE;
+  eskf_op_cycles = 0U;
+  eskf_queue_head = 0U;
+  eskf_queue_tail = 0U;
+  eskf_horizon_head = 0U;
+  eskf_horizon_tail = 0U;
+  eskf_time = 0U;
+  Eskf_ResetCovariance();
+  eskf_stats.predictions = 0U;
+  eskf_stats.fusions = 0U;
+  eskf_stats.rejected = 0U;
+  eskf_stats.dropped = 0U;
+  eskf_stats.stale = 0U;
+  eskf_stats.late = 0U;
+  eskf_stats.gaps = 0U;
+  eskf_stats.footprint = sizeof(eskf_p) + sizeof(eskf_fp) + sizeof(eskf_f) + sizeof(eskf_horizon)
+                         + sizeof(eskf_queue);
+  Timing_PerfReset(&eskf_stats.push_cycles);
+  Timing_PerfReset(&eskf_stats.queue_cycles);
+  Timing_PerfReset(&eskf_stats.poll_cycles);
+  Timing_PerfReset(&eskf_stats.step_cycles);
+  Timing_PerfReset(&eskf_stats.predict_cycles);
+  Timing_PerfReset(&eskf_stats.fuse_cycles);
+}
+
+/**
+  * @brief  Start the navigation from an attitude, at rest at the origin,
+  *         biases 0. The horizon, the measurements and any prediction or
+  *         fusion in progress are dropped.
+  * @param  q Attitude, w x y z, from the AHRS once settled
+  */
+extern "C" void Eskf_Start(const float q[4])
+{
+  uint32_t i;
+
+  for (i = 0U; i < 4U; i++)
+  {
+    eskf_state.q[i] = q[i];
+    eskf_q[i] = q[i];
+  }
+  for (i = 0U; i < 3U; i++)
+  {
+    eskf_state.velocity[i] = 0.0f;
+    eskf_state.position[i] = 0.0f;
+    eskf_state.gyro_bias[i] = 0.0f;
+    eskf_state.accel_bias[i] = 0.0f;
+    eskf_rate_correction[i] = 0.0f;
+    eskf_angle_correction[i] = 0.0f;
+    eskf_velocity_correction[i] = 0.0f;
+    eskf_position_correction[i] = 0.0f;
+    eskf_angle[i] = 0.0f;
+    eskf_delta_v[i] = 0.0f;
+    eskf_velocity[i] = 0.0f;
+    eskf_position[i] = 0.0f;
+  }
+  eskf_dt = 0.0f;
+  eskf_timed = 0U;
+  eskf_time = 0U;
+  eskf_horizon_tail = eskf_horizon_head;
+  eskf_step = ESKF_STEP_IDLE;
+  eskf_op_cycles = 0U;
+  eskf_queue_tail = eskf_queue_head;
+  Eskf_ResetCovariance();
+  eskf_state.started = 1U;
+}
+
+/**
+  * @brief  Integrate one IMU sample into the output state, and close the
+  *         period of the horizon every ESKF_PREDICT_US.
+  * @param  sample IMU sample at the loop rate, unfiltered
+  */
+extern "C" void Eskf_Push(const IMU_LoopSampleTypeDef *sample)
+{
+  uint32_t start = Timing_Cycles();
+  uint32_t elapsed = (uint32_t)(sample->timestamp - eskf_latest);
+  Eskf_EntryTypeDef *e;
+  Matrix3 r;
+  float w[3];
+  float a[3];
+  float f[3];
+  float dt;
+  uint32_t i;
+
+  if (eskf_state.started == 0U)
+  {
+    return;
+  }
+  eskf_latest = sample->timestamp;
+  if ((eskf_timed == 0U) || (elapsed > eskf_max_gap_cycles))
+  {
+    eskf_timed = 1U;
+    eskf_stats.gaps++;
+    elapsed = 0U;
+  }
+  dt = (float)elapsed * eskf_seconds_per_cycle;
+
+  /* Raw integrals for the filter, which removes its biases per period */
+  for (i = 0U; i < 3U; i++)
+  {
+    w[i] = sample->gyro[i] * eskf_gyro_scale;
+    a[i] = sample->accel[i] * eskf_accel_scale;
+    eskf_angle[i] += w[i] * dt;
+    eskf_delta_v[i] += a[i] * dt;
+    w[i] = ((w[i] - eskf_state.gyro_bias[i]) + eskf_rate_correction[i]) * dt;
+    a[i] -= eskf_state.accel_bias[i];
+    eskf_angle_correction[i] += eskf_rate_correction[i] * dt;
+  }
+  eskf_dt += dt;
+
+  /* Specific force in the earth axes, gravity added back to get the
+   * acceleration */
+  Eskf_Rotation(eskf_state.q, r);
+  for (i = 0U; i < 3U; i++)
+  {
+    f[i] = (r(i, 0) * a[0]) + (r(i, 1) * a[1]) + (r(i, 2) * a[2]);
+  }
+  f[2] -= ESKF_GRAVITY;
+  for (i = 0U; i < 3U; i++)
+  {
+    eskf_state.position[i] += (eskf_state.velocity[i] + (0.5f * f[i] * dt)) * dt;
+    eskf_state.velocity[i] += f[i] * dt;
+  }
+  Eskf_Rotate(eskf_state.q, w);
+
+  /* Period over: into the horizon, or extended while it is full */
+  if (eskf_dt >= eskf_period)
+  {
+    if ((eskf_horizon_head - eskf_horizon_tail) < ESKF_HORIZON_LEN)
+    {
+      e = &eskf_horizon[eskf_horizon_head & ESKF_HORIZON_MASK];
+      e->timestamp = sample->timestamp;
+      e->dt = eskf_dt;
+      for (i = 0U; i < 3U; i++)
+      {
+        e->angle[i] = eskf_angle[i];
+        e->delta_v[i] = eskf_delta_v[i];
+        e->q[i + 1U] = eskf_state.q[i + 1U];
+        e->velocity[i] = eskf_state.velocity[i];
+        e->position[i] = eskf_state.position[i];
+        e->angle_correction[i] = eskf_angle_correction[i];
+        e->velocity_correction[i] = eskf_velocity_correction[i];
+        e->position_correction[i] = eskf_position_correction[i];
+        eskf_angle[i] = 0.0f;
+        eskf_delta_v[i] = 0.0f;
+      }
+      e->q[0] = eskf_state.q[0];
+      eskf_dt = 0.0f;
+      eskf_horizon_head++;
+    }
+    else
+    {
+      eskf_stats.late++;
+    }
+  }
+  Timing_PerfAdd(&eskf_stats.push_cycles, Timing_Cycles() - start);
+}
+
+/**
+  * @brief  Run filter steps until the budget is spent or nothing is left.
+  *         The measurements at the time of the filter go before the next
+  *         period of the horizon.
+  * @param  budget_cycles Cycle budget, checked between steps
+  */
+extern "C" void Eskf_Poll(uint32_t budget_cycles)
+{
+  uint32_t start = Timing_Cycles();
+  uint32_t step_start;
+  uint32_t cycles;
+  Timing_PerfTypeDef *done;
+
+  do
+  {
+    step_start = Timing_Cycles();
+    done = NULL;
+    switch (eskf_step)
+    {
+      case ESKF_STEP_IDLE:
+        if ((eskf_queue_head != eskf_queue_tail)
+            && (eskf_queue[eskf_queue_tail & ESKF_QUEUE_MASK].timestamp <= eskf_time))
+        {
+          eskf_step = ESKF_STEP_GAIN;
+        }
+        else if ((eskf_horizon_head != eskf_horizon_tail)
+                 && ((eskf_latest - eskf_horizon[eskf_horizon_tail & ESKF_HORIZON_MASK].timestamp)
+                     >= eskf_delay_cycles))
+        {
+          eskf_step = ESKF_STEP_TRANSITION;
+        }
+        else
+        {
+          Timing_PerfAdd(&eskf_stats.poll_cycles, Timing_Cycles() - start);
+          return;
+        }
+        break;
+
+      case ESKF_STEP_TRANSITION:
+        Eskf_Advance(&eskf_horizon[eskf_horizon_tail & ESKF_HORIZON_MASK]);
+        Eskf_Output(&eskf_horizon[eskf_horizon_tail & ESKF_HORIZON_MASK]);
+        eskf_horizon_tail++;
+        eskf_block = 0U;
+        eskf_step = ESKF_STEP_PRODUCT;
+        break;
+
+      case ESKF_STEP_PRODUCT:
+        Eskf_Product(eskf_p, eskf_f, eskf_fp, eskf_block);
+        eskf_block++;
+        if (eskf_block >= ESKF_PRODUCT_BLOCKS)
+        {
+          eskf_block = 0U;
+          eskf_step = ESKF_STEP_COVARIANCE;
+        }
+        break;
+
+      case ESKF_STEP_COVARIANCE:
+        Eskf_Covariance(eskf_fp, eskf_f, eskf_p, eskf_block);
+        eskf_block++;
+        if (eskf_block >= ESKF_PRODUCT_BLOCKS)
+        {
+          eskf_step = ESKF_STEP_NOISE;
+        }
+        break;
+
+      case ESKF_STEP_NOISE:
+        Eskf_Symmetrize(eskf_p);
+        Eskf_Noise(eskf_p, eskf_f.dt);
+        eskf_stats.predictions++;
+        done = &eskf_stats.predict_cycles;
+        eskf_step = ESKF_STEP_IDLE;
+        break;
+
+      case ESKF_STEP_GAIN:
+        eskf_row = 0U;
+        eskf_step = (Eskf_Gain() != 0U) ? ESKF_STEP_FUSE : ESKF_STEP_IDLE;
+        break;
+
+      case ESKF_STEP_FUSE:
+        Eskf_Fuse(eskf_row);
+        eskf_row += ESKF_FUSE_ROWS;
+        if (eskf_row >= ESKF_STATES)
+        {
+          eskf_stats.fusions++;
+          done = &eskf_stats.fuse_cycles;
+          eskf_step = ESKF_STEP_IDLE;
+        }
+        break;
+
+      default:
+        eskf_step = ESKF_STEP_IDLE;
+        break;
+    }
+
+    /* A prediction or a fusion is timed over all its steps */
+    cycles = Timing_Cycles() - step_start;
+    Timing_PerfAdd(&eskf_stats.step_cycles, cycles);
+    eskf_op_cycles += cycles;
+    if (eskf_step == ESKF_STEP_IDLE)
+    {
+      if (done != NULL)
+      {
+        Timing_PerfAdd(done, eskf_op_cycles);
+      }
+      eskf_op_cycles = 0U;
+    }
+  } while ((Timing_Cycles() - start) < budget_cycles);
+
+  Timing_PerfAdd(&eskf_stats.poll_cycles, Timing_Cycles() - start);
+}
+
+/**
+  * @brief  Queue a position measurement, from the start point, fused when
+  *         the filter reaches its time.
+  * @param  timestamp Cycle time of the measurement, at most ESKF_DELAY_US old
+  * @param  position Earth axes, m
+  * @param  variance Variance of each component, m^2
+  * @retval HAL_OK, HAL_BUSY when the queue is full, HAL_ERROR when not
+  *         started, the variance is not positive or the measurement is
+  *         older than the filter
+  */
+extern "C" HAL_StatusTypeDef Eskf_FusePosition(uint64_t timestamp, const float position[3], float variance)
+{
+  return Eskf_Queue(timestamp, ESKF_POSITION, position, 3U, variance);
+}
+
+/**
+  * @brief  Queue a velocity measurement.
+  * @param  timestamp Cycle time of the measurement
+  * @param  velocity Earth axes, m/s
+  * @param  variance Variance of each component, m^2/s^2
+  * @retval See Eskf_FusePosition()
+  */
+extern "C" HAL_StatusTypeDef Eskf_FuseVelocity(uint64_t timestamp, const float velocity[3], float variance)
+{
+  return Eskf_Queue(timestamp, ESKF_VELOCITY, velocity, 3U, variance);
+}
+
+/**
+  * @brief  Queue a height measurement, the position z alone.
+  * @param  timestamp Cycle time of the measurement
+  * @param  height Height above the start point, m
+  * @param  variance Its variance, m^2
+  * @retval See Eskf_FusePosition()
+  */
+extern "C" HAL_StatusTypeDef Eskf_FuseHeight(uint64_t timestamp, float height, float variance)
+{
+  return Eskf_Queue(timestamp, ESKF_POSITION + 2U, &height, 1U, variance);
+}
+
+/**
+  * @brief  Output state, at the latest IMU sample.
+  * @retval State
+  */
+extern "C" const Eskf_StateTypeDef *Eskf_State(void)
+{
+  return &eskf_state;
+}
+
+/**
+  * @brief  Variance of one error state component.
+  * @param  index Component, 0 to ESKF_STATES - 1: attitude, velocity,
+  *         position, gyro bias, accelerometer bias, X Y Z each
+  * @retval Variance, 0 for an index out of range
+  */
+extern "C" float Eskf_Variance(uint32_t index)
+{
+  return (index < ESKF_STATES) ? eskf_p(index, index) : 0.0f;
+}
+
+/**
+  * @brief  Filter statistics.
+  * @retval Statistics
+  */
+extern "C" const Eskf_StatsTypeDef *Eskf_Stats(void)
+{
+  return &eskf_stats;
+}
+
+#ifdef ESKF_BENCH
+/**
+  * @brief  Run the covariance prediction ESKF_BENCH_RUNS times on the block
+  *         sparse path and on dense 15 x 15 products, from the same
+  *         covariance and transition, and compare them. Independent of the
+  *         filter, which is not disturbed.
+  * @param  result Cycles per prediction of each, and largest difference
+  */
+extern "C" void Eskf_Bench(Eskf_BenchTypeDef *result)
+{
+  static const float q[4] = { 0.9f, 0.3f, -0.2f, 0.25f };
+  static const float angle[3] = { 0.004f, -0.002f, 0.006f };
+  static const float delta_v[3] = { 0.01f, -0.02f, 0.04f };
+  Eskf_TransitionTypeDef f;
+  float qn[4];
+  float n = FastMath_InvSqrt((q[0] * q[0]) + (q[1] * q[1]) + (q[2] * q[2]) + (q[3] * q[3]));
+  float e;
+  uint32_t seed = 1U;
+  uint32_t total;
+  uint32_t start;
+  uint32_t run;
+  uint32_t i;
+  uint32_t j;
+
+  for (i = 0U; i < 4U; i++)
+  {
+    qn[i] = q[i] * n;
+  }
+  Eskf_Transition(qn, angle, delta_v, 0.004f, f);
+
+  /* Symmetric, dominant diagonal */
+  for (i = 0U; i < ESKF_STATES; i++)
+  {
+    for (j = i; j < ESKF_STATES; j++)
+    {
+      seed = (seed * 1664525U) + 1013904223U;
+      eskf_bench_p(i, j) = ((float)(seed >> 8) * (1.0f / 16777216.0f)) - 0.5f;
+      eskf_bench_p(j, i) = eskf_bench_p(i, j);
+    }
+    eskf_bench_p(i, i) += (float)ESKF_STATES;
+  }
+
+  total = 0U;
+  for (run = 0U; run < ESKF_BENCH_RUNS; run++)
+  {
+    eskf_bench_sparse = eskf_bench_p;
+    start = Timing_Cycles();
+    for (i = 0U; i < ESKF_PRODUCT_BLOCKS; i++)
+    {
+      Eskf_Product(eskf_bench_sparse, f, eskf_bench_product, i);
+    }
+    for (i = 0U; i < ESKF_PRODUCT_BLOCKS; i++)
+    {
+      Eskf_Covariance(eskf_bench_product, f, eskf_bench_sparse, i);
+    }
+    Eskf_Symmetrize(eskf_bench_sparse);
+    total += Timing_Cycles() - start;
+  }
+  result->sparse_cycles = total / ESKF_BENCH_RUNS;
+
+  eskf_bench_f.SetZero();
+  for (i = 0U; i < ESKF_STATES; i++)
+  {
+    eskf_bench_f(i, i) = 1.0f;
+  }
+  eskf_bench_f.SetBlock(ESKF_ATTITUDE, ESKF_ATTITUDE, f.attitude);
+  eskf_bench_f.SetBlock(ESKF_VELOCITY, ESKF_ATTITUDE, f.velocity);
+  eskf_bench_f.SetBlock(ESKF_VELOCITY, ESKF_ACCEL_BIAS, f.accel_bias);
+  for (i = 0U; i < 3U; i++)
+  {
+    eskf_bench_f(ESKF_ATTITUDE + i, ESKF_GYRO_BIAS + i) = -f.dt;
+    eskf_bench_f(ESKF_POSITION + i, ESKF_VELOCITY + i) = f.dt;
+  }
+  total = 0U;
+  for (run = 0U; run < ESKF_BENCH_RUNS; run++)
+  {
+    start = Timing_Cycles();
+    eskf_bench_fp.SetProduct(eskf_bench_f, eskf_bench_p);
+    eskf_bench_dense.SetProductTransposed(eskf_bench_fp, eskf_bench_f);
+    total += Timing_Cycles() - start;
+  }
+  result->dense_cycles = total / ESKF_BENCH_RUNS;
+
+  result->max_error = 0.0f;
+  for (i = 0U; i < ESKF_STATES; i++)
+  {
+    for (j = 0U; j < ESKF_STATES; j++)
+    {
+      e = fabsf(eskf_bench_sparse(i, j) - eskf_bench_dense(i, j));
+      result->max_error = (e > result->max_error) ? e : result->max_error;
+    }
+  }
+}
+#endif
@@ -0,0 +1,147 @@
+/**
+  ******************************************************************************
+  * @file    fast_math.c
+  * @brief   This file provides the table of the fast exponential and the
+  *          benchmark of the fast math kernels against libm.
+  *
+  *          FastMath_Bench() runs each kernel and its single precision libm
+  *          counterpart over the same FAST_MATH_BENCH_SAMPLES inputs spread
+  *          over a typical range, and reports the cycles per call measured
+  *          with the DWT counter, the loop overhead removed, and the worst
+  *          error against double precision libm. It is a start up check for
+  *          the debugger, built in with FAST_MATH_BENCH.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "fast_math.h"
+#include "timing.h"
+
+/* Private define ------------------------------------------------------------*/
+/**
+  * Time fast and libm over the inputs then find the worst error. The
+  * expressions use the inputs fast_math_a[n] and fast_math_b[n].
+  */
+#define FAST_MATH_BENCH_RUN(result, label, fast, libm, error)                    \
+  do                                                                             \
+  {                                                                              \
+    uint32_t n;                                                                  \
+    uint32_t start;                                                              \
+    double worst = 0.0;                                                          \
+                                                                                 \
+    (result)->name = (label);                                                    \
+    start = Timing_Cycles();                                                     \
+    for (n = 0U; n < FAST_MATH_BENCH_SAMPLES; n++)                               \
+    {                                                                            \
+      fast_math_sink = (fast);                                                   \
+    }                                                                            \
+    (result)->fast_cycles = FastMath_PerCall(Timing_Cycles() - start, overhead); \
+    start = Timing_Cycles();                                                     \
+    for (n = 0U; n < FAST_MATH_BENCH_SAMPLES; n++)                               \
+    {                                                                            \
+      fast_math_sink = (libm);                                                   \
+    }                                                                            \
+    (result)->libm_cycles = FastMath_PerCall(Timing_Cycles() - start, overhead); \
+    for (n = 0U; n < FAST_MATH_BENCH_SAMPLES; n++)                               \
+    {                                                                            \
+      double e = (error);                                                        \
+                                                                                 \
+      worst = (e > worst) ? e : worst;                                           \
+    }                                                                            \
+    (result)->max_error = (float)worst;                                          \
+  } while (0)
+
+/* Exported variables --------------------------------------------------------*/
+const float fast_math_exp2_table[16] =
+{
+  1.0f,          1.0442737341f, 1.0905077457f, 1.1387885809f,
+  1.1892070770f, 1.2418577671f, 1.2968395948f, 1.3542555571f,
+  1.4142135382f, 1.4768261909f, 1.5422108173f, 1.6104903221f,
+  1.6817928553f, 1.7562521696f, 1.8340080976f, 1.9152065516f
+};
+
+/* Private variables ---------------------------------------------------------*/
+static float fast_math_a[FAST_MATH_BENCH_SAMPLES];
+static float fast_math_b[FAST_MATH_BENCH_SAMPLES];
+static volatile float fast_math_sink;
+
+/* Private function prototypes -----------------------------------------------*/
+static void FastMath_Fill(float *x, float lo, float hi);
+static uint32_t FastMath_PerCall(uint32_t cycles, uint32_t overhead);
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Fill an input array with evenly spread values, in a scrambled
+  *         order so no branch settles.
+  * @param  x Inputs
+  * @param  lo Lowest value
+  * @param  hi Highest value
+  */
+static void FastMath_Fill(float *x, float lo, float hi)
+{
+  uint32_t n;
+
+  /* 97 is odd, so n * 97 visits every slot once */
+  for (n = 0U; n < FAST_MATH_BENCH_SAMPLES; n++)
+  {
+    x[(n * 97U) % FAST_MATH_BENCH_SAMPLES] = lo + (((hi - lo) * (float)n) / (float)(FAST_MATH_BENCH_SAMPLES - 1U));
+  }
+}
+
+/**
+  * @brief  Cycles per call of a timed loop.
+  * @param  cycles Cycles of the loop
+  * @param  overhead Cycles of the same loop storing its input
+  * @retval Cycles per call
+  */
+static uint32_t FastMath_PerCall(uint32_t cycles, uint32_t overhead)
+{
+  return (cycles > overhead) ? ((cycles - overhead) / FAST_MATH_BENCH_SAMPLES) : 0U;
+}
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Measure the fast kernels against libm.
+  * @param  results One result per kernel: sin, cos, atan2, asin, sqrt,
+  *         inverse sqrt, exp, log2 (absolute error)
+  */
+void FastMath_Bench(FastMath_BenchTypeDef results[FAST_MATH_BENCH_COUNT])
+{
+  uint32_t overhead;
+  uint32_t start;
+  uint32_t n;
+
+  FastMath_Fill(fast_math_a, -10.0f, 10.0f);
+  FastMath_Fill(fast_math_b, -1.0f, 1.0f);
+  start = Timing_Cycles();
+  for (n = 0U; n < FAST_MATH_BENCH_SAMPLES; n++)
+  {
+    fast_math_sink = fast_math_a[n];
+  }
+  overhead = Timing_Cycles() - start;
+
+  /* Absolute errors */
+  FAST_MATH_BENCH_RUN(&results[0], "sin", FastMath_Sin(fast_math_a[n]), sinf(fast_math_a[n]),
+                      fabs((double)FastMath_Sin(fast_math_a[n]) - sin((double)fast_math_a[n])));
+  FAST_MATH_BENCH_RUN(&results[1], "cos", FastMath_Cos(fast_math_a[n]), cosf(fast_math_a[n]),
+                      fabs((double)FastMath_Cos(fast_math_a[n]) - cos((double)fast_math_a[n])));
+  FastMath_Fill(fast_math_a, -1.0f, 1.0f);
+  FAST_MATH_BENCH_RUN(&results[2], "atan2", FastMath_Atan2(fast_math_b[n], fast_math_a[n]),
+                      atan2f(fast_math_b[n], fast_math_a[n]),
+                      fabs((double)FastMath_Atan2(fast_math_b[n], fast_math_a[n])
+                           - atan2((double)fast_math_b[n], (double)fast_math_a[n])));
+  FAST_MATH_BENCH_RUN(&results[3], "asin", FastMath_Asin(fast_math_a[n]), asinf(fast_math_a[n]),
+                      fabs((double)FastMath_Asin(fast_math_a[n]) - asin((double)fast_math_a[n])));
+
+  /* Relative errors */
+  FastMath_Fill(fast_math_a, 0.001f, 1000.0f);
+  FAST_MATH_BENCH_RUN(&results[4], "sqrt", FastMath_Sqrt(fast_math_a[n]), sqrtf(fast_math_a[n]),
+                      fabs(((double)FastMath_Sqrt(fast_math_a[n]) / sqrt((double)fast_math_a[n])) - 1.0));
+  FAST_MATH_BENCH_RUN(&results[5], "invsqrt", FastMath_InvSqrt(fast_math_a[n]), 1.0f / sqrtf(fast_math_a[n]),
+                      fabs(((double)FastMath_InvSqrt(fast_math_a[n]) * sqrt((double)fast_math_a[n])) - 1.0));
+  FastMath_Fill(fast_math_a, -20.0f, 20.0f);
+  FAST_MATH_BENCH_RUN(&results[6], "exp", FastMath_Exp(fast_math_a[n]), expf(fast_math_a[n]),
+                      fabs(((double)FastMath_Exp(fast_math_a[n]) / exp((double)fast_math_a[n])) - 1.0));
+  FastMath_Fill(fast_math_a, 0.001f, 1000.0f);
+  FAST_MATH_BENCH_RUN(&results[7], "log2", FastMath_Log2(fast_math_a[n]), log2f(fast_math_a[n]),
+                      fabs((double)FastMath_Log2(fast_math_a[n]) - log2((double)fast_math_a[n])));
+}
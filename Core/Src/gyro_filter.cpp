@@ -0,0 +1,208 @@
+/**
+  ******************************************************************************
+  * @file    gyro_filter.cpp
+  * @brief   This file provides the gyro filter chain. The sections are
+  *          designed by the compiler and the bank is constant initialized,
+  *          so no start up code computes coefficients.
+  *
+  *          With GYRO_FILTER_FIXED the same sections run in Q15 on the
+  *          rate rounded to whole sensor counts, the int16 path of the
+  *          Cortex-M4 dual multiply accumulates. GyroFilter_Bench() runs
+  *          both chains on the same input to compare their cost and output,
+  *          the Q15 bank timed apart from the rounding that feeds it.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "gyro_filter.h"
+#include "biquad.hpp"
+
+/* Private variables ---------------------------------------------------------*/
+static constexpr BiquadCoeffs gyro_filter_stages[] =
+{
+  BiquadPt1(GYRO_FILTER_PT1_HZ, GYRO_FILTER_RATE_HZ),
+  BiquadLowpass(GYRO_FILTER_LOWPASS_HZ, GYRO_FILTER_RATE_HZ, GYRO_FILTER_LOWPASS_Q),
+};
+
+static constexpr uint32_t gyro_filter_count = sizeof(gyro_filter_stages) / sizeof(gyro_filter_stages[0]);
+
+static BiquadBank<gyro_filter_count> gyro_filter(gyro_filter_stages);
+static BiquadBankQ15<gyro_filter_count> gyro_filter_q15(gyro_filter_stages);
+
+/** Cost of the GyroFilter_Apply() calls, 3 axes through every section */
+static Timing_PerfTypeDef gyro_filter_cycles;
+
+#ifdef GYRO_FILTER_BENCH
+/** Two tones and a pseudo random noise, in counts, and the same rounded */
+static float gyro_filter_input[GYRO_FILTER_BENCH_SAMPLES][3];
+static int16_t gyro_filter_counts[GYRO_FILTER_BENCH_SAMPLES][3];
+static volatile float gyro_filter_sink;
+#endif
+
+/* Private functions ---------------------------------------------------------*/
+#if defined(GYRO_FILTER_FIXED) || defined(GYRO_FILTER_BENCH)
+/**
+  * @brief  Round a sample to whole counts, saturated to int16.
+  * @param  gyro Angular rate in counts, X Y Z
+  * @param  counts Rounded rate
+  */
+static void GyroFilter_ToCounts(const float gyro[3], int16_t counts[3])
+{
+  uint32_t a;
+
+  for (a = 0U; a < 3U; a++)
+  {
+    float v = gyro[a];
+
+    v = (v > 32767.0f) ? 32767.0f : ((v < -32768.0f) ? -32768.0f : v);
+    counts[a] = (int16_t)FastMath_Round(v);
+  }
+}
+
+/**
+  * @brief  Filter one sample through the Q15 chain. The loop samples are
+  *         float, out of the decimation and the voter, hence the round
+  *         trip through int16.
+  * @param  gyro Angular rate in counts, X Y Z
+  */
+static void GyroFilter_ApplyFixed(float gyro[3])
+{
+  int16_t counts[3];
+  uint32_t a;
+
+  GyroFilter_ToCounts(gyro, counts);
+  gyro_filter_q15.Apply(counts);
+  for (a = 0U; a < 3U; a++)
+  {
+    gyro[a] = (float)counts[a];
+  }
+}
+#endif
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Clear the filter state and statistics.
+  */
+extern "C" void GyroFilter_Reset(void)
+{
+  gyro_filter.Reset();
+  gyro_filter_q15.Reset();
+  Timing_PerfReset(&gyro_filter_cycles);
+}
+
+/**
+  * @brief  Filter one gyro sample in place.
+  * @param  gyro Angular rate, X Y Z
+  */
+extern "C" void GyroFilter_Apply(float gyro[3])
+{
+  uint32_t start = Timing_Cycles();
+
+#ifdef GYRO_FILTER_FIXED
+  GyroFilter_ApplyFixed(gyro);
+#else
+  gyro_filter.Apply(gyro);
+#endif
+  Timing_PerfAdd(&gyro_filter_cycles, Timing_Cycles() - start);
+}
+
+/**
+  * @brief  Cost statistics of GyroFilter_Apply().
+  * @retval Cycle statistics
+  */
+extern "C" const Timing_PerfTypeDef *GyroFilter_Cycles(void)
+{
+  return &gyro_filter_cycles;
+}
+
+#ifdef GYRO_FILTER_BENCH
+/**
+  * @brief  Run the float and the Q15 chains on the same input, each timed
+  *         on its own, then side by side for the output difference. The
+  *         Q15 bank is timed on input rounded beforehand, then again with
+  *         the conversions of GyroFilter_ApplyFixed(). The filter state is
+  *         cleared afterwards.
+  * @param  result Cycles per 3-axis sample of each chain, and difference
+  */
+extern "C" void GyroFilter_Bench(GyroFilter_BenchTypeDef *result)
+{
+  uint32_t seed = 1U;
+  uint32_t start;
+  uint32_t cycles;
+  uint32_t n;
+  uint32_t a;
+  float value[3];
+  float fixed[3];
+  int16_t counts[3];
+  float worst = 0.0f;
+
+  for (n = 0U; n < GYRO_FILTER_BENCH_SAMPLES; n++)
+  {
+    float t = (float)n / GYRO_FILTER_RATE_HZ;
+
+    for (a = 0U; a < 3U; a++)
+    {
+      seed = (seed * 1664525U) + 1013904223U;
+      gyro_filter_input[n][a] = (2000.0f * FastMath_Sin(6.2831853f * 80.0f * t))
+                                + (300.0f * FastMath_Sin(6.2831853f * 320.0f * t))
+                                + ((float)(int32_t)(seed >> 20) - 2048.0f) * 0.05f;
+    }
+    GyroFilter_ToCounts(gyro_filter_input[n], gyro_filter_counts[n]);
+  }
+
+  GyroFilter_Reset();
+  start = Timing_Cycles();
+  for (n = 0U; n < GYRO_FILTER_BENCH_SAMPLES; n++)
+  {
+    value[0] = gyro_filter_input[n][0];
+    value[1] = gyro_filter_input[n][1];
+    value[2] = gyro_filter_input[n][2];
+    gyro_filter.Apply(value);
+    gyro_filter_sink = value[0];
+  }
+  result->float_cycles = (Timing_Cycles() - start) / GYRO_FILTER_BENCH_SAMPLES;
+
+  start = Timing_Cycles();
+  for (n = 0U; n < GYRO_FILTER_BENCH_SAMPLES; n++)
+  {
+    counts[0] = gyro_filter_counts[n][0];
+    counts[1] = gyro_filter_counts[n][1];
+    counts[2] = gyro_filter_counts[n][2];
+    gyro_filter_q15.Apply(counts);
+    gyro_filter_sink = (float)counts[0];
+  }
+  result->fixed_cycles = (Timing_Cycles() - start) / GYRO_FILTER_BENCH_SAMPLES;
+
+  gyro_filter_q15.Reset();
+  start = Timing_Cycles();
+  for (n = 0U; n < GYRO_FILTER_BENCH_SAMPLES; n++)
+  {
+    value[0] = gyro_filter_input[n][0];
+    value[1] = gyro_filter_input[n][1];
+    value[2] = gyro_filter_input[n][2];
+    GyroFilter_ApplyFixed(value);
+    gyro_filter_sink = value[0];
+  }
+  cycles = (Timing_Cycles() - start) / GYRO_FILTER_BENCH_SAMPLES;
+  result->convert_cycles = (cycles > result->fixed_cycles) ? (cycles - result->fixed_cycles) : 0U;
+
+  GyroFilter_Reset();
+  for (n = 0U; n < GYRO_FILTER_BENCH_SAMPLES; n++)
+  {
+    for (a = 0U; a < 3U; a++)
+    {
+      value[a] = gyro_filter_input[n][a];
+      fixed[a] = value[a];
+    }
+    gyro_filter.Apply(value);
+    GyroFilter_ApplyFixed(fixed);
+    for (a = 0U; a < 3U; a++)
+    {
+      float d = fabsf(value[a] - fixed[a]);
+
+      worst = (d > worst) ? d : worst;
+    }
+  }
+  result->max_difference = worst;
+  GyroFilter_Reset();
+}
+#endif
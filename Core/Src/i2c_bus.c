@@ -0,0 +1,980 @@
+/**
+  ******************************************************************************
+  * @file    i2c_bus.c
+  * @brief   This file provides the asynchronous I2C transaction engine.
+  *
+  *          Jobs are pushed into a per bus ring of pointers. The first job is
+  *          started from the caller and every following one from the
+  *          completion callback of its predecessor, so the CPU only spends
+  *          the ISR time on the bus.
+  *
+  *          A job is two segments of the sequential HAL API: the register
+  *          address is sent with HAL_I2C_Master_Seq_Transmit_DMA() as
+  *          I2C_FIRST_FRAME, then the data is read with a repeated start or
+  *          written straight on as I2C_LAST_FRAME, started from the transmit
+  *          completion interrupt. HAL_I2C_Mem_Read_DMA() and
+  *          HAL_I2C_Mem_Write_DMA() are not used: they poll SB, ADDR and TXE
+  *          through the whole address phase before their DMA starts.
+  *
+  *          A scan list is queued as a single job and runs the same two
+  *          segments per entry without releasing the bus: the register of
+  *          every entry after the first one is sent as I2C_OTHER_FRAME, a
+  *          repeated start that skips the BUSY wait of I2C_FIRST_FRAME, and
+  *          every read is a LAST frame so its final byte is NACKed. Only the
+  *          read of the last entry is I2C_LAST_FRAME and ends with a STOP,
+  *          the others are I2C_LAST_FRAME_NO_STOP. A sweep of N entries
+  *          costs the same 2N segment interrupts as N jobs, but a single
+  *          STOP, bus free time and queue round trip.
+  *
+  *          Queue accesses are protected by raising BASEPRI to
+  *          I2C_BUS_IRQ_PRIORITY for a few instructions: jobs are submitted
+  *          both from the main loop and from completion callbacks of other
+  *          jobs, on either bus. The mask only covers the queue and the active
+  *          job, never a HAL call: the context that claims the bus starts the
+  *          transfer with interrupts enabled. The data-ready EXTI, above
+  *          I2C_BUS_IRQ_PRIORITY, is never held back by the engine, and the
+  *          I2C2 interrupts below the I2C1 ones never hold the IMU bus back.
+  *
+  *          Bus faults never reach Error_Handler(). Acknowledge failures only
+  *          fail the job. Bus errors, arbitration loss, overruns, DMA errors
+  *          and timeouts fail the job and start a recovery that is advanced
+  *          one step per I2C_Bus_Poll() call: the peripheral is released, SCL
+  *          is clocked as a GPIO until the slave releases SDA (at most
+  *          I2C_BUS_RECOVERY_PULSES pulses), a STOP is generated by hand and
+  *          the peripheral is initialized again. Each step only waits for its
+  *          half period to elapse between calls, so a recovery costs about
+  *          (2 * I2C_BUS_RECOVERY_PULSES + 2) * I2C_BUS_RECOVERY_HALF_PERIOD_US
+  *          microseconds of bus time and never blocks the caller. Queued
+  *          jobs are kept and resumed afterwards. A slave holding SDA low
+  *          keeps BUSY set: the job start gives up after
+  *          I2C_BUS_BUSY_WAIT_US, leaves the job queued, and the stall
+  *          becomes a recovery after I2C_BUS_TIMEOUT_BASE_US.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "i2c_bus.h"
+
+/* Private define ------------------------------------------------------------*/
+#define I2C_BUS_QUEUE_MASK    (I2C_BUS_QUEUE_LEN - 1U)
+
+#if (I2C_BUS_QUEUE_LEN & I2C_BUS_QUEUE_MASK) != 0U
+#error "I2C_BUS_QUEUE_LEN must be a power of two"
+#endif
+
+/** Longest wait for the previous STOP to free the bus before a job start */
+#define I2C_BUS_BUSY_WAIT_US  10U
+
+/** Errors that leave the bus in an unknown state and need a recovery */
+#define I2C_BUS_FATAL_ERRORS  (HAL_I2C_ERROR_BERR | HAL_I2C_ERROR_ARLO | HAL_I2C_ERROR_OVR | \
+                               HAL_I2C_ERROR_DMA | HAL_I2C_ERROR_TIMEOUT)
+
+/* Private variables ---------------------------------------------------------*/
+I2C_BusTypeDef i2c_bus1;
+I2C_BusTypeDef i2c_bus2;
+
+static I2C_BusTypeDef *i2c_buses[I2C_BUS_MAX];
+
+/* Private function prototypes -----------------------------------------------*/
+static void I2C_Bus_StartNext(I2C_BusTypeDef *bus);
+static HAL_StatusTypeDef I2C_Bus_Step(I2C_BusTypeDef *bus, I2C_JobTypeDef *job);
+static void I2C_Bus_Finish(I2C_BusTypeDef *bus, I2C_JobStateTypeDef state, uint32_t error);
+static void I2C_Bus_Complete(I2C_BusTypeDef *bus, I2C_JobTypeDef *job, I2C_JobStateTypeDef state,
+                             uint32_t error);
+static void I2C_Bus_Fail(I2C_BusTypeDef *bus, uint32_t error);
+static void I2C_Bus_TransferDone(I2C_BusTypeDef *bus);
+static uint8_t I2C_Bus_Advance(I2C_JobTypeDef *job);
+static HAL_StatusTypeDef I2C_Scan_Step(I2C_BusTypeDef *bus, I2C_ScanTypeDef *scan);
+static uint8_t I2C_Bus_WaitFree(I2C_BusTypeDef *bus);
+static void I2C_Bus_CountErrors(I2C_BusTypeDef *bus, uint32_t error);
+static void I2C_Bus_BeginRecovery(I2C_BusTypeDef *bus);
+static void I2C_Bus_CheckTimeout(I2C_BusTypeDef *bus, uint32_t now);
+static void I2C_Bus_ReleasePins(I2C_BusTypeDef *bus);
+static HAL_StatusTypeDef I2C_Bus_Fill(I2C_BusTypeDef *bus, I2C_JobTypeDef *job, uint8_t address, uint16_t reg,
+                                      uint8_t reg_size, I2C_JobOpTypeDef op, uint8_t *data, uint16_t size,
+                                      I2C_JobCallbackTypeDef callback, void *context);
+
+/* Private functions ---------------------------------------------------------*/
+static inline uint32_t I2C_Bus_Lock(void)
+{
+  uint32_t basepri = __get_BASEPRI();
+  __set_BASEPRI_MAX(I2C_BUS_IRQ_PRIORITY << (8U - __NVIC_PRIO_BITS));
+  return basepri;
+}
+
+static inline void I2C_Bus_Unlock(uint32_t basepri)
+{
+  __set_BASEPRI(basepri);
+}
+
+/**
+  * @brief  Start queued jobs until one is accepted by the HAL or the queue is
+  *         empty. Jobs the HAL refuses to start are completed in error.
+  * @param  bus Bus to service
+  */
+static void I2C_Bus_StartNext(I2C_BusTypeDef *bus)
+{
+  while ((bus->active == NULL) && (bus->head != bus->tail) && (bus->recovery == I2C_RECOVERY_IDLE))
+  {
+    I2C_JobTypeDef *job;
+    uint32_t basepri;
+
+    if (I2C_Bus_WaitFree(bus) == 0U)
+    {
+      /* Left queued, I2C_Bus_Poll() retries and declares the bus stuck */
+      return;
+    }
+
+    /* Claim the bus: a context that preempted this one may have done it */
+    basepri = I2C_Bus_Lock();
+    if ((bus->active != NULL) || (bus->head == bus->tail) || (bus->recovery != I2C_RECOVERY_IDLE))
+    {
+      I2C_Bus_Unlock(basepri);
+      return;
+    }
+    job = bus->queue[bus->head & I2C_BUS_QUEUE_MASK];
+    bus->head++;
+    bus->active = job;
+    job->state = I2C_JOB_ACTIVE;
+    job->start_cycles = Timing_Cycles();
+    I2C_Bus_Unlock(basepri);
+
+    job->phase = 0U;
+    if (I2C_Bus_Step(bus, job) != HAL_OK)
+    {
+      I2C_Bus_Fail(bus, bus->hi2c->ErrorCode);
+    }
+  }
+}
+
+/**
+  * @brief  Start the current segment of a job. None of them waits on the bus:
+  *         the HAL only sets START or DMAEN and returns.
+  * @param  bus Bus owning the job
+  * @param  job Active job
+  * @retval HAL status of the segment start
+  */
+static HAL_StatusTypeDef I2C_Bus_Step(I2C_BusTypeDef *bus, I2C_JobTypeDef *job)
+{
+  uint16_t address = (uint16_t)(job->address << 1);
+  uint16_t count = 1U;
+
+  if (job->op == I2C_JOB_SCAN)
+  {
+    return I2C_Scan_Step(bus, (I2C_ScanTypeDef *)job);
+  }
+  if (job->phase == 0U)
+  {
+    if (job->reg_size == I2C_MEMADD_SIZE_16BIT)
+    {
+      job->header[0] = (uint8_t)(job->reg >> 8);
+      job->header[1] = (uint8_t)job->reg;
+      count = 2U;
+    }
+    else
+    {
+      job->header[0] = (uint8_t)job->reg;
+    }
+    return HAL_I2C_Master_Seq_Transmit_DMA(bus->hi2c, address, job->header, count,
+                                           (job->op == I2C_JOB_COMMAND) ? I2C_FIRST_AND_LAST_FRAME
+                                                                        : I2C_FIRST_FRAME);
+  }
+
+  if (job->op == I2C_JOB_READ)
+  {
+    /* Repeated start, the last byte is NACKed before the STOP */
+    return HAL_I2C_Master_Seq_Receive_DMA(bus->hi2c, address, job->data, job->size, I2C_LAST_FRAME);
+  }
+  /* Same direction, the data follows the address without a new start */
+  return HAL_I2C_Master_Seq_Transmit_DMA(bus->hi2c, address, job->data, job->size, I2C_LAST_FRAME);
+}
+
+/**
+  * @brief  Start the current segment of a scan: the register of the entry,
+  *         then its data.
+  * @param  bus Bus owning the scan
+  * @param  scan Active scan
+  * @retval HAL status of the segment start
+  */
+static HAL_StatusTypeDef I2C_Scan_Step(I2C_BusTypeDef *bus, I2C_ScanTypeDef *scan)
+{
+  uint32_t index = (uint32_t)scan->job.phase >> 1;
+  const I2C_ScanEntryTypeDef *entry = &scan->entries[index];
+  uint16_t address = (uint16_t)(entry->address << 1);
+
+  if ((scan->job.phase & 1U) == 0U)
+  {
+    /* The bus is still held after the previous entry: a repeated start */
+    scan->job.header[0] = entry->reg;
+    return HAL_I2C_Master_Seq_Transmit_DMA(bus->hi2c, address, scan->job.header, 1U,
+                                           (index == 0U) ? I2C_FIRST_FRAME : I2C_OTHER_FRAME);
+  }
+  /* Last byte NACKed so the slave releases SDA, STOP after the last entry */
+  return HAL_I2C_Master_Seq_Receive_DMA(bus->hi2c, address, entry->data, entry->size,
+                                        ((index + 1U) == scan->count) ? I2C_LAST_FRAME
+                                                                       : I2C_LAST_FRAME_NO_STOP);
+}
+
+/**
+  * @brief  Give the STOP of the previous transfer a few microseconds to free
+  *         the bus. A first frame makes the HAL wait for BUSY, and so does
+  *         any frame while CR1.STOP is pending, in a loop of up to 25 ms
+  *         counted in instructions: it is only entered once this DWT bounded
+  *         wait has seen both clear, and so exits at its first test.
+  * @param  bus Bus about to start a job
+  * @retval 1 when the bus is free, 0 when it is still busy
+  */
+static uint8_t I2C_Bus_WaitFree(I2C_BusTypeDef *bus)
+{
+  uint32_t start = Timing_Cycles();
+  uint32_t limit = Timing_UsToCycles(I2C_BUS_BUSY_WAIT_US);
+
+  while ((__HAL_I2C_GET_FLAG(bus->hi2c, I2C_FLAG_BUSY) != RESET) ||
+         (READ_BIT(bus->hi2c->Instance->CR1, I2C_CR1_STOP) != 0U))
+  {
+    if ((Timing_Cycles() - start) > limit)
+    {
+      if (bus->stall_start == 0U)
+      {
+        bus->stall_start = start | 1U;
+      }
+      return 0U;
+    }
+  }
+  bus->stall_start = 0U;
+  return 1U;
+}
+
+/**
+  * @brief  Account for the error classes held in a HAL error code.
+  * @param  bus Bus reporting the error
+  * @param  error HAL_I2C_ERROR_xxx bit field
+  */
+static void I2C_Bus_CountErrors(I2C_BusTypeDef *bus, uint32_t error)
+{
+  if ((error & HAL_I2C_ERROR_BERR) != 0U)
+  {
+    bus->errors.berr++;
+  }
+  if ((error & HAL_I2C_ERROR_ARLO) != 0U)
+  {
+    bus->errors.arlo++;
+  }
+  if ((error & HAL_I2C_ERROR_AF) != 0U)
+  {
+    bus->errors.af++;
+  }
+  if ((error & HAL_I2C_ERROR_OVR) != 0U)
+  {
+    bus->errors.ovr++;
+  }
+  if ((error & HAL_I2C_ERROR_DMA) != 0U)
+  {
+    bus->errors.dma++;
+  }
+  if ((error & HAL_I2C_ERROR_TIMEOUT) != 0U)
+  {
+    bus->errors.timeout++;
+  }
+}
+
+/**
+  * @brief  Stop starting jobs and hand the bus to the recovery state machine.
+  * @param  bus Faulty bus
+  */
+static void I2C_Bus_BeginRecovery(I2C_BusTypeDef *bus)
+{
+  if (bus->recovery == I2C_RECOVERY_IDLE)
+  {
+    bus->recovery_start = Timing_Cycles();
+    bus->recovery = I2C_RECOVERY_PENDING;
+  }
+}
+
+/**
+  * @brief  Fail the active job when it overstays its time budget, or the bus
+  *         when it stays busy with nothing running.
+  * @param  bus Bus to watch
+  * @param  now Current DWT stamp
+  */
+static void I2C_Bus_CheckTimeout(I2C_BusTypeDef *bus, uint32_t now)
+{
+  uint32_t basepri = I2C_Bus_Lock();
+  I2C_JobTypeDef *job = bus->active;
+
+  if (job != NULL)
+  {
+    uint32_t limit = Timing_UsToCycles(I2C_BUS_TIMEOUT_BASE_US + (I2C_BUS_TIMEOUT_BYTE_US * job->size));
+
+    if ((now - job->start_cycles) <= limit)
+    {
+      I2C_Bus_Unlock(basepri);
+      return;
+    }
+    /* Taken from the completion interrupt, which now finds no job */
+    bus->active = NULL;
+    I2C_Bus_BeginRecovery(bus);
+    I2C_Bus_Unlock(basepri);
+    bus->errors.timeout++;
+    I2C_Bus_Complete(bus, job, I2C_JOB_ERROR, HAL_I2C_ERROR_TIMEOUT);
+    return;
+  }
+  I2C_Bus_Unlock(basepri);
+
+  if (bus->head != bus->tail)
+  {
+    I2C_Bus_StartNext(bus);
+    if ((bus->active == NULL) && (bus->stall_start != 0U) &&
+        ((now - bus->stall_start) > Timing_UsToCycles(I2C_BUS_TIMEOUT_BASE_US)))
+    {
+      bus->errors.timeout++;
+      bus->stall_start = 0U;
+      I2C_Bus_BeginRecovery(bus);
+    }
+  }
+}
+
+/**
+  * @brief  Release the peripheral and drive SCL/SDA as open-drain GPIOs.
+  * @param  bus Bus to clear
+  */
+static void I2C_Bus_ReleasePins(I2C_BusTypeDef *bus)
+{
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+  /* Stops the DMA streams and masks the I2C interrupts through MspDeInit */
+  (void)HAL_I2C_DeInit(bus->hi2c);
+
+  HAL_GPIO_WritePin(bus->scl_port, bus->scl_pin, GPIO_PIN_SET);
+  HAL_GPIO_WritePin(bus->sda_port, bus->sda_pin, GPIO_PIN_SET);
+  GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_OD;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+  GPIO_InitStruct.Pin = bus->scl_pin;
+  HAL_GPIO_Init(bus->scl_port, &GPIO_InitStruct);
+  GPIO_InitStruct.Pin = bus->sda_pin;
+  HAL_GPIO_Init(bus->sda_port, &GPIO_InitStruct);
+}
+
+/**
+  * @brief  Complete the active job, account for it and notify its owner.
+  * @param  bus Bus owning the job
+  * @param  state Final state of the job
+  * @param  error HAL error code reported with I2C_JOB_ERROR
+  */
+static void I2C_Bus_Finish(I2C_BusTypeDef *bus, I2C_JobStateTypeDef state, uint32_t error)
+{
+  uint32_t basepri = I2C_Bus_Lock();
+  I2C_JobTypeDef *job = bus->active;
+
+  bus->active = NULL;
+  I2C_Bus_Unlock(basepri);
+
+  if (job != NULL)
+  {
+    I2C_Bus_Complete(bus, job, state, error);
+  }
+}
+
+/**
+  * @brief  Account for a job taken off the bus and notify its owner.
+  * @param  bus Bus that ran the job
+  * @param  job Job, no longer active
+  * @param  state Final state of the job
+  * @param  error HAL error code reported with I2C_JOB_ERROR
+  */
+static void I2C_Bus_Complete(I2C_BusTypeDef *bus, I2C_JobTypeDef *job, I2C_JobStateTypeDef state,
+                             uint32_t error)
+{
+  job->cycles = Timing_Cycles() - job->start_cycles;
+  job->error = error;
+  bus->stats.busy_cycles += job->cycles;
+  Timing_PerfAdd(&bus->stats.job_cycles, job->cycles);
+  if (state == I2C_JOB_DONE)
+  {
+    bus->stats.completed++;
+  }
+  else
+  {
+    bus->stats.failed++;
+  }
+
+  if (job->op == I2C_JOB_SCAN)
+  {
+    I2C_ScanTypeDef *scan = (I2C_ScanTypeDef *)job;
+
+    if (state == I2C_JOB_DONE)
+    {
+      scan->stats.sweeps++;
+      Timing_PerfAdd(&scan->stats.sweep_cycles, job->cycles);
+    }
+    else
+    {
+      scan->stats.failed++;
+    }
+  }
+
+  job->state = state;
+  if (job->callback != NULL)
+  {
+    job->callback(job);
+  }
+}
+
+/**
+  * @brief  Fail the active job. The recovery is started first, so a job the
+  *         callback submits again waits for the bus to be cleared.
+  * @param  bus Bus owning the job
+  * @param  error HAL_I2C_ERROR_xxx bit field
+  */
+static void I2C_Bus_Fail(I2C_BusTypeDef *bus, uint32_t error)
+{
+  I2C_Bus_CountErrors(bus, error);
+  if ((error & I2C_BUS_FATAL_ERRORS) != 0U)
+  {
+    I2C_Bus_BeginRecovery(bus);
+  }
+  I2C_Bus_Finish(bus, I2C_JOB_ERROR, error);
+}
+
+/**
+  * @brief  The active segment completed: start the next segment of the job,
+  *         or complete the job and start the next one.
+  * @param  bus Bus owning the transfer
+  */
+static void I2C_Bus_TransferDone(I2C_BusTypeDef *bus)
+{
+  I2C_JobTypeDef *job = bus->active;
+
+  if ((job != NULL) && (I2C_Bus_Advance(job) != 0U))
+  {
+    if (I2C_Bus_Step(bus, job) == HAL_OK)
+    {
+      return;
+    }
+    I2C_Bus_Fail(bus, bus->hi2c->ErrorCode);
+  }
+  else
+  {
+    I2C_Bus_Finish(bus, I2C_JOB_DONE, HAL_I2C_ERROR_NONE);
+  }
+  I2C_Bus_StartNext(bus);
+}
+
+/**
+  * @brief  Move the active job to its next segment.
+  * @param  job Active job
+  * @retval 1 when a segment remains to be started, 0 when the job is over
+  */
+static uint8_t I2C_Bus_Advance(I2C_JobTypeDef *job)
+{
+  if (job->op == I2C_JOB_SCAN)
+  {
+    job->phase++;
+    return (uint8_t)(((uint32_t)job->phase >> 1) < ((I2C_ScanTypeDef *)job)->count);
+  }
+  if ((job->phase == 0U) && (job->op != I2C_JOB_COMMAND))
+  {
+    job->phase = 1U;
+    return 1U;
+  }
+  return 0U;
+}
+
+/**
+  * @brief  Fill a register job and submit it.
+  * @param  bus Bus to run the job on
+  * @param  job Job storage, not already pending
+  * @param  address 7-bit device address
+  * @param  reg First register, or command byte
+  * @param  reg_size I2C_MEMADD_SIZE_8BIT or I2C_MEMADD_SIZE_16BIT
+  * @param  op Operation
+  * @param  data Data buffer
+  * @param  size Number of data bytes
+  * @param  callback Completion callback, may be NULL
+  * @param  context Stored in the job for the callback
+  * @retval See I2C_Bus_Submit()
+  */
+static HAL_StatusTypeDef I2C_Bus_Fill(I2C_BusTypeDef *bus, I2C_JobTypeDef *job, uint8_t address, uint16_t reg,
+                                      uint8_t reg_size, I2C_JobOpTypeDef op, uint8_t *data, uint16_t size,
+                                      I2C_JobCallbackTypeDef callback, void *context)
+{
+  if (I2C_Job_IsPending(job))
+  {
+    return HAL_BUSY;
+  }
+
+  job->address = address;
+  job->reg = reg;
+  job->reg_size = reg_size;
+  job->op = (uint8_t)op;
+  job->data = data;
+  job->size = size;
+  job->callback = callback;
+  job->context = context;
+  return I2C_Bus_Submit(bus, job);
+}
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Attach a transaction engine to an initialized HAL I2C handle.
+  * @param  bus Bus to initialize
+  * @param  hi2c HAL handle, its DMA streams and IRQs must be configured
+  */
+void I2C_Bus_Init(I2C_BusTypeDef *bus, I2C_HandleTypeDef *hi2c)
+{
+  uint32_t i;
+
+  bus->hi2c = hi2c;
+  bus->head = 0U;
+  bus->tail = 0U;
+  bus->active = NULL;
+  bus->stall_start = 0U;
+  bus->scl_port = NULL;
+  bus->sda_port = NULL;
+  bus->recovery = I2C_RECOVERY_IDLE;
+  I2C_Bus_ResetStats(bus);
+
+  for (i = 0U; i < I2C_BUS_MAX; i++)
+  {
+    if ((i2c_buses[i] == NULL) || (i2c_buses[i] == bus))
+    {
+      i2c_buses[i] = bus;
+      break;
+    }
+  }
+}
+
+/**
+  * @brief  Give the engine the pins of a bus so that a slave holding SDA low
+  *         can be clocked out. Without pins, a recovery only re-initializes
+  *         the peripheral.
+  * @param  bus Bus to configure
+  * @param  scl_port SCL GPIO port
+  * @param  scl_pin SCL GPIO pin
+  * @param  sda_port SDA GPIO port
+  * @param  sda_pin SDA GPIO pin
+  */
+void I2C_Bus_SetRecoveryPins(I2C_BusTypeDef *bus, GPIO_TypeDef *scl_port, uint16_t scl_pin,
+                             GPIO_TypeDef *sda_port, uint16_t sda_pin)
+{
+  bus->scl_port = scl_port;
+  bus->scl_pin = scl_pin;
+  bus->sda_port = sda_port;
+  bus->sda_pin = sda_pin;
+}
+
+/**
+  * @brief  Watch the bus for timeouts and advance a pending recovery by one
+  *         step. Call from the main loop; it never waits.
+  * @param  bus Bus to service
+  */
+void I2C_Bus_Poll(I2C_BusTypeDef *bus)
+{
+  uint32_t now = Timing_Cycles();
+  uint32_t half_period = Timing_UsToCycles(I2C_BUS_RECOVERY_HALF_PERIOD_US);
+
+  switch (bus->recovery)
+  {
+    case I2C_RECOVERY_IDLE:
+      I2C_Bus_CheckTimeout(bus, now);
+      break;
+
+    case I2C_RECOVERY_PENDING:
+      if (bus->scl_port == NULL)
+      {
+        (void)HAL_I2C_DeInit(bus->hi2c);
+        bus->recovery = I2C_RECOVERY_REINIT;
+        break;
+      }
+      I2C_Bus_ReleasePins(bus);
+      if (HAL_GPIO_ReadPin(bus->sda_port, bus->sda_pin) == GPIO_PIN_RESET)
+      {
+        bus->errors.stuck_slaves++;
+      }
+      bus->recovery_edges = 0U;
+      bus->recovery_stamp = now;
+      bus->recovery = I2C_RECOVERY_CLOCKING;
+      break;
+
+    case I2C_RECOVERY_CLOCKING:
+      if ((now - bus->recovery_stamp) < half_period)
+      {
+        break;
+      }
+      bus->recovery_stamp = now;
+      if ((bus->recovery_edges & 1U) == 0U)
+      {
+        if (HAL_GPIO_ReadPin(bus->sda_port, bus->sda_pin) == GPIO_PIN_SET)
+        {
+          /* SDA released with SCL high, the slave is out of its byte */
+          bus->recovery_edges = 0U;
+          bus->recovery = I2C_RECOVERY_STOP;
+          break;
+        }
+        if (bus->recovery_edges >= (2U * I2C_BUS_RECOVERY_PULSES))
+        {
+          bus->recovery_edges = 0U;
+          bus->recovery = I2C_RECOVERY_STOP;
+          break;
+        }
+        HAL_GPIO_WritePin(bus->scl_port, bus->scl_pin, GPIO_PIN_RESET);
+      }
+      else
+      {
+        HAL_GPIO_WritePin(bus->scl_port, bus->scl_pin, GPIO_PIN_SET);
+      }
+      bus->recovery_edges++;
+      break;
+
+    case I2C_RECOVERY_STOP:
+      if ((now - bus->recovery_stamp) < half_period)
+      {
+        break;
+      }
+      bus->recovery_stamp = now;
+      if (bus->recovery_edges == 0U)
+      {
+        /* SDA falling with SCL high, then rising: START followed by STOP */
+        HAL_GPIO_WritePin(bus->sda_port, bus->sda_pin, GPIO_PIN_RESET);
+        bus->recovery_edges++;
+      }
+      else
+      {
+        HAL_GPIO_WritePin(bus->sda_port, bus->sda_pin, GPIO_PIN_SET);
+        bus->recovery = I2C_RECOVERY_REINIT;
+      }
+      break;
+
+    case I2C_RECOVERY_REINIT:
+      /* HAL_I2C_MspInit() maps the pins back to the I2C alternate function */
+      if (HAL_I2C_Init(bus->hi2c) != HAL_OK)
+      {
+        bus->errors.reinit_failures++;
+        bus->recovery = I2C_RECOVERY_PENDING;
+        break;
+      }
+      bus->errors.recoveries++;
+      Timing_PerfAdd(&bus->errors.recovery_cycles, now - bus->recovery_start);
+      bus->stall_start = 0U;
+      bus->recovery = I2C_RECOVERY_IDLE;
+      I2C_Bus_StartNext(bus);
+      break;
+
+    default:
+      bus->recovery = I2C_RECOVERY_PENDING;
+      break;
+  }
+}
+
+/**
+  * @brief  Queue a job on a bus, the transfer starts at once when the bus is
+  *         idle.
+  * @param  bus Bus to run the job on
+  * @param  job Filled job, not already pending
+  * @retval HAL_OK when queued, HAL_BUSY when the job is already pending or the
+  *         queue is full
+  */
+HAL_StatusTypeDef I2C_Bus_Submit(I2C_BusTypeDef *bus, I2C_JobTypeDef *job)
+{
+  uint32_t basepri = I2C_Bus_Lock();
+  uint32_t pending;
+
+  if (I2C_Job_IsPending(job))
+  {
+    I2C_Bus_Unlock(basepri);
+    return HAL_BUSY;
+  }
+
+  pending = bus->tail - bus->head;
+  if (pending >= I2C_BUS_QUEUE_LEN)
+  {
+    bus->stats.rejected++;
+    I2C_Bus_Unlock(basepri);
+    return HAL_BUSY;
+  }
+
+  job->state = I2C_JOB_QUEUED;
+  job->error = HAL_I2C_ERROR_NONE;
+  bus->queue[bus->tail & I2C_BUS_QUEUE_MASK] = job;
+  bus->tail++;
+  bus->stats.submitted++;
+  if ((pending + 1U) > bus->stats.queue_peak)
+  {
+    bus->stats.queue_peak = pending + 1U;
+  }
+
+  I2C_Bus_Unlock(basepri);
+
+  I2C_Bus_StartNext(bus);
+  return HAL_OK;
+}
+
+/**
+  * @brief  Fill a job with a register read and submit it.
+  * @param  bus Bus to run the job on
+  * @param  job Job storage, not already pending
+  * @param  address 7-bit device address
+  * @param  reg First register to read
+  * @param  data Destination buffer
+  * @param  size Number of bytes to read
+  * @param  callback Completion callback, may be NULL
+  * @param  context Stored in the job for the callback
+  * @retval See I2C_Bus_Submit()
+  */
+HAL_StatusTypeDef I2C_Bus_Read(I2C_BusTypeDef *bus, I2C_JobTypeDef *job, uint8_t address, uint8_t reg,
+                               uint8_t *data, uint16_t size, I2C_JobCallbackTypeDef callback, void *context)
+{
+  return I2C_Bus_Fill(bus, job, address, reg, I2C_MEMADD_SIZE_8BIT, I2C_JOB_READ, data, size, callback, context);
+}
+
+/**
+  * @brief  Fill a job with a register write and submit it.
+  * @param  bus Bus to run the job on
+  * @param  job Job storage, not already pending
+  * @param  address 7-bit device address
+  * @param  reg First register to write
+  * @param  data Source buffer, must stay valid until the job completes
+  * @param  size Number of bytes to write
+  * @param  callback Completion callback, may be NULL
+  * @param  context Stored in the job for the callback
+  * @retval See I2C_Bus_Submit()
+  */
+HAL_StatusTypeDef I2C_Bus_Write(I2C_BusTypeDef *bus, I2C_JobTypeDef *job, uint8_t address, uint8_t reg,
+                                uint8_t *data, uint16_t size, I2C_JobCallbackTypeDef callback, void *context)
+{
+  return I2C_Bus_Fill(bus, job, address, reg, I2C_MEMADD_SIZE_8BIT, I2C_JOB_WRITE, data, size, callback, context);
+}
+
+/**
+  * @brief  Register read on a device with 16-bit register addresses.
+  * @param  bus Bus to run the job on
+  * @param  job Job storage, not already pending
+  * @param  address 7-bit device address
+  * @param  reg First register to read, sent MSB first
+  * @param  data Destination buffer
+  * @param  size Number of bytes to read
+  * @param  callback Completion callback, may be NULL
+  * @param  context Stored in the job for the callback
+  * @retval See I2C_Bus_Submit()
+  */
+HAL_StatusTypeDef I2C_Bus_Read16(I2C_BusTypeDef *bus, I2C_JobTypeDef *job, uint8_t address, uint16_t reg,
+                                 uint8_t *data, uint16_t size, I2C_JobCallbackTypeDef callback, void *context)
+{
+  return I2C_Bus_Fill(bus, job, address, reg, I2C_MEMADD_SIZE_16BIT, I2C_JOB_READ, data, size, callback, context);
+}
+
+/**
+  * @brief  Register write on a device with 16-bit register addresses.
+  * @param  bus Bus to run the job on
+  * @param  job Job storage, not already pending
+  * @param  address 7-bit device address
+  * @param  reg First register to write, sent MSB first
+  * @param  data Source buffer, must stay valid until the job completes
+  * @param  size Number of bytes to write
+  * @param  callback Completion callback, may be NULL
+  * @param  context Stored in the job for the callback
+  * @retval See I2C_Bus_Submit()
+  */
+HAL_StatusTypeDef I2C_Bus_Write16(I2C_BusTypeDef *bus, I2C_JobTypeDef *job, uint8_t address, uint16_t reg,
+                                  uint8_t *data, uint16_t size, I2C_JobCallbackTypeDef callback, void *context)
+{
+  return I2C_Bus_Fill(bus, job, address, reg, I2C_MEMADD_SIZE_16BIT, I2C_JOB_WRITE, data, size, callback, context);
+}
+
+/**
+  * @brief  Fill a job with a single command byte and submit it, for devices
+  *         driven by commands instead of registers (MS5611).
+  * @param  bus Bus to run the job on
+  * @param  job Job storage, not already pending and not in CCMRAM
+  * @param  address 7-bit device address
+  * @param  command Byte to send
+  * @param  callback Completion callback, may be NULL
+  * @param  context Stored in the job for the callback
+  * @retval See I2C_Bus_Submit()
+  */
+HAL_StatusTypeDef I2C_Bus_Command(I2C_BusTypeDef *bus, I2C_JobTypeDef *job, uint8_t address, uint8_t command,
+                                  I2C_JobCallbackTypeDef callback, void *context)
+{
+  return I2C_Bus_Fill(bus, job, address, command, I2C_MEMADD_SIZE_8BIT, I2C_JOB_COMMAND, NULL, 0U, callback, context);
+}
+
+/**
+  * @brief  Prepare a scan list. The table is not copied and must outlive the
+  *         scan; its entries may be changed while the scan is not pending.
+  * @param  scan Scan to initialize, not in CCMRAM
+  * @param  entries Table of register reads
+  * @param  count Number of entries in the table, at most I2C_SCAN_MAX_ENTRIES
+  * @param  callback Called once per sweep, may be NULL
+  * @param  context Stored in the embedded job for the callback
+  */
+void I2C_Scan_Init(I2C_ScanTypeDef *scan, const I2C_ScanEntryTypeDef *entries, uint8_t count,
+                   I2C_JobCallbackTypeDef callback, void *context)
+{
+  scan->job.address = (count > 0U) ? entries[0].address : 0U;
+  scan->job.reg = 0U;
+  scan->job.reg_size = I2C_MEMADD_SIZE_8BIT;
+  scan->job.op = I2C_JOB_SCAN;
+  scan->job.size = 0U;
+  scan->job.data = NULL;
+  scan->job.callback = callback;
+  scan->job.context = context;
+  scan->job.state = I2C_JOB_IDLE;
+  scan->entries = entries;
+  scan->count = count;
+  scan->stats.sweeps = 0U;
+  scan->stats.failed = 0U;
+  Timing_PerfReset(&scan->stats.sweep_cycles);
+}
+
+/**
+  * @brief  Queue one sweep of a scan list.
+  * @param  bus Bus to run the sweep on
+  * @param  scan Initialized scan, not already pending
+  * @retval HAL_ERROR for an empty or oversized table, otherwise see
+  *         I2C_Bus_Submit()
+  */
+HAL_StatusTypeDef I2C_Bus_SubmitScan(I2C_BusTypeDef *bus, I2C_ScanTypeDef *scan)
+{
+  uint16_t size = 0U;
+  uint8_t i;
+
+  if ((scan->count == 0U) || (scan->count > I2C_SCAN_MAX_ENTRIES))
+  {
+    return HAL_ERROR;
+  }
+  if (I2C_Job_IsPending(&scan->job))
+  {
+    return HAL_BUSY;
+  }
+  for (i = 0U; i < scan->count; i++)
+  {
+    /* Register byte plus data, sizes the timeout of the sweep */
+    size += scan->entries[i].size + 1U;
+  }
+  scan->job.size = size;
+  return I2C_Bus_Submit(bus, &scan->job);
+}
+
+/**
+  * @brief  Number of jobs queued or running on a bus.
+  * @param  bus Bus to inspect
+  * @retval Pending job count
+  */
+uint32_t I2C_Bus_Pending(const I2C_BusTypeDef *bus)
+{
+  return (bus->tail - bus->head) + ((bus->active != NULL) ? 1U : 0U);
+}
+
+/**
+  * @brief  Bus occupancy since the previous call.
+  * @note   Must be called at least every 2^32 core cycles (25 s at 168 MHz).
+  * @param  bus Bus to inspect
+  * @retval Busy time in per mille of the elapsed time
+  */
+uint32_t I2C_Bus_Utilization(I2C_BusTypeDef *bus)
+{
+  uint32_t now = Timing_Cycles();
+  uint32_t busy = (uint32_t)bus->stats.busy_cycles;
+  uint32_t elapsed = now - bus->util_stamp;
+  uint32_t busy_delta = busy - bus->util_busy_cycles;
+
+  bus->util_stamp = now;
+  bus->util_busy_cycles = busy;
+  if (elapsed == 0U)
+  {
+    return 0U;
+  }
+  return (uint32_t)(((uint64_t)busy_delta * 1000U) / elapsed);
+}
+
+/**
+  * @brief  Clear the statistics of a bus.
+  * @param  bus Bus to reset
+  */
+void I2C_Bus_ResetStats(I2C_BusTypeDef *bus)
+{
+  bus->stats.submitted = 0U;
+  bus->stats.completed = 0U;
+  bus->stats.failed = 0U;
+  bus->stats.rejected = 0U;
+  bus->stats.queue_peak = 0U;
+  bus->stats.busy_cycles = 0U;
+  Timing_PerfReset(&bus->stats.job_cycles);
+  bus->util_busy_cycles = 0U;
+  bus->util_stamp = Timing_Cycles();
+  bus->errors.berr = 0U;
+  bus->errors.arlo = 0U;
+  bus->errors.af = 0U;
+  bus->errors.ovr = 0U;
+  bus->errors.dma = 0U;
+  bus->errors.timeout = 0U;
+  bus->errors.recoveries = 0U;
+  bus->errors.stuck_slaves = 0U;
+  bus->errors.reinit_failures = 0U;
+  Timing_PerfReset(&bus->errors.recovery_cycles);
+}
+
+/**
+  * @brief  Find the bus driven by a HAL handle.
+  * @param  hi2c HAL handle
+  * @retval Registered bus, NULL if the handle is not managed by the engine
+  */
+I2C_BusTypeDef *I2C_Bus_FromHandle(const I2C_HandleTypeDef *hi2c)
+{
+  uint32_t i;
+
+  for (i = 0U; i < I2C_BUS_MAX; i++)
+  {
+    if ((i2c_buses[i] != NULL) && (i2c_buses[i]->hi2c == hi2c))
+    {
+      return i2c_buses[i];
+    }
+  }
+  return NULL;
+}
+
+/* HAL callbacks -------------------------------------------------------------*/
+/**
+  * @brief  Register address or data written.
+  * @param  hi2c HAL handle
+  */
+void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+  I2C_BusTypeDef *bus = I2C_Bus_FromHandle(hi2c);
+
+  if (bus != NULL)
+  {
+    I2C_Bus_TransferDone(bus);
+  }
+}
+
+/**
+  * @brief  Data read.
+  * @param  hi2c HAL handle
+  */
+void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+  I2C_BusTypeDef *bus = I2C_Bus_FromHandle(hi2c);
+
+  if (bus != NULL)
+  {
+    I2C_Bus_TransferDone(bus);
+  }
+}
+
+/**
+  * @brief  Transfer error, the active job is failed. The queue goes on after
+  *         a NACK and waits for a bus recovery after any other error.
+  * @param  hi2c HAL handle
+  */
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+  I2C_BusTypeDef *bus = I2C_Bus_FromHandle(hi2c);
+  uint32_t error = hi2c->ErrorCode;
+
+  if (bus != NULL)
+  {
+    I2C_Bus_Fail(bus, error);
+    I2C_Bus_StartNext(bus);
+  }
+}
@@ -0,0 +1,26 @@
+/**
+  ******************************************************************************
+  * @file    imu.c
+  * @brief   This file provides the IMU sample conversions.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "imu.h"
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Convert a raw sample of an IMU already running at the loop rate.
+  * @param  sample Raw sample
+  * @param  loop Destination
+  */
+void IMU_ToLoop(const IMU_SampleTypeDef *sample, IMU_LoopSampleTypeDef *loop)
+{
+  uint32_t i;
+
+  loop->timestamp = sample->timestamp;
+  for (i = 0U; i < 3U; i++)
+  {
+    loop->gyro[i] = (float)sample->gyro[i];
+    loop->accel[i] = (float)sample->accel[i];
+  }
+}
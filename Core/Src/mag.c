@@ -0,0 +1,295 @@
+/**
+  ******************************************************************************
+  * @file    mag.c
+  * @brief   This file provides the QMC5883L/HMC5883L I2C magnetometer driver.
+  *
+  *          Both parts are put in continuous measurement mode once and
+  *          Mag_Measure(), run by the sensor scheduler at MAG_RATE_HZ, reads
+  *          the three axes with a single burst, or hands the burst to a bus
+  *          sweep through Mag_SweepEntry(). The completion callback
+  *          publishes the sample behind a sequence counter, Mag_Read() copies
+  *          it out from the main loop.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "mag.h"
+#include "sample_ring.h"
+
+/* Private define ------------------------------------------------------------*/
+/** Consecutive bus failures before the device is configured again */
+#define MAG_MAX_FAILURES        10U
+
+/* Exported variables --------------------------------------------------------*/
+Mag_HandleTypeDef hmag;
+
+/* Private variables ---------------------------------------------------------*/
+static const uint8_t mag_qmc5883l_config[][2] =
+{
+  { 0x0BU, 0x01U },  /* SET/RESET period, recommended value           */
+  { 0x09U, 0x1DU },  /* Continuous, 200 Hz, +-8 G, oversampling 512   */
+};
+
+static const uint8_t mag_hmc5883l_config[][2] =
+{
+  { 0x00U, 0x78U },  /* Config A: 8 samples averaged, 75 Hz           */
+  { 0x01U, 0x20U },  /* Config B: +-1.3 Ga                            */
+  { 0x02U, 0x00U },  /* Mode: continuous                              */
+};
+
+static const Mag_PartTypeDef mag_parts[] =
+{
+  [MAG_PART_QMC5883L] =
+  {
+    mag_qmc5883l_config, sizeof(mag_qmc5883l_config) / sizeof(mag_qmc5883l_config[0]),
+    0x00U, 0U, { 0U, 2U, 4U },     /* X Y Z, little endian */
+    MAG_QMC5883L_GAUSS_PER_LSB,
+  },
+  [MAG_PART_HMC5883L] =
+  {
+    mag_hmc5883l_config, sizeof(mag_hmc5883l_config) / sizeof(mag_hmc5883l_config[0]),
+    0x03U, 1U, { 0U, 4U, 2U },     /* X Z Y, big endian */
+    MAG_HMC5883L_GAUSS_PER_LSB,
+  },
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static void Mag_JobCallback(I2C_JobTypeDef *job);
+static void Mag_Complete(Mag_HandleTypeDef *dev, const I2C_JobTypeDef *job);
+static uint8_t Mag_Ready(Mag_HandleTypeDef *dev);
+static void Mag_WriteConfig(Mag_HandleTypeDef *dev);
+static void Mag_OnField(Mag_HandleTypeDef *dev);
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Queue the current configuration write.
+  * @param  dev Driver instance
+  */
+static void Mag_WriteConfig(Mag_HandleTypeDef *dev)
+{
+  dev->reg_value = dev->part->config[dev->config_index][1];
+  if (I2C_Bus_Write(dev->bus, &dev->job, dev->address, dev->part->config[dev->config_index][0],
+                    &dev->reg_value, 1U, Mag_JobCallback, dev) != HAL_OK)
+  {
+    dev->state = MAG_STATE_CONFIG;
+  }
+}
+
+/**
+  * @brief  Field burst received: publish it.
+  * @param  dev Driver instance
+  */
+static void Mag_OnField(Mag_HandleTypeDef *dev)
+{
+  int16_t field[3];
+  uint64_t timestamp = Timing_Cycles64();
+  Mag_SampleTypeDef *slot;
+  uint32_t i;
+
+  for (i = 0U; i < 3U; i++)
+  {
+    const uint8_t *bytes = &dev->raw[dev->part->axis[i]];
+
+    field[i] = (dev->part->big_endian != 0U) ? (int16_t)(((uint16_t)bytes[0] << 8) | bytes[1])
+                                            : (int16_t)(((uint16_t)bytes[1] << 8) | bytes[0]);
+  }
+
+  /* Odd sequence while the sample is being written, see Mag_Read() */
+  dev->sequence++;
+  __DMB();
+  dev->sample.timestamp = timestamp;
+  dev->sample.field[0] = field[0];
+  dev->sample.field[1] = field[1];
+  dev->sample.field[2] = field[2];
+  __DMB();
+  dev->sequence++;
+  dev->stats.samples++;
+
+  /* Filled in place, a full ring counts an overrun and drops the sample */
+  slot = MagRing_Reserve();
+  if (slot != NULL)
+  {
+    slot->timestamp = timestamp;
+    slot->field[0] = field[0];
+    slot->field[1] = field[1];
+    slot->field[2] = field[2];
+    MagRing_Commit();
+  }
+}
+
+/**
+  * @brief  Completion callback of every job of the driver, interrupt context.
+  * @param  job Completed job
+  */
+static void Mag_JobCallback(I2C_JobTypeDef *job)
+{
+  Mag_Complete((Mag_HandleTypeDef *)job->context, job);
+}
+
+/**
+  * @brief  Handle a completed job of the driver or a sweep carrying its field
+  *         read, interrupt context.
+  * @param  dev Driver instance
+  * @param  job Completed job or sweep
+  */
+static void Mag_Complete(Mag_HandleTypeDef *dev, const I2C_JobTypeDef *job)
+{
+  if (job->state != I2C_JOB_DONE)
+  {
+    dev->stats.bus_errors++;
+    dev->failures++;
+    if (dev->state != MAG_STATE_RUN)
+    {
+      dev->state = MAG_STATE_CONFIG;
+    }
+    return;
+  }
+  dev->failures = 0U;
+
+  switch (dev->state)
+  {
+    case MAG_STATE_CONFIG_BUSY:
+      dev->config_index++;
+      if (dev->config_index < dev->part->config_count)
+      {
+        Mag_WriteConfig(dev);
+        break;
+      }
+      dev->state = MAG_STATE_RUN;
+      break;
+
+    case MAG_STATE_RUN:
+      Mag_OnField(dev);
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+  * @brief  Check that the driver may read the field, and configure the device
+  *         again from Mag_Poll() once it went silent.
+  * @param  dev Driver instance
+  * @retval 1 when running with no job pending, 0 otherwise
+  */
+static uint8_t Mag_Ready(Mag_HandleTypeDef *dev)
+{
+  if ((dev->state != MAG_STATE_RUN) || I2C_Job_IsPending(&dev->job))
+  {
+    return 0U;
+  }
+  if (dev->failures > MAG_MAX_FAILURES)
+  {
+    dev->failures = 0U;
+    dev->state = MAG_STATE_CONFIG;
+    return 0U;
+  }
+  return 1U;
+}
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Bind a driver instance to its bus. The device is configured by the
+  *         following Mag_Poll() calls.
+  * @param  dev Driver instance
+  * @param  bus Bus the sensor is on
+  * @param  address 7-bit device address
+  * @param  part Part found at that address
+  */
+void Mag_Init(Mag_HandleTypeDef *dev, I2C_BusTypeDef *bus, uint8_t address, Mag_PartIdTypeDef part)
+{
+  dev->bus = bus;
+  dev->part = &mag_parts[part];
+  dev->address = address;
+  dev->state = MAG_STATE_CONFIG;
+  dev->failures = 0U;
+  dev->sequence = 0U;
+  dev->job.state = I2C_JOB_IDLE;
+  dev->stats.samples = 0U;
+  dev->stats.bus_errors = 0U;
+}
+
+/**
+  * @brief  Start the configuration when needed, call from the main loop.
+  * @param  dev Driver instance
+  */
+void Mag_Poll(Mag_HandleTypeDef *dev)
+{
+  if ((dev->state != MAG_STATE_CONFIG) || I2C_Job_IsPending(&dev->job))
+  {
+    return;
+  }
+  dev->config_index = 0U;
+  dev->state = MAG_STATE_CONFIG_BUSY;
+  Mag_WriteConfig(dev);
+}
+
+/**
+  * @brief  Start a field read, called at MAG_RATE_HZ by the scheduler.
+  * @param  dev Driver instance
+  * @retval Job of the read, NULL when the device is not running
+  */
+I2C_JobTypeDef *Mag_Measure(Mag_HandleTypeDef *dev)
+{
+  if (Mag_Ready(dev) == 0U)
+  {
+    return NULL;
+  }
+  if (I2C_Bus_Read(dev->bus, &dev->job, dev->address, dev->part->data_reg,
+                   dev->raw, MAG_READ_BYTES, Mag_JobCallback, dev) != HAL_OK)
+  {
+    return NULL;
+  }
+  return &dev->job;
+}
+
+/**
+  * @brief  Describe the field read as a scan list entry. The sweep completion
+  *         is handed back with Mag_SweepDone().
+  * @param  dev Driver instance
+  * @param  entry Entry to fill
+  * @retval 1 when the entry was filled, 0 when the device is not running
+  */
+uint8_t Mag_SweepEntry(Mag_HandleTypeDef *dev, I2C_ScanEntryTypeDef *entry)
+{
+  if (Mag_Ready(dev) == 0U)
+  {
+    return 0U;
+  }
+  entry->address = dev->address;
+  entry->reg = dev->part->data_reg;
+  entry->size = MAG_READ_BYTES;
+  entry->data = dev->raw;
+  return 1U;
+}
+
+/**
+  * @brief  Sweep carrying the field read completed, interrupt context.
+  * @param  dev Driver instance
+  * @param  sweep Job of the completed scan
+  */
+void Mag_SweepDone(Mag_HandleTypeDef *dev, const I2C_JobTypeDef *sweep)
+{
+  Mag_Complete(dev, sweep);
+}
+
+/**
+  * @brief  Copy the latest sample, safe against the completion interrupt.
+  * @param  dev Driver instance
+  * @param  sample Destination
+  * @retval Sequence number of the sample, 0 while none is available
+  */
+uint32_t Mag_Read(Mag_HandleTypeDef *dev, Mag_SampleTypeDef *sample)
+{
+  uint32_t sequence;
+
+  do
+  {
+    sequence = dev->sequence;
+    __DMB();
+    *sample = dev->sample;
+    __DMB();
+  } while (((sequence & 1U) != 0U) || (sequence != dev->sequence));
+
+  return sequence >> 1;
+}
@@ -0,0 +1,646 @@
+/**
+  ******************************************************************************
+  * @file    mag_cal.c
+  * @brief   This file provides the online magnetometer calibration.
+  *
+  *          A field m distorted by hard and soft iron lies on the ellipsoid
+  *            m' M m + 2 v' m = 1
+  *          which is linear in the 9 coefficients of the symmetric M and v:
+  *            phi = [x2 y2 z2 2xy 2xz 2yz 2x 2y 2z], phi' theta = 1.
+  *          Each sample only updates the normal equations, kept as the sum of
+  *          [phi 1] [phi 1]' (55 multiply-adds) with an exponential
+  *          forgetting factor, so no sample batch is stored and old frames
+  *          fade out.
+  *
+  *          The form above degrades when the origin gets close to the
+  *          surface of the ellipsoid, which a large hard-iron offset does.
+  *          Before each fit the sums are therefore moved to the sample mean,
+  *          always inside the ellipsoid: a translation of m is a linear map
+  *          of [phi 1], so the sums are transformed exactly. The same
+  *          moments give the sample covariance, and a fit is only attempted
+  *          when the samples spread in every direction.
+  *
+  *          Every MAG_CAL_SOLVE_INTERVAL samples the equations are solved by a
+  *          Cholesky factorization, the center c = -inv(M) v and the shape
+  *          M / (1 + c' M c) are extracted, and the soft-iron correction W
+  *          is the symmetric square root of the shape, scaled to keep the
+  *          mean field strength. Fits with a non positive definite shape, an
+  *          unlikely radius or axis ratio, or a large residual are refused
+  *          and the previous calibration is kept.
+  *
+  *          The work is split into short steps and MagCal_Poll() runs steps
+  *          until its cycle budget is spent, so the main loop never sees a
+  *          whole fit at once.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "mag_cal.h"
+#include <math.h>
+
+/* Private define ------------------------------------------------------------*/
+#define MAG_CAL_QUEUE_MASK      (MAG_CAL_QUEUE_LEN - 1U)
+
+#if (MAG_CAL_QUEUE_LEN & MAG_CAL_QUEUE_MASK) != 0U
+#error "MAG_CAL_QUEUE_LEN must be a power of two"
+#endif
+
+/** Index of (row, col), col <= row, in a packed lower triangle */
+#define MAG_CAL_LOWER(row, col) ((((row) * ((row) + 1U)) / 2U) + (col))
+
+/** Row of the constant term in the sums: sum(phi) and the weight */
+#define MAG_CAL_ONE             MAG_CAL_PARAMS
+#define MAG_CAL_DIM             (MAG_CAL_PARAMS + 1U)
+
+/** Cholesky pivots below this fraction of the largest diagonal term mean
+  * the samples do not span the ellipsoid */
+#define MAG_CAL_PIVOT_RATIO     1.0e-7f
+
+/** Jacobi sweeps of the 3x3 eigen decomposition */
+#define MAG_CAL_JACOBI_SWEEPS   6U
+
+/* Exported variables --------------------------------------------------------*/
+MagCal_HandleTypeDef hmagcal;
+
+/* Private function prototypes -----------------------------------------------*/
+static void MagCal_Accumulate(MagCal_HandleTypeDef *cal, const float m[3]);
+static void MagCal_Translate(const float d[3], float v[MAG_CAL_DIM]);
+static uint8_t MagCal_Recenter(MagCal_HandleTypeDef *cal);
+static uint8_t MagCal_Factor(MagCal_HandleTypeDef *cal);
+static uint8_t MagCal_Solve(MagCal_HandleTypeDef *cal);
+static uint8_t MagCal_Eigen(MagCal_HandleTypeDef *cal);
+static void MagCal_Jacobi(float a[3][3], float v[3][3]);
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Fold one sample into the normal equations.
+  * @param  cal Calibration instance
+  * @param  m Field in gauss
+  */
+static void MagCal_Accumulate(MagCal_HandleTypeDef *cal, const float m[3])
+{
+  float phi[MAG_CAL_DIM];
+  uint32_t row;
+  uint32_t col;
+  uint32_t k = 0U;
+
+  phi[0] = m[0] * m[0];
+  phi[1] = m[1] * m[1];
+  phi[2] = m[2] * m[2];
+  phi[3] = 2.0f * m[0] * m[1];
+  phi[4] = 2.0f * m[0] * m[2];
+  phi[5] = 2.0f * m[1] * m[2];
+  phi[6] = 2.0f * m[0];
+  phi[7] = 2.0f * m[1];
+  phi[8] = 2.0f * m[2];
+  phi[MAG_CAL_ONE] = 1.0f;
+
+  for (row = 0U; row < MAG_CAL_DIM; row++)
+  {
+    for (col = 0U; col <= row; col++)
+    {
+      cal->sums[k] = (MAG_CAL_FORGET * cal->sums[k]) + (phi[row] * phi[col]);
+      k++;
+    }
+  }
+  cal->stats.samples++;
+}
+
+/**
+  * @brief  Map [phi(m) 1] to [phi(m + d) 1].
+  * @param  d Translation in gauss
+  * @param  v Vector transformed in place
+  */
+static void MagCal_Translate(const float d[3], float v[MAG_CAL_DIM])
+{
+  float one = v[MAG_CAL_ONE];
+
+  v[0] += (d[0] * v[6]) + (d[0] * d[0] * one);
+  v[1] += (d[1] * v[7]) + (d[1] * d[1] * one);
+  v[2] += (d[2] * v[8]) + (d[2] * d[2] * one);
+  v[3] += (d[1] * v[6]) + (d[0] * v[7]) + (2.0f * d[0] * d[1] * one);
+  v[4] += (d[2] * v[6]) + (d[0] * v[8]) + (2.0f * d[0] * d[2] * one);
+  v[5] += (d[2] * v[7]) + (d[1] * v[8]) + (2.0f * d[1] * d[2] * one);
+  v[6] += 2.0f * d[0] * one;
+  v[7] += 2.0f * d[1] * one;
+  v[8] += 2.0f * d[2] * one;
+}
+
+/**
+  * @brief  Check the coverage of the samples and move the origin of the sums
+  *         to their mean: sums = T sums T' with T the translation by -mean.
+  * @param  cal Calibration instance
+  * @retval 1 when the samples spread enough for a fit, 0 otherwise
+  */
+static uint8_t MagCal_Recenter(MagCal_HandleTypeDef *cal)
+{
+  float dense[MAG_CAL_DIM][MAG_CAL_DIM];
+  float vector[MAG_CAL_DIM];
+  float cov[3][3];
+  float axes[3][3];
+  float d[3];
+  float w = cal->sums[MAG_CAL_LOWER(MAG_CAL_ONE, MAG_CAL_ONE)];
+  uint32_t i;
+  uint32_t j;
+
+  /* sum(2m) and sum(4 m m') are already in the sums */
+  for (i = 0U; i < 3U; i++)
+  {
+    d[i] = -cal->sums[MAG_CAL_LOWER(MAG_CAL_ONE, 6U + i)] / (2.0f * w);
+  }
+  for (i = 0U; i < 3U; i++)
+  {
+    for (j = 0U; j <= i; j++)
+    {
+      cov[i][j] = (cal->sums[MAG_CAL_LOWER(6U + i, 6U + j)] / (4.0f * w)) - (d[i] * d[j]);
+      cov[j][i] = cov[i][j];
+    }
+  }
+  MagCal_Jacobi(cov, axes);
+  if (fminf(fminf(cov[0][0], cov[1][1]), cov[2][2]) < (MAG_CAL_MIN_SPREAD * MAG_CAL_MIN_SPREAD))
+  {
+    return 0U;
+  }
+
+  for (i = 0U; i < MAG_CAL_DIM; i++)
+  {
+    for (j = 0U; j <= i; j++)
+    {
+      dense[i][j] = cal->sums[MAG_CAL_LOWER(i, j)];
+      dense[j][i] = dense[i][j];
+    }
+  }
+  /* Columns then rows: T S, then (T S) T' */
+  for (j = 0U; j < MAG_CAL_DIM; j++)
+  {
+    for (i = 0U; i < MAG_CAL_DIM; i++)
+    {
+      vector[i] = dense[i][j];
+    }
+    MagCal_Translate(d, vector);
+    for (i = 0U; i < MAG_CAL_DIM; i++)
+    {
+      dense[i][j] = vector[i];
+    }
+  }
+  for (i = 0U; i < MAG_CAL_DIM; i++)
+  {
+    MagCal_Translate(d, dense[i]);
+    for (j = 0U; j <= i; j++)
+    {
+      cal->sums[MAG_CAL_LOWER(i, j)] = dense[i][j];
+    }
+  }
+  for (i = 0U; i < 3U; i++)
+  {
+    cal->shift[i] -= d[i];
+  }
+  return 1U;
+}
+
+/**
+  * @brief  Cholesky factorization of the normal equations into cal->chol.
+  * @param  cal Calibration instance
+  * @retval 1 on success, 0 when the samples do not span the ellipsoid
+  */
+static uint8_t MagCal_Factor(MagCal_HandleTypeDef *cal)
+{
+  float *l = cal->chol;
+  float largest = 0.0f;
+  uint32_t i;
+  uint32_t j;
+  uint32_t k;
+
+  for (i = 0U; i < MAG_CAL_PARAMS; i++)
+  {
+    if (cal->sums[MAG_CAL_LOWER(i, i)] > largest)
+    {
+      largest = cal->sums[MAG_CAL_LOWER(i, i)];
+    }
+  }
+
+  for (i = 0U; i < MAG_CAL_PARAMS; i++)
+  {
+    for (j = 0U; j <= i; j++)
+    {
+      float sum = cal->sums[MAG_CAL_LOWER(i, j)];
+
+      for (k = 0U; k < j; k++)
+      {
+        sum -= l[MAG_CAL_LOWER(i, k)] * l[MAG_CAL_LOWER(j, k)];
+      }
+      if (i == j)
+      {
+        if (sum <= (MAG_CAL_PIVOT_RATIO * largest))
+        {
+          return 0U;
+        }
+        l[MAG_CAL_LOWER(i, i)] = sqrtf(sum);
+      }
+      else
+      {
+        l[MAG_CAL_LOWER(i, j)] = sum / l[MAG_CAL_LOWER(j, j)];
+      }
+    }
+  }
+  return 1U;
+}
+
+/**
+  * @brief  Solve for the ellipsoid coefficients and extract its center.
+  * @param  cal Calibration instance
+  * @retval 1 on success, 0 when the fit is refused
+  */
+static uint8_t MagCal_Solve(MagCal_HandleTypeDef *cal)
+{
+  const float *l = cal->chol;
+  const float *b = &cal->sums[MAG_CAL_LOWER(MAG_CAL_ONE, 0U)];
+  float w = cal->sums[MAG_CAL_LOWER(MAG_CAL_ONE, MAG_CAL_ONE)];
+  float *t = cal->theta;
+  float m[3][3];
+  float inv[3][3];
+  float det;
+  float residual;
+  float k;
+  int32_t i;
+  int32_t j;
+
+  /* L y = b, then L' theta = y */
+  for (i = 0; i < (int32_t)MAG_CAL_PARAMS; i++)
+  {
+    float sum = b[i];
+
+    for (j = 0; j < i; j++)
+    {
+      sum -= l[MAG_CAL_LOWER((uint32_t)i, (uint32_t)j)] * t[j];
+    }
+    t[i] = sum / l[MAG_CAL_LOWER((uint32_t)i, (uint32_t)i)];
+  }
+  for (i = (int32_t)MAG_CAL_PARAMS - 1; i >= 0; i--)
+  {
+    float sum = t[i];
+
+    for (j = i + 1; j < (int32_t)MAG_CAL_PARAMS; j++)
+    {
+      sum -= l[MAG_CAL_LOWER((uint32_t)j, (uint32_t)i)] * t[j];
+    }
+    t[i] = sum / l[MAG_CAL_LOWER((uint32_t)i, (uint32_t)i)];
+  }
+
+  /* At the optimum the weighted squared residual is weight - theta' b */
+  residual = w;
+  for (i = 0; i < (int32_t)MAG_CAL_PARAMS; i++)
+  {
+    residual -= t[i] * b[i];
+  }
+  cal->stats.rms = sqrtf(fmaxf(residual, 0.0f) / w);
+  if (cal->stats.rms > MAG_CAL_MAX_RMS)
+  {
+    return 0U;
+  }
+
+  m[0][0] = t[0];
+  m[1][1] = t[1];
+  m[2][2] = t[2];
+  m[0][1] = t[3];
+  m[1][0] = t[3];
+  m[0][2] = t[4];
+  m[2][0] = t[4];
+  m[1][2] = t[5];
+  m[2][1] = t[5];
+
+  inv[0][0] = (m[1][1] * m[2][2]) - (m[1][2] * m[2][1]);
+  inv[0][1] = (m[0][2] * m[2][1]) - (m[0][1] * m[2][2]);
+  inv[0][2] = (m[0][1] * m[1][2]) - (m[0][2] * m[1][1]);
+  inv[1][1] = (m[0][0] * m[2][2]) - (m[0][2] * m[2][0]);
+  inv[1][2] = (m[0][2] * m[1][0]) - (m[0][0] * m[1][2]);
+  inv[2][2] = (m[0][0] * m[1][1]) - (m[0][1] * m[1][0]);
+  inv[1][0] = inv[0][1];
+  inv[2][0] = inv[0][2];
+  inv[2][1] = inv[1][2];
+  det = (m[0][0] * inv[0][0]) + (m[0][1] * inv[1][0]) + (m[0][2] * inv[2][0]);
+  if (det <= 0.0f)
+  {
+    return 0U;
+  }
+
+  /* c = -inv(M) v, then the shape is M / (1 + c' M c) */
+  k = 1.0f;
+  for (i = 0; i < 3; i++)
+  {
+    cal->center[i] = -((inv[i][0] * t[6]) + (inv[i][1] * t[7]) + (inv[i][2] * t[8])) / det;
+  }
+  for (i = 0; i < 3; i++)
+  {
+    k += cal->center[i] * ((m[i][0] * cal->center[0]) + (m[i][1] * cal->center[1]) + (m[i][2] * cal->center[2]));
+  }
+  if (k <= 0.0f)
+  {
+    return 0U;
+  }
+  for (i = 0; i < 3; i++)
+  {
+    for (j = 0; j < 3; j++)
+    {
+      cal->shape[i][j] = m[i][j] / k;
+    }
+  }
+  return 1U;
+}
+
+/**
+  * @brief  Eigen decomposition of a symmetric 3x3 matrix by Jacobi rotations.
+  * @param  a Matrix, diagonalized in place
+  * @param  v Eigenvectors, one per column
+  */
+static void MagCal_Jacobi(float a[3][3], float v[3][3])
+{
+  static const uint8_t pairs[3][2] = { { 0U, 1U }, { 0U, 2U }, { 1U, 2U } };
+  uint32_t sweep;
+  uint32_t n;
+  uint32_t i;
+
+  for (i = 0U; i < 3U; i++)
+  {
+    v[i][0] = (i == 0U) ? 1.0f : 0.0f;
+    v[i][1] = (i == 1U) ? 1.0f : 0.0f;
+    v[i][2] = (i == 2U) ? 1.0f : 0.0f;
+  }
+
+  for (sweep = 0U; sweep < MAG_CAL_JACOBI_SWEEPS; sweep++)
+  {
+    for (n = 0U; n < 3U; n++)
+    {
+      uint32_t p = pairs[n][0];
+      uint32_t q = pairs[n][1];
+      float theta;
+      float t;
+      float c;
+      float s;
+
+      if (fabsf(a[p][q]) < 1.0e-12f)
+      {
+        continue;
+      }
+      theta = (a[q][q] - a[p][p]) / (2.0f * a[p][q]);
+      t = ((theta >= 0.0f) ? 1.0f : -1.0f) / (fabsf(theta) + sqrtf((theta * theta) + 1.0f));
+      c = 1.0f / sqrtf((t * t) + 1.0f);
+      s = t * c;
+
+      for (i = 0U; i < 3U; i++)
+      {
+        float aip = a[i][p];
+        float aiq = a[i][q];
+
+        a[i][p] = (c * aip) - (s * aiq);
+        a[i][q] = (s * aip) + (c * aiq);
+      }
+      for (i = 0U; i < 3U; i++)
+      {
+        float api = a[p][i];
+        float aqi = a[q][i];
+
+        a[p][i] = (c * api) - (s * aqi);
+        a[q][i] = (s * api) + (c * aqi);
+      }
+      for (i = 0U; i < 3U; i++)
+      {
+        float vip = v[i][p];
+        float viq = v[i][q];
+
+        v[i][p] = (c * vip) - (s * viq);
+        v[i][q] = (s * vip) + (c * viq);
+      }
+    }
+  }
+}
+
+/**
+  * @brief  Soft-iron correction from the shape, checks and publication.
+  * @param  cal Calibration instance
+  * @retval 1 when the fit was published, 0 when it is refused
+  */
+static uint8_t MagCal_Eigen(MagCal_HandleTypeDef *cal)
+{
+  float a[3][3];
+  float v[3][3];
+  float root[3];
+  float smallest;
+  float largest;
+  float radius;
+  uint32_t i;
+  uint32_t j;
+
+  for (i = 0U; i < 3U; i++)
+  {
+    for (j = 0U; j < 3U; j++)
+    {
+      a[i][j] = cal->shape[i][j];
+    }
+  }
+  MagCal_Jacobi(a, v);
+
+  smallest = fminf(fminf(a[0][0], a[1][1]), a[2][2]);
+  largest = fmaxf(fmaxf(a[0][0], a[1][1]), a[2][2]);
+  if ((smallest <= 0.0f) || (largest > (MAG_CAL_MAX_AXIS_RATIO * MAG_CAL_MAX_AXIS_RATIO * smallest)))
+  {
+    return 0U;
+  }
+
+  /* Semi-axes are 1 / sqrt(eigenvalue), the radius is their geometric mean */
+  for (i = 0U; i < 3U; i++)
+  {
+    root[i] = sqrtf(a[i][i]);
+  }
+  radius = 1.0f / cbrtf(root[0] * root[1] * root[2]);
+  if ((radius < MAG_CAL_MIN_RADIUS) || (radius > MAG_CAL_MAX_RADIUS))
+  {
+    return 0U;
+  }
+
+  /* W = radius * V sqrt(D) V' */
+  for (i = 0U; i < 3U; i++)
+  {
+    for (j = 0U; j < 3U; j++)
+    {
+      cal->soft[i][j] = radius * ((v[i][0] * root[0] * v[j][0]) + (v[i][1] * root[1] * v[j][1])
+                                  + (v[i][2] * root[2] * v[j][2]));
+    }
+    cal->offset[i] = cal->shift[i] + cal->center[i];
+  }
+  cal->radius = radius;
+  cal->valid = 1U;
+  return 1U;
+}
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Start from an empty fit with no calibration published.
+  * @param  cal Calibration instance
+  * @param  gauss_per_lsb Scale of the raw counts given to MagCal_Push()
+  */
+void MagCal_Init(MagCal_HandleTypeDef *cal, float gauss_per_lsb)
+{
+  uint32_t i;
+
+  cal->gauss_per_lsb = gauss_per_lsb;
+  cal->head = 0U;
+  cal->tail = 0U;
+  cal->step = MAG_CAL_STEP_ACCUMULATE;
+  cal->since_fit = 0U;
+  for (i = 0U; i < MAG_CAL_SUMS; i++)
+  {
+    cal->sums[i] = 0.0f;
+  }
+  for (i = 0U; i < 3U; i++)
+  {
+    cal->shift[i] = 0.0f;
+  }
+  cal->valid = 0U;
+  cal->stats.samples = 0U;
+  cal->stats.dropped = 0U;
+  cal->stats.fits = 0U;
+  cal->stats.uncovered = 0U;
+  cal->stats.rejected = 0U;
+  cal->stats.rms = 0.0f;
+  Timing_PerfReset(&cal->stats.poll_cycles);
+}
+
+/**
+  * @brief  Queue a raw sample for the fitter, call from the main loop.
+  * @param  cal Calibration instance
+  * @param  field Field in sensor counts
+  */
+void MagCal_Push(MagCal_HandleTypeDef *cal, const int16_t field[3])
+{
+  float *slot;
+
+  if ((cal->head - cal->tail) >= MAG_CAL_QUEUE_LEN)
+  {
+    cal->stats.dropped++;
+    return;
+  }
+  slot = cal->queue[cal->head & MAG_CAL_QUEUE_MASK];
+  slot[0] = (float)field[0] * cal->gauss_per_lsb;
+  slot[1] = (float)field[1] * cal->gauss_per_lsb;
+  slot[2] = (float)field[2] * cal->gauss_per_lsb;
+  cal->head++;
+}
+
+/**
+  * @brief  Run fitter steps until the budget is spent, call from the main
+  *         loop. The budget is checked between steps; the longest step, the
+  *         9x9 factorization, takes a few microseconds.
+  * @param  cal Calibration instance
+  * @param  budget_cycles Cycle budget of the call
+  */
+void MagCal_Poll(MagCal_HandleTypeDef *cal, uint32_t budget_cycles)
+{
+  uint32_t start = Timing_Cycles();
+  const float *m;
+  float q[3];
+
+  do
+  {
+    switch (cal->step)
+    {
+      case MAG_CAL_STEP_ACCUMULATE:
+        if (cal->head == cal->tail)
+        {
+          Timing_PerfAdd(&cal->stats.poll_cycles, Timing_Cycles() - start);
+          return;
+        }
+        m = cal->queue[cal->tail & MAG_CAL_QUEUE_MASK];
+        q[0] = m[0] - cal->shift[0];
+        q[1] = m[1] - cal->shift[1];
+        q[2] = m[2] - cal->shift[2];
+        MagCal_Accumulate(cal, q);
+        cal->tail++;
+        cal->since_fit++;
+        if ((cal->since_fit >= MAG_CAL_SOLVE_INTERVAL)
+            && (cal->sums[MAG_CAL_LOWER(MAG_CAL_ONE, MAG_CAL_ONE)] >= MAG_CAL_MIN_SAMPLES))
+        {
+          cal->since_fit = 0U;
+          cal->step = MAG_CAL_STEP_RECENTER;
+        }
+        break;
+
+      case MAG_CAL_STEP_RECENTER:
+        cal->step = MAG_CAL_STEP_FACTOR;
+        if (MagCal_Recenter(cal) == 0U)
+        {
+          cal->stats.uncovered++;
+          cal->step = MAG_CAL_STEP_ACCUMULATE;
+        }
+        break;
+
+      case MAG_CAL_STEP_FACTOR:
+        cal->step = MAG_CAL_STEP_SOLVE;
+        if (MagCal_Factor(cal) == 0U)
+        {
+          cal->stats.rejected++;
+          cal->step = MAG_CAL_STEP_ACCUMULATE;
+        }
+        break;
+
+      case MAG_CAL_STEP_SOLVE:
+        cal->step = MAG_CAL_STEP_EIGEN;
+        if (MagCal_Solve(cal) == 0U)
+        {
+          cal->stats.rejected++;
+          cal->step = MAG_CAL_STEP_ACCUMULATE;
+        }
+        break;
+
+      case MAG_CAL_STEP_EIGEN:
+        if (MagCal_Eigen(cal) != 0U)
+        {
+          cal->stats.fits++;
+        }
+        else
+        {
+          cal->stats.rejected++;
+        }
+        cal->step = MAG_CAL_STEP_ACCUMULATE;
+        break;
+
+      default:
+        cal->step = MAG_CAL_STEP_ACCUMULATE;
+        break;
+    }
+  } while ((Timing_Cycles() - start) < budget_cycles);
+
+  Timing_PerfAdd(&cal->stats.poll_cycles, Timing_Cycles() - start);
+}
+
+/**
+  * @brief  Apply the published calibration.
+  * @param  cal Calibration instance
+  * @param  field Field in sensor counts
+  * @param  out Calibrated field in gauss, only scaled while no fit was
+  *         published
+  */
+void MagCal_Apply(const MagCal_HandleTypeDef *cal, const int16_t field[3], float out[3])
+{
+  float m[3];
+  uint32_t i;
+
+  for (i = 0U; i < 3U; i++)
+  {
+    m[i] = (float)field[i] * cal->gauss_per_lsb;
+  }
+  if (cal->valid == 0U)
+  {
+    out[0] = m[0];
+    out[1] = m[1];
+    out[2] = m[2];
+    return;
+  }
+  for (i = 0U; i < 3U; i++)
+  {
+    m[i] -= cal->offset[i];
+  }
+  for (i = 0U; i < 3U; i++)
+  {
+    out[i] = (cal->soft[i][0] * m[0]) + (cal->soft[i][1] * m[1]) + (cal->soft[i][2] * m[2]);
+  }
+}
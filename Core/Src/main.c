@@ -18,12 +18,34 @@
 /* USER CODE END Header */
 /* Includes ------------------------------------------------------------------*/
 #include "main.h"
+#include "dma.h"
 #include "i2c.h"
 #include "gpio.h"
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
-
+#include "timing.h"
+#include "i2c_bus.h"
+#include "imu.h"
+#include "mpu6050.h"
+#include "sched.h"
+#include "detect.h"
+#include "spi_imu.h"
+#include "ms5611.h"
+#include "mag.h"
+#include "mag_cal.h"
+#include "vl53l1x.h"
+#include "sample_ring.h"
+#include "decim.h"
+#include "vote.h"
+#include "vibe.h"
+#include "gyro_filter.h"
+#include "dyn_notch.h"
+#include "fast_math.h"
+#include "spectrum.h"
+#include "outlier.h"
+#include "ahrs.h"
+#include "eskf.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -33,6 +55,12 @@
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
+/** Baro slots between two magnetometer reads of the baro/mag sweep */
+#define SWEEP_MAG_DIVIDER  (MS5611_RATE_HZ / MAG_RATE_HZ)
+
+#if (MS5611_RATE_HZ % MAG_RATE_HZ) != 0U
+#error "MAG_RATE_HZ must divide MS5611_RATE_HZ"
+#endif
 
 /* USER CODE END PD */
 
@@ -44,17 +72,172 @@
 /* Private variables ---------------------------------------------------------*/
 
 /* USER CODE BEGIN PV */
+static Sched_TaskTypeDef gyro_task;
+static Sched_TaskTypeDef baro_task;
+static Sched_TaskTypeDef mag_task;
+static Sched_TaskTypeDef range_task;
+static Sched_TaskTypeDef sweep_task;
+/* Baro ADC then mag burst, refilled by the drivers before every sweep */
+static I2C_ScanEntryTypeDef sweep_entries[2];
+static I2C_ScanTypeDef sweep;
+static uint32_t sweep_slot;
+static I2C_BusTypeDef *const detect_buses[] = { &i2c_bus1, &i2c_bus2 };
+static Sched_HandleTypeDef *const bus_scheds[] = { &sched_i2c1, &sched_i2c2 };
+static IMU_LoopSampleTypeDef loop_sample;
+#ifdef FAST_MATH_BENCH
+static FastMath_BenchTypeDef fast_math_bench[FAST_MATH_BENCH_COUNT];
+#endif
+#ifdef GYRO_FILTER_BENCH
+static GyroFilter_BenchTypeDef gyro_filter_bench;
+#endif
+#ifdef OUTLIER_BENCH
+static Outlier_BenchTypeDef outlier_bench;
+#endif
+#ifdef ESKF_BENCH
+static Eskf_BenchTypeDef eskf_bench;
+#endif
+#ifdef SPECTRUM_CAPTURE
+/* Latest frame of each axis, read with the debugger until a link takes them */
+static Spectrum_FrameTypeDef spectrum_frames[3];
+#endif
 
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
 void SystemClock_Config(void);
 /* USER CODE BEGIN PFP */
+static I2C_JobTypeDef *Gyro_Run(void *context);
+static I2C_JobTypeDef *Baro_Run(void *context);
+static I2C_JobTypeDef *Mag_Run(void *context);
+static I2C_JobTypeDef *Range_Run(void *context);
+static I2C_JobTypeDef *Sweep_Run(void *context);
+static void Sweep_Done(I2C_JobTypeDef *job);
+static void Loop_Push(uint32_t stream, const IMU_LoopSampleTypeDef *sample);
+#ifdef SPECTRUM_CAPTURE
+static void Spectrum_Store(const Spectrum_FrameTypeDef *frame, void *context);
+#endif
 
 /* USER CODE END PFP */
 
 /* Private user code ---------------------------------------------------------*/
 /* USER CODE BEGIN 0 */
+/**
+  * @brief  Scheduler task of the primary IMU.
+  * @param  context MPU-6050 driver instance
+  * @retval Job of the FIFO drain, NULL when none was started
+  */
+static I2C_JobTypeDef *Gyro_Run(void *context)
+{
+  return MPU6050_Drain((MPU6050_HandleTypeDef *)context);
+}
+
+/**
+  * @brief  Scheduler task of the barometer.
+  * @param  context MS5611 driver instance
+  * @retval Job of the slot, NULL when the conversion is still running
+  */
+static I2C_JobTypeDef *Baro_Run(void *context)
+{
+  return MS5611_Convert((MS5611_HandleTypeDef *)context);
+}
+
+/**
+  * @brief  Scheduler task of the magnetometer.
+  * @param  context Magnetometer driver instance
+  * @retval Job of the field read, NULL when none was started
+  */
+static I2C_JobTypeDef *Mag_Run(void *context)
+{
+  return Mag_Measure((Mag_HandleTypeDef *)context);
+}
+
+/**
+  * @brief  Scheduler task of the rangefinder.
+  * @param  context VL53L1X driver instance
+  * @retval Job of the result-ready poll, NULL when none was started
+  */
+static I2C_JobTypeDef *Range_Run(void *context)
+{
+  return VL53L1X_Range((VL53L1X_HandleTypeDef *)context);
+}
+
+/**
+  * @brief  Scheduler task of the barometer and magnetometer sharing a bus.
+  *         Every other baro slot reads the ADC and the field in one sweep,
+  *         with a repeated start between them and a single STOP. Conversion
+  *         starts, early slots and a device down fall back to the drivers'
+  *         own jobs.
+  * @param  context Scan of the sweep
+  * @retval Job of the slot, NULL when none was started
+  */
+static I2C_JobTypeDef *Sweep_Run(void *context)
+{
+  I2C_ScanTypeDef *scan = (I2C_ScanTypeDef *)context;
+  uint8_t mag_due = (uint8_t)(sweep_slot == 0U);
+  I2C_JobTypeDef *job;
+
+  sweep_slot = (sweep_slot + 1U) % SWEEP_MAG_DIVIDER;
+  if ((mag_due != 0U) && (MS5611_SweepEntry(&hms5611, &sweep_entries[0]) != 0U) &&
+      (Mag_SweepEntry(&hmag, &sweep_entries[1]) != 0U))
+  {
+    return (I2C_Bus_SubmitScan(hms5611.bus, scan) == HAL_OK) ? &scan->job : NULL;
+  }
+  job = MS5611_Convert(&hms5611);
+  if ((job == NULL) && (mag_due != 0U))
+  {
+    job = Mag_Measure(&hmag);
+  }
+  return job;
+}
+
+/**
+  * @brief  Baro/mag sweep completed, hands both reads back to their drivers.
+  * @param  job Job of the sweep
+  */
+static void Sweep_Done(I2C_JobTypeDef *job)
+{
+  MS5611_SweepDone(&hms5611, job);
+  Mag_SweepDone(&hmag, job);
+}
+
+/**
+  * @brief  Vote a new IMU stream sample, analyze the voted gyro and filter
+  *         it through the dynamic notches then the fixed sections. The
+  *         spectrum capture, the attitude and the navigation see the gyro
+  *         before any filtering. The navigation starts from the attitude
+  *         once it has settled.
+  * @param  stream Voter stream of the sample
+  * @param  sample Sample at the control loop rate
+  */
+static void Loop_Push(uint32_t stream, const IMU_LoopSampleTypeDef *sample)
+{
+  Vote_Push(&hvote, stream, sample);
+  if (Vote_Run(&hvote, Timing_Cycles64(), &loop_sample) != 0U)
+  {
+    Ahrs_Update(&hahrs, &loop_sample);
+    if ((Eskf_State()->started == 0U) && (hahrs.aligned != 0U) && (hahrs.settle <= 0.0f))
+    {
+      Eskf_Start(hahrs.q);
+    }
+    Eskf_Push(&loop_sample);
+    Spectrum_Push(loop_sample.gyro);
+    DynNotch_Push(loop_sample.gyro);
+    DynNotch_Apply(loop_sample.gyro);
+    GyroFilter_Apply(loop_sample.gyro);
+  }
+}
+
+#ifdef SPECTRUM_CAPTURE
+/**
+  * @brief  Spectrum sink, keeps the latest frame of each axis.
+  * @param  frame Frame of one axis
+  * @param  context Frame of each axis
+  */
+static void Spectrum_Store(const Spectrum_FrameTypeDef *frame, void *context)
+{
+  ((Spectrum_FrameTypeDef *)context)[frame->axis] = *frame;
+}
+#endif
 
 /* USER CODE END 0 */
 
@@ -65,7 +248,19 @@ void SystemClock_Config(void);
 int main(void)
 {
   /* USER CODE BEGIN 1 */
-
+  const Detect_DeviceTypeDef *imu;
+  const Detect_DeviceTypeDef *baro;
+  const Detect_DeviceTypeDef *mag;
+  const Detect_DeviceTypeDef *range;
+  const Mag_SampleTypeDef *mag_sample;
+  float mag_field[3];
+  MS5611_SampleTypeDef baro_sample;
+  VL53L1X_SampleTypeDef range_sample;
+  int32_t baro_reference = 0;
+  uint32_t range_sequence = 0U;
+  uint32_t range_latest;
+  const IMU_SampleTypeDef *imu_sample;
+  IMU_LoopSampleTypeDef stream_sample;
   /* USER CODE END 1 */
 
   /* MCU Configuration--------------------------------------------------------*/
@@ -81,14 +276,129 @@ int main(void)
   SystemClock_Config();
 
   /* USER CODE BEGIN SysInit */
-
+  Timing_Init();
+#ifdef FAST_MATH_BENCH
+  /* Results in fast_math_bench, read with the debugger */
+  FastMath_Bench(fast_math_bench);
+#endif
+#ifdef GYRO_FILTER_BENCH
+  /* Float against Q15 chain in gyro_filter_bench, read with the debugger */
+  GyroFilter_Bench(&gyro_filter_bench);
+#endif
+#ifdef OUTLIER_BENCH
+  /* Sorted window against sorting in outlier_bench, read with the debugger */
+  Outlier_Bench(&outlier_bench);
+#endif
+#ifdef ESKF_BENCH
+  /* Block sparse against dense covariance prediction in eskf_bench, read
+   * with the debugger */
+  Eskf_Bench(&eskf_bench);
+#endif
   /* USER CODE END SysInit */
 
   /* Initialize all configured peripherals */
   MX_GPIO_Init();
+  MX_DMA_Init();
   MX_I2C1_Init();
+  MX_I2C2_Init();
   /* USER CODE BEGIN 2 */
-
+  /* I2C1 is owned by the IMU, baro/mag/rangefinder traffic lives on I2C2 */
+  I2C_Bus_Init(&i2c_bus1, &hi2c1);
+  I2C_Bus_SetRecoveryPins(&i2c_bus1, I2C1_SCL_GPIO_Port, I2C1_SCL_Pin, I2C1_SDA_GPIO_Port, I2C1_SDA_Pin);
+  I2C_Bus_Init(&i2c_bus2, &hi2c2);
+  I2C_Bus_SetRecoveryPins(&i2c_bus2, I2C2_SCL_GPIO_Port, I2C2_SCL_Pin, I2C2_SDA_GPIO_Port, I2C2_SDA_Pin);
+  Detect_Init(&hdetect, detect_buses, sizeof(detect_buses) / sizeof(detect_buses[0]));
+  Detect_Start(&hdetect);
+  while (Detect_Poll(&hdetect) == HAL_BUSY)
+  {
+    I2C_Bus_Poll(&i2c_bus1);
+    I2C_Bus_Poll(&i2c_bus2);
+  }
+  imu = Detect_Find(&hdetect, DETECT_DEV_MPU6050, 0U);
+  MPU6050_Init(&hmpu6050, &i2c_bus1, ((imu != NULL) && (imu->bus == 0U)) ? imu->address : MPU6050_ADDRESS);
+  SPI_IMU_Init(&hspi_imu);
+  if (Decim_Init(&hdecim, DECIM_RATIO) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  Vote_Init(&hvote, VOTE_POLICY_BLEND);
+  Ahrs_Init(&hahrs, AHRS_METHOD_MAHONY, MPU6050_GYRO_DPS_PER_LSB, MPU6050_ACCEL_G_PER_LSB);
+  Eskf_Init(MPU6050_GYRO_DPS_PER_LSB, MPU6050_ACCEL_G_PER_LSB);
+  GyroFilter_Reset();
+  Outlier_Reset();
+  DynNotch_Init(GYRO_FILTER_RATE_HZ);
+#ifdef SPECTRUM_CAPTURE
+  Spectrum_Init(GYRO_FILTER_RATE_HZ, Spectrum_Store, spectrum_frames);
+  Spectrum_Start();
+#else
+  Spectrum_Init(GYRO_FILTER_RATE_HZ, NULL, NULL);
+#endif
+  Vibe_Init(&hvibe, (float)MPU6050_ODR_HZ, MPU6050_ACCEL_G_PER_LSB);
+  Vibe_Init(&hvibe2, (float)SPI_IMU_ODR_HZ, SPI_IMU_ACCEL_G_PER_LSB);
+  Sched_Init(&sched_i2c1, &i2c_bus1, hi2c1.Init.ClockSpeed);
+  Sched_Init(&sched_i2c2, &i2c_bus2, hi2c2.Init.ClockSpeed);
+  if (Sched_AddTask(&sched_i2c1, &gyro_task, MPU6050_DRAIN_HZ, MPU6050_DRAIN_TRANSACTIONS, MPU6050_DRAIN_BYTES,
+                    SCHED_CLASS_CRITICAL, Gyro_Run, &hmpu6050) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  baro = Detect_Find(&hdetect, DETECT_DEV_MS5611, 0U);
+  if (baro != NULL)
+  {
+    MS5611_Init(&hms5611, detect_buses[baro->bus], baro->address);
+  }
+  mag = Detect_Find(&hdetect, DETECT_DEV_QMC5883L, 0U);
+  if (mag != NULL)
+  {
+    Mag_Init(&hmag, detect_buses[mag->bus], mag->address, MAG_PART_QMC5883L);
+  }
+  else
+  {
+    mag = Detect_Find(&hdetect, DETECT_DEV_HMC5883L, 0U);
+    if (mag != NULL)
+    {
+      Mag_Init(&hmag, detect_buses[mag->bus], mag->address, MAG_PART_HMC5883L);
+    }
+  }
+  if (mag != NULL)
+  {
+    MagCal_Init(&hmagcal, hmag.part->gauss_per_lsb);
+  }
+  if ((baro != NULL) && (mag != NULL) && (baro->bus == mag->bus))
+  {
+    /* Budgeted as a baro slot plus a mag read on every slot */
+    I2C_Scan_Init(&sweep, sweep_entries, 2U, Sweep_Done, NULL);
+    if (Sched_AddTask(bus_scheds[baro->bus], &sweep_task, MS5611_RATE_HZ,
+                      MS5611_SLOT_TRANSACTIONS + MAG_READ_TRANSACTIONS, MS5611_SLOT_BYTES + MAG_READ_BYTES,
+                      SCHED_CLASS_BACKGROUND, Sweep_Run, &sweep) != HAL_OK)
+    {
+      Error_Handler();
+    }
+  }
+  else
+  {
+    if ((baro != NULL) && (Sched_AddTask(bus_scheds[baro->bus], &baro_task, MS5611_RATE_HZ,
+                                         MS5611_SLOT_TRANSACTIONS, MS5611_SLOT_BYTES, SCHED_CLASS_BACKGROUND,
+                                         Baro_Run, &hms5611) != HAL_OK))
+    {
+      Error_Handler();
+    }
+    if ((mag != NULL) && (Sched_AddTask(bus_scheds[mag->bus], &mag_task, MAG_RATE_HZ, MAG_READ_TRANSACTIONS,
+                                        MAG_READ_BYTES, SCHED_CLASS_BACKGROUND, Mag_Run, &hmag) != HAL_OK))
+    {
+      Error_Handler();
+    }
+  }
+  range = Detect_Find(&hdetect, DETECT_DEV_VL53L1X, 0U);
+  if (range != NULL)
+  {
+    VL53L1X_Init(&hvl53l1x, detect_buses[range->bus], range->address);
+    if (Sched_AddTask(bus_scheds[range->bus], &range_task, VL53L1X_POLL_HZ, VL53L1X_POLL_TRANSACTIONS,
+                      VL53L1X_POLL_BYTES, SCHED_CLASS_BACKGROUND, Range_Run, &hvl53l1x) != HAL_OK)
+    {
+      Error_Handler();
+    }
+  }
   /* USER CODE END 2 */
 
   /* Infinite loop */
@@ -98,6 +408,80 @@ int main(void)
     /* USER CODE END WHILE */
 
     /* USER CODE BEGIN 3 */
+    I2C_Bus_Poll(&i2c_bus1);
+    I2C_Bus_Poll(&i2c_bus2);
+    MPU6050_Poll(&hmpu6050);
+    SPI_IMU_Poll(&hspi_imu);
+    /* Both IMU streams at the control loop rate into the voter: stream 0
+     * is the I2C MPU-6050, stream 1 the decimated 8 kHz SPI IMU */
+    while ((imu_sample = ImuRing_Front()) != NULL)
+    {
+      Vibe_Process(&hvibe, imu_sample);
+      IMU_ToLoop(imu_sample, &stream_sample);
+      ImuRing_Release();
+      Loop_Push(0U, &stream_sample);
+    }
+    while ((imu_sample = Imu2Ring_Front()) != NULL)
+    {
+      Vibe_Process(&hvibe2, imu_sample);
+      if (Decim_Process(&hdecim, imu_sample, &stream_sample) != 0U)
+      {
+        Loop_Push(1U, &stream_sample);
+      }
+      Imu2Ring_Release();
+    }
+    DynNotch_Poll(Timing_UsToCycles(DYN_NOTCH_BUDGET_US));
+    Spectrum_Poll(Timing_UsToCycles(SPECTRUM_BUDGET_US));
+    Eskf_Poll(Timing_UsToCycles(ESKF_BUDGET_US));
+    if (baro != NULL)
+    {
+      MS5611_Poll(&hms5611);
+      /* Pressure, outliers removed, to the navigation height: from the
+       * pressure at the navigation start, fused once started */
+      while (BaroRing_Pop(&baro_sample) != 0U)
+      {
+        (void)Outlier_Baro(&baro_sample);
+        if (Eskf_State()->started == 0U)
+        {
+          baro_reference = baro_sample.pressure;
+        }
+        else if (baro_reference != 0)
+        {
+          (void)Eskf_FuseHeight(baro_sample.timestamp, MS5611_Height(baro_sample.pressure, baro_reference),
+                               ESKF_BARO_VARIANCE);
+        }
+      }
+    }
+    if (mag != NULL)
+    {
+      Mag_Poll(&hmag);
+      while ((mag_sample = MagRing_Front()) != NULL)
+      {
+        MagCal_Push(&hmagcal, mag_sample->field);
+        /* The magnetometer axes are taken as the IMU axes */
+        if (hmagcal.valid != 0U)
+        {
+          MagCal_Apply(&hmagcal, mag_sample->field, mag_field);
+          Ahrs_UpdateMag(&hahrs, mag_field);
+        }
+        MagRing_Release();
+      }
+      MagCal_Poll(&hmagcal, Timing_UsToCycles(MAG_CAL_BUDGET_US));
+    }
+    if (range != NULL)
+    {
+      VL53L1X_Poll(&hvl53l1x);
+      /* No distance consumer yet, new ranges go through the outlier
+       * rejection */
+      range_latest = VL53L1X_Read(&hvl53l1x, &range_sample);
+      if (range_latest != range_sequence)
+      {
+        range_sequence = range_latest;
+        (void)Outlier_Range(&range_sample);
+      }
+    }
+    Sched_Poll(&sched_i2c1);
+    Sched_Poll(&sched_i2c2);
   }
   /* USER CODE END 3 */
 }
@@ -148,7 +532,21 @@ void SystemClock_Config(void)
 }
 
 /* USER CODE BEGIN 4 */
-
+/**
+  * @brief  EXTI line detection callback.
+  * @param  GPIO_Pin Pin of the EXTI line
+  */
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
+{
+  if (GPIO_Pin == IMU1_DRDY_Pin)
+  {
+    MPU6050_DataReady(&hmpu6050);
+  }
+  else if (GPIO_Pin == IMU2_DRDY_Pin)
+  {
+    SPI_IMU_DataReady(&hspi_imu);
+  }
+}
 /* USER CODE END 4 */
 
 /**
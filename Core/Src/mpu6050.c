@@ -0,0 +1,409 @@
+/**
+  ******************************************************************************
+  * @file    mpu6050.c
+  * @brief   This file provides the MPU-6050/ICM-2060x I2C IMU driver.
+  *
+  *          The sensor samples gyro and accelerometer at MPU6050_ODR_HZ into
+  *          its 1 kB FIFO. MPU6050_Drain(), run by the sensor scheduler every
+  *          MPU6050_DRAIN_SAMPLES sample periods, reads FIFO_COUNT and, from
+  *          the completion callback, drains
+  *          up to MPU6050_MAX_BATCH samples with a single DMA burst read of
+  *          FIFO_R_W. Two bus transactions thus carry several samples
+  *          instead of one transaction per sample.
+  *
+  *          The FIFO holds no timestamps. The INT pin pulses when each sample
+  *          is written to the FIFO and its EXTI handler, MPU6050_DataReady(),
+  *          latches the 64-bit cycle clock. At drain time the n samples in
+  *          the FIFO are matched to the last n edges before the count read.
+  *          Without usable edges (pin not wired, history overrun) the newest
+  *          sample is assumed to be half a period older than the count read
+  *          and the older ones are spaced by the measured period.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "mpu6050.h"
+#include "sample_ring.h"
+
+/* Private define ------------------------------------------------------------*/
+/** Time given to the device to reboot after a reset */
+#define MPU6050_RESET_DELAY_US      100000U
+
+/** Consecutive bus failures before the device is reset again */
+#define MPU6050_MAX_FAILURES        10U
+
+#define MPU6050_PWR_MGMT_1_RESET    0x80U
+#define MPU6050_USER_CTRL_FIFO_EN   0x40U
+#define MPU6050_USER_CTRL_FIFO_RST  0x04U
+
+#define MPU6050_DRDY_MASK           (MPU6050_DRDY_HISTORY - 1U)
+
+#if (MPU6050_DRDY_HISTORY & MPU6050_DRDY_MASK) != 0U
+#error "MPU6050_DRDY_HISTORY must be a power of two"
+#endif
+
+/* Private variables ---------------------------------------------------------*/
+MPU6050_HandleTypeDef hmpu6050;
+
+/** Register writes issued after the reset, in order */
+static const uint8_t mpu6050_config[][2] =
+{
+  { MPU6050_REG_PWR_MGMT_1,   0x01U },                       /* Clock from the X gyro PLL        */
+  { MPU6050_REG_SMPLRT_DIV,   MPU6050_SMPLRT_DIV },          /* ODR = 8 kHz / (1 + div)          */
+  { MPU6050_REG_CONFIG,       0x00U },                       /* DLPF_CFG 0: 256 Hz, 8 kHz output */
+  { MPU6050_REG_GYRO_CONFIG,  0x18U },                       /* +-2000 dps                       */
+  { MPU6050_REG_ACCEL_CONFIG, 0x10U },                       /* +-8 g                            */
+  { MPU6050_REG_INT_PIN_CFG,  0x00U },                       /* Active high 50 us pulse          */
+  { MPU6050_REG_INT_ENABLE,   0x01U },                       /* Data ready                       */
+  { MPU6050_REG_FIFO_EN,      0x00U },
+  { MPU6050_REG_USER_CTRL,    MPU6050_USER_CTRL_FIFO_RST },
+  { MPU6050_REG_FIFO_EN,      0x78U },                       /* Gyro X Y Z and accelerometer     */
+  { MPU6050_REG_USER_CTRL,    MPU6050_USER_CTRL_FIFO_EN },
+};
+
+#define MPU6050_CONFIG_COUNT  (sizeof(mpu6050_config) / sizeof(mpu6050_config[0]))
+
+/** Identifiers of the supported register compatible parts */
+static const uint8_t mpu6050_whoami[] =
+{
+  0x68U,  /* MPU-6050 */
+  0x70U,  /* MPU-6500 */
+  0x11U,  /* ICM-20601 */
+  0x12U,  /* ICM-20602 */
+  0xAFU,  /* ICM-20608 */
+  0x98U,  /* ICM-20689 */
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static void MPU6050_JobCallback(I2C_JobTypeDef *job);
+static void MPU6050_WriteConfig(MPU6050_HandleTypeDef *dev);
+static void MPU6050_OnCount(MPU6050_HandleTypeDef *dev);
+static void MPU6050_OnFifo(MPU6050_HandleTypeDef *dev);
+static void MPU6050_MatchEdges(MPU6050_HandleTypeDef *dev);
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Issue the configuration write of the current index.
+  * @param  dev Driver instance
+  */
+static void MPU6050_WriteConfig(MPU6050_HandleTypeDef *dev)
+{
+  dev->reg_value = mpu6050_config[dev->config_index][1];
+  if (I2C_Bus_Write(dev->bus, &dev->job, dev->address, mpu6050_config[dev->config_index][0],
+                    &dev->reg_value, 1U, MPU6050_JobCallback, dev) != HAL_OK)
+  {
+    dev->state = MPU6050_STATE_RESET;
+  }
+}
+
+/**
+  * @brief  Find the data-ready edges preceding the FIFO count read and
+  *         refresh the sample period from them.
+  * @param  dev Driver instance
+  */
+static void MPU6050_MatchEdges(MPU6050_HandleTypeDef *dev)
+{
+  uint32_t count = dev->drdy_count;
+  uint32_t nominal = SystemCoreClock / MPU6050_ODR_HZ;
+  uint32_t oldest;
+  uint32_t edge;
+
+  /* One more edge may land while this runs and overwrite the oldest slot */
+  oldest = (count >= MPU6050_DRDY_HISTORY) ? (count - MPU6050_DRDY_HISTORY + 1U) : 0U;
+
+  /* Edges latched while the count was being read belong to the next sample */
+  edge = count;
+  while ((edge > oldest) && (dev->drdy_stamps[(edge - 1U) & MPU6050_DRDY_MASK] > dev->count_stamp))
+  {
+    edge--;
+  }
+  dev->drdy_edge = edge;
+
+  /* The newest edge must be the last sample written, or the pin is silent */
+  dev->drdy_valid = (uint8_t)((edge > oldest)
+                              && ((dev->count_stamp - dev->drdy_stamps[(edge - 1U) & MPU6050_DRDY_MASK])
+                                  < (uint64_t)(nominal + (nominal / 2U))));
+  if ((dev->drdy_valid != 0U) && ((edge - 1U) > oldest))
+  {
+    /* Average period over the history, kept only if close to the nominal one */
+    uint32_t span = (edge - 1U) - oldest;
+    uint32_t period = (uint32_t)((dev->drdy_stamps[(edge - 1U) & MPU6050_DRDY_MASK]
+                                  - dev->drdy_stamps[oldest & MPU6050_DRDY_MASK]) / span);
+
+    if ((period > (nominal - (nominal / 4U))) && (period < (nominal + (nominal / 4U))))
+    {
+      dev->period_cycles = period;
+    }
+  }
+}
+
+/**
+  * @brief  FIFO count received: reset an overflowed FIFO or start the burst.
+  * @param  dev Driver instance
+  */
+static void MPU6050_OnCount(MPU6050_HandleTypeDef *dev)
+{
+  uint16_t count = (uint16_t)(((uint16_t)dev->count_raw[0] << 8) | dev->count_raw[1]);
+  uint16_t batch;
+  uint64_t now = Timing_Cycles64();
+
+  /* The count is latched while the bus transfer runs, take its middle */
+  dev->count_stamp = now - (uint32_t)((uint32_t)now - (dev->job.start_cycles + (dev->job.cycles / 2U)));
+  dev->stats.drains++;
+  MPU6050_MatchEdges(dev);
+
+  if ((count > (MPU6050_FIFO_SIZE - MPU6050_FIFO_SAMPLE_SIZE)) || ((count % MPU6050_FIFO_SAMPLE_SIZE) != 0U))
+  {
+    /* Full or misaligned FIFO: samples are lost, restart it clean */
+    dev->stats.fifo_overflows++;
+    dev->reg_value = MPU6050_USER_CTRL_FIFO_EN | MPU6050_USER_CTRL_FIFO_RST;
+    (void)I2C_Bus_Write(dev->bus, &dev->job, dev->address, MPU6050_REG_USER_CTRL,
+                        &dev->reg_value, 1U, MPU6050_JobCallback, dev);
+    return;
+  }
+
+  dev->fifo_samples = count / MPU6050_FIFO_SAMPLE_SIZE;
+  batch = (dev->fifo_samples > MPU6050_MAX_BATCH) ? MPU6050_MAX_BATCH : dev->fifo_samples;
+  if (batch > 0U)
+  {
+    (void)I2C_Bus_Read(dev->bus, &dev->job, dev->address, MPU6050_REG_FIFO_R_W, dev->fifo,
+                       (uint16_t)(batch * MPU6050_FIFO_SAMPLE_SIZE), MPU6050_JobCallback, dev);
+  }
+}
+
+/**
+  * @brief  FIFO burst received: unpack and timestamp the samples.
+  * @param  dev Driver instance
+  */
+static void MPU6050_OnFifo(MPU6050_HandleTypeDef *dev)
+{
+  uint32_t batch = dev->job.size / MPU6050_FIFO_SAMPLE_SIZE;
+  uint64_t newest = dev->count_stamp - (dev->period_cycles / 2U);
+  uint32_t count = dev->drdy_count;
+  uint32_t i;
+
+  dev->stats.bursts++;
+  for (i = 0U; i < batch; i++)
+  {
+    const uint8_t *raw = &dev->fifo[i * MPU6050_FIFO_SAMPLE_SIZE];
+    IMU_SampleTypeDef sample;
+    uint32_t back = dev->fifo_samples - 1U - i;
+
+    if ((dev->drdy_valid != 0U) && (dev->drdy_edge > back)
+        && ((count - (dev->drdy_edge - 1U - back)) < MPU6050_DRDY_HISTORY))
+    {
+      sample.timestamp = dev->drdy_stamps[(dev->drdy_edge - 1U - back) & MPU6050_DRDY_MASK];
+      dev->stats.drdy_stamped++;
+    }
+    else
+    {
+      sample.timestamp = newest - ((uint64_t)back * dev->period_cycles);
+      dev->stats.nominal_stamped++;
+    }
+    sample.accel[0] = (int16_t)(((uint16_t)raw[0] << 8) | raw[1]);
+    sample.accel[1] = (int16_t)(((uint16_t)raw[2] << 8) | raw[3]);
+    sample.accel[2] = (int16_t)(((uint16_t)raw[4] << 8) | raw[5]);
+    sample.gyro[0] = (int16_t)(((uint16_t)raw[6] << 8) | raw[7]);
+    sample.gyro[1] = (int16_t)(((uint16_t)raw[8] << 8) | raw[9]);
+    sample.gyro[2] = (int16_t)(((uint16_t)raw[10] << 8) | raw[11]);
+    if (ImuRing_Push(&sample) != 0U)
+    {
+      if (dev->stats.samples == 0U)
+      {
+        dev->stats.first_sample_ms = HAL_GetTick();
+      }
+      dev->stats.samples++;
+    }
+  }
+}
+
+/**
+  * @brief  Completion of every driver job, runs in interrupt context.
+  * @param  job Completed job
+  */
+static void MPU6050_JobCallback(I2C_JobTypeDef *job)
+{
+  MPU6050_HandleTypeDef *dev = (MPU6050_HandleTypeDef *)job->context;
+
+  if (job->state != I2C_JOB_DONE)
+  {
+    dev->stats.bus_errors++;
+    dev->failures++;
+    if (dev->state != MPU6050_STATE_RUN)
+    {
+      dev->state = MPU6050_STATE_RESET;
+    }
+    return;
+  }
+  dev->failures = 0U;
+
+  switch (dev->state)
+  {
+    case MPU6050_STATE_IDENTIFY:
+      if (MPU6050_IsKnown(dev->whoami) == 0U)
+      {
+        dev->state = MPU6050_STATE_ERROR;
+        break;
+      }
+      dev->state = MPU6050_STATE_CONFIG;
+      dev->config_index = 0U;
+      MPU6050_WriteConfig(dev);
+      break;
+
+    case MPU6050_STATE_CONFIG:
+      dev->config_index++;
+      if (dev->config_index < MPU6050_CONFIG_COUNT)
+      {
+        MPU6050_WriteConfig(dev);
+        break;
+      }
+      dev->stamp = Timing_Cycles();
+      dev->state = MPU6050_STATE_RUN;
+      break;
+
+    case MPU6050_STATE_RUN:
+      if (job->reg == MPU6050_REG_FIFO_COUNTH)
+      {
+        MPU6050_OnCount(dev);
+      }
+      else if (job->reg == MPU6050_REG_FIFO_R_W)
+      {
+        MPU6050_OnFifo(dev);
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Check a WHO_AM_I value against the supported parts.
+  * @param  whoami Value read from MPU6050_REG_WHO_AM_I
+  * @retval 1 for a supported part, 0 otherwise
+  */
+uint8_t MPU6050_IsKnown(uint8_t whoami)
+{
+  uint32_t i;
+
+  for (i = 0U; i < sizeof(mpu6050_whoami); i++)
+  {
+    if (mpu6050_whoami[i] == whoami)
+    {
+      return 1U;
+    }
+  }
+  return 0U;
+}
+
+/**
+  * @brief  Bind a driver instance to its bus. The device is configured by the
+  *         following MPU6050_Poll() calls, the samples go to ImuRing.
+  * @param  dev Driver instance
+  * @param  bus Bus the sensor is on
+  * @param  address 7-bit device address
+  */
+void MPU6050_Init(MPU6050_HandleTypeDef *dev, I2C_BusTypeDef *bus, uint8_t address)
+{
+  dev->bus = bus;
+  dev->address = address;
+  dev->state = MPU6050_STATE_RESET;
+  dev->failures = 0U;
+  dev->job.state = I2C_JOB_IDLE;
+  dev->period_cycles = SystemCoreClock / MPU6050_ODR_HZ;
+  dev->stats.drains = 0U;
+  dev->stats.bursts = 0U;
+  dev->stats.samples = 0U;
+  dev->stats.fifo_overflows = 0U;
+  dev->stats.bus_errors = 0U;
+  dev->stats.drdy_stamped = 0U;
+  dev->stats.nominal_stamped = 0U;
+  dev->stats.first_sample_ms = 0U;
+  dev->drdy_valid = 0U;
+  dev->drdy_edge = 0U;
+  dev->drdy_count = 0U;
+}
+
+/**
+  * @brief  Advance the driver, call from the main loop. Never waits: at most
+  *         one bus job is queued per call.
+  * @param  dev Driver instance
+  */
+void MPU6050_Poll(MPU6050_HandleTypeDef *dev)
+{
+  uint32_t now = Timing_Cycles();
+
+  if (I2C_Job_IsPending(&dev->job))
+  {
+    return;
+  }
+
+  switch (dev->state)
+  {
+    case MPU6050_STATE_RESET:
+      dev->reg_value = MPU6050_PWR_MGMT_1_RESET;
+      if (I2C_Bus_Write(dev->bus, &dev->job, dev->address, MPU6050_REG_PWR_MGMT_1,
+                        &dev->reg_value, 1U, MPU6050_JobCallback, dev) == HAL_OK)
+      {
+        dev->stamp = now;
+        dev->state = MPU6050_STATE_WAIT_RESET;
+      }
+      break;
+
+    case MPU6050_STATE_WAIT_RESET:
+      if ((now - dev->stamp) < Timing_UsToCycles(MPU6050_RESET_DELAY_US))
+      {
+        break;
+      }
+      dev->state = MPU6050_STATE_IDENTIFY;
+      if (I2C_Bus_Read(dev->bus, &dev->job, dev->address, MPU6050_REG_WHO_AM_I,
+                       &dev->whoami, 1U, MPU6050_JobCallback, dev) != HAL_OK)
+      {
+        dev->state = MPU6050_STATE_WAIT_RESET;
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+  * @brief  Start a FIFO drain, called at MPU6050_DRAIN_HZ by the scheduler.
+  * @param  dev Driver instance
+  * @retval Job carrying the drain, NULL when the device is not running
+  */
+I2C_JobTypeDef *MPU6050_Drain(MPU6050_HandleTypeDef *dev)
+{
+  if ((dev->state != MPU6050_STATE_RUN) || I2C_Job_IsPending(&dev->job))
+  {
+    return NULL;
+  }
+  if (dev->failures > MPU6050_MAX_FAILURES)
+  {
+    /* Silent device, start over from MPU6050_Poll() */
+    dev->failures = 0U;
+    dev->state = MPU6050_STATE_RESET;
+    return NULL;
+  }
+  if (I2C_Bus_Read(dev->bus, &dev->job, dev->address, MPU6050_REG_FIFO_COUNTH,
+                   dev->count_raw, 2U, MPU6050_JobCallback, dev) != HAL_OK)
+  {
+    return NULL;
+  }
+  return &dev->job;
+}
+
+/**
+  * @brief  Latch the time of a data-ready edge, call first thing from the
+  *         INT pin EXTI callback.
+  * @param  dev Driver instance
+  */
+void MPU6050_DataReady(MPU6050_HandleTypeDef *dev)
+{
+  uint64_t stamp = Timing_Cycles64();
+  uint32_t count = dev->drdy_count;
+
+  dev->drdy_stamps[count & MPU6050_DRDY_MASK] = stamp;
+  dev->drdy_count = count + 1U;
+}
@@ -0,0 +1,461 @@
+/**
+  ******************************************************************************
+  * @file    ms5611.c
+  * @brief   This file provides the MS5611 I2C barometer driver.
+  *
+  *          A conversion takes up to MS5611_CONVERSION_US at OSR 4096 and the
+  *          device holds the bus idle meanwhile, so nothing waits for it:
+  *          MS5611_Convert(), run by the sensor scheduler at MS5611_RATE_HZ,
+  *          reads the ADC result of the conversion started on the previous
+  *          slot and the completion callback immediately starts the next
+  *          one. Every slot therefore collects a conversion and the ADC is
+  *          never left idle. Temperature conversions are interleaved after
+  *          every MS5611_PRESSURE_PER_TEMP pressure conversions and each
+  *          pressure result is compensated against the latest temperature.
+  *          The ADC read can also ride in a scan list shared with other
+  *          sensors of the bus, see MS5611_SweepEntry().
+  *
+  *          The first and second order compensation of the datasheet is done
+  *          in 64-bit integer arithmetic by MS5611_Compensate(), which only
+  *          depends on its arguments.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "ms5611.h"
+#include "sample_ring.h"
+#include "fast_math.h"
+
+/* Private define ------------------------------------------------------------*/
+/** Consecutive bus failures before the device is reset again */
+#define MS5611_MAX_FAILURES     10U
+
+#define MS5611_VALID_D1         0x01U
+#define MS5611_VALID_D2         0x02U
+
+/* Exported variables --------------------------------------------------------*/
+MS5611_HandleTypeDef hms5611;
+
+/* Private function prototypes -----------------------------------------------*/
+static void MS5611_JobCallback(I2C_JobTypeDef *job);
+static void MS5611_Complete(MS5611_HandleTypeDef *dev, const I2C_JobTypeDef *job);
+static uint8_t MS5611_Ready(MS5611_HandleTypeDef *dev);
+static void MS5611_StartConversion(MS5611_HandleTypeDef *dev, uint8_t command);
+static void MS5611_OnAdc(MS5611_HandleTypeDef *dev);
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Queue a conversion command.
+  * @param  dev Driver instance
+  * @param  command MS5611_CMD_CONVERT_D1 or MS5611_CMD_CONVERT_D2
+  */
+static void MS5611_StartConversion(MS5611_HandleTypeDef *dev, uint8_t command)
+{
+  dev->converting = command;
+  if (I2C_Bus_Command(dev->bus, &dev->job, dev->address, (uint8_t)(command | MS5611_OSR),
+                      MS5611_JobCallback, dev) != HAL_OK)
+  {
+    dev->converting = 0U;
+  }
+}
+
+/**
+  * @brief  ADC result received: store it, start the next conversion and
+  *         publish a sample after a pressure conversion.
+  * @param  dev Driver instance
+  */
+static void MS5611_OnAdc(MS5611_HandleTypeDef *dev)
+{
+  uint32_t adc = ((uint32_t)dev->raw[0] << 16) | ((uint32_t)dev->raw[1] << 8) | dev->raw[2];
+  uint8_t converted = dev->converting;
+  uint8_t next;
+  int32_t pressure;
+  int32_t temperature;
+  MS5611_SampleTypeDef *slot;
+  uint32_t start;
+
+  if (adc == 0U)
+  {
+    /* Read before the end of the conversion, the result is lost */
+    dev->stats.not_ready++;
+    MS5611_StartConversion(dev, converted);
+    return;
+  }
+  dev->stats.conversions++;
+
+  if (converted == MS5611_CMD_CONVERT_D1)
+  {
+    dev->d1 = adc;
+    dev->d1_stamp = dev->conversion_stamp + (Timing_UsToCycles(MS5611_CONVERSION_US) / 2U);
+    dev->valid |= MS5611_VALID_D1;
+    dev->pressure_count++;
+  }
+  else
+  {
+    dev->d2 = adc;
+    dev->valid |= MS5611_VALID_D2;
+    dev->pressure_count = 0U;
+  }
+
+  next = (((dev->valid & MS5611_VALID_D2) == 0U) || (dev->pressure_count >= MS5611_PRESSURE_PER_TEMP))
+         ? MS5611_CMD_CONVERT_D2 : MS5611_CMD_CONVERT_D1;
+  MS5611_StartConversion(dev, next);
+
+  if ((converted != MS5611_CMD_CONVERT_D1) || (dev->valid != (MS5611_VALID_D1 | MS5611_VALID_D2)))
+  {
+    return;
+  }
+
+  start = Timing_Cycles();
+  MS5611_Compensate(dev->prom, dev->d1, dev->d2, &pressure, &temperature);
+  Timing_PerfAdd(&dev->stats.compensate_cycles, Timing_Cycles() - start);
+
+  /* Odd sequence while the sample is being written, see MS5611_Read() */
+  dev->sequence++;
+  __DMB();
+  dev->sample.timestamp = dev->d1_stamp;
+  dev->sample.pressure = pressure;
+  dev->sample.temperature = temperature;
+  __DMB();
+  dev->sequence++;
+  dev->stats.samples++;
+
+  /* Filled in place, a full ring counts an overrun and drops the sample */
+  slot = BaroRing_Reserve();
+  if (slot != NULL)
+  {
+    slot->timestamp = dev->d1_stamp;
+    slot->pressure = pressure;
+    slot->temperature = temperature;
+    BaroRing_Commit();
+  }
+}
+
+/**
+  * @brief  Completion callback of every job of the driver, interrupt context.
+  * @param  job Completed job
+  */
+static void MS5611_JobCallback(I2C_JobTypeDef *job)
+{
+  MS5611_Complete((MS5611_HandleTypeDef *)job->context, job);
+}
+
+/**
+  * @brief  Handle a completed job of the driver or a sweep carrying its ADC
+  *         read, interrupt context.
+  * @param  dev Driver instance
+  * @param  job Completed job or sweep
+  */
+static void MS5611_Complete(MS5611_HandleTypeDef *dev, const I2C_JobTypeDef *job)
+{
+  uint32_t start = Timing_Cycles();
+
+  if (job->state != I2C_JOB_DONE)
+  {
+    dev->stats.bus_errors++;
+    dev->failures++;
+    if (dev->state != MS5611_STATE_RUN)
+    {
+      dev->state = MS5611_STATE_RESET;
+    }
+    /* Conversion lost, MS5611_Convert() starts a new one */
+    dev->converting = 0U;
+    return;
+  }
+  dev->failures = 0U;
+
+  switch (dev->state)
+  {
+    case MS5611_STATE_PROM:
+      dev->prom[dev->prom_index] = (uint16_t)(((uint16_t)dev->raw[0] << 8) | dev->raw[1]);
+      dev->prom_index++;
+      if (dev->prom_index < MS5611_PROM_WORDS)
+      {
+        if (I2C_Bus_Read(dev->bus, &dev->job, dev->address, (uint8_t)(MS5611_CMD_PROM_READ + (2U * dev->prom_index)),
+                         dev->raw, 2U, MS5611_JobCallback, dev) != HAL_OK)
+        {
+          dev->state = MS5611_STATE_RESET;
+        }
+        break;
+      }
+      dev->state = (MS5611_CheckProm(dev->prom) != 0U) ? MS5611_STATE_RUN : MS5611_STATE_ERROR;
+      break;
+
+    case MS5611_STATE_RUN:
+      if (job->op == I2C_JOB_COMMAND)
+      {
+        dev->conversion_stamp = Timing_Cycles64();
+      }
+      else
+      {
+        MS5611_OnAdc(dev);
+      }
+      Timing_PerfAdd(&dev->stats.isr_cycles, Timing_Cycles() - start);
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+  * @brief  Check that the driver may put a slot on the bus, and start over
+  *         from MS5611_Poll() once the device went silent.
+  * @param  dev Driver instance
+  * @retval 1 when running with no job pending, 0 otherwise
+  */
+static uint8_t MS5611_Ready(MS5611_HandleTypeDef *dev)
+{
+  if ((dev->state != MS5611_STATE_RUN) || I2C_Job_IsPending(&dev->job))
+  {
+    return 0U;
+  }
+  if (dev->failures > MS5611_MAX_FAILURES)
+  {
+    dev->failures = 0U;
+    dev->state = MS5611_STATE_RESET;
+    return 0U;
+  }
+  return 1U;
+}
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Check the 4-bit CRC of the PROM (application note AN520).
+  * @param  prom Calibration words as read
+  * @retval 1 when the CRC matches, 0 otherwise
+  */
+uint8_t MS5611_CheckProm(const uint16_t prom[MS5611_PROM_WORDS])
+{
+  uint32_t remainder = 0U;
+  uint32_t i;
+  uint32_t bit;
+
+  for (i = 0U; i < (2U * MS5611_PROM_WORDS); i++)
+  {
+    uint32_t word = prom[i >> 1];
+
+    if (i == ((2U * MS5611_PROM_WORDS) - 1U))
+    {
+      /* The CRC byte itself counts as zero */
+      word &= 0xFF00U;
+    }
+    remainder ^= ((i & 1U) != 0U) ? (word & 0x00FFU) : (word >> 8);
+    for (bit = 8U; bit > 0U; bit--)
+    {
+      remainder = ((remainder & 0x8000U) != 0U) ? ((remainder << 1) ^ 0x3000U) : (remainder << 1);
+      remainder &= 0xFFFFU;
+    }
+  }
+  return (uint8_t)(((remainder >> 12) & 0x0FU) == (prom[MS5611_PROM_WORDS - 1U] & 0x0FU));
+}
+
+/**
+  * @brief  First and second order compensation of the datasheet.
+  * @param  prom Calibration words, C1..C6 at indexes 1..6
+  * @param  d1 Raw pressure
+  * @param  d2 Raw temperature
+  * @param  pressure Pressure in Pa
+  * @param  temperature Temperature in 0.01 degC
+  */
+void MS5611_Compensate(const uint16_t prom[MS5611_PROM_WORDS], uint32_t d1, uint32_t d2,
+                       int32_t *pressure, int32_t *temperature)
+{
+  int32_t dt = (int32_t)d2 - ((int32_t)prom[5] << 8);
+  int32_t temp = 2000 + (int32_t)(((int64_t)dt * prom[6]) >> 23);
+  int64_t off = ((int64_t)prom[2] << 16) + (((int64_t)prom[4] * dt) >> 7);
+  int64_t sens = ((int64_t)prom[1] << 15) + (((int64_t)prom[3] * dt) >> 8);
+
+  if (temp < 2000)
+  {
+    int64_t low = (int64_t)(temp - 2000) * (temp - 2000);
+    int64_t off2 = (5 * low) >> 1;
+    int64_t sens2 = (5 * low) >> 2;
+
+    if (temp < -1500)
+    {
+      int64_t very_low = (int64_t)(temp + 1500) * (temp + 1500);
+
+      off2 += 7 * very_low;
+      sens2 += (11 * very_low) >> 1;
+    }
+    temp -= (int32_t)(((int64_t)dt * dt) >> 31);
+    off -= off2;
+    sens -= sens2;
+  }
+
+  *temperature = temp;
+  *pressure = (int32_t)(((((int64_t)d1 * sens) >> 21) - off) >> 15);
+}
+
+/**
+  * @brief  Height from the pressure by the international barometric
+  *         formula, 44330.8 m (1 - (p / p0)^0.190263), the power by the fast
+  *         base 2 logarithm and exponential: a few mm from the formula.
+  * @param  pressure Pressure in Pa
+  * @param  reference Pressure in Pa at height 0
+  * @retval Height above the reference in m
+  */
+float MS5611_Height(int32_t pressure, int32_t reference)
+{
+  float ratio = (float)pressure / (float)reference;
+
+  return 44330.8f * (1.0f - FastMath_Exp((0.190263f * 0.69314718f) * FastMath_Log2(ratio)));
+}
+
+/**
+  * @brief  Bind a driver instance to its bus. The device is reset and its
+  *         calibration read by the following MS5611_Poll() calls.
+  * @param  dev Driver instance
+  * @param  bus Bus the sensor is on
+  * @param  address 7-bit device address
+  */
+void MS5611_Init(MS5611_HandleTypeDef *dev, I2C_BusTypeDef *bus, uint8_t address)
+{
+  dev->bus = bus;
+  dev->address = address;
+  dev->state = MS5611_STATE_RESET;
+  dev->converting = 0U;
+  dev->pressure_count = 0U;
+  dev->failures = 0U;
+  dev->valid = 0U;
+  dev->sequence = 0U;
+  dev->job.state = I2C_JOB_IDLE;
+  dev->stats.conversions = 0U;
+  dev->stats.samples = 0U;
+  dev->stats.early = 0U;
+  dev->stats.not_ready = 0U;
+  dev->stats.bus_errors = 0U;
+  Timing_PerfReset(&dev->stats.compensate_cycles);
+  Timing_PerfReset(&dev->stats.isr_cycles);
+}
+
+/**
+  * @brief  Advance the device setup, call from the main loop. Never waits:
+  *         at most one bus job is queued per call.
+  * @param  dev Driver instance
+  */
+void MS5611_Poll(MS5611_HandleTypeDef *dev)
+{
+  uint32_t now = Timing_Cycles();
+
+  if (I2C_Job_IsPending(&dev->job))
+  {
+    return;
+  }
+
+  switch (dev->state)
+  {
+    case MS5611_STATE_RESET:
+      dev->converting = 0U;
+      dev->valid = 0U;
+      if (I2C_Bus_Command(dev->bus, &dev->job, dev->address, MS5611_CMD_RESET, MS5611_JobCallback, dev) == HAL_OK)
+      {
+        dev->stamp = now;
+        dev->state = MS5611_STATE_WAIT_RESET;
+      }
+      break;
+
+    case MS5611_STATE_WAIT_RESET:
+      if ((now - dev->stamp) < Timing_UsToCycles(MS5611_RESET_DELAY_US))
+      {
+        break;
+      }
+      dev->prom_index = 0U;
+      dev->state = MS5611_STATE_PROM;
+      if (I2C_Bus_Read(dev->bus, &dev->job, dev->address, MS5611_CMD_PROM_READ,
+                       dev->raw, 2U, MS5611_JobCallback, dev) != HAL_OK)
+      {
+        dev->state = MS5611_STATE_WAIT_RESET;
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+  * @brief  Collect the conversion in progress and start the next one, called
+  *         at MS5611_RATE_HZ by the scheduler. A slot coming before the end
+  *         of the conversion is left idle rather than waited out.
+  * @param  dev Driver instance
+  * @retval Job of the slot, NULL when there is nothing to do
+  */
+I2C_JobTypeDef *MS5611_Convert(MS5611_HandleTypeDef *dev)
+{
+  if (MS5611_Ready(dev) == 0U)
+  {
+    return NULL;
+  }
+
+  if (dev->converting == 0U)
+  {
+    MS5611_StartConversion(dev, MS5611_CMD_CONVERT_D2);
+    return (dev->converting != 0U) ? &dev->job : NULL;
+  }
+  if ((Timing_Cycles() - (uint32_t)dev->conversion_stamp) < Timing_UsToCycles(MS5611_CONVERSION_US))
+  {
+    dev->stats.early++;
+    return NULL;
+  }
+  if (I2C_Bus_Read(dev->bus, &dev->job, dev->address, MS5611_CMD_ADC_READ,
+                   dev->raw, 3U, MS5611_JobCallback, dev) != HAL_OK)
+  {
+    return NULL;
+  }
+  return &dev->job;
+}
+
+/**
+  * @brief  Describe the ADC read of the slot as a scan list entry, when the
+  *         conversion in progress is over. The sweep completion is handed
+  *         back with MS5611_SweepDone(), which starts the next conversion.
+  *         Conversion starts and early slots are left to MS5611_Convert().
+  * @param  dev Driver instance
+  * @param  entry Entry to fill
+  * @retval 1 when the entry was filled, 0 when no ADC read is due
+  */
+uint8_t MS5611_SweepEntry(MS5611_HandleTypeDef *dev, I2C_ScanEntryTypeDef *entry)
+{
+  if ((MS5611_Ready(dev) == 0U) || (dev->converting == 0U) ||
+      ((Timing_Cycles() - (uint32_t)dev->conversion_stamp) < Timing_UsToCycles(MS5611_CONVERSION_US)))
+  {
+    return 0U;
+  }
+  entry->address = dev->address;
+  entry->reg = MS5611_CMD_ADC_READ;
+  entry->size = 3U;
+  entry->data = dev->raw;
+  return 1U;
+}
+
+/**
+  * @brief  Sweep carrying the ADC read completed, interrupt context.
+  * @param  dev Driver instance
+  * @param  sweep Job of the completed scan
+  */
+void MS5611_SweepDone(MS5611_HandleTypeDef *dev, const I2C_JobTypeDef *sweep)
+{
+  MS5611_Complete(dev, sweep);
+}
+
+/**
+  * @brief  Copy the latest sample, safe against the completion interrupt.
+  * @param  dev Driver instance
+  * @param  sample Destination
+  * @retval Sequence number of the sample, 0 while none is available
+  */
+uint32_t MS5611_Read(MS5611_HandleTypeDef *dev, MS5611_SampleTypeDef *sample)
+{
+  uint32_t sequence;
+
+  do
+  {
+    sequence = dev->sequence;
+    __DMB();
+    *sample = dev->sample;
+    __DMB();
+  } while (((sequence & 1U) != 0U) || (sequence != dev->sequence));
+
+  return sequence >> 1;
+}
@@ -0,0 +1,192 @@
+/**
+  ******************************************************************************
+  * @file    outlier.cpp
+  * @brief   This file provides the outlier rejection of the altitude
+  *          sensors, Hampel filters of median.hpp on the barometer pressure
+  *          and on the valid rangefinder distances. Invalid ranges pass
+  *          unchanged and stay out of the window.
+  *
+  *          With OUTLIER_BENCH, Outlier_Bench() runs the barometer filter
+  *          and a reference that sorts a copy of its window on every sample
+  *          over the same input, to compare their cost and output.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "outlier.h"
+#include "median.hpp"
+
+/* Private variables ---------------------------------------------------------*/
+static HampelFilter<int32_t, OUTLIER_BARO_WINDOW> outlier_baro(OUTLIER_BARO_THRESHOLD, OUTLIER_BARO_MIN_SIGMA);
+static HampelFilter<uint16_t, OUTLIER_RANGE_WINDOW> outlier_range(OUTLIER_RANGE_THRESHOLD,
+                                                                  OUTLIER_RANGE_MIN_SIGMA);
+
+static Outlier_StatsTypeDef outlier_stats;
+
+#ifdef OUTLIER_BENCH
+/** Pressure in Pa, a slow climb with noise and prop wash spikes */
+static int32_t outlier_input[OUTLIER_BENCH_SAMPLES];
+static volatile int32_t outlier_sink;
+#endif
+
+/* Private functions ---------------------------------------------------------*/
+#ifdef OUTLIER_BENCH
+/**
+  * @brief  Hampel filter of one sample by sorting: the reference of the
+  *         benchmark, same decision as HampelFilter::Apply().
+  * @param  ring Last OUTLIER_BARO_WINDOW samples, updated
+  * @param  count Samples pushed so far, updated
+  * @param  x Sample, replaced by the median when it is an outlier
+  */
+static void Outlier_SortApply(int32_t ring[OUTLIER_BARO_WINDOW], uint32_t *count, int32_t *x)
+{
+  int32_t sorted[OUTLIER_BARO_WINDOW];
+  int32_t median;
+  float sigma;
+  uint32_t n;
+
+  ring[*count % OUTLIER_BARO_WINDOW] = *x;
+  (*count)++;
+  if (*count < OUTLIER_BARO_WINDOW)
+  {
+    return;
+  }
+  std::copy(&ring[0], &ring[OUTLIER_BARO_WINDOW], &sorted[0]);
+  std::sort(&sorted[0], &sorted[OUTLIER_BARO_WINDOW]);
+  median = sorted[OUTLIER_BARO_WINDOW / 2U];
+  for (n = 0U; n < OUTLIER_BARO_WINDOW; n++)
+  {
+    sorted[n] = (sorted[n] > median) ? (sorted[n] - median) : (median - sorted[n]);
+  }
+  std::sort(&sorted[0], &sorted[OUTLIER_BARO_WINDOW]);
+  sigma = 1.4826f * (float)sorted[OUTLIER_BARO_WINDOW / 2U];
+  sigma = (sigma > OUTLIER_BARO_MIN_SIGMA) ? sigma : OUTLIER_BARO_MIN_SIGMA;
+  if (fabsf((float)*x - (float)median) > (OUTLIER_BARO_THRESHOLD * sigma))
+  {
+    *x = median;
+  }
+}
+#endif
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Empty the windows and clear the statistics.
+  */
+extern "C" void Outlier_Reset(void)
+{
+  outlier_baro.Reset();
+  outlier_range.Reset();
+  outlier_stats.baro.samples = 0U;
+  outlier_stats.baro.outliers = 0U;
+  Timing_PerfReset(&outlier_stats.baro.cycles);
+  outlier_stats.range.samples = 0U;
+  outlier_stats.range.outliers = 0U;
+  Timing_PerfReset(&outlier_stats.range.cycles);
+}
+
+/**
+  * @brief  Filter one barometer sample in place.
+  * @param  sample Compensated sample, pressure replaced when an outlier
+  * @retval 1 when the pressure was replaced
+  */
+extern "C" uint8_t Outlier_Baro(MS5611_SampleTypeDef *sample)
+{
+  uint32_t start = Timing_Cycles();
+  bool outlier = outlier_baro.Apply(sample->pressure);
+
+  outlier_stats.baro.samples++;
+  outlier_stats.baro.outliers += outlier ? 1U : 0U;
+  Timing_PerfAdd(&outlier_stats.baro.cycles, Timing_Cycles() - start);
+  return outlier ? 1U : 0U;
+}
+
+/**
+  * @brief  Filter one rangefinder sample in place.
+  * @param  sample Range, distance replaced when an outlier
+  * @retval 1 when the distance was replaced
+  */
+extern "C" uint8_t Outlier_Range(VL53L1X_SampleTypeDef *sample)
+{
+  uint32_t start = Timing_Cycles();
+  bool outlier;
+
+  if (sample->valid == 0U)
+  {
+    return 0U;
+  }
+  outlier = outlier_range.Apply(sample->range_mm);
+  outlier_stats.range.samples++;
+  outlier_stats.range.outliers += outlier ? 1U : 0U;
+  Timing_PerfAdd(&outlier_stats.range.cycles, Timing_Cycles() - start);
+  return outlier ? 1U : 0U;
+}
+
+/**
+  * @brief  Outlier rejection statistics.
+  * @retval Statistics
+  */
+extern "C" const Outlier_StatsTypeDef *Outlier_Stats(void)
+{
+  return &outlier_stats;
+}
+
+#ifdef OUTLIER_BENCH
+/**
+  * @brief  Run the barometer filter and the sorting reference on the same
+  *         input, each timed on its own, then side by side for the output
+  *         mismatches. The filter is an instance of its own, the barometer
+  *         stream is not disturbed.
+  * @param  result Cycles per sample of each, and mismatches
+  */
+extern "C" void Outlier_Bench(Outlier_BenchTypeDef *result)
+{
+  HampelFilter<int32_t, OUTLIER_BARO_WINDOW> filter(OUTLIER_BARO_THRESHOLD, OUTLIER_BARO_MIN_SIGMA);
+  int32_t ring[OUTLIER_BARO_WINDOW];
+  uint32_t count = 0U;
+  uint32_t seed = 1U;
+  uint32_t start;
+  uint32_t n;
+  int32_t a;
+  int32_t b;
+
+  for (n = 0U; n < OUTLIER_BENCH_SAMPLES; n++)
+  {
+    seed = (seed * 1664525U) + 1013904223U;
+    outlier_input[n] = 101325 - (int32_t)(n / 8U) + (int32_t)((seed >> 29) & 3U) - 1;
+    if ((seed >> 24) < 8U)
+    {
+      /* About 3 % spikes, up to 128 Pa */
+      outlier_input[n] += (int32_t)((seed >> 8) & 0xFFU) - 128;
+    }
+  }
+
+  start = Timing_Cycles();
+  for (n = 0U; n < OUTLIER_BENCH_SAMPLES; n++)
+  {
+    a = outlier_input[n];
+    (void)filter.Apply(a);
+    outlier_sink = a;
+  }
+  result->window_cycles = (Timing_Cycles() - start) / OUTLIER_BENCH_SAMPLES;
+
+  start = Timing_Cycles();
+  for (n = 0U; n < OUTLIER_BENCH_SAMPLES; n++)
+  {
+    b = outlier_input[n];
+    Outlier_SortApply(ring, &count, &b);
+    outlier_sink = b;
+  }
+  result->sort_cycles = (Timing_Cycles() - start) / OUTLIER_BENCH_SAMPLES;
+
+  filter.Reset();
+  count = 0U;
+  result->mismatches = 0U;
+  for (n = 0U; n < OUTLIER_BENCH_SAMPLES; n++)
+  {
+    a = outlier_input[n];
+    b = outlier_input[n];
+    (void)filter.Apply(a);
+    Outlier_SortApply(ring, &count, &b);
+    result->mismatches += (a != b) ? 1U : 0U;
+  }
+}
+#endif
@@ -0,0 +1,38 @@
+/**
+  ******************************************************************************
+  * @file    sample_ring.cpp
+  * @brief   This file provides the sensor sample rings and their C
+  *          interface. SpscRing has a constexpr constructor, so the rings are
+  *          constant initialized and usable before the constructors run.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "sample_ring.h"
+#include "spsc_ring.hpp"
+
+/* Private macro -------------------------------------------------------------*/
+/**
+  * @brief  Ring instance and C interface matching SAMPLE_RING_DECLARE().
+  */
+#define SAMPLE_RING_DEFINE(NAME, TYPE, LEN)                                       \
+  static SpscRing<TYPE, LEN> NAME##_instance;                           \
+  extern "C" TYPE *NAME##_Reserve(void) { return NAME##_instance.Reserve(); }     \
+  extern "C" void NAME##_Commit(void) { NAME##_instance.Commit(); }               \
+  extern "C" const TYPE *NAME##_Front(void) { return NAME##_instance.Front(); }   \
+  extern "C" void NAME##_Release(void) { NAME##_instance.Release(); }             \
+  extern "C" uint8_t NAME##_Push(const TYPE *sample)                              \
+  {                                                                               \
+    return NAME##_instance.Push(*sample) ? 1U : 0U;                               \
+  }                                                                               \
+  extern "C" uint8_t NAME##_Pop(TYPE *sample)                                     \
+  {                                                                               \
+    return NAME##_instance.Pop(*sample) ? 1U : 0U;                                \
+  }                                                                               \
+  extern "C" uint32_t NAME##_Count(void) { return NAME##_instance.Count(); }      \
+  extern "C" uint32_t NAME##_Overruns(void) { return NAME##_instance.Overruns(); }
+
+/* Private variables ---------------------------------------------------------*/
+SAMPLE_RING_DEFINE(ImuRing, IMU_SampleTypeDef, IMU_RING_LEN)
+SAMPLE_RING_DEFINE(Imu2Ring, IMU_SampleTypeDef, IMU_RING_LEN)
+SAMPLE_RING_DEFINE(BaroRing, MS5611_SampleTypeDef, BARO_RING_LEN)
+SAMPLE_RING_DEFINE(MagRing, Mag_SampleTypeDef, MAG_RING_LEN)
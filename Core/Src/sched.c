@@ -0,0 +1,258 @@
+/**
+  ******************************************************************************
+  * @file    sched.c
+  * @brief   This file provides the multi-rate sensor scheduler.
+  *
+  *          Each task reserves rate * cost of the bus, where the cost is the
+  *          bit time of its transactions at the bus clock plus the interrupt
+  *          gap between them. A task pushing the total over
+  *          SCHED_BUDGET_PERMILLE is refused when it is added, so an
+  *          over-subscribed sensor set is caught at start up instead of
+  *          showing up as jitter in flight.
+  *
+  *          Critical tasks (gyro) are dispatched as soon as they are due.
+  *          Background tasks (baro, mag) are only dispatched when the bus is
+  *          idle and their estimated transfer ends before the next critical
+  *          task is due, so they never delay a gyro read.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "sched.h"
+
+/* Exported variables --------------------------------------------------------*/
+Sched_HandleTypeDef sched_i2c1;
+Sched_HandleTypeDef sched_i2c2;
+
+/* Private function prototypes -----------------------------------------------*/
+static void Sched_Dispatch(Sched_TaskTypeDef *task, uint32_t now);
+static uint8_t Sched_GapFits(const Sched_HandleTypeDef *sched, uint32_t now, uint32_t cycles);
+static void Sched_Report(Sched_HandleTypeDef *sched, uint32_t now);
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Run a due task and move its due stamp to the next period. Periods
+  *         already elapsed are dropped rather than run back to back.
+  * @param  task Task to run
+  * @param  now Current DWT stamp
+  */
+static void Sched_Dispatch(Sched_TaskTypeDef *task, uint32_t now)
+{
+  uint32_t late = now - task->due;
+  uint32_t skipped = late / task->period_cycles;
+  I2C_JobTypeDef *job;
+
+  job = task->run(task->context);
+  if (job != NULL)
+  {
+    task->job = job;
+    task->job_due = task->due;
+    task->stats.runs++;
+    task->window_runs++;
+  }
+  else
+  {
+    task->stats.idle++;
+  }
+
+  task->stats.missed += skipped;
+  task->due += (skipped + 1U) * task->period_cycles;
+}
+
+/**
+  * @brief  Check that a transfer started now ends before any critical task
+  *         becomes due.
+  * @param  sched Scheduler
+  * @param  now Current DWT stamp
+  * @param  cycles Estimated duration of the transfer
+  * @retval 1 when the transfer fits, 0 otherwise
+  */
+static uint8_t Sched_GapFits(const Sched_HandleTypeDef *sched, uint32_t now, uint32_t cycles)
+{
+  uint32_t needed = cycles + Timing_UsToCycles(SCHED_GAP_MARGIN_US);
+  uint32_t i;
+
+  for (i = 0U; i < sched->count; i++)
+  {
+    const Sched_TaskTypeDef *task = sched->tasks[i];
+
+    if ((task->type == SCHED_CLASS_CRITICAL) && ((int32_t)(task->due - now) < (int32_t)needed))
+    {
+      return 0U;
+    }
+  }
+  return 1U;
+}
+
+/**
+  * @brief  Close the report window: achieved rates and measured bus use.
+  * @param  sched Scheduler
+  * @param  now Current DWT stamp
+  */
+static void Sched_Report(Sched_HandleTypeDef *sched, uint32_t now)
+{
+  uint32_t elapsed = now - sched->window_stamp;
+  uint32_t i;
+
+  for (i = 0U; i < sched->count; i++)
+  {
+    Sched_TaskTypeDef *task = sched->tasks[i];
+
+    task->stats.achieved_mhz = (uint32_t)(((uint64_t)task->window_runs * SystemCoreClock * 1000U) / elapsed);
+    task->window_runs = 0U;
+  }
+  sched->bus_permille = I2C_Bus_Utilization(sched->bus);
+  sched->window_stamp = now;
+}
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Initialize an empty scheduler.
+  * @param  sched Scheduler to initialize
+  * @param  bus Bus shared by the tasks
+  * @param  bus_hz Bus clock, I2C_InitTypeDef::ClockSpeed
+  */
+void Sched_Init(Sched_HandleTypeDef *sched, I2C_BusTypeDef *bus, uint32_t bus_hz)
+{
+  sched->bus = bus;
+  sched->bus_hz = bus_hz;
+  sched->count = 0U;
+  sched->load_permille = 0U;
+  sched->rejected = 0U;
+  sched->bus_permille = 0U;
+  sched->window_stamp = Timing_Cycles();
+  (void)I2C_Bus_Utilization(bus);
+}
+
+/**
+  * @brief  Register a periodic task after checking the bus budget.
+  * @param  sched Scheduler
+  * @param  task Task storage, must stay alive while registered
+  * @param  rate_hz Activation rate
+  * @param  transactions Register transactions per activation
+  * @param  bytes Data bytes per activation, all transactions included
+  * @param  type Dispatch class
+  * @param  run Task body
+  * @param  context Argument of run
+  * @retval HAL_OK, HAL_ERROR when the table is full or the bus budget exceeded
+  */
+HAL_StatusTypeDef Sched_AddTask(Sched_HandleTypeDef *sched, Sched_TaskTypeDef *task, uint32_t rate_hz,
+                                uint8_t transactions, uint16_t bytes, Sched_ClassTypeDef type,
+                                Sched_RunTypeDef run, void *context)
+{
+  uint32_t load;
+
+  if ((rate_hz == 0U) || (run == NULL) || (sched->count >= SCHED_MAX_TASKS))
+  {
+    sched->rejected++;
+    return HAL_ERROR;
+  }
+
+  load = SCHED_LOAD_PERMILLE(rate_hz, transactions, bytes, sched->bus_hz);
+  if ((sched->load_permille + load) > SCHED_BUDGET_PERMILLE)
+  {
+    sched->rejected++;
+    return HAL_ERROR;
+  }
+
+  task->run = run;
+  task->context = context;
+  task->rate_hz = rate_hz;
+  task->bytes = bytes;
+  task->transactions = transactions;
+  task->type = (uint8_t)type;
+  task->load_permille = load;
+  task->cost_cycles = (uint32_t)(((uint64_t)SCHED_COST_NS(transactions, bytes, sched->bus_hz) * SystemCoreClock)
+                                 / 1000000000U);
+  task->period_cycles = SystemCoreClock / rate_hz;
+  task->due = Timing_Cycles() + task->period_cycles;
+  task->job = NULL;
+  task->window_runs = 0U;
+  task->stats.runs = 0U;
+  task->stats.idle = 0U;
+  task->stats.deferred = 0U;
+  task->stats.missed = 0U;
+  task->stats.achieved_mhz = 0U;
+  Timing_PerfReset(&task->stats.latency_cycles);
+
+  sched->tasks[sched->count] = task;
+  sched->count++;
+  sched->load_permille += load;
+  return HAL_OK;
+}
+
+/**
+  * @brief  Dispatch the due tasks, call from the main loop. Critical tasks
+  *         run first; at most one background task is started per call and
+  *         only when its transfer fits before the next critical task.
+  * @param  sched Scheduler
+  */
+void Sched_Poll(Sched_HandleTypeDef *sched)
+{
+  uint32_t now = Timing_Cycles();
+  uint32_t i;
+
+  /* Retire the completed activations */
+  for (i = 0U; i < sched->count; i++)
+  {
+    Sched_TaskTypeDef *task = sched->tasks[i];
+
+    if ((task->job != NULL) && (I2C_Job_IsPending(task->job) == 0U))
+    {
+      Timing_PerfAdd(&task->stats.latency_cycles,
+                     (task->job->start_cycles + task->job->cycles) - task->job_due);
+      task->job = NULL;
+    }
+  }
+
+  for (i = 0U; i < sched->count; i++)
+  {
+    Sched_TaskTypeDef *task = sched->tasks[i];
+
+    if ((task->type == SCHED_CLASS_CRITICAL) && (task->job == NULL) && ((int32_t)(now - task->due) >= 0))
+    {
+      Sched_Dispatch(task, now);
+    }
+  }
+
+  for (i = 0U; i < sched->count; i++)
+  {
+    Sched_TaskTypeDef *task = sched->tasks[i];
+
+    if ((task->type != SCHED_CLASS_BACKGROUND) || (task->job != NULL) || ((int32_t)(now - task->due) < 0))
+    {
+      continue;
+    }
+    if ((I2C_Bus_Pending(sched->bus) != 0U) || (Sched_GapFits(sched, now, task->cost_cycles) == 0U))
+    {
+      task->stats.deferred++;
+      continue;
+    }
+    Sched_Dispatch(task, now);
+    break;
+  }
+
+  if ((now - sched->window_stamp) >= Timing_UsToCycles(SCHED_REPORT_PERIOD_US))
+  {
+    Sched_Report(sched, now);
+  }
+}
+
+/**
+  * @brief  Clear the statistics of all tasks.
+  * @param  sched Scheduler
+  */
+void Sched_ResetStats(Sched_HandleTypeDef *sched)
+{
+  uint32_t i;
+
+  for (i = 0U; i < sched->count; i++)
+  {
+    Sched_TaskTypeDef *task = sched->tasks[i];
+
+    task->stats.runs = 0U;
+    task->stats.idle = 0U;
+    task->stats.deferred = 0U;
+    task->stats.missed = 0U;
+    Timing_PerfReset(&task->stats.latency_cycles);
+  }
+}
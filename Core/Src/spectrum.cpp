@@ -0,0 +1,346 @@
+/**
+  ******************************************************************************
+  * @file    spectrum.cpp
+  * @brief   This file provides the gyro spectrum capture.
+  *
+  *          While started, the gyro samples of every axis are kept in a
+  *          history of SPECTRUM_FFT_LEN samples. Every half history, a
+  *          segment of each axis goes through the Hann windowed real FFT of
+  *          rfft.hpp and its bin powers are added to the sums of the axis,
+  *          the Welch method with 50 % overlap. After SPECTRUM_AVERAGES
+  *          segments, each axis is encoded into a frame and handed to the
+  *          sink, then its sums restart from zero.
+  *
+  *          The density is one sided, 2 |X[k]|^2 / (fs sum(w^2)) averaged
+  *          over the segments, DC not doubled. A frame carries the highest
+  *          density in dB and each bin in half dB steps under it, so a 2 s
+  *          frame set of the 3 axes is 420 bytes where the raw int16
+  *          samples would be 24 kB.
+  *
+  *          The work is split into short steps, a load, one FFT stage, the
+  *          accumulation or the encoding of SPECTRUM_BINS_PER_STEP bins, and
+  *          Spectrum_Poll() runs steps until its cycle budget is spent: none
+  *          takes more than about 10 us at 168 MHz, and the segments of the
+  *          three axes have SPECTRUM_FFT_LEN / 2 samples to complete.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "spectrum.h"
+#include "fast_math.h"
+#include "rfft.hpp"
+
+/* Private define ------------------------------------------------------------*/
+#define SPECTRUM_HALF           (SPECTRUM_FFT_LEN / 2U)
+#define SPECTRUM_MASK           (SPECTRUM_FFT_LEN - 1U)
+
+/** 20 log10(2), half dB steps per octave of power */
+#define SPECTRUM_STEPS_PER_LOG2 6.02059991f
+
+/** Power sums are floored here, a normal float, before their logarithm */
+#define SPECTRUM_MIN_POWER      1e-30f
+
+/* Private typedef -----------------------------------------------------------*/
+/**
+  * @brief  Work item of Spectrum_Poll().
+  */
+typedef enum
+{
+  SPECTRUM_STEP_IDLE = 0U,    /*!< Waiting for half a history of samples  */
+  SPECTRUM_STEP_LOAD,         /*!< Load of the transform                  */
+  SPECTRUM_STEP_FFT,          /*!< One butterfly stage                    */
+  SPECTRUM_STEP_ACCUMULATE,   /*!< Bin powers added to the sums           */
+  SPECTRUM_STEP_PEAK,         /*!< Highest density of the frame           */
+  SPECTRUM_STEP_ENCODE,       /*!< Bin levels under the peak              */
+  SPECTRUM_STEP_EMIT          /*!< Frame handed to the sink               */
+} Spectrum_StepTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static float spectrum_rate_hz;
+static Spectrum_SinkTypeDef spectrum_sink;
+static void *spectrum_context;
+static uint8_t spectrum_running;
+
+static float spectrum_history[3][SPECTRUM_FFT_LEN];
+static uint32_t spectrum_head;
+static uint32_t spectrum_filled;
+static uint32_t spectrum_pending;
+
+/** Segment or frame in progress */
+static RealFft<SPECTRUM_FFT_LEN> spectrum_fft;
+static uint8_t spectrum_step;
+static uint32_t spectrum_axis;
+static uint32_t spectrum_stage;
+static uint32_t spectrum_bin;
+static uint32_t spectrum_count;
+static float spectrum_peak_log2;
+
+/** Power sums of each axis, DC halved so every bin scales alike */
+static float spectrum_sum[3][SPECTRUM_BINS];
+
+static Spectrum_FrameTypeDef spectrum_frame;
+static Spectrum_StatsTypeDef spectrum_stats;
+
+/* Private function prototypes -----------------------------------------------*/
+static void Spectrum_Accumulate(void);
+static void Spectrum_Peak(void);
+static void Spectrum_Encode(void);
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Add the power of the next bins to the sums of the current axis.
+  */
+static void Spectrum_Accumulate(void)
+{
+  float *sum = spectrum_sum[spectrum_axis];
+  uint32_t end = spectrum_bin + SPECTRUM_BINS_PER_STEP;
+  uint32_t k = spectrum_bin;
+
+  if (k == 0U)
+  {
+    sum[0] += 0.5f * spectrum_fft.Power(0U);
+    k++;
+  }
+  for (; k < end; k++)
+  {
+    sum[k] += spectrum_fft.Power(k);
+  }
+  spectrum_bin = end;
+}
+
+/**
+  * @brief  Find the highest sum of the current axis and start its frame.
+  */
+static void Spectrum_Peak(void)
+{
+  const float *sum = spectrum_sum[spectrum_axis];
+  float peak = sum[0];
+  float scale = 2.0f / ((float)spectrum_count * spectrum_rate_hz * spectrum_fft.WindowPower());
+  uint32_t k;
+
+  for (k = 1U; k < SPECTRUM_BINS; k++)
+  {
+    peak = (sum[k] > peak) ? sum[k] : peak;
+  }
+  peak = (peak > SPECTRUM_MIN_POWER) ? peak : SPECTRUM_MIN_POWER;
+  spectrum_peak_log2 = FastMath_Log2(peak);
+
+  spectrum_frame.axis = (uint8_t)spectrum_axis;
+  spectrum_frame.segments = (uint8_t)spectrum_count;
+  spectrum_frame.bin_hz = spectrum_rate_hz / (float)SPECTRUM_FFT_LEN;
+  spectrum_frame.peak_db = 0.5f * SPECTRUM_STEPS_PER_LOG2 * (spectrum_peak_log2 + FastMath_Log2(scale));
+}
+
+/**
+  * @brief  Encode the next bins of the current axis under its peak.
+  */
+static void Spectrum_Encode(void)
+{
+  const float *sum = spectrum_sum[spectrum_axis];
+  uint32_t end = spectrum_bin + SPECTRUM_BINS_PER_STEP;
+  uint32_t k;
+
+  for (k = spectrum_bin; k < end; k++)
+  {
+    float power = (sum[k] > SPECTRUM_MIN_POWER) ? sum[k] : SPECTRUM_MIN_POWER;
+    float steps = SPECTRUM_STEPS_PER_LOG2 * (spectrum_peak_log2 - FastMath_Log2(power));
+
+    spectrum_frame.level[k] = (steps < (float)SPECTRUM_LEVEL_FLOOR)
+                              ? (uint8_t)FastMath_Round(steps) : (uint8_t)SPECTRUM_LEVEL_FLOOR;
+  }
+  spectrum_bin = end;
+}
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Build the tables and set the receiver of the frames. The capture
+  *         is stopped.
+  * @param  sample_hz Rate of the pushed samples
+  * @param  sink Receiver of the frames
+  * @param  context Passed to the sink
+  */
+extern "C" void Spectrum_Init(float sample_hz, Spectrum_SinkTypeDef sink, void *context)
+{
+  spectrum_fft.Init();
+  spectrum_rate_hz = sample_hz;
+  spectrum_sink = sink;
+  spectrum_context = context;
+  spectrum_running = 0U;
+  spectrum_pending = 0U;
+  spectrum_step = SPECTRUM_STEP_IDLE;
+  spectrum_frame.sequence = 0U;
+  spectrum_stats.segments = 0U;
+  spectrum_stats.frames = 0U;
+  spectrum_stats.late = 0U;
+  Timing_PerfReset(&spectrum_stats.poll_cycles);
+}
+
+/**
+  * @brief  Start a capture from an empty history and empty sums.
+  */
+extern "C" void Spectrum_Start(void)
+{
+  uint32_t a;
+  uint32_t k;
+
+  for (a = 0U; a < 3U; a++)
+  {
+    for (k = 0U; k < SPECTRUM_BINS; k++)
+    {
+      spectrum_sum[a][k] = 0.0f;
+    }
+  }
+  spectrum_head = 0U;
+  spectrum_filled = 0U;
+  spectrum_pending = 0U;
+  spectrum_count = 0U;
+  spectrum_step = SPECTRUM_STEP_IDLE;
+  spectrum_running = 1U;
+}
+
+/**
+  * @brief  Stop the capture, the frame set in progress is dropped.
+  */
+extern "C" void Spectrum_Stop(void)
+{
+  spectrum_running = 0U;
+  spectrum_pending = 0U;
+  spectrum_step = SPECTRUM_STEP_IDLE;
+}
+
+/**
+  * @brief  Add a gyro sample to the history, nothing while stopped.
+  * @param  gyro Angular rate, X Y Z
+  */
+extern "C" void Spectrum_Push(const float gyro[3])
+{
+  if (spectrum_running == 0U)
+  {
+    return;
+  }
+  spectrum_history[0][spectrum_head] = gyro[0];
+  spectrum_history[1][spectrum_head] = gyro[1];
+  spectrum_history[2][spectrum_head] = gyro[2];
+  spectrum_head = (spectrum_head + 1U) & SPECTRUM_MASK;
+  if (spectrum_filled < SPECTRUM_FFT_LEN)
+  {
+    spectrum_filled++;
+  }
+  else
+  {
+    spectrum_pending++;
+  }
+}
+
+/**
+  * @brief  Run capture steps until the budget is spent or nothing is left.
+  * @param  budget_cycles Cycle budget, checked between steps
+  */
+extern "C" void Spectrum_Poll(uint32_t budget_cycles)
+{
+  uint32_t start = Timing_Cycles();
+
+  do
+  {
+    switch (spectrum_step)
+    {
+      case SPECTRUM_STEP_IDLE:
+        if (spectrum_pending < SPECTRUM_HALF)
+        {
+          Timing_PerfAdd(&spectrum_stats.poll_cycles, Timing_Cycles() - start);
+          return;
+        }
+        if (spectrum_pending >= SPECTRUM_FFT_LEN)
+        {
+          spectrum_stats.late++;
+        }
+        spectrum_pending = 0U;
+        spectrum_axis = 0U;
+        spectrum_step = SPECTRUM_STEP_LOAD;
+        break;
+
+      case SPECTRUM_STEP_LOAD:
+        spectrum_fft.Load(spectrum_history[spectrum_axis], spectrum_head);
+        spectrum_stage = 0U;
+        spectrum_step = SPECTRUM_STEP_FFT;
+        break;
+
+      case SPECTRUM_STEP_FFT:
+        spectrum_fft.Stage(spectrum_stage);
+        spectrum_stage++;
+        if (spectrum_stage >= spectrum_fft.Stages())
+        {
+          spectrum_bin = 0U;
+          spectrum_step = SPECTRUM_STEP_ACCUMULATE;
+        }
+        break;
+
+      case SPECTRUM_STEP_ACCUMULATE:
+        Spectrum_Accumulate();
+        if (spectrum_bin < SPECTRUM_BINS)
+        {
+          break;
+        }
+        spectrum_stats.segments++;
+        spectrum_axis++;
+        if (spectrum_axis < 3U)
+        {
+          spectrum_step = SPECTRUM_STEP_LOAD;
+          break;
+        }
+        spectrum_count++;
+        spectrum_axis = 0U;
+        spectrum_step = (spectrum_count < SPECTRUM_AVERAGES) ? SPECTRUM_STEP_IDLE : SPECTRUM_STEP_PEAK;
+        break;
+
+      case SPECTRUM_STEP_PEAK:
+        Spectrum_Peak();
+        spectrum_bin = 0U;
+        spectrum_step = SPECTRUM_STEP_ENCODE;
+        break;
+
+      case SPECTRUM_STEP_ENCODE:
+        Spectrum_Encode();
+        if (spectrum_bin >= SPECTRUM_BINS)
+        {
+          spectrum_step = SPECTRUM_STEP_EMIT;
+        }
+        break;
+
+      case SPECTRUM_STEP_EMIT:
+        if (spectrum_sink != NULL)
+        {
+          spectrum_sink(&spectrum_frame, spectrum_context);
+        }
+        spectrum_stats.frames++;
+        for (spectrum_bin = 0U; spectrum_bin < SPECTRUM_BINS; spectrum_bin++)
+        {
+          spectrum_sum[spectrum_axis][spectrum_bin] = 0.0f;
+        }
+        spectrum_axis++;
+        if (spectrum_axis < 3U)
+        {
+          spectrum_step = SPECTRUM_STEP_PEAK;
+          break;
+        }
+        spectrum_frame.sequence++;
+        spectrum_count = 0U;
+        spectrum_step = SPECTRUM_STEP_IDLE;
+        break;
+
+      default:
+        spectrum_step = SPECTRUM_STEP_IDLE;
+        break;
+    }
+  } while ((Timing_Cycles() - start) < budget_cycles);
+
+  Timing_PerfAdd(&spectrum_stats.poll_cycles, Timing_Cycles() - start);
+}
+
+/**
+  * @brief  Capture statistics.
+  * @retval Statistics
+  */
+extern "C" const Spectrum_StatsTypeDef *Spectrum_Stats(void)
+{
+  return &spectrum_stats;
+}
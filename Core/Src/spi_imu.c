@@ -0,0 +1,417 @@
+/**
+  ******************************************************************************
+  * @file    spi_imu.c
+  * @brief   This file provides the SPI1 IMU driver.
+  *
+  *          SPI1 runs in mode 3 on PA5 (SCK), PA6 (MISO) and PA7 (MOSI),
+  *          chip select on IMU2_CS and data-ready on the IMU2_DRDY EXTI. The
+  *          HAL SPI driver is not part of this tree, so the peripheral is
+  *          driven through its registers and only the two DMA2 streams go
+  *          through the HAL DMA driver:
+  *            - SPI1_RX: DMA2 Stream0, channel 3
+  *            - SPI1_TX: DMA2 Stream3, channel 3
+  *
+  *          Setup (identification, reset, configuration) is a few polled
+  *          register transfers advanced by SPI_IMU_Poll(). Once running,
+  *          each data-ready edge latches the 64-bit cycle clock, drops chip
+  *          select and starts both DMA streams for the address byte plus the
+  *          14-byte burst; the CPU touches no byte of the transfer. The RX
+  *          completion raises chip select and converts the big endian burst
+  *          straight into its slot of Imu2Ring.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "spi_imu.h"
+#include "sample_ring.h"
+
+/* Private define ------------------------------------------------------------*/
+#define SPI_IMU_SCK_Pin           GPIO_PIN_5
+#define SPI_IMU_MISO_Pin          GPIO_PIN_6
+#define SPI_IMU_MOSI_Pin          GPIO_PIN_7
+#define SPI_IMU_GPIO_Port         GPIOA
+
+#define SPI_IMU_READ              0x80U
+#define SPI_IMU_REG_WHO_AM_I      0x75U
+
+/** Identification attempts before the driver gives up */
+#define SPI_IMU_IDENTIFY_TRIES    5U
+
+/* Exported variables --------------------------------------------------------*/
+SPI_IMU_HandleTypeDef hspi_imu;
+DMA_HandleTypeDef hdma_spi1_rx;
+DMA_HandleTypeDef hdma_spi1_tx;
+
+/* Private variables ---------------------------------------------------------*/
+static const uint8_t spi_imu_mpu6000_whoami[] =
+{
+  0x68U,  /* MPU-6000 */
+  0x11U,  /* ICM-20601 */
+  0x12U,  /* ICM-20602 */
+  0xAFU,  /* ICM-20608 */
+  0x98U,  /* ICM-20689 */
+};
+
+static const uint8_t spi_imu_mpu6000_config[][2] =
+{
+  { 0x6BU, 0x01U },  /* PWR_MGMT_1: clock from the X gyro PLL      */
+  { 0x6AU, 0x10U },  /* USER_CTRL: I2C interface disabled          */
+  { 0x19U, 0x00U },  /* SMPLRT_DIV: 8 kHz                          */
+  { 0x1AU, 0x00U },  /* CONFIG: DLPF_CFG 0, 8 kHz gyro output      */
+  { 0x1BU, 0x18U },  /* GYRO_CONFIG: +-2000 dps                    */
+  { 0x1CU, 0x10U },  /* ACCEL_CONFIG: +-8 g                        */
+  { 0x37U, 0x10U },  /* INT_PIN_CFG: active high pulse, read clear */
+  { 0x38U, 0x01U },  /* INT_ENABLE: data ready                     */
+};
+
+static const uint8_t spi_imu_icm42688_whoami[] =
+{
+  0x47U,  /* ICM-42688-P */
+};
+
+static const uint8_t spi_imu_icm42688_config[][2] =
+{
+  { 0x4FU, 0x03U },  /* GYRO_CONFIG0: +-2000 dps, 8 kHz            */
+  { 0x50U, 0x23U },  /* ACCEL_CONFIG0: +-8 g, 8 kHz                */
+  { 0x14U, 0x03U },  /* INT_CONFIG: INT1 pulsed, push-pull, high   */
+  { 0x64U, 0x60U },  /* INT_CONFIG1: 8 us pulse as needed at 8 kHz */
+  { 0x65U, 0x08U },  /* INT_SOURCE0: data ready on INT1            */
+  { 0x4EU, 0x0FU },  /* PWR_MGMT0: gyro and accel low noise, last  */
+};
+
+static const SPI_IMU_PartTypeDef spi_imu_parts[] =
+{
+  {
+    spi_imu_mpu6000_whoami, sizeof(spi_imu_mpu6000_whoami),
+    0x6BU, 0x80U,
+    spi_imu_mpu6000_config, sizeof(spi_imu_mpu6000_config) / sizeof(spi_imu_mpu6000_config[0]),
+    0x3BU, 0U, 8U,     /* ACCEL_XOUT_H: accel, temperature, gyro */
+  },
+  {
+    spi_imu_icm42688_whoami, sizeof(spi_imu_icm42688_whoami),
+    0x11U, 0x01U,
+    spi_imu_icm42688_config, sizeof(spi_imu_icm42688_config) / sizeof(spi_imu_icm42688_config[0]),
+    0x1DU, 2U, 8U,     /* TEMP_DATA1: temperature, accel, gyro */
+  },
+};
+
+#define SPI_IMU_PART_COUNT  (sizeof(spi_imu_parts) / sizeof(spi_imu_parts[0]))
+
+/* Private function prototypes -----------------------------------------------*/
+static void SPI_IMU_Transfer(const uint8_t *tx, uint8_t *rx, uint32_t size);
+static uint8_t SPI_IMU_ReadReg(uint8_t reg);
+static void SPI_IMU_WriteReg(uint8_t reg, uint8_t value);
+static const SPI_IMU_PartTypeDef *SPI_IMU_Identify(uint8_t whoami);
+static void SPI_IMU_EndBurst(void);
+static void SPI_IMU_RxCplt(DMA_HandleTypeDef *hdma);
+static void SPI_IMU_DmaError(DMA_HandleTypeDef *hdma);
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Polled full-duplex transfer under chip select, setup only.
+  * @param  tx Bytes to send
+  * @param  rx Bytes received
+  * @param  size Number of bytes
+  */
+static void SPI_IMU_Transfer(const uint8_t *tx, uint8_t *rx, uint32_t size)
+{
+  uint32_t i;
+
+  IMU2_CS_GPIO_Port->BSRR = (uint32_t)IMU2_CS_Pin << 16U;
+  for (i = 0U; i < size; i++)
+  {
+    while ((SPI1->SR & SPI_SR_TXE) == 0U)
+    {
+    }
+    *(volatile uint8_t *)&SPI1->DR = tx[i];
+    while ((SPI1->SR & SPI_SR_RXNE) == 0U)
+    {
+    }
+    rx[i] = *(volatile uint8_t *)&SPI1->DR;
+  }
+  while ((SPI1->SR & SPI_SR_BSY) != 0U)
+  {
+  }
+  IMU2_CS_GPIO_Port->BSRR = IMU2_CS_Pin;
+}
+
+static uint8_t SPI_IMU_ReadReg(uint8_t reg)
+{
+  uint8_t tx[2] = { (uint8_t)(reg | SPI_IMU_READ), 0U };
+  uint8_t rx[2];
+
+  SPI_IMU_Transfer(tx, rx, 2U);
+  return rx[1];
+}
+
+static void SPI_IMU_WriteReg(uint8_t reg, uint8_t value)
+{
+  uint8_t tx[2] = { reg, value };
+  uint8_t rx[2];
+
+  SPI_IMU_Transfer(tx, rx, 2U);
+}
+
+/**
+  * @brief  Find the part family of a WHO_AM_I value.
+  * @param  whoami Value read from the WHO_AM_I register
+  * @retval Part family, NULL when unsupported
+  */
+static const SPI_IMU_PartTypeDef *SPI_IMU_Identify(uint8_t whoami)
+{
+  uint32_t i;
+  uint32_t j;
+
+  for (i = 0U; i < SPI_IMU_PART_COUNT; i++)
+  {
+    for (j = 0U; j < spi_imu_parts[i].whoami_count; j++)
+    {
+      if (spi_imu_parts[i].whoami[j] == whoami)
+      {
+        return &spi_imu_parts[i];
+      }
+    }
+  }
+  return NULL;
+}
+
+/**
+  * @brief  Release the device and the DMA requests at the end of a burst.
+  */
+static void SPI_IMU_EndBurst(void)
+{
+  while ((SPI1->SR & SPI_SR_BSY) != 0U)
+  {
+  }
+  IMU2_CS_GPIO_Port->BSRR = IMU2_CS_Pin;
+  SPI1->CR2 &= ~(SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN);
+}
+
+/**
+  * @brief  Burst received, runs in the DMA2 Stream0 interrupt.
+  * @param  hdma SPI1 RX DMA handle
+  */
+static void SPI_IMU_RxCplt(DMA_HandleTypeDef *hdma)
+{
+  SPI_IMU_HandleTypeDef *dev = (SPI_IMU_HandleTypeDef *)hdma->Parent;
+  uint32_t start = Timing_Cycles();
+  const uint8_t *accel = &dev->rx[1U + dev->part->accel_offset];
+  const uint8_t *gyro = &dev->rx[1U + dev->part->gyro_offset];
+  IMU_SampleTypeDef *slot;
+
+  SPI_IMU_EndBurst();
+
+  /* Filled in place, a full ring counts an overrun and drops the sample */
+  slot = Imu2Ring_Reserve();
+  if (slot != NULL)
+  {
+    slot->timestamp = dev->drdy_stamp;
+    slot->accel[0] = (int16_t)(((uint16_t)accel[0] << 8) | accel[1]);
+    slot->accel[1] = (int16_t)(((uint16_t)accel[2] << 8) | accel[3]);
+    slot->accel[2] = (int16_t)(((uint16_t)accel[4] << 8) | accel[5]);
+    slot->gyro[0] = (int16_t)(((uint16_t)gyro[0] << 8) | gyro[1]);
+    slot->gyro[1] = (int16_t)(((uint16_t)gyro[2] << 8) | gyro[3]);
+    slot->gyro[2] = (int16_t)(((uint16_t)gyro[4] << 8) | gyro[5]);
+    Imu2Ring_Commit();
+    dev->stats.samples++;
+  }
+  dev->busy = 0U;
+
+  Timing_PerfAdd(&dev->stats.latency_cycles, Timing_Cycles() - (uint32_t)dev->drdy_stamp);
+  Timing_PerfAdd(&dev->stats.isr_cycles, Timing_Cycles() - start);
+}
+
+/**
+  * @brief  DMA transfer error on either stream: drop the burst.
+  * @param  hdma Failed DMA handle
+  */
+static void SPI_IMU_DmaError(DMA_HandleTypeDef *hdma)
+{
+  SPI_IMU_HandleTypeDef *dev = (SPI_IMU_HandleTypeDef *)hdma->Parent;
+
+  (void)HAL_DMA_Abort(&hdma_spi1_rx);
+  (void)HAL_DMA_Abort(&hdma_spi1_tx);
+  SPI_IMU_EndBurst();
+  dev->stats.dma_errors++;
+  dev->busy = 0U;
+}
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Set SPI1 and its DMA streams up. The device is configured by the
+  *         following SPI_IMU_Poll() calls, the samples go to Imu2Ring.
+  * @param  dev Driver instance
+  */
+void SPI_IMU_Init(SPI_IMU_HandleTypeDef *dev)
+{
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+  uint32_t i;
+
+  dev->part = NULL;
+  dev->busy = 0U;
+  dev->whoami = 0U;
+  dev->tries = 0U;
+  dev->state = SPI_IMU_STATE_IDENTIFY;
+  dev->stamp = Timing_Cycles();
+  dev->stats.samples = 0U;
+  dev->stats.busy = 0U;
+  dev->stats.dma_errors = 0U;
+  Timing_PerfReset(&dev->stats.latency_cycles);
+  Timing_PerfReset(&dev->stats.isr_cycles);
+  for (i = 0U; i < sizeof(dev->tx); i++)
+  {
+    dev->tx[i] = 0U;
+  }
+
+  __HAL_RCC_GPIOA_CLK_ENABLE();
+  __HAL_RCC_SPI1_CLK_ENABLE();
+  __HAL_RCC_DMA2_CLK_ENABLE();
+
+  GPIO_InitStruct.Pin = SPI_IMU_SCK_Pin | SPI_IMU_MISO_Pin | SPI_IMU_MOSI_Pin;
+  GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+  GPIO_InitStruct.Alternate = GPIO_AF5_SPI1;
+  HAL_GPIO_Init(SPI_IMU_GPIO_Port, &GPIO_InitStruct);
+
+  /* Master, software slave select, mode 3, 8-bit MSB first */
+  SPI1->CR1 = SPI_CR1_MSTR | SPI_CR1_SSM | SPI_CR1_SSI | SPI_CR1_CPOL | SPI_CR1_CPHA | SPI_IMU_BR_SETUP;
+  SPI1->CR2 = 0U;
+  SPI1->CR1 |= SPI_CR1_SPE;
+
+  hdma_spi1_rx.Instance = DMA2_Stream0;
+  hdma_spi1_rx.Init.Channel = DMA_CHANNEL_3;
+  hdma_spi1_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+  hdma_spi1_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma_spi1_rx.Init.MemInc = DMA_MINC_ENABLE;
+  hdma_spi1_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdma_spi1_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+  hdma_spi1_rx.Init.Mode = DMA_NORMAL;
+  hdma_spi1_rx.Init.Priority = DMA_PRIORITY_VERY_HIGH;
+  hdma_spi1_rx.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+  if (HAL_DMA_Init(&hdma_spi1_rx) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  hdma_spi1_rx.Parent = dev;
+  hdma_spi1_rx.XferCpltCallback = SPI_IMU_RxCplt;
+  hdma_spi1_rx.XferErrorCallback = SPI_IMU_DmaError;
+
+  hdma_spi1_tx.Instance = DMA2_Stream3;
+  hdma_spi1_tx.Init.Channel = DMA_CHANNEL_3;
+  hdma_spi1_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+  hdma_spi1_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma_spi1_tx.Init.MemInc = DMA_MINC_ENABLE;
+  hdma_spi1_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdma_spi1_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+  hdma_spi1_tx.Init.Mode = DMA_NORMAL;
+  hdma_spi1_tx.Init.Priority = DMA_PRIORITY_HIGH;
+  hdma_spi1_tx.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+  if (HAL_DMA_Init(&hdma_spi1_tx) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  hdma_spi1_tx.Parent = dev;
+  hdma_spi1_tx.XferErrorCallback = SPI_IMU_DmaError;
+
+  /* Same priority as the data-ready EXTI: a burst is never preempted by
+     the next edge, which then finds the previous sample in the ring */
+  HAL_NVIC_SetPriority(DMA2_Stream0_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA2_Stream0_IRQn);
+  HAL_NVIC_SetPriority(DMA2_Stream3_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA2_Stream3_IRQn);
+}
+
+/**
+  * @brief  Advance the device setup, call from the main loop. The polled
+  *         register transfers take a few tens of microseconds each.
+  * @param  dev Driver instance
+  */
+void SPI_IMU_Poll(SPI_IMU_HandleTypeDef *dev)
+{
+  uint32_t now = Timing_Cycles();
+  uint32_t i;
+
+  switch (dev->state)
+  {
+    case SPI_IMU_STATE_IDENTIFY:
+      if ((now - dev->stamp) < Timing_UsToCycles(SPI_IMU_RESET_DELAY_US))
+      {
+        break;
+      }
+      dev->stamp = now;
+      dev->whoami = SPI_IMU_ReadReg(SPI_IMU_REG_WHO_AM_I);
+      dev->part = SPI_IMU_Identify(dev->whoami);
+      if (dev->part == NULL)
+      {
+        dev->tries++;
+        if (dev->tries >= SPI_IMU_IDENTIFY_TRIES)
+        {
+          dev->state = SPI_IMU_STATE_ERROR;
+        }
+        break;
+      }
+      SPI_IMU_WriteReg(dev->part->reset_reg, dev->part->reset_value);
+      dev->state = SPI_IMU_STATE_WAIT_RESET;
+      break;
+
+    case SPI_IMU_STATE_WAIT_RESET:
+      if ((now - dev->stamp) >= Timing_UsToCycles(SPI_IMU_RESET_DELAY_US))
+      {
+        dev->state = SPI_IMU_STATE_CONFIG;
+      }
+      break;
+
+    case SPI_IMU_STATE_CONFIG:
+      for (i = 0U; i < dev->part->config_count; i++)
+      {
+        SPI_IMU_WriteReg(dev->part->config[i][0], dev->part->config[i][1]);
+      }
+      dev->tx[0] = (uint8_t)(dev->part->data_reg | SPI_IMU_READ);
+
+      /* Sensor registers may be read at full speed */
+      SPI1->CR1 &= ~SPI_CR1_SPE;
+      SPI1->CR1 = (SPI1->CR1 & ~SPI_CR1_BR) | SPI_IMU_BR_RUN;
+      SPI1->CR1 |= SPI_CR1_SPE;
+      dev->stamp = now;
+      dev->state = SPI_IMU_STATE_RUN;
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+  * @brief  Start the burst of a new sample, call first thing from the
+  *         data-ready EXTI callback.
+  * @param  dev Driver instance
+  */
+void SPI_IMU_DataReady(SPI_IMU_HandleTypeDef *dev)
+{
+  uint64_t stamp = Timing_Cycles64();
+  uint32_t start = (uint32_t)stamp;
+
+  if (dev->state != SPI_IMU_STATE_RUN)
+  {
+    return;
+  }
+  if (dev->busy != 0U)
+  {
+    dev->stats.busy++;
+    return;
+  }
+
+  dev->busy = 1U;
+  dev->drdy_stamp = stamp;
+  IMU2_CS_GPIO_Port->BSRR = (uint32_t)IMU2_CS_Pin << 16U;
+  if ((HAL_DMA_Start_IT(&hdma_spi1_rx, (uint32_t)(uintptr_t)&SPI1->DR, (uint32_t)(uintptr_t)dev->rx, sizeof(dev->rx)) != HAL_OK)
+      || (HAL_DMA_Start_IT(&hdma_spi1_tx, (uint32_t)(uintptr_t)dev->tx, (uint32_t)(uintptr_t)&SPI1->DR, sizeof(dev->tx)) != HAL_OK))
+  {
+    SPI_IMU_DmaError(&hdma_spi1_rx);
+    return;
+  }
+  /* RX request first so that no received byte can be missed */
+  SPI1->CR2 |= SPI_CR2_RXDMAEN;
+  SPI1->CR2 |= SPI_CR2_TXDMAEN;
+  Timing_PerfAdd(&dev->stats.isr_cycles, Timing_Cycles() - start);
+}
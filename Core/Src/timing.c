@@ -0,0 +1,79 @@
+/**
+  ******************************************************************************
+  * @file    timing.c
+  * @brief   This file provides the DWT cycle counter setup and the cycle
+  *          statistics helpers.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "timing.h"
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t timing_high;  /*!< Wraps of CYCCNT seen so far        */
+static uint32_t timing_last;  /*!< CYCCNT at the previous extension   */
+
+/**
+  * @brief  Enable the DWT cycle counter.
+  * @note   Must be called once before any other Timing_ function, the counter
+  *         keeps running in every power mode but Stop/Standby.
+  */
+void Timing_Init(void)
+{
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0U;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  timing_high = 0U;
+  timing_last = 0U;
+}
+
+/**
+  * @brief  Read the cycle counter extended to 64 bits, it never wraps.
+  * @note   A wrap is only seen if this is called at least once every 2^32
+  *         core cycles (25 s at 168 MHz); SysTick_Handler() calls it every
+  *         millisecond. Callable from any interrupt priority.
+  * @retval Core cycles since Timing_Init()
+  */
+uint64_t Timing_Cycles64(void)
+{
+  uint32_t primask = __get_PRIMASK();
+  uint32_t now;
+  uint64_t cycles;
+
+  __disable_irq();
+  now = DWT->CYCCNT;
+  if (now < timing_last)
+  {
+    timing_high++;
+  }
+  timing_last = now;
+  cycles = ((uint64_t)timing_high << 32) | now;
+  __set_PRIMASK(primask);
+  return cycles;
+}
+
+/**
+  * @brief  Clear a cycle statistics accumulator.
+  * @param  perf Accumulator to clear
+  */
+void Timing_PerfReset(Timing_PerfTypeDef *perf)
+{
+  perf->last = 0U;
+  perf->min = 0U;
+  perf->max = 0U;
+  perf->count = 0U;
+  perf->total = 0U;
+}
+
+/**
+  * @brief  Average of the measurements held by an accumulator.
+  * @param  perf Accumulator to read
+  * @retval Average duration in core cycles, 0 when nothing was measured
+  */
+uint32_t Timing_PerfAverage(const Timing_PerfTypeDef *perf)
+{
+  if (perf->count == 0U)
+  {
+    return 0U;
+  }
+  return (uint32_t)(perf->total / perf->count);
+}
@@ -0,0 +1,100 @@
+/**
+  ******************************************************************************
+  * @file    vibe.c
+  * @brief   This file provides the vibration metrics.
+  *
+  *          Each axis is split by a first order low pass at
+  *          VIBE_HIGHPASS_HZ; the residual is the vibration, squared and
+  *          averaged by a second first order filter of time constant
+  *          VIBE_WINDOW_S. Both are exponential windows: a handful of
+  *          multiply-adds per sample and no sample history, so the metrics
+  *          run at the full IMU rate. Clipping is counted on the raw counts,
+  *          before any filter hides it.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "vibe.h"
+#include <math.h>
+
+/* Private define ------------------------------------------------------------*/
+#define VIBE_TWO_PI           6.28318531f
+
+/* Exported variables --------------------------------------------------------*/
+Vibe_HandleTypeDef hvibe;
+Vibe_HandleTypeDef hvibe2;
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Set up the metrics of an IMU stream and clear them.
+  * @param  vibe Metrics instance
+  * @param  rate_hz Sample rate of the stream
+  * @param  g_per_lsb Accelerometer scale
+  */
+void Vibe_Init(Vibe_HandleTypeDef *vibe, float rate_hz, float g_per_lsb)
+{
+  uint32_t i;
+
+  vibe->g_per_lsb = g_per_lsb;
+  vibe->highpass_alpha = 1.0f - expf(-VIBE_TWO_PI * VIBE_HIGHPASS_HZ / rate_hz);
+  vibe->window_alpha = 1.0f - expf(-1.0f / (VIBE_WINDOW_S * rate_hz));
+  vibe->primed = 0U;
+  for (i = 0U; i < 3U; i++)
+  {
+    vibe->mean[i] = 0.0f;
+    vibe->power[i] = 0.0f;
+    vibe->clips[i] = 0U;
+  }
+  vibe->samples = 0U;
+  Timing_PerfReset(&vibe->cycles);
+}
+
+/**
+  * @brief  Account one raw sample.
+  * @param  vibe Metrics instance
+  * @param  sample Raw IMU sample
+  */
+void Vibe_Process(Vibe_HandleTypeDef *vibe, const IMU_SampleTypeDef *sample)
+{
+  uint32_t start = Timing_Cycles();
+  uint32_t i;
+
+  for (i = 0U; i < 3U; i++)
+  {
+    int32_t raw = sample->accel[i];
+    float x = (float)raw;
+    float d;
+
+    if ((raw >= VIBE_CLIP_COUNTS) || (raw <= -VIBE_CLIP_COUNTS))
+    {
+      vibe->clips[i]++;
+    }
+    if (vibe->primed == 0U)
+    {
+      /* Start from the first sample rather than from a 1 g step */
+      vibe->mean[i] = x;
+    }
+    vibe->mean[i] += vibe->highpass_alpha * (x - vibe->mean[i]);
+    d = x - vibe->mean[i];
+    vibe->power[i] += vibe->window_alpha * ((d * d) - vibe->power[i]);
+  }
+  vibe->primed = 1U;
+  vibe->samples++;
+  Timing_PerfAdd(&vibe->cycles, Timing_Cycles() - start);
+}
+
+/**
+  * @brief  Fill the telemetry and log fields.
+  * @param  vibe Metrics instance
+  * @param  report Destination
+  */
+void Vibe_Report(const Vibe_HandleTypeDef *vibe, Vibe_ReportTypeDef *report)
+{
+  uint32_t i;
+
+  for (i = 0U; i < 3U; i++)
+  {
+    report->rms[i] = sqrtf(vibe->power[i]) * vibe->g_per_lsb;
+    report->clips[i] = vibe->clips[i];
+  }
+  report->samples = vibe->samples;
+}
@@ -0,0 +1,433 @@
+/**
+  ******************************************************************************
+  * @file    vl53l1x.c
+  * @brief   This file provides the VL53L1X I2C time-of-flight rangefinder
+  *          driver.
+  *
+  *          The setup follows the sequence of ST's ultra lite driver: boot
+  *          wait, default configuration block, first ranging for the VHV
+  *          calibration, short distance mode and timing budget, then
+  *          continuous ranging. VL53L1X_Poll() issues one setup job at a time
+  *          from the main loop.
+  *
+  *          Once ranging, the device has no FIFO and its interrupt pin is not
+  *          wired, so VL53L1X_Range(), run by the sensor scheduler as a
+  *          background task, reads the result-ready flag. When a range is
+  *          ready the completion callback chains the result read and the
+  *          interrupt clear; otherwise the poll costs a single 1-byte read.
+  *          The bus time of all the jobs between two ranges is accumulated
+  *          in the statistics.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "vl53l1x.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+/** Consecutive bus failures before the device is set up again */
+#define VL53L1X_MAX_FAILURES    10U
+
+/** Model ID and module type read at VL53L1X_REG_MODEL_ID */
+#define VL53L1X_MODEL_ID        0xEACCU
+
+/** Interrupt polarity of the default configuration: active high */
+#define VL53L1X_READY           0x01U
+
+/** Values of VL53L1X_REG_MODE_START */
+#define VL53L1X_MODE_STOP       0x00U
+#define VL53L1X_MODE_START      0x40U
+
+/** Offset of the range in the result block */
+#define VL53L1X_RESULT_RANGE    13U
+
+/** Range statuses that are not mapped */
+#define VL53L1X_STATUS_UNKNOWN  255U
+
+/* Private typedef -----------------------------------------------------------*/
+/**
+  * @brief  One register write of the setup sequence, value sent big endian.
+  */
+typedef struct
+{
+  uint16_t reg;
+  uint8_t size;
+  uint32_t value;
+} VL53L1X_WriteTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+VL53L1X_HandleTypeDef hvl53l1x;
+
+/* Private variables ---------------------------------------------------------*/
+/** Default configuration of registers 0x2D to 0x87, ultra lite driver */
+static const uint8_t vl53l1x_config[VL53L1X_CONFIG_SIZE] =
+{
+  0x00U, 0x00U, 0x00U, 0x01U, 0x02U, 0x00U, 0x02U, 0x08U,  /* 0x2D */
+  0x00U, 0x08U, 0x10U, 0x01U, 0x01U, 0x00U, 0x00U, 0x00U,  /* 0x35 */
+  0x00U, 0xFFU, 0x00U, 0x0FU, 0x00U, 0x00U, 0x00U, 0x00U,  /* 0x3D */
+  0x00U, 0x20U, 0x0BU, 0x00U, 0x00U, 0x02U, 0x0AU, 0x21U,  /* 0x45 */
+  0x00U, 0x00U, 0x05U, 0x00U, 0x00U, 0x00U, 0x00U, 0xC8U,  /* 0x4D */
+  0x00U, 0x00U, 0x38U, 0xFFU, 0x01U, 0x00U, 0x08U, 0x00U,  /* 0x55 */
+  0x00U, 0x01U, 0xCCU, 0x0FU, 0x01U, 0xF1U, 0x0DU, 0x01U,  /* 0x5D */
+  0x68U, 0x00U, 0x80U, 0x08U, 0xB8U, 0x00U, 0x00U, 0x00U,  /* 0x65 */
+  0x00U, 0x0FU, 0x89U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U,  /* 0x6D */
+  0x00U, 0x00U, 0x01U, 0x0FU, 0x0DU, 0x0EU, 0x0EU, 0x00U,  /* 0x75 */
+  0x00U, 0x02U, 0xC7U, 0xFFU, 0x9BU, 0x00U, 0x00U, 0x00U,  /* 0x7D */
+  0x01U, 0x00U, 0x00U,                                     /* 0x85 */
+};
+
+/** Writes between the VHV ranging and continuous ranging */
+static const VL53L1X_WriteTypeDef vl53l1x_setup[] =
+{
+  { VL53L1X_REG_INTERRUPT_CLEAR,     1U, 0x01U },        /* End of the VHV ranging      */
+  { VL53L1X_REG_MODE_START,          1U, VL53L1X_MODE_STOP },
+  { VL53L1X_REG_VHV_LOOP_BOUND,      1U, 0x09U },        /* Two bounds VHV              */
+  { VL53L1X_REG_VHV_INIT,            1U, 0x00U },        /* Start VHV from last value   */
+  { VL53L1X_REG_PHASECAL_TIMEOUT,    1U, 0x14U },        /* Short distance mode         */
+  { VL53L1X_REG_VCSEL_PERIOD_A,      1U, 0x07U },
+  { VL53L1X_REG_VCSEL_PERIOD_B,      1U, 0x05U },
+  { VL53L1X_REG_VALID_PHASE_HIGH,    1U, 0x38U },
+  { VL53L1X_REG_WOI_SD0,             2U, 0x0705U },
+  { VL53L1X_REG_INITIAL_PHASE_SD0,   2U, 0x0606U },
+  { VL53L1X_REG_TIMEOUT_MACROP_A,    2U, 0x0051U },      /* 20 ms budget, short mode    */
+  { VL53L1X_REG_TIMEOUT_MACROP_B,    2U, 0x006EU },
+  { VL53L1X_REG_INTERMEASUREMENT,    4U, 0U },           /* From the oscillator value   */
+  { VL53L1X_REG_INTERRUPT_CLEAR,     1U, 0x01U },
+  { VL53L1X_REG_MODE_START,          1U, VL53L1X_MODE_START },
+};
+
+#define VL53L1X_SETUP_COUNT     (sizeof(vl53l1x_setup) / sizeof(vl53l1x_setup[0]))
+
+/** Device range status to ultra lite driver status, 0 is a valid range */
+static const uint8_t vl53l1x_status[24] =
+{
+  255U, 255U, 255U, 5U, 2U, 4U, 1U, 7U, 3U, 0U, 255U, 255U,
+  9U, 13U, 255U, 255U, 255U, 255U, 10U, 6U, 255U, 255U, 11U, 12U,
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static void VL53L1X_JobCallback(I2C_JobTypeDef *job);
+static HAL_StatusTypeDef VL53L1X_ReadReg(VL53L1X_HandleTypeDef *dev, uint16_t reg, uint16_t size);
+static HAL_StatusTypeDef VL53L1X_WriteReg(VL53L1X_HandleTypeDef *dev, uint16_t reg, uint8_t size, uint32_t value);
+static void VL53L1X_WriteSetup(VL53L1X_HandleTypeDef *dev);
+static void VL53L1X_OnResult(VL53L1X_HandleTypeDef *dev);
+static void VL53L1X_OnRun(VL53L1X_HandleTypeDef *dev, I2C_JobTypeDef *job);
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Queue a register read into the buffer.
+  * @param  dev Driver instance
+  * @param  reg First register
+  * @param  size Number of bytes
+  * @retval HAL_OK when queued
+  */
+static HAL_StatusTypeDef VL53L1X_ReadReg(VL53L1X_HandleTypeDef *dev, uint16_t reg, uint16_t size)
+{
+  return I2C_Bus_Read16(dev->bus, &dev->job, dev->address, reg, dev->buffer, size, VL53L1X_JobCallback, dev);
+}
+
+/**
+  * @brief  Queue a register write of up to 4 bytes, sent big endian.
+  * @param  dev Driver instance
+  * @param  reg First register
+  * @param  size Number of bytes
+  * @param  value Value to write
+  * @retval HAL_OK when queued
+  */
+static HAL_StatusTypeDef VL53L1X_WriteReg(VL53L1X_HandleTypeDef *dev, uint16_t reg, uint8_t size, uint32_t value)
+{
+  uint32_t i;
+
+  for (i = 0U; i < size; i++)
+  {
+    dev->buffer[i] = (uint8_t)(value >> (8U * (size - 1U - i)));
+  }
+  return I2C_Bus_Write16(dev->bus, &dev->job, dev->address, reg, dev->buffer, size, VL53L1X_JobCallback, dev);
+}
+
+/**
+  * @brief  Queue the current write of the setup sequence.
+  * @param  dev Driver instance
+  */
+static void VL53L1X_WriteSetup(VL53L1X_HandleTypeDef *dev)
+{
+  const VL53L1X_WriteTypeDef *write = &vl53l1x_setup[dev->setup_index];
+  uint32_t value = (write->reg == VL53L1X_REG_INTERMEASUREMENT) ? dev->intermeasurement : write->value;
+
+  /* On failure the write is issued again by VL53L1X_Poll() */
+  (void)VL53L1X_WriteReg(dev, write->reg, write->size, value);
+}
+
+/**
+  * @brief  Result block received: publish the range.
+  * @param  dev Driver instance
+  */
+static void VL53L1X_OnResult(VL53L1X_HandleTypeDef *dev)
+{
+  uint8_t device_status = dev->buffer[0] & 0x1FU;
+  uint8_t status = (device_status < sizeof(vl53l1x_status)) ? vl53l1x_status[device_status]
+                                                           : VL53L1X_STATUS_UNKNOWN;
+  uint16_t range = (uint16_t)(((uint16_t)dev->buffer[VL53L1X_RESULT_RANGE] << 8) |
+                              dev->buffer[VL53L1X_RESULT_RANGE + 1U]);
+
+  /* The range was ready at some point of the last poll period and the
+   * ranging is integrated over the timing budget before that */
+  uint32_t age = Timing_UsToCycles((500000U / VL53L1X_POLL_HZ) + (VL53L1X_TIMING_BUDGET_MS * 500U));
+
+  /* Odd sequence while the sample is being written, see VL53L1X_Read() */
+  dev->sequence++;
+  __DMB();
+  dev->sample.timestamp = dev->ready_stamp - age;
+  dev->sample.range_mm = range;
+  dev->sample.status = status;
+  dev->sample.valid = (status == 0U) ? 1U : 0U;
+  __DMB();
+  dev->sequence++;
+  dev->stats.samples++;
+  if (status != 0U)
+  {
+    dev->stats.invalid++;
+  }
+}
+
+/**
+  * @brief  Completion of a job while ranging: status read, result read or
+  *         interrupt clear, told apart by the register of the job.
+  * @param  dev Driver instance
+  * @param  job Completed job
+  */
+static void VL53L1X_OnRun(VL53L1X_HandleTypeDef *dev, I2C_JobTypeDef *job)
+{
+  dev->bus_cycles += job->cycles;
+
+  switch (job->reg)
+  {
+    case VL53L1X_REG_GPIO_TIO_HV_STATUS:
+      if ((dev->buffer[0] & 0x01U) != VL53L1X_READY)
+      {
+        dev->stats.not_ready++;
+        break;
+      }
+      (void)VL53L1X_ReadReg(dev, VL53L1X_REG_RESULT, VL53L1X_RESULT_SIZE);
+      break;
+
+    case VL53L1X_REG_RESULT:
+      VL53L1X_OnResult(dev);
+      /* Arms the next result-ready flag, the ranging itself does not stop */
+      (void)VL53L1X_WriteReg(dev, VL53L1X_REG_INTERRUPT_CLEAR, 1U, 0x01U);
+      break;
+
+    case VL53L1X_REG_INTERRUPT_CLEAR:
+      Timing_PerfAdd(&dev->stats.sample_bus_cycles, dev->bus_cycles);
+      dev->bus_cycles = 0U;
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+  * @brief  Completion callback of every job of the driver, interrupt context.
+  * @param  job Completed job
+  */
+static void VL53L1X_JobCallback(I2C_JobTypeDef *job)
+{
+  VL53L1X_HandleTypeDef *dev = (VL53L1X_HandleTypeDef *)job->context;
+  uint16_t osc;
+
+  if (job->state != I2C_JOB_DONE)
+  {
+    /* Setup steps are issued again by VL53L1X_Poll() */
+    dev->stats.bus_errors++;
+    dev->failures++;
+    return;
+  }
+  dev->failures = 0U;
+
+  switch (dev->state)
+  {
+    case VL53L1X_STATE_BOOT:
+      if ((dev->buffer[0] & 0x01U) != 0U)
+      {
+        dev->state = VL53L1X_STATE_IDENTIFY;
+      }
+      break;
+
+    case VL53L1X_STATE_IDENTIFY:
+      dev->state = ((((uint16_t)dev->buffer[0] << 8) | dev->buffer[1]) == VL53L1X_MODEL_ID)
+                   ? VL53L1X_STATE_OSCILLATOR : VL53L1X_STATE_ERROR;
+      break;
+
+    case VL53L1X_STATE_OSCILLATOR:
+      /* Inter-measurement period in oscillator ticks, ultra lite driver */
+      osc = (uint16_t)((((uint16_t)dev->buffer[0] << 8) | dev->buffer[1]) & 0x03FFU);
+      dev->intermeasurement = ((uint32_t)osc * VL53L1X_RANGE_PERIOD_MS * 1075U) / 1000U;
+      dev->state = VL53L1X_STATE_CONFIG;
+      break;
+
+    case VL53L1X_STATE_CONFIG:
+      dev->state = VL53L1X_STATE_VHV_START;
+      break;
+
+    case VL53L1X_STATE_VHV_START:
+      dev->state = VL53L1X_STATE_VHV_WAIT;
+      break;
+
+    case VL53L1X_STATE_VHV_WAIT:
+      if ((dev->buffer[0] & 0x01U) == VL53L1X_READY)
+      {
+        dev->setup_index = 0U;
+        dev->state = VL53L1X_STATE_SETUP;
+      }
+      break;
+
+    case VL53L1X_STATE_SETUP:
+      dev->setup_index++;
+      if (dev->setup_index < VL53L1X_SETUP_COUNT)
+      {
+        VL53L1X_WriteSetup(dev);
+        break;
+      }
+      dev->bus_cycles = 0U;
+      dev->state = VL53L1X_STATE_RUN;
+      break;
+
+    case VL53L1X_STATE_RUN:
+      VL53L1X_OnRun(dev, job);
+      break;
+
+    default:
+      break;
+  }
+}
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Bind a driver instance to its bus. The device is set up by the
+  *         following VL53L1X_Poll() calls.
+  * @param  dev Driver instance
+  * @param  bus Bus the sensor is on
+  * @param  address 7-bit device address
+  */
+void VL53L1X_Init(VL53L1X_HandleTypeDef *dev, I2C_BusTypeDef *bus, uint8_t address)
+{
+  dev->bus = bus;
+  dev->address = address;
+  dev->state = VL53L1X_STATE_BOOT;
+  dev->setup_index = 0U;
+  dev->failures = 0U;
+  dev->stamp = Timing_Cycles() - Timing_UsToCycles(VL53L1X_SETUP_POLL_US);
+  dev->bus_cycles = 0U;
+  dev->sequence = 0U;
+  dev->job.state = I2C_JOB_IDLE;
+  dev->stats.polls = 0U;
+  dev->stats.not_ready = 0U;
+  dev->stats.samples = 0U;
+  dev->stats.invalid = 0U;
+  dev->stats.bus_errors = 0U;
+  Timing_PerfReset(&dev->stats.sample_bus_cycles);
+}
+
+/**
+  * @brief  Advance the device setup, call from the main loop. Never waits:
+  *         at most one bus job is queued every VL53L1X_SETUP_POLL_US.
+  * @param  dev Driver instance
+  */
+void VL53L1X_Poll(VL53L1X_HandleTypeDef *dev)
+{
+  uint32_t now = Timing_Cycles();
+
+  if ((dev->state == VL53L1X_STATE_RUN) || (dev->state == VL53L1X_STATE_ERROR) ||
+      I2C_Job_IsPending(&dev->job) || ((now - dev->stamp) < Timing_UsToCycles(VL53L1X_SETUP_POLL_US)))
+  {
+    return;
+  }
+  dev->stamp = now;
+
+  switch (dev->state)
+  {
+    case VL53L1X_STATE_BOOT:
+      (void)VL53L1X_ReadReg(dev, VL53L1X_REG_SYSTEM_STATUS, 1U);
+      break;
+
+    case VL53L1X_STATE_IDENTIFY:
+      (void)VL53L1X_ReadReg(dev, VL53L1X_REG_MODEL_ID, 2U);
+      break;
+
+    case VL53L1X_STATE_OSCILLATOR:
+      (void)VL53L1X_ReadReg(dev, VL53L1X_REG_OSC_CALIBRATE, 2U);
+      break;
+
+    case VL53L1X_STATE_CONFIG:
+      memcpy(dev->buffer, vl53l1x_config, VL53L1X_CONFIG_SIZE);
+      (void)I2C_Bus_Write16(dev->bus, &dev->job, dev->address, VL53L1X_REG_CONFIG_FIRST,
+                            dev->buffer, VL53L1X_CONFIG_SIZE, VL53L1X_JobCallback, dev);
+      break;
+
+    case VL53L1X_STATE_VHV_START:
+      (void)VL53L1X_WriteReg(dev, VL53L1X_REG_MODE_START, 1U, VL53L1X_MODE_START);
+      break;
+
+    case VL53L1X_STATE_VHV_WAIT:
+      (void)VL53L1X_ReadReg(dev, VL53L1X_REG_GPIO_TIO_HV_STATUS, 1U);
+      break;
+
+    case VL53L1X_STATE_SETUP:
+      VL53L1X_WriteSetup(dev);
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+  * @brief  Check for a new range, called at VL53L1X_POLL_HZ by the scheduler.
+  *         The result read and interrupt clear are chained from the
+  *         completion callback only when a range is ready.
+  * @param  dev Driver instance
+  * @retval Job of the poll, NULL when the device is not ranging
+  */
+I2C_JobTypeDef *VL53L1X_Range(VL53L1X_HandleTypeDef *dev)
+{
+  if ((dev->state != VL53L1X_STATE_RUN) || I2C_Job_IsPending(&dev->job))
+  {
+    return NULL;
+  }
+  if (dev->failures > VL53L1X_MAX_FAILURES)
+  {
+    /* Silent device, set it up again from VL53L1X_Poll() */
+    dev->failures = 0U;
+    dev->state = VL53L1X_STATE_BOOT;
+    return NULL;
+  }
+
+  dev->ready_stamp = Timing_Cycles64();
+  if (VL53L1X_ReadReg(dev, VL53L1X_REG_GPIO_TIO_HV_STATUS, 1U) != HAL_OK)
+  {
+    return NULL;
+  }
+  dev->stats.polls++;
+  return &dev->job;
+}
+
+/**
+  * @brief  Copy the latest sample, safe against the completion interrupt.
+  * @param  dev Driver instance
+  * @param  sample Destination
+  * @retval Sequence number of the sample, 0 while none is available
+  */
+uint32_t VL53L1X_Read(VL53L1X_HandleTypeDef *dev, VL53L1X_SampleTypeDef *sample)
+{
+  uint32_t sequence;
+
+  do
+  {
+    sequence = dev->sequence;
+    __DMB();
+    *sample = dev->sample;
+    __DMB();
+  } while (((sequence & 1U) != 0U) || (sequence != dev->sequence));
+
+  return sequence >> 1;
+}
@@ -0,0 +1,352 @@
+/**
+  ******************************************************************************
+  * @file    vote.c
+  * @brief   This file provides the dual IMU voter.
+  *
+  *          Each stream is checked on every sample: stale (no sample within
+  *          VOTE_TIMEOUT_US), stuck (gyro repeated bit for bit) and noisy
+  *          (sample to sample change energy far above the other stream's).
+  *          A failed stream is used again only after VOTE_RECOVER_SAMPLES
+  *          fault free checks.
+  *
+  *          Two healthy streams are also compared: a bias or scale fault
+  *          shows as a persistent difference. Two streams cannot tell which
+  *          one is wrong, so the voter then falls back to the stream with
+  *          the fewest past faults, the current primary on a tie, and
+  *          reports the inconsistency.
+  *
+  *          Healthy and consistent streams are blended with weights inverse
+  *          to their noise estimates, or the primary alone is used. Any
+  *          weight change would step the output by the offset between the
+  *          streams; that step, taken from the filtered difference so the
+  *          last sample of a failing stream does not leak in, goes into an
+  *          offset that decays to zero. Failover never shows as a rate spike
+  *          in the filters.
+  *
+  *          The output is clocked by the primary stream: Vote_Run() produces
+  *          a sample when the primary delivered a new one.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "vote.h"
+#include <math.h>
+
+#if VOTE_IMUS != 2U
+#error "The consistency check compares exactly two streams"
+#endif
+
+/* Exported variables --------------------------------------------------------*/
+Vote_HandleTypeDef hvote;
+
+/* Private function prototypes -----------------------------------------------*/
+static void Vote_Check(Vote_HandleTypeDef *vote, uint64_t now);
+static uint8_t Vote_Usable(const Vote_HandleTypeDef *vote, uint32_t index);
+static void Vote_Compare(Vote_HandleTypeDef *vote, uint8_t voting);
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Update the fault flags of every stream.
+  * @param  vote Voter instance
+  * @param  now Current cycle time
+  */
+static void Vote_Check(Vote_HandleTypeDef *vote, uint64_t now)
+{
+  uint64_t timeout = Timing_UsToCycles(VOTE_TIMEOUT_US);
+  uint8_t faults[VOTE_IMUS];
+  uint32_t i;
+  uint32_t other;
+
+  for (i = 0U; i < VOTE_IMUS; i++)
+  {
+    Vote_ImuTypeDef *imu = &vote->imu[i];
+
+    faults[i] = 0U;
+    if ((imu->valid == 0U) || ((now - imu->sample.timestamp) > timeout))
+    {
+      faults[i] |= VOTE_FAULT_STALE;
+    }
+    if (imu->stuck >= VOTE_STUCK_SAMPLES)
+    {
+      faults[i] |= VOTE_FAULT_STUCK;
+    }
+  }
+
+  /* Noise relative to a stream that is itself alive */
+  for (i = 0U; i < VOTE_IMUS; i++)
+  {
+    other = 1U - i;
+    if ((faults[other] == 0U) &&
+        (vote->imu[i].noise > ((VOTE_NOISE_RATIO * vote->imu[other].noise) + VOTE_NOISE_FLOOR)))
+    {
+      faults[i] |= VOTE_FAULT_NOISY;
+    }
+  }
+
+  for (i = 0U; i < VOTE_IMUS; i++)
+  {
+    Vote_ImuTypeDef *imu = &vote->imu[i];
+
+    if (faults[i] != 0U)
+    {
+      if ((imu->faults == 0U) && (imu->valid != 0U))
+      {
+        imu->fault_events++;
+      }
+      imu->healthy = 0U;
+    }
+    else if (imu->healthy < VOTE_RECOVER_SAMPLES)
+    {
+      imu->healthy++;
+    }
+    imu->faults = faults[i];
+  }
+}
+
+/**
+  * @brief  Whether a stream may take part in the output.
+  * @param  vote Voter instance
+  * @param  index Stream
+  * @retval 1 when usable
+  */
+static uint8_t Vote_Usable(const Vote_HandleTypeDef *vote, uint32_t index)
+{
+  const Vote_ImuTypeDef *imu = &vote->imu[index];
+
+  return ((imu->faults == 0U) &&
+          (((vote->active & (1U << index)) != 0U) || (imu->healthy >= VOTE_RECOVER_SAMPLES))) ? 1U : 0U;
+}
+
+/**
+  * @brief  Track the difference between the two fault free streams, at the
+  *         output rate, and pick the primary while they disagree. A stream
+  *         still recovering is tracked so its offset is known when it joins.
+  * @param  vote Voter instance
+  * @param  voting 1 when both streams are usable
+  */
+static void Vote_Compare(Vote_HandleTypeDef *vote, uint8_t voting)
+{
+  float worst = 0.0f;
+  uint32_t other = 1U - vote->primary;
+  uint32_t i;
+
+  for (i = 0U; i < 3U; i++)
+  {
+    float d = vote->imu[0].sample.gyro[i] - vote->imu[1].sample.gyro[i];
+
+    vote->gyro_diff[i] += VOTE_DIFF_ALPHA * (d - vote->gyro_diff[i]);
+    vote->accel_diff[i] += VOTE_DIFF_ALPHA *
+                           ((vote->imu[0].sample.accel[i] - vote->imu[1].sample.accel[i]) - vote->accel_diff[i]);
+    if (fabsf(vote->gyro_diff[i]) > worst)
+    {
+      worst = fabsf(vote->gyro_diff[i]);
+    }
+  }
+
+  if (voting == 0U)
+  {
+    vote->inconsistent = 0U;
+  }
+  else if ((vote->inconsistent == 0U) && (worst > VOTE_DIFF_MAX))
+  {
+    vote->inconsistent = 1U;
+    vote->stats.inconsistencies++;
+    if (vote->imu[other].fault_events < vote->imu[vote->primary].fault_events)
+    {
+      vote->primary = (uint8_t)other;
+      vote->stats.switches++;
+    }
+  }
+  else if ((vote->inconsistent != 0U) && (worst < (0.5f * VOTE_DIFF_MAX)))
+  {
+    vote->inconsistent = 0U;
+  }
+}
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Reset a voter, every stream starts as usable.
+  * @param  vote Voter instance
+  * @param  policy Combination of healthy streams
+  */
+void Vote_Init(Vote_HandleTypeDef *vote, Vote_PolicyTypeDef policy)
+{
+  uint32_t i;
+
+  vote->policy = (uint8_t)policy;
+  vote->primary = 0U;
+  vote->active = (uint8_t)((1U << VOTE_IMUS) - 1U);
+  vote->inconsistent = 0U;
+  for (i = 0U; i < VOTE_IMUS; i++)
+  {
+    vote->imu[i].valid = 0U;
+    vote->imu[i].fresh = 0U;
+    vote->imu[i].faults = 0U;
+    vote->imu[i].stuck = 0U;
+    vote->imu[i].healthy = 0U;
+    vote->imu[i].fault_events = 0U;
+    vote->imu[i].noise = 0.0f;
+    vote->weight[i] = 0.0f;
+  }
+  for (i = 0U; i < 3U; i++)
+  {
+    vote->gyro_diff[i] = 0.0f;
+    vote->accel_diff[i] = 0.0f;
+    vote->gyro_offset[i] = 0.0f;
+    vote->accel_offset[i] = 0.0f;
+  }
+  vote->stats.outputs = 0U;
+  vote->stats.switches = 0U;
+  vote->stats.inconsistencies = 0U;
+  vote->stats.no_imu = 0U;
+  Timing_PerfReset(&vote->stats.cycles);
+}
+
+/**
+  * @brief  Give a new sample of a stream, call Vote_Run() after each one.
+  * @param  vote Voter instance
+  * @param  index Stream, 0 to VOTE_IMUS - 1
+  * @param  sample New sample
+  */
+void Vote_Push(Vote_HandleTypeDef *vote, uint32_t index, const IMU_LoopSampleTypeDef *sample)
+{
+  Vote_ImuTypeDef *imu = &vote->imu[index];
+  float energy = 0.0f;
+  uint32_t repeated = 0U;
+  uint32_t i;
+
+  if (imu->valid != 0U)
+  {
+    for (i = 0U; i < 3U; i++)
+    {
+      float d = sample->gyro[i] - imu->sample.gyro[i];
+
+      energy += d * d;
+      repeated += (d == 0.0f) ? 1U : 0U;
+    }
+    imu->noise += VOTE_NOISE_ALPHA * ((energy * (1.0f / 3.0f)) - imu->noise);
+    if (repeated == 3U)
+    {
+      if (imu->stuck < VOTE_STUCK_SAMPLES)
+      {
+        imu->stuck++;
+      }
+    }
+    else
+    {
+      imu->stuck = 0U;
+    }
+  }
+
+  imu->sample = *sample;
+  imu->valid = 1U;
+  imu->fresh = 1U;
+}
+
+/**
+  * @brief  Check the streams and produce the voted sample when the primary
+  *         stream has a new one.
+  * @param  vote Voter instance
+  * @param  now Current cycle time, see Timing_Cycles64()
+  * @param  out Destination of the voted sample
+  * @retval 1 when out was written, 0 otherwise
+  */
+uint8_t Vote_Run(Vote_HandleTypeDef *vote, uint64_t now, IMU_LoopSampleTypeDef *out)
+{
+  uint32_t start = Timing_Cycles();
+  float weight[VOTE_IMUS];
+  float total;
+  float shift;
+  float skew;
+  uint8_t usable[VOTE_IMUS];
+  uint8_t active = 0U;
+  uint32_t other;
+  uint32_t i;
+  uint32_t k;
+
+  Vote_Check(vote, now);
+  for (i = 0U; i < VOTE_IMUS; i++)
+  {
+    usable[i] = Vote_Usable(vote, i);
+  }
+
+  if (usable[vote->primary] == 0U)
+  {
+    other = 1U - vote->primary;
+    if (usable[other] == 0U)
+    {
+      vote->stats.no_imu++;
+      vote->active = 0U;
+      Timing_PerfAdd(&vote->stats.cycles, Timing_Cycles() - start);
+      return 0U;
+    }
+    vote->primary = (uint8_t)other;
+    vote->stats.switches++;
+  }
+  if (vote->imu[vote->primary].fresh == 0U)
+  {
+    Timing_PerfAdd(&vote->stats.cycles, Timing_Cycles() - start);
+    return 0U;
+  }
+
+  /* The differences stay frozen while a stream is faulty */
+  if ((vote->imu[0].faults == 0U) && (vote->imu[1].faults == 0U))
+  {
+    Vote_Compare(vote, ((usable[0] != 0U) && (usable[1] != 0U)) ? 1U : 0U);
+  }
+  else
+  {
+    vote->inconsistent = 0U;
+  }
+
+  /* Weights of this output */
+  total = 0.0f;
+  for (i = 0U; i < VOTE_IMUS; i++)
+  {
+    weight[i] = 0.0f;
+    if ((usable[i] != 0U) && ((i == vote->primary) ||
+        ((vote->policy == VOTE_POLICY_BLEND) && (vote->inconsistent == 0U))))
+    {
+      weight[i] = 1.0f / (vote->imu[i].noise + VOTE_NOISE_FLOOR);
+      active |= (uint8_t)(1U << i);
+    }
+    total += weight[i];
+  }
+
+  for (i = 0U; i < VOTE_IMUS; i++)
+  {
+    weight[i] /= total;
+  }
+
+  /* Output step due to the weight change alone, the weights summing to 1:
+   * (old w0 - new w0) * (stream 0 - stream 1) */
+  shift = (vote->stats.outputs != 0U) ? (vote->weight[0] - weight[0]) : 0.0f;
+  skew = 0.0f;
+  for (k = 0U; k < 3U; k++)
+  {
+    float gyro = 0.0f;
+    float accel = 0.0f;
+
+    for (i = 0U; i < VOTE_IMUS; i++)
+    {
+      gyro += weight[i] * vote->imu[i].sample.gyro[k];
+      accel += weight[i] * vote->imu[i].sample.accel[k];
+    }
+    vote->gyro_offset[k] = (vote->gyro_offset[k] + (shift * vote->gyro_diff[k])) * VOTE_HANDOVER_DECAY;
+    vote->accel_offset[k] = (vote->accel_offset[k] + (shift * vote->accel_diff[k])) * VOTE_HANDOVER_DECAY;
+    out->gyro[k] = gyro + vote->gyro_offset[k];
+    out->accel[k] = accel + vote->accel_offset[k];
+  }
+
+  /* A blend represents the weighted instant of its samples */
+  for (i = 0U; i < VOTE_IMUS; i++)
+  {
+    skew += weight[i] * (float)(int64_t)(vote->imu[i].sample.timestamp - vote->imu[vote->primary].sample.timestamp);
+    vote->weight[i] = weight[i];
+    vote->imu[i].fresh = 0U;
+  }
+  out->timestamp = vote->imu[vote->primary].sample.timestamp + (uint64_t)(int64_t)skew;
+  vote->active = active;
+  vote->stats.outputs++;
+  Timing_PerfAdd(&vote->stats.cycles, Timing_Cycles() - start);
+  return 1U;
+}
@@ -0,0 +1,441 @@
+/**
+  ******************************************************************************
+  * @file    mock_hal.c
+  * @brief   This file provides the host HAL: recorded I2C, DMA and GPIO
+  *          calls, the core registers as variables and the SPI1 register
+  *          model driving a device callback.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "mock_hal.h"
+#include <string.h>
+
+/* Exported variables --------------------------------------------------------*/
+Mock_HalTypeDef mock_hal;
+CoreDebug_Type mock_core_debug;
+uint32_t mock_primask;
+uint32_t mock_basepri;
+uint32_t SystemCoreClock = 168000000U;
+GPIO_TypeDef mock_gpioa;
+GPIO_TypeDef mock_gpiob;
+GPIO_TypeDef mock_gpioc;
+DMA_Stream_TypeDef mock_dma2_stream0;
+DMA_Stream_TypeDef mock_dma2_stream3;
+SPI_TypeDef mock_spi1;
+I2C_TypeDef mock_i2c1;
+I2C_TypeDef mock_i2c2;
+
+/* Private variables ---------------------------------------------------------*/
+static DWT_Type mock_dwt;
+
+/* Private function prototypes -----------------------------------------------*/
+static HAL_StatusTypeDef Mock_I2cStart(I2C_HandleTypeDef *hi2c, uint8_t read, uint16_t DevAddress,
+                                       uint8_t *pData, uint16_t Size, uint32_t XferOptions);
+static Mock_I2cSegmentTypeDef *Mock_I2cFind(const I2C_HandleTypeDef *hi2c);
+static void Mock_HalCall(void);
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Account for a HAL call made with the I2C engine's lock held.
+  */
+static void Mock_HalCall(void)
+{
+  if ((mock_basepri != 0U) || (mock_primask != 0U))
+  {
+    mock_hal.basepri_calls++;
+  }
+}
+
+static Mock_I2cSegmentTypeDef *Mock_I2cFind(const I2C_HandleTypeDef *hi2c)
+{
+  uint32_t i;
+
+  for (i = 0U; i < MOCK_I2C_HANDLES; i++)
+  {
+    Mock_I2cSegmentTypeDef *segment = mock_hal.i2c_pending[i];
+
+    if ((segment != NULL) && (segment->hi2c == hi2c) && (segment->done == 0U))
+    {
+      return segment;
+    }
+  }
+  return NULL;
+}
+
+static HAL_StatusTypeDef Mock_I2cStart(I2C_HandleTypeDef *hi2c, uint8_t read, uint16_t DevAddress,
+                                       uint8_t *pData, uint16_t Size, uint32_t XferOptions)
+{
+  Mock_I2cSegmentTypeDef *segment;
+  HAL_StatusTypeDef status = mock_hal.i2c_status;
+  uint32_t slot;
+
+  Mock_HalCall();
+  if (status != HAL_OK)
+  {
+    hi2c->ErrorCode = mock_hal.i2c_status_error;
+    mock_hal.i2c_status = HAL_OK;
+    return status;
+  }
+  if (Mock_I2cFind(hi2c) != NULL)
+  {
+    /* The HAL refuses a start while its handle is busy */
+    return HAL_BUSY;
+  }
+
+  hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+  segment = &mock_hal.i2c_log[mock_hal.i2c_count % MOCK_I2C_LOG_LEN];
+  segment->hi2c = hi2c;
+  segment->read = read;
+  segment->address = (uint8_t)(DevAddress >> 1);
+  segment->data = pData;
+  segment->size = Size;
+  segment->option = XferOptions;
+  segment->done = 0U;
+  mock_hal.i2c_count++;
+
+  /* Replaces a finished segment, the HAL runs one per handle */
+  for (slot = 0U; slot < MOCK_I2C_HANDLES; slot++)
+  {
+    Mock_I2cSegmentTypeDef *previous = mock_hal.i2c_pending[slot];
+
+    if ((previous == NULL) || (previous->done != 0U) || (previous == segment))
+    {
+      mock_hal.i2c_pending[slot] = segment;
+      break;
+    }
+  }
+  return HAL_OK;
+}
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Clear every record, the registers and the cycle counter. The
+  *         counter then advances by one cycle per read.
+  */
+void Mock_Reset(void)
+{
+  memset(&mock_hal, 0, sizeof(mock_hal));
+  memset(&mock_dwt, 0, sizeof(mock_dwt));
+  memset(&mock_gpioa, 0, sizeof(mock_gpioa));
+  memset(&mock_gpiob, 0, sizeof(mock_gpiob));
+  memset(&mock_gpioc, 0, sizeof(mock_gpioc));
+  memset(&mock_spi1, 0, sizeof(mock_spi1));
+  memset(&mock_i2c1, 0, sizeof(mock_i2c1));
+  memset(&mock_i2c2, 0, sizeof(mock_i2c2));
+  mock_primask = 0U;
+  mock_basepri = 0U;
+  mock_hal.cycle_step = 1U;
+  mock_hal.i2c_status = HAL_OK;
+}
+
+/**
+  * @brief  Let time pass.
+  * @param  us Duration in microseconds
+  */
+void Mock_AdvanceUs(uint32_t us)
+{
+  mock_dwt.CYCCNT += us * (SystemCoreClock / 1000000U);
+}
+
+DWT_Type *Mock_Dwt(void)
+{
+  mock_dwt.CYCCNT += mock_hal.cycle_step;
+  return &mock_dwt;
+}
+
+/**
+  * @brief  Segment in progress on a handle.
+  * @param  hi2c HAL handle
+  * @retval Started and not completed segment, NULL when the handle is idle
+  */
+const Mock_I2cSegmentTypeDef *Mock_I2cPending(const I2C_HandleTypeDef *hi2c)
+{
+  return Mock_I2cFind(hi2c);
+}
+
+/**
+  * @brief  Complete the segment in progress on a handle as its interrupt
+  *         would: the device model serves it, then the HAL callback runs.
+  * @param  hi2c HAL handle
+  * @retval 1 when a segment was completed, 0 when the handle was idle
+  */
+uint32_t Mock_I2cRun(I2C_HandleTypeDef *hi2c)
+{
+  Mock_I2cSegmentTypeDef *segment = Mock_I2cFind(hi2c);
+  uint32_t error = HAL_I2C_ERROR_NONE;
+  uint8_t read;
+
+  if (segment == NULL)
+  {
+    return 0U;
+  }
+  if (mock_hal.i2c_device != NULL)
+  {
+    error = mock_hal.i2c_device(segment);
+  }
+  segment->done = 1U;
+  mock_hal.i2c_done++;
+  read = segment->read;
+
+  if (error != HAL_I2C_ERROR_NONE)
+  {
+    hi2c->ErrorCode = error;
+    HAL_I2C_ErrorCallback(hi2c);
+  }
+  else if (read != 0U)
+  {
+    HAL_I2C_MasterRxCpltCallback(hi2c);
+  }
+  else
+  {
+    HAL_I2C_MasterTxCpltCallback(hi2c);
+  }
+  return 1U;
+}
+
+/**
+  * @brief  Complete segments on a handle until it is idle.
+  * @param  hi2c HAL handle
+  * @retval Number of segments completed
+  */
+uint32_t Mock_I2cRunAll(I2C_HandleTypeDef *hi2c)
+{
+  uint32_t count = 0U;
+
+  while (Mock_I2cRun(hi2c) != 0U)
+  {
+    count++;
+  }
+  return count;
+}
+
+/**
+  * @brief  End the segment in progress on a handle with an error.
+  * @param  hi2c HAL handle
+  * @param  error HAL_I2C_ERROR_xxx reported
+  */
+void Mock_I2cFail(I2C_HandleTypeDef *hi2c, uint32_t error)
+{
+  Mock_I2cSegmentTypeDef *segment = Mock_I2cFind(hi2c);
+
+  if (segment != NULL)
+  {
+    segment->done = 1U;
+    mock_hal.i2c_done++;
+  }
+  hi2c->ErrorCode = error;
+  HAL_I2C_ErrorCallback(hi2c);
+}
+
+/**
+  * @brief  Run the pending SPI1 DMA burst through the device model, then
+  *         report the RX stream completion.
+  * @retval 1 when a burst ran, 0 when none was started with chip select low
+  *         and both DMA requests enabled
+  */
+uint32_t Mock_SpiDmaRun(void)
+{
+  Mock_DmaStartTypeDef rx = {0};
+  Mock_DmaStartTypeDef tx = {0};
+  const uint8_t *src;
+  uint8_t *dst;
+  uint32_t i;
+
+  for (i = 0U; i < mock_hal.dma_count; i++)
+  {
+    if (mock_hal.dma_log[i].hdma->Init.Direction == DMA_MEMORY_TO_PERIPH)
+    {
+      tx = mock_hal.dma_log[i];
+    }
+    else
+    {
+      rx = mock_hal.dma_log[i];
+    }
+  }
+  mock_hal.dma_count = 0U;
+  if ((rx.hdma == NULL) || (tx.hdma == NULL) || (rx.length != tx.length) ||
+      (rx.src != (uint32_t)(uintptr_t)&SPI1->DR) || (tx.dst != (uint32_t)(uintptr_t)&SPI1->DR) ||
+      ((IMU2_CS_GPIO_Port->BSRR & ((uint32_t)IMU2_CS_Pin << 16U)) == 0U) ||
+      ((SPI1->CR2 & (SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN)) != (SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN)))
+  {
+    return 0U;
+  }
+
+  src = (const uint8_t *)(uintptr_t)tx.src;
+  dst = (uint8_t *)(uintptr_t)rx.dst;
+  mock_hal.spi_frames++;
+  for (i = 0U; i < rx.length; i++)
+  {
+    dst[i] = (mock_hal.spi_device != NULL) ? mock_hal.spi_device(src[i], i) : 0xFFU;
+  }
+  if (rx.hdma->XferCpltCallback != NULL)
+  {
+    rx.hdma->XferCpltCallback(rx.hdma);
+  }
+  return 1U;
+}
+
+/**
+  * @brief  SPI1 status flag test of a polled transfer. Chip select falling
+  *         opens a frame; a TXE poll arms a byte, the next RXNE poll
+  *         clocks the byte written to DR in between through the device.
+  * @param  flag SPI_SR_xxx mask tested
+  * @retval flag, for the driver to test SR against
+  */
+uint32_t Mock_SpiPoll(uint32_t flag)
+{
+  if (flag == 0x00000002U)
+  {
+    if ((IMU2_CS_GPIO_Port->BSRR & ((uint32_t)IMU2_CS_Pin << 16U)) != 0U)
+    {
+      IMU2_CS_GPIO_Port->BSRR = 0U;
+      mock_hal.spi_index = 0U;
+      mock_hal.spi_frames++;
+    }
+    mock_spi1.SR = flag;
+    mock_hal.spi_pending = 1U;
+  }
+  else if ((flag == 0x00000001U) && (mock_hal.spi_pending != 0U))
+  {
+    uint8_t mosi = (uint8_t)mock_spi1.DR;
+
+    mock_hal.spi_pending = 0U;
+    mock_spi1.DR = (mock_hal.spi_device != NULL) ? mock_hal.spi_device(mosi, mock_hal.spi_index) : 0xFFU;
+    mock_hal.spi_index++;
+    mock_spi1.SR |= flag;
+  }
+  return flag;
+}
+
+/* HAL -----------------------------------------------------------------------*/
+void Error_Handler(void)
+{
+  mock_hal.error_handler++;
+}
+
+uint32_t HAL_GetTick(void)
+{
+  return mock_dwt.CYCCNT / (SystemCoreClock / 1000U);
+}
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority)
+{
+  UNUSED(IRQn);
+  UNUSED(PreemptPriority);
+  UNUSED(SubPriority);
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn)
+{
+  UNUSED(IRQn);
+}
+
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn)
+{
+  UNUSED(IRQn);
+}
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init)
+{
+  UNUSED(GPIOx);
+  UNUSED(GPIO_Init);
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+  return ((GPIOx->IDR & GPIO_Pin) != 0U) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+  if (PinState != GPIO_PIN_RESET)
+  {
+    GPIOx->ODR |= GPIO_Pin;
+  }
+  else
+  {
+    GPIOx->ODR &= ~(uint32_t)GPIO_Pin;
+  }
+}
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma)
+{
+  hdma->XferCpltCallback = NULL;
+  hdma->XferErrorCallback = NULL;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_Start_IT(DMA_HandleTypeDef *hdma, uint32_t SrcAddress, uint32_t DstAddress,
+                                   uint32_t DataLength)
+{
+  Mock_DmaStartTypeDef *start;
+
+  if (mock_hal.dma_count >= MOCK_DMA_LOG_LEN)
+  {
+    return HAL_BUSY;
+  }
+  start = &mock_hal.dma_log[mock_hal.dma_count++];
+  start->hdma = hdma;
+  start->src = SrcAddress;
+  start->dst = DstAddress;
+  start->length = DataLength;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_Abort(DMA_HandleTypeDef *hdma)
+{
+  UNUSED(hdma);
+  mock_hal.dma_aborts++;
+  mock_hal.dma_count = 0U;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c)
+{
+  UNUSED(hi2c);
+  Mock_HalCall();
+  mock_hal.i2c_init++;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_DeInit(I2C_HandleTypeDef *hi2c)
+{
+  Mock_I2cSegmentTypeDef *segment = Mock_I2cFind(hi2c);
+
+  Mock_HalCall();
+  if (segment != NULL)
+  {
+    /* The transfer is dropped with its DMA streams */
+    segment->done = 1U;
+  }
+  mock_hal.i2c_deinit++;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Seq_Transmit_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData,
+                                                  uint16_t Size, uint32_t XferOptions)
+{
+  return Mock_I2cStart(hi2c, 0U, DevAddress, pData, Size, XferOptions);
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Seq_Receive_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData,
+                                                 uint16_t Size, uint32_t XferOptions)
+{
+  return Mock_I2cStart(hi2c, 1U, DevAddress, pData, Size, XferOptions);
+}
+
+/* The HAL callbacks are weak, as in the HAL, for tests without an I2C user */
+__attribute__((weak)) void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+  UNUSED(hi2c);
+}
+
+__attribute__((weak)) void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+  UNUSED(hi2c);
+}
+
+__attribute__((weak)) void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+  UNUSED(hi2c);
+}
@@ -0,0 +1,106 @@
+/**
+  ******************************************************************************
+  * @file    mock_hal.h
+  * @brief   This file contains the test side of the host HAL: the records of
+  *          the calls made by the firmware and the functions completing them
+  *          as the peripheral interrupts would.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __MOCK_HAL_H__
+#define __MOCK_HAL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define MOCK_I2C_LOG_LEN          256U
+#define MOCK_I2C_HANDLES          4U
+#define MOCK_DMA_LOG_LEN          8U
+
+/* Exported types ------------------------------------------------------------*/
+/**
+  * @brief  One I2C segment started through the sequential HAL API.
+  */
+typedef struct
+{
+  I2C_HandleTypeDef *hi2c;   /*!< Handle the segment was started on        */
+  uint8_t read;              /*!< 1 for Seq_Receive, 0 for Seq_Transmit    */
+  uint8_t address;           /*!< 7-bit device address                     */
+  uint8_t *data;             /*!< Buffer given to the HAL                  */
+  uint16_t size;             /*!< Number of bytes                          */
+  uint32_t option;           /*!< I2C_xxx_FRAME transfer option            */
+  uint8_t done;              /*!< Completion reported                      */
+} Mock_I2cSegmentTypeDef;
+
+/**
+  * @brief  I2C device model: serves a segment before its completion is
+  *         reported, filling the buffer of a read.
+  * @retval HAL_I2C_ERROR_NONE, or the error the HAL reports instead
+  */
+typedef uint32_t (*Mock_I2cDeviceTypeDef)(const Mock_I2cSegmentTypeDef *segment);
+
+/**
+  * @brief  SPI device model: byte clocked out by the device while the master
+  *         sends mosi, index counting the bytes since chip select fell.
+  */
+typedef uint8_t (*Mock_SpiDeviceTypeDef)(uint8_t mosi, uint32_t index);
+
+/**
+  * @brief  One DMA stream start.
+  */
+typedef struct
+{
+  DMA_HandleTypeDef *hdma;   /*!< Stream handle                            */
+  uint32_t src;              /*!< Source address                           */
+  uint32_t dst;              /*!< Destination address                      */
+  uint32_t length;           /*!< Number of data items                     */
+} Mock_DmaStartTypeDef;
+
+/**
+  * @brief  Everything the mock records, cleared by Mock_Reset().
+  */
+typedef struct
+{
+  uint32_t cycle_step;                            /*!< CYCCNT advance per read  */
+  Mock_I2cSegmentTypeDef i2c_log[MOCK_I2C_LOG_LEN]; /*!< Started segments       */
+  uint32_t i2c_count;                             /*!< Segments started         */
+  uint32_t i2c_done;                              /*!< Segments completed       */
+  Mock_I2cSegmentTypeDef *i2c_pending[MOCK_I2C_HANDLES]; /*!< Last start per handle */
+  HAL_StatusTypeDef i2c_status;                   /*!< Returned by the next start */
+  uint32_t i2c_status_error;                      /*!< ErrorCode set with it    */
+  Mock_I2cDeviceTypeDef i2c_device;               /*!< Device on every bus      */
+  uint32_t i2c_init;                              /*!< HAL_I2C_Init() calls     */
+  uint32_t i2c_deinit;                            /*!< HAL_I2C_DeInit() calls   */
+  uint32_t basepri_calls;                         /*!< HAL calls under BASEPRI  */
+  Mock_DmaStartTypeDef dma_log[MOCK_DMA_LOG_LEN]; /*!< Pending stream starts    */
+  uint32_t dma_count;                             /*!< Stream starts pending    */
+  uint32_t dma_aborts;                            /*!< HAL_DMA_Abort() calls    */
+  Mock_SpiDeviceTypeDef spi_device;               /*!< Device on SPI1 / IMU2_CS */
+  uint32_t spi_index;                             /*!< Byte in the CS frame     */
+  uint8_t spi_pending;                            /*!< Byte written, not clocked */
+  uint32_t spi_frames;                            /*!< Chip select assertions   */
+  uint32_t error_handler;                         /*!< Error_Handler() calls    */
+} Mock_HalTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern Mock_HalTypeDef mock_hal;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void Mock_Reset(void);
+void Mock_AdvanceUs(uint32_t us);
+const Mock_I2cSegmentTypeDef *Mock_I2cPending(const I2C_HandleTypeDef *hi2c);
+uint32_t Mock_I2cRun(I2C_HandleTypeDef *hi2c);
+uint32_t Mock_I2cRunAll(I2C_HandleTypeDef *hi2c);
+void Mock_I2cFail(I2C_HandleTypeDef *hi2c, uint32_t error);
+uint32_t Mock_SpiDmaRun(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MOCK_HAL_H__ */
@@ -0,0 +1,377 @@
+/**
+  ******************************************************************************
+  * @file    stm32f4xx_hal.h
+  * @brief   Host replacement of the HAL and CMSIS device headers, for the
+  *          unit tests only.
+  *
+  *          It is found before the real one by Core/Inc/main.h, so the
+  *          firmware modules build unchanged with the host compiler. Only
+  *          what the tested modules use is declared, with the same names
+  *          and the same behaviour seen from the driver:
+  *            - the core registers (DWT, BASEPRI, PRIMASK) are plain
+  *              variables, the cycle counter advancing by a set step on
+  *              every read so that bounded waits terminate;
+  *            - the HAL I2C, DMA and GPIO calls are recorded by mock_hal.c
+  *              and completed by the test through mock_hal.h;
+  *            - SPI1 is a register block whose TXE/RXNE polls exchange a
+  *              byte with a device model.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __STM32F4xx_HAL_H
+#define __STM32F4xx_HAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stddef.h>
+#include <stdint.h>
+
+/* CMSIS ---------------------------------------------------------------------*/
+#define __IO                        volatile
+#define __NVIC_PRIO_BITS            4U
+
+#define __DMB()                     __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define __DSB()                     __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define __ISB()                     __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define __NOP()                     do { } while (0)
+
+#define SET_BIT(REG, BIT)           ((REG) |= (BIT))
+#define CLEAR_BIT(REG, BIT)         ((REG) &= ~(BIT))
+#define READ_BIT(REG, BIT)          ((REG) & (BIT))
+#define UNUSED(X)                   (void)(X)
+
+typedef enum
+{
+  RESET = 0U,
+  SET = !RESET
+} FlagStatus, ITStatus;
+
+typedef enum
+{
+  NonMaskableInt_IRQn = -14,
+  EXTI4_IRQn = 10,
+  DMA1_Stream0_IRQn = 11,
+  DMA1_Stream6_IRQn = 17,
+  EXTI9_5_IRQn = 23,
+  I2C1_EV_IRQn = 31,
+  I2C1_ER_IRQn = 32,
+  I2C2_EV_IRQn = 33,
+  I2C2_ER_IRQn = 34,
+  DMA2_Stream0_IRQn = 56,
+  DMA2_Stream3_IRQn = 59
+} IRQn_Type;
+
+typedef struct
+{
+  __IO uint32_t CTRL;
+  __IO uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct
+{
+  __IO uint32_t DEMCR;
+} CoreDebug_Type;
+
+#define DWT_CTRL_CYCCNTENA_Msk          0x00000001U
+#define CoreDebug_DEMCR_TRCENA_Msk      0x01000000U
+
+/** Every access reads the counter through Mock_Dwt(), which advances it */
+#define DWT                         ((DWT_Type *)Mock_Dwt())
+#define CoreDebug                   (&mock_core_debug)
+
+extern CoreDebug_Type mock_core_debug;
+extern uint32_t mock_primask;
+extern uint32_t mock_basepri;
+extern uint32_t SystemCoreClock;
+
+DWT_Type *Mock_Dwt(void);
+
+static inline uint32_t __get_PRIMASK(void)
+{
+  return mock_primask;
+}
+
+static inline void __set_PRIMASK(uint32_t primask)
+{
+  mock_primask = primask;
+}
+
+static inline void __disable_irq(void)
+{
+  mock_primask = 1U;
+}
+
+static inline void __enable_irq(void)
+{
+  mock_primask = 0U;
+}
+
+static inline uint32_t __get_BASEPRI(void)
+{
+  return mock_basepri;
+}
+
+static inline void __set_BASEPRI(uint32_t basepri)
+{
+  mock_basepri = basepri;
+}
+
+static inline void __set_BASEPRI_MAX(uint32_t basepri)
+{
+  if ((basepri != 0U) && ((mock_basepri == 0U) || (basepri < mock_basepri)))
+  {
+    mock_basepri = basepri;
+  }
+}
+
+/* HAL -----------------------------------------------------------------------*/
+typedef enum
+{
+  HAL_OK = 0x00U,
+  HAL_ERROR = 0x01U,
+  HAL_BUSY = 0x02U,
+  HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+uint32_t HAL_GetTick(void);
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority);
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn);
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn);
+
+#define __HAL_RCC_GPIOA_CLK_ENABLE()    do { } while (0)
+#define __HAL_RCC_GPIOB_CLK_ENABLE()    do { } while (0)
+#define __HAL_RCC_GPIOC_CLK_ENABLE()    do { } while (0)
+#define __HAL_RCC_SPI1_CLK_ENABLE()     do { } while (0)
+#define __HAL_RCC_DMA1_CLK_ENABLE()     do { } while (0)
+#define __HAL_RCC_DMA2_CLK_ENABLE()     do { } while (0)
+
+/* GPIO ----------------------------------------------------------------------*/
+typedef struct
+{
+  __IO uint32_t MODER;
+  __IO uint32_t IDR;
+  __IO uint32_t ODR;
+  __IO uint32_t BSRR;
+} GPIO_TypeDef;
+
+typedef struct
+{
+  uint32_t Pin;
+  uint32_t Mode;
+  uint32_t Pull;
+  uint32_t Speed;
+  uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+typedef enum
+{
+  GPIO_PIN_RESET = 0U,
+  GPIO_PIN_SET
+} GPIO_PinState;
+
+extern GPIO_TypeDef mock_gpioa;
+extern GPIO_TypeDef mock_gpiob;
+extern GPIO_TypeDef mock_gpioc;
+
+#define GPIOA                       (&mock_gpioa)
+#define GPIOB                       (&mock_gpiob)
+#define GPIOC                       (&mock_gpioc)
+
+#define GPIO_PIN_0                  ((uint16_t)0x0001)
+#define GPIO_PIN_1                  ((uint16_t)0x0002)
+#define GPIO_PIN_2                  ((uint16_t)0x0004)
+#define GPIO_PIN_3                  ((uint16_t)0x0008)
+#define GPIO_PIN_4                  ((uint16_t)0x0010)
+#define GPIO_PIN_5                  ((uint16_t)0x0020)
+#define GPIO_PIN_6                  ((uint16_t)0x0040)
+#define GPIO_PIN_7                  ((uint16_t)0x0080)
+#define GPIO_PIN_8                  ((uint16_t)0x0100)
+#define GPIO_PIN_9                  ((uint16_t)0x0200)
+#define GPIO_PIN_10                 ((uint16_t)0x0400)
+#define GPIO_PIN_11                 ((uint16_t)0x0800)
+
+#define GPIO_MODE_INPUT             0x00000000U
+#define GPIO_MODE_OUTPUT_PP         0x00000001U
+#define GPIO_MODE_OUTPUT_OD         0x00000011U
+#define GPIO_MODE_AF_PP             0x00000002U
+#define GPIO_MODE_AF_OD             0x00000012U
+#define GPIO_MODE_IT_RISING         0x10110000U
+#define GPIO_NOPULL                 0x00000000U
+#define GPIO_PULLUP                 0x00000001U
+#define GPIO_SPEED_FREQ_LOW         0x00000000U
+#define GPIO_SPEED_FREQ_HIGH        0x00000002U
+#define GPIO_SPEED_FREQ_VERY_HIGH   0x00000003U
+#define GPIO_AF4_I2C1               ((uint8_t)0x04)
+#define GPIO_AF4_I2C2               ((uint8_t)0x04)
+#define GPIO_AF5_SPI1               ((uint8_t)0x05)
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+
+/* DMA -----------------------------------------------------------------------*/
+typedef struct
+{
+  __IO uint32_t CR;
+  __IO uint32_t NDTR;
+} DMA_Stream_TypeDef;
+
+typedef struct
+{
+  uint32_t Channel;
+  uint32_t Direction;
+  uint32_t PeriphInc;
+  uint32_t MemInc;
+  uint32_t PeriphDataAlignment;
+  uint32_t MemDataAlignment;
+  uint32_t Mode;
+  uint32_t Priority;
+  uint32_t FIFOMode;
+} DMA_InitTypeDef;
+
+typedef struct __DMA_HandleTypeDef
+{
+  DMA_Stream_TypeDef *Instance;
+  DMA_InitTypeDef Init;
+  void *Parent;
+  void (*XferCpltCallback)(struct __DMA_HandleTypeDef *hdma);
+  void (*XferErrorCallback)(struct __DMA_HandleTypeDef *hdma);
+} DMA_HandleTypeDef;
+
+extern DMA_Stream_TypeDef mock_dma2_stream0;
+extern DMA_Stream_TypeDef mock_dma2_stream3;
+
+#define DMA2_Stream0                (&mock_dma2_stream0)
+#define DMA2_Stream3                (&mock_dma2_stream3)
+
+#define DMA_CHANNEL_3               0x06000000U
+#define DMA_PERIPH_TO_MEMORY        0x00000000U
+#define DMA_MEMORY_TO_PERIPH        0x00000040U
+#define DMA_PINC_DISABLE            0x00000000U
+#define DMA_MINC_ENABLE             0x00000400U
+#define DMA_PDATAALIGN_BYTE         0x00000000U
+#define DMA_MDATAALIGN_BYTE         0x00000000U
+#define DMA_NORMAL                  0x00000000U
+#define DMA_PRIORITY_HIGH           0x00020000U
+#define DMA_PRIORITY_VERY_HIGH      0x00030000U
+#define DMA_FIFOMODE_DISABLE        0x00000000U
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma);
+HAL_StatusTypeDef HAL_DMA_Start_IT(DMA_HandleTypeDef *hdma, uint32_t SrcAddress, uint32_t DstAddress,
+                                   uint32_t DataLength);
+HAL_StatusTypeDef HAL_DMA_Abort(DMA_HandleTypeDef *hdma);
+
+/* SPI -----------------------------------------------------------------------*/
+typedef struct
+{
+  __IO uint32_t CR1;
+  __IO uint32_t CR2;
+  __IO uint32_t SR;
+  __IO uint32_t DR;
+} SPI_TypeDef;
+
+extern SPI_TypeDef mock_spi1;
+
+#define SPI1                        (&mock_spi1)
+
+#define SPI_CR1_CPHA                0x00000001U
+#define SPI_CR1_CPOL                0x00000002U
+#define SPI_CR1_MSTR                0x00000004U
+#define SPI_CR1_BR_0                0x00000008U
+#define SPI_CR1_BR_1                0x00000010U
+#define SPI_CR1_BR_2                0x00000020U
+#define SPI_CR1_BR                  0x00000038U
+#define SPI_CR1_SPE                 0x00000040U
+#define SPI_CR1_SSI                 0x00000100U
+#define SPI_CR1_SSM                 0x00000200U
+#define SPI_CR2_RXDMAEN             0x00000001U
+#define SPI_CR2_TXDMAEN             0x00000002U
+
+/** The status flags are only tested by the polled transfer loops: each test
+  * runs the SPI model, a TXE poll opening a byte and an RXNE poll exchanging
+  * the byte written in between with the device */
+#define SPI_SR_RXNE                 Mock_SpiPoll(0x00000001U)
+#define SPI_SR_TXE                  Mock_SpiPoll(0x00000002U)
+#define SPI_SR_BSY                  Mock_SpiPoll(0x00000080U)
+
+uint32_t Mock_SpiPoll(uint32_t flag);
+
+/* I2C -----------------------------------------------------------------------*/
+typedef struct
+{
+  __IO uint32_t CR1;
+  __IO uint32_t CR2;
+  __IO uint32_t SR1;
+  __IO uint32_t SR2;
+} I2C_TypeDef;
+
+typedef struct
+{
+  uint32_t ClockSpeed;
+  uint32_t DutyCycle;
+  uint32_t OwnAddress1;
+  uint32_t AddressingMode;
+  uint32_t DualAddressMode;
+  uint32_t OwnAddress2;
+  uint32_t GeneralCallMode;
+  uint32_t NoStretchMode;
+} I2C_InitTypeDef;
+
+typedef struct __I2C_HandleTypeDef
+{
+  I2C_TypeDef *Instance;
+  I2C_InitTypeDef Init;
+  __IO uint32_t ErrorCode;
+} I2C_HandleTypeDef;
+
+extern I2C_TypeDef mock_i2c1;
+extern I2C_TypeDef mock_i2c2;
+
+#define I2C1                        (&mock_i2c1)
+#define I2C2                        (&mock_i2c2)
+
+#define I2C_CR1_STOP                0x00000200U
+#define I2C_SR2_BUSY                0x00000002U
+#define I2C_FLAG_BUSY               I2C_SR2_BUSY
+
+#define __HAL_I2C_GET_FLAG(__HANDLE__, __FLAG__) \
+  ((((__HANDLE__)->Instance->SR2 & (__FLAG__)) == (__FLAG__)) ? SET : RESET)
+
+#define HAL_I2C_ERROR_NONE          0x00000000U
+#define HAL_I2C_ERROR_BERR          0x00000001U
+#define HAL_I2C_ERROR_ARLO          0x00000002U
+#define HAL_I2C_ERROR_AF            0x00000004U
+#define HAL_I2C_ERROR_OVR           0x00000008U
+#define HAL_I2C_ERROR_DMA           0x00000010U
+#define HAL_I2C_ERROR_TIMEOUT       0x00000020U
+
+#define I2C_MEMADD_SIZE_8BIT        0x00000001U
+#define I2C_MEMADD_SIZE_16BIT       0x00000010U
+
+#define I2C_FIRST_FRAME             0x00000000U
+#define I2C_FIRST_AND_NEXT_FRAME    0x00000001U
+#define I2C_NEXT_FRAME              0x00000002U
+#define I2C_FIRST_AND_LAST_FRAME    0x00000008U
+#define I2C_LAST_FRAME_NO_STOP      0x00000010U
+#define I2C_LAST_FRAME              0x00000020U
+#define I2C_OTHER_FRAME             0x00AA0000U
+#define I2C_OTHER_AND_LAST_FRAME    0xAA000000U
+
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c);
+HAL_StatusTypeDef HAL_I2C_DeInit(I2C_HandleTypeDef *hi2c);
+HAL_StatusTypeDef HAL_I2C_Master_Seq_Transmit_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData,
+                                                  uint16_t Size, uint32_t XferOptions);
+HAL_StatusTypeDef HAL_I2C_Master_Seq_Receive_DMA(I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData,
+                                                 uint16_t Size, uint32_t XferOptions);
+void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c);
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __STM32F4xx_HAL_H */
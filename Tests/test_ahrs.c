@@ -0,0 +1,388 @@
+/**
+  ******************************************************************************
+  * @file    test_ahrs.c
+  * @brief   Host tests of the AHRS accuracy on synthetic flights: the true
+  *          attitude is integrated in double precision from a known rate
+  *          profile, and the gyro, accelerometer and magnetometer seen in it
+  *          are given to Ahrs_Update() at 2 kHz with noise, gyro bias and
+  *          linear acceleration, under both correction methods.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "ahrs.h"
+#include "mock_hal.h"
+#include "unit.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define LOOP_HZ               2000U
+#define SUBSTEPS              10U       /*!< Truth integration steps per sample */
+#define GYRO_DPS_PER_COUNT    (1.0 / 16.4)
+#define ACCEL_G_PER_COUNT     (1.0 / 4096.0)
+#define MAG_DECIM             20U       /*!< Loop samples per field, 100 Hz  */
+#define SETTLED_S             30.0      /*!< Errors measured from then on    */
+#define DEG                   (M_PI / 180.0)
+
+/* Private types -------------------------------------------------------------*/
+typedef struct
+{
+  double w;
+  double x;
+  double y;
+  double z;
+} QuatTypeDef;
+
+/**
+  * @brief  Synthetic flight.
+  */
+typedef struct
+{
+  Ahrs_MethodTypeDef method;
+  double duration_s;
+  double rate;                           /*!< Rate amplitude, rad/s           */
+  double frequency;                      /*!< Rate profile frequency scale    */
+  double bias_dps;                       /*!< Gyro bias, scaled per axis      */
+  double linear_g;                       /*!< Linear acceleration amplitude   */
+  uint8_t noise;                         /*!< Sensor noise                    */
+  uint8_t accel;                         /*!< Accelerometer given, else 0     */
+  uint8_t mag;                           /*!< Magnetometer given              */
+} FlightTypeDef;
+
+/**
+  * @brief  Errors once settled, deg: whole attitude with the magnetometer,
+  *         tilt alone without it.
+  */
+typedef struct
+{
+  double mean;
+  double max;
+  double norm_error;                     /*!< Largest | |q| - 1 |             */
+  double bias_error;                     /*!< Learned bias error at the end, dps */
+} ErrorTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t random_state;
+
+/* Private functions ---------------------------------------------------------*/
+static double Uniform(void)
+{
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return (random_state + 1.0) / 4294967297.0;
+}
+
+static double Gauss(void)
+{
+  double u = Uniform();
+  double v = Uniform();
+
+  return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+static QuatTypeDef Multiply(QuatTypeDef a, QuatTypeDef b)
+{
+  QuatTypeDef r;
+
+  r.w = (a.w * b.w) - (a.x * b.x) - (a.y * b.y) - (a.z * b.z);
+  r.x = (a.w * b.x) + (a.x * b.w) + (a.y * b.z) - (a.z * b.y);
+  r.y = (a.w * b.y) - (a.x * b.z) + (a.y * b.w) + (a.z * b.x);
+  r.z = (a.w * b.z) + (a.x * b.y) - (a.y * b.x) + (a.z * b.w);
+  return r;
+}
+
+static QuatTypeDef Conjugate(QuatTypeDef q)
+{
+  QuatTypeDef r = { q.w, -q.x, -q.y, -q.z };
+
+  return r;
+}
+
+static QuatTypeDef FromAhrs(const Ahrs_HandleTypeDef *ahrs)
+{
+  QuatTypeDef r = { ahrs->q[0], ahrs->q[1], ahrs->q[2], ahrs->q[3] };
+
+  return r;
+}
+
+/**
+  * @brief  Earth axes vector seen in the body axes: q* e q.
+  */
+static void ToBody(QuatTypeDef q, const double earth[3], double body[3])
+{
+  QuatTypeDef v = { 0.0, earth[0], earth[1], earth[2] };
+  QuatTypeDef r = Multiply(Multiply(Conjugate(q), v), q);
+
+  body[0] = r.x;
+  body[1] = r.y;
+  body[2] = r.z;
+}
+
+/**
+  * @brief  Angle of the rotation between two attitudes, deg.
+  */
+static double Angle(QuatTypeDef a, QuatTypeDef b)
+{
+  double w = fabs(Multiply(Conjugate(a), b).w);
+
+  return 2.0 * acos((w < 1.0) ? w : 1.0) / DEG;
+}
+
+/**
+  * @brief  Angle between the up directions of two attitudes, deg.
+  */
+static double Tilt(QuatTypeDef a, QuatTypeDef b)
+{
+  static const double up[3] = { 0.0, 0.0, 1.0 };
+  double ua[3];
+  double ub[3];
+  double c;
+
+  ToBody(a, up, ua);
+  ToBody(b, up, ub);
+  c = (ua[0] * ub[0]) + (ua[1] * ub[1]) + (ua[2] * ub[2]);
+  return acos((c < 1.0) ? c : 1.0) / DEG;
+}
+
+/**
+  * @brief  Roll, pitch and yaw to a quaternion, Z Y X order.
+  */
+static QuatTypeDef FromEuler(double roll, double pitch, double yaw)
+{
+  double cr = cos(roll / 2.0);
+  double sr = sin(roll / 2.0);
+  double cp = cos(pitch / 2.0);
+  double sp = sin(pitch / 2.0);
+  double cy = cos(yaw / 2.0);
+  double sy = sin(yaw / 2.0);
+  QuatTypeDef r;
+
+  r.w = (cr * cp * cy) + (sr * sp * sy);
+  r.x = (sr * cp * cy) - (cr * sp * sy);
+  r.y = (cr * sp * cy) + (sr * cp * sy);
+  r.z = (cr * cp * sy) - (sr * sp * cy);
+  return r;
+}
+
+/**
+  * @brief  Body rate of the flight, rad/s.
+  */
+static void Rate(const FlightTypeDef *flight, double t, double w[3])
+{
+  double f = flight->frequency;
+
+  w[0] = flight->rate * sin(2.0 * M_PI * 0.3 * f * t);
+  w[1] = flight->rate * 0.8 * sin((2.0 * M_PI * 0.21 * f * t) + 1.0);
+  w[2] = flight->rate * 0.5 * cos(2.0 * M_PI * 0.13 * f * t);
+}
+
+/**
+  * @brief  Fly the AHRS through a flight from a known attitude.
+  */
+static ErrorTypeDef Fly(const FlightTypeDef *flight, QuatTypeDef truth)
+{
+  static const double up[3] = { 0.0, 0.0, 1.0 };
+  static const double field[3] = { 0.2, 0.0, -0.4 };
+  ErrorTypeDef result = { 0.0, 0.0, 0.0, 0.0 };
+  IMU_LoopSampleTypeDef sample;
+  double bias[3];
+  double gyro_scale = GYRO_DPS_PER_COUNT * DEG;
+  uint32_t samples = (uint32_t)(flight->duration_s * LOOP_HZ);
+  uint32_t measured = 0U;
+  uint32_t n;
+  uint32_t s;
+  uint32_t k;
+
+  Mock_Reset();
+  random_state = 2463534242U;
+  bias[0] = flight->bias_dps * DEG;
+  bias[1] = -0.7 * flight->bias_dps * DEG;
+  bias[2] = 0.5 * flight->bias_dps * DEG;
+  Ahrs_Init(&hahrs, flight->method, (float)GYRO_DPS_PER_COUNT, (float)ACCEL_G_PER_COUNT);
+  sample.timestamp = 1000U;
+
+  for (n = 0U; n < samples; n++)
+  {
+    double t = (double)n / LOOP_HZ;
+    double w[3];
+    double accel[3];
+    double mag[3];
+    double error;
+    double norm;
+
+    /* Truth over the sample, the rate held */
+    Rate(flight, t, w);
+    for (s = 0U; s < SUBSTEPS; s++)
+    {
+      double h = 1.0 / (LOOP_HZ * SUBSTEPS);
+      double angle = sqrt((w[0] * w[0]) + (w[1] * w[1]) + (w[2] * w[2])) * h;
+      double scale = (angle > 0.0) ? (sin(angle / 2.0) / angle * h) : (h / 2.0);
+      QuatTypeDef step = { cos(angle / 2.0), w[0] * scale, w[1] * scale, w[2] * scale };
+
+      truth = Multiply(truth, step);
+    }
+
+    ToBody(truth, up, accel);
+    ToBody(truth, field, mag);
+    sample.timestamp += SystemCoreClock / LOOP_HZ;
+    for (k = 0U; k < 3U; k++)
+    {
+      double linear = flight->linear_g * sin((2.0 * M_PI * 2.0 * t) + k);
+
+      sample.gyro[k] = (float)(((w[k] + bias[k]) / gyro_scale) + ((flight->noise != 0U) ? (3.0 * Gauss()) : 0.0));
+      sample.accel[k] = (flight->accel != 0U) ?
+                        (float)(((accel[k] + linear) / ACCEL_G_PER_COUNT) + ((flight->noise != 0U) ? (20.0 * Gauss()) : 0.0)) :
+                        0.0f;
+    }
+    Ahrs_Update(&hahrs, &sample);
+    if ((flight->mag != 0U) && ((n % MAG_DECIM) == 0U))
+    {
+      float f[3];
+
+      for (k = 0U; k < 3U; k++)
+      {
+        f[k] = (float)(mag[k] + ((flight->noise != 0U) ? (0.003 * Gauss()) : 0.0));
+      }
+      Ahrs_UpdateMag(&hahrs, f);
+    }
+
+    norm = sqrt((hahrs.q[0] * hahrs.q[0]) + (hahrs.q[1] * hahrs.q[1]) + (hahrs.q[2] * hahrs.q[2]) +
+                (hahrs.q[3] * hahrs.q[3]));
+    result.norm_error = (fabs(norm - 1.0) > result.norm_error) ? fabs(norm - 1.0) : result.norm_error;
+    if ((flight->accel == 0U) || (t > SETTLED_S))
+    {
+      error = ((flight->mag != 0U) || (flight->accel == 0U)) ? Angle(truth, FromAhrs(&hahrs)) :
+              Tilt(truth, FromAhrs(&hahrs));
+      result.max = (error > result.max) ? error : result.max;
+      result.mean += error;
+      measured++;
+    }
+  }
+  result.mean /= measured;
+
+  /* The integral holds minus the bias */
+  for (k = 0U; k < 3U; k++)
+  {
+    double e = fabs(hahrs.integral[k] + bias[k]) / DEG;
+
+    result.bias_error = (e > result.bias_error) ? e : result.bias_error;
+  }
+  return result;
+}
+
+/* Tests ---------------------------------------------------------------------*/
+static void Test_GyroOnly(void)
+{
+  static const double rates[] = { 1.0, 5.0, 15.0 };
+  uint32_t i;
+
+  /* Without the accelerometer, nothing but the integration: its drift
+     over a minute of fast rotation, from the truth at rest */
+  for (i = 0U; i < 3U; i++)
+  {
+    FlightTypeDef flight = { AHRS_METHOD_MAHONY, 60.0, rates[i], 2.3, 0.0, 0.0, 0U, 0U, 0U };
+    ErrorTypeDef e = Fly(&flight, FromEuler(0.0, 0.0, 0.0));
+
+    UNIT_CHECK(e.max < 0.5);
+    UNIT_CHECK(e.norm_error < 1e-5);
+    UNIT_CHECK(hahrs.stats.corrections == (uint32_t)(60U * LOOP_HZ / AHRS_CORRECTION_DECIM));
+    UNIT_CHECK(hahrs.stats.accel_rejected == hahrs.stats.corrections);
+    printf("  %4.1f rad/s gyro only: %.3f deg after 60 s\n", rates[i], e.max);
+  }
+}
+
+static void Test_Alignment(void)
+{
+  FlightTypeDef flight = { AHRS_METHOD_MAHONY, 0.1, 0.0, 1.0, 0.0, 0.0, 0U, 1U, 0U };
+  QuatTypeDef truth = FromEuler(20.0 * DEG, -10.0 * DEG, 30.0 * DEG);
+  float euler[3];
+
+  /* The first correction sets the tilt from the accelerometer, heading 0 */
+  (void)Fly(&flight, truth);
+  Ahrs_Euler(&hahrs, euler);
+  UNIT_CHECK(hahrs.aligned == 1U);
+  UNIT_NEAR(euler[0] / DEG, 20.0, 0.05);
+  UNIT_NEAR(euler[1] / DEG, -10.0, 0.05);
+  UNIT_NEAR(Tilt(truth, FromAhrs(&hahrs)), 0.0, 0.05);
+}
+
+/**
+  * @brief  Noisy flights with a gyro bias, settled error and, for Mahony,
+  *         the learned bias. The fixed rate step of Madgwick cancels a bias
+  *         below it with a vanishing error, so its integral learns slowly.
+  */
+static void CheckFlight(double rate, double linear_g, uint8_t mag, double mean, double max, double bias)
+{
+  uint32_t method;
+
+  for (method = 0U; method < 2U; method++)
+  {
+    FlightTypeDef flight = { (Ahrs_MethodTypeDef)method, 120.0, rate, 1.0, 1.0, linear_g, 1U, 1U, mag };
+    ErrorTypeDef e = Fly(&flight, FromEuler(20.0 * DEG, -10.0 * DEG, 30.0 * DEG));
+
+    UNIT_CHECK(e.mean < mean);
+    UNIT_CHECK(e.max < max);
+    UNIT_CHECK((method != (uint32_t)AHRS_METHOD_MAHONY) || (e.bias_error < bias));
+    UNIT_CHECK(e.norm_error < 1e-5);
+    printf("  %-8s %3.1f rad/s %.1f g %s: mean %.3f max %.3f deg, bias error %.3f dps\n",
+           (method != 0U) ? "madgwick" : "mahony", rate, linear_g, (mag != 0U) ? "attitude" : "tilt",
+           e.mean, e.max, e.bias_error);
+  }
+}
+
+static void Test_Static(void)
+{
+  CheckFlight(0.0, 0.0, 1U, 0.3, 1.0, 0.05);
+}
+
+static void Test_Rotating(void)
+{
+  CheckFlight(1.0, 0.0, 1U, 1.0, 3.0, 0.3);
+  CheckFlight(3.0, 0.0, 1U, 1.0, 3.0, 0.3);
+}
+
+static void Test_NoMag(void)
+{
+  CheckFlight(1.0, 0.0, 0U, 1.0, 3.0, 0.5);
+}
+
+static void Test_LinearAccel(void)
+{
+  /* Within the gate, 0.1 g tilts the measured up by up to 6 deg */
+  CheckFlight(1.0, 0.1, 1U, 1.2, 4.0, 0.3);
+}
+
+static void Test_Gap(void)
+{
+  IMU_LoopSampleTypeDef sample;
+
+  memset(&sample, 0, sizeof(sample));
+  Mock_Reset();
+  Ahrs_Init(&hahrs, AHRS_METHOD_MAHONY, (float)GYRO_DPS_PER_COUNT, (float)ACCEL_G_PER_COUNT);
+
+  /* A fast rate over a gap is not integrated, the next period is */
+  sample.timestamp = 1000U;
+  sample.gyro[2] = (float)(90.0 / GYRO_DPS_PER_COUNT);
+  Ahrs_Update(&hahrs, &sample);
+  sample.timestamp += Timing_UsToCycles(AHRS_MAX_GAP_US + 1000U);
+  Ahrs_Update(&hahrs, &sample);
+  UNIT_CHECK(hahrs.stats.gaps == 2U);
+  UNIT_NEAR(hahrs.q[0], 1.0, 1e-7);
+
+  sample.timestamp += Timing_UsToCycles(10000U);
+  Ahrs_Update(&hahrs, &sample);
+  UNIT_CHECK(hahrs.stats.gaps == 2U);
+  UNIT_NEAR(2.0 * atan2(hahrs.q[3], hahrs.q[0]) / DEG, 0.9, 1e-4);
+}
+
+int main(void)
+{
+  UNIT_RUN(Test_GyroOnly);
+  UNIT_RUN(Test_Alignment);
+  UNIT_RUN(Test_Static);
+  UNIT_RUN(Test_Rotating);
+  UNIT_RUN(Test_NoMag);
+  UNIT_RUN(Test_LinearAccel);
+  UNIT_RUN(Test_Gap);
+  return Unit_Result();
+}
@@ -0,0 +1,323 @@
+/**
+  ******************************************************************************
+  * @file    test_biquad.cpp
+  * @brief   Host tests of the biquad designs: magnitude of PT1, PT2, low
+  *          pass and notch at their corner or center from the transfer
+  *          function, the same measured through BiquadBank on sines, and
+  *          the single precision BiquadNotchTune() against BiquadNotch(),
+  *          and a host benchmark of the float and Q15 banks on 3 axes. The
+  *          target cycle counts come from GyroFilter_Bench().
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "biquad.hpp"
+#include "unit.h"
+#include <complex>
+
+/* Private define ------------------------------------------------------------*/
+#define SAMPLE_HZ             2000.0f
+#define MINUS_3DB             0.70710678118654752
+#define BENCH_SAMPLES         4096U     /*!< Gyro samples per pass            */
+#define BENCH_PASSES          100U
+
+/* Private variables ---------------------------------------------------------*/
+static int16_t bench_input[BENCH_SAMPLES][3];
+static volatile float bench_sink;
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  |H(e^jw)| of a section at a frequency, in double precision.
+  */
+static double Magnitude(const BiquadCoeffs &c, double hz, double sample_hz)
+{
+  std::complex<double> z1 = std::polar(1.0, -2.0 * M_PI * hz / sample_hz);
+  std::complex<double> z2 = z1 * z1;
+
+  return std::abs(((double)c.b0 + ((double)c.b1 * z1) + ((double)c.b2 * z2)) /
+                  (1.0 + ((double)c.a1 * z1) + ((double)c.a2 * z2)));
+}
+
+/**
+  * @brief  Amplitude out of a bank fed a unit sine, once settled.
+  */
+static double Measure(const BiquadCoeffs &c, double hz)
+{
+  const BiquadCoeffs stages[1] = { c };
+  BiquadBank<1> bank(stages);
+  double peak = 0.0;
+  float silent = 0.0f;
+  uint32_t n;
+
+  for (n = 0U; n < 40000U; n++)
+  {
+    float x[3];
+    double phase = 2.0 * M_PI * hz * n / SAMPLE_HZ;
+
+    x[0] = (float)sin(phase);
+    x[1] = (float)cos(phase);
+    x[2] = 0.0f;
+    bank.Apply(x);
+    if (n >= 30000U)
+    {
+      /* Sine and cosine give the envelope at every sample */
+      double amplitude = sqrt(((double)x[0] * x[0]) + ((double)x[1] * x[1]));
+
+      peak = (amplitude > peak) ? amplitude : peak;
+    }
+    silent = (x[2] != 0.0f) ? x[2] : silent;
+  }
+
+  /* The axes do not leak into each other */
+  UNIT_CHECK(silent == 0.0f);
+  return peak;
+}
+
+/* Tests ---------------------------------------------------------------------*/
+static void Test_ConstexprMath(void)
+{
+  /* The designs are evaluated by the compiler */
+  constexpr BiquadCoeffs pt1 = BiquadPt1(100.0f, SAMPLE_HZ);
+  static_assert((pt1.b0 > 0.0f) && (pt1.b0 < 1.0f), "PT1 gain");
+  static_assert((pt1.a1 > -1.0f) && (pt1.a1 < 0.0f), "PT1 pole inside the unit circle");
+
+  for (double x = -20.0; x <= 20.0; x += 0.01)
+  {
+    UNIT_NEAR(BiquadSin(x), sin(x), 1e-11);
+    UNIT_NEAR(BiquadCos(x), cos(x), 1e-11);
+  }
+  for (double x = 1e-6; x < 1e6; x *= 1.7)
+  {
+    UNIT_NEAR(BiquadSqrt(x), sqrt(x), 1e-14 * sqrt(x));
+  }
+}
+
+static void Test_Pt1(void)
+{
+  /* Exact up to near Nyquist */
+  for (float f : { 5.0f, 50.0f, 250.0f, 600.0f, 900.0f })
+  {
+    BiquadCoeffs c = BiquadPt1(f, SAMPLE_HZ);
+
+    UNIT_NEAR(Magnitude(c, f, SAMPLE_HZ), MINUS_3DB, 1e-5);
+    UNIT_NEAR(Magnitude(c, 0.0, SAMPLE_HZ), 1.0, 1e-5);
+    UNIT_CHECK(Magnitude(c, 0.9 * f, SAMPLE_HZ) > MINUS_3DB);
+    UNIT_CHECK(Magnitude(c, 1.1 * f, SAMPLE_HZ) < MINUS_3DB);
+    UNIT_CHECK((c.b1 == 0.0f) && (c.b2 == 0.0f) && (c.a2 == 0.0f));
+  }
+}
+
+static void Test_Pt2(void)
+{
+  for (float f : { 5.0f, 50.0f, 250.0f, 600.0f })
+  {
+    BiquadCoeffs c = BiquadPt2(f, SAMPLE_HZ);
+
+    UNIT_NEAR(Magnitude(c, f, SAMPLE_HZ), MINUS_3DB, 1e-5);
+
+    /* (1 - p)^2 is small at low corners, so is its rounding */
+    UNIT_NEAR(Magnitude(c, 0.0, SAMPLE_HZ), 1.0, 1e-4);
+
+    /* Two real poles: no peaking anywhere */
+    for (double h = 1.0; h < (SAMPLE_HZ / 2.0); h += 7.0)
+    {
+      UNIT_CHECK(Magnitude(c, h, SAMPLE_HZ) <= 1.0 + 1e-6);
+    }
+  }
+}
+
+static void Test_Lowpass(void)
+{
+  for (float f : { 20.0f, 100.0f, 400.0f, 800.0f })
+  {
+    BiquadCoeffs c = BiquadLowpass(f, SAMPLE_HZ, 0.70710678f);
+
+    UNIT_NEAR(Magnitude(c, f, SAMPLE_HZ), MINUS_3DB, 1e-5);
+    UNIT_NEAR(Magnitude(c, 0.0, SAMPLE_HZ), 1.0, 1e-5);
+    UNIT_NEAR(Magnitude(c, SAMPLE_HZ / 2.0, SAMPLE_HZ), 0.0, 1e-6);
+  }
+
+  /* Q is the gain at the corner */
+  UNIT_NEAR(Magnitude(BiquadLowpass(100.0f, SAMPLE_HZ, 2.0f), 100.0, SAMPLE_HZ), 2.0, 1e-3);
+}
+
+static void Test_Notch(void)
+{
+  for (float f : { 60.0f, 150.0f, 300.0f, 700.0f })
+  {
+    for (float q : { 0.7f, 3.0f, 10.0f })
+    {
+      BiquadCoeffs c = BiquadNotch(f, SAMPLE_HZ, q);
+      double w0 = 2.0 * M_PI * f / SAMPLE_HZ;
+      double alpha = sin(w0) / (2.0 * q);
+      double edge = acos(cos(w0) / sqrt(1.0 + (alpha * alpha)));
+      double lo = (edge - atan(alpha)) * SAMPLE_HZ / (2.0 * M_PI);
+      double hi = (edge + atan(alpha)) * SAMPLE_HZ / (2.0 * M_PI);
+
+      UNIT_CHECK(Magnitude(c, f, SAMPLE_HZ) < 1e-3);
+      UNIT_NEAR(Magnitude(c, 0.0, SAMPLE_HZ), 1.0, 1e-5);
+      UNIT_NEAR(Magnitude(c, SAMPLE_HZ / 2.0, SAMPLE_HZ), 1.0, 1e-5);
+
+      /* -3 dB where |cos w - cos w0| = alpha sin w, the band edges; the
+         bandwidth is center / q for narrow notches well below Nyquist */
+      UNIT_NEAR(Magnitude(c, lo, SAMPLE_HZ), MINUS_3DB, 1e-4);
+      UNIT_NEAR(Magnitude(c, hi, SAMPLE_HZ), MINUS_3DB, 1e-4);
+      UNIT_CHECK((lo < f) && (hi > f));
+      if ((q >= 3.0f) && (f <= 150.0f))
+      {
+        UNIT_NEAR(hi - lo, f / q, 0.1 * f / q);
+      }
+    }
+  }
+}
+
+static void Test_BankResponse(void)
+{
+  /* The bank on real samples agrees with the transfer function */
+  BiquadCoeffs pt1 = BiquadPt1(100.0f, SAMPLE_HZ);
+  BiquadCoeffs pt2 = BiquadPt2(100.0f, SAMPLE_HZ);
+  BiquadCoeffs lowpass = BiquadLowpass(300.0f, SAMPLE_HZ, 0.70710678f);
+  BiquadCoeffs notch = BiquadNotch(200.0f, SAMPLE_HZ, 3.0f);
+
+  UNIT_NEAR(Measure(pt1, 100.0), MINUS_3DB, 1e-4);
+  UNIT_NEAR(Measure(pt2, 100.0), MINUS_3DB, 1e-4);
+  UNIT_NEAR(Measure(lowpass, 300.0), MINUS_3DB, 1e-4);
+  UNIT_NEAR(Measure(notch, 200.0), 0.0, 1e-3);
+  UNIT_NEAR(Measure(notch, 20.0), Magnitude(notch, 20.0, SAMPLE_HZ), 1e-4);
+}
+
+static void Test_NotchTune(void)
+{
+  double worst = 0.0;
+
+  /* The single precision retune matches the double design closely
+     enough that the rejection at the center is kept */
+  for (float f = 20.0f; f < 950.0f; f += 3.7f)
+  {
+    for (float q : { 1.0f, 3.0f, 8.0f })
+    {
+      BiquadCoeffs ref = BiquadNotch(f, SAMPLE_HZ, q);
+      BiquadCoeffs tune = BiquadNotchTune(f, SAMPLE_HZ, q);
+      const float pairs[5][2] = { { ref.b0, tune.b0 }, { ref.b1, tune.b1 }, { ref.b2, tune.b2 },
+                                  { ref.a1, tune.a1 }, { ref.a2, tune.a2 } };
+
+      for (const auto &p : pairs)
+      {
+        double e = fabs((double)p[0] - (double)p[1]);
+
+        worst = (e > worst) ? e : worst;
+      }
+      UNIT_CHECK(Magnitude(tune, f, SAMPLE_HZ) < 2e-3);
+      UNIT_NEAR(Magnitude(tune, 0.0, SAMPLE_HZ), 1.0, 5e-5);
+    }
+  }
+  UNIT_CHECK(worst < 1e-6);
+  printf("  notch retune: worst coefficient error %.2g\n", worst);
+}
+
+/**
+  * @brief  Time a float and a Q15 bank of N sections, alternately notches and
+  *         low pass, on the same gyro stream, and compare their outputs.
+  * @retval Largest difference between the two outputs, in LSB
+  */
+template <uint32_t N>
+static int32_t Bench(void)
+{
+  BiquadCoeffs stages[N];
+  int32_t worst = 0;
+  double start;
+  double float_ns;
+  double q15_ns;
+  float sum = 0.0f;
+  int32_t sum_q15 = 0;
+
+  for (uint32_t s = 0U; s < N; s++)
+  {
+    stages[s] = ((s & 1U) == 0U) ? BiquadNotch(150.0f + (60.0f * (float)s), SAMPLE_HZ, 3.0f)
+                                 : BiquadLowpass(250.0f, SAMPLE_HZ, 0.70710678f);
+  }
+  BiquadBank<N> bank(stages);
+  BiquadBankQ15<N> bank_q15(stages);
+
+  start = Unit_Nanoseconds();
+  for (uint32_t pass = 0U; pass < BENCH_PASSES; pass++)
+  {
+    for (uint32_t n = 0U; n < BENCH_SAMPLES; n++)
+    {
+      float x[3] = { (float)bench_input[n][0], (float)bench_input[n][1], (float)bench_input[n][2] };
+
+      bank.Apply(x);
+      sum += x[0] + x[1] + x[2];
+    }
+  }
+  float_ns = (Unit_Nanoseconds() - start) / ((double)BENCH_PASSES * BENCH_SAMPLES);
+
+  start = Unit_Nanoseconds();
+  for (uint32_t pass = 0U; pass < BENCH_PASSES; pass++)
+  {
+    for (uint32_t n = 0U; n < BENCH_SAMPLES; n++)
+    {
+      int16_t x[3] = { bench_input[n][0], bench_input[n][1], bench_input[n][2] };
+
+      bank_q15.Apply(x);
+      sum_q15 += x[0] + x[1] + x[2];
+    }
+  }
+  q15_ns = (Unit_Nanoseconds() - start) / ((double)BENCH_PASSES * BENCH_SAMPLES);
+  bench_sink = sum + (float)sum_q15;
+
+  /* One more pass from rest on both, sample by sample */
+  bank.Reset();
+  bank_q15.Reset();
+  for (uint32_t n = 0U; n < BENCH_SAMPLES; n++)
+  {
+    float x[3] = { (float)bench_input[n][0], (float)bench_input[n][1], (float)bench_input[n][2] };
+    int16_t q[3] = { bench_input[n][0], bench_input[n][1], bench_input[n][2] };
+
+    bank.Apply(x);
+    bank_q15.Apply(q);
+    for (uint32_t a = 0U; a < 3U; a++)
+    {
+      int32_t e = std::abs((int32_t)std::lround(x[a]) - q[a]);
+
+      worst = (e > worst) ? e : worst;
+    }
+  }
+
+  printf("  3 axes x %lu stages: float %6.1f ns, q15 %6.1f ns per sample, %ld LSB apart\n",
+         (unsigned long)N, float_ns, q15_ns, (long)worst);
+  return worst;
+}
+
+static void Test_Bench(void)
+{
+  uint32_t n;
+
+  /* Hover noise around a slow turn, near full scale on one axis */
+  for (n = 0U; n < BENCH_SAMPLES; n++)
+  {
+    double t = n / (double)SAMPLE_HZ;
+
+    bench_input[n][0] = (int16_t)lround((3000.0 * sin(2.0 * M_PI * 3.0 * t)) + (800.0 * sin(2.0 * M_PI * 180.0 * t)));
+    bench_input[n][1] = (int16_t)lround(-1500.0 + (600.0 * sin((2.0 * M_PI * 270.0 * t) + 1.0)));
+    bench_input[n][2] = (int16_t)lround((24000.0 * sin(2.0 * M_PI * 0.5 * t)) + (400.0 * sin(2.0 * M_PI * 330.0 * t)));
+  }
+
+  /* The Q14 coefficients move the responses apart by a few LSB */
+  UNIT_CHECK(Bench<1>() <= 32);
+  UNIT_CHECK(Bench<2>() <= 32);
+  UNIT_CHECK(Bench<4>() <= 32);
+  UNIT_CHECK(Bench<8>() <= 32);
+}
+
+int main(void)
+{
+  UNIT_RUN(Test_ConstexprMath);
+  UNIT_RUN(Test_Pt1);
+  UNIT_RUN(Test_Pt2);
+  UNIT_RUN(Test_Lowpass);
+  UNIT_RUN(Test_Notch);
+  UNIT_RUN(Test_BankResponse);
+  UNIT_RUN(Test_NotchTune);
+  UNIT_RUN(Test_Bench);
+  return Unit_Result();
+}
@@ -0,0 +1,607 @@
+/**
+  ******************************************************************************
+  * @file    test_eskf.cpp
+  * @brief   Host tests of the navigation filter: the matrix products against
+  *          a double precision reference, the block sparse covariance
+  *          prediction against dense F P F' + Q, and a simulated flight with
+  *          late GPS fixes and barometer heights. eskf.cpp is built here
+  *          with ESKF_BENCH.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "eskf.h"
+#include "matrix.hpp"
+#include "mock_hal.h"
+#include "unit.h"
+#include <cmath>
+#include <cstring>
+
+/* Private define ------------------------------------------------------------*/
+#define LOOP_HZ               2000U
+#define GYRO_DPS_PER_COUNT    (1.0 / 16.4)
+#define ACCEL_G_PER_COUNT     (1.0 / 4096.0)
+#define START_CYCLES          1000U
+#define DEG                   (M_PI / 180.0)
+
+/** Sample spacing of the prediction test, a little over 1 / LOOP_HZ so that
+  * a period is 8 samples whatever the rounding of its sum */
+#define SPACED_CYCLES         84010U
+
+/** Measurements of the simulated flight: 10 Hz GPS 150 ms late, 50 Hz
+  * barometer 10 ms late, in loop samples */
+#define GPS_DECIM             200U
+#define GPS_DELAY             300U
+#define BARO_DECIM            40U
+#define BARO_DELAY            20U
+#define PENDING_LEN           8U
+
+/* Private types -------------------------------------------------------------*/
+typedef double DenseTypeDef[ESKF_STATES][ESKF_STATES];
+
+struct Quat
+{
+  double w;
+  double x;
+  double y;
+  double z;
+};
+
+/**
+  * @brief  Measurement waiting for its delay.
+  */
+struct Pending
+{
+  uint32_t due;                          /*!< Loop sample it is given at      */
+  uint64_t timestamp;                    /*!< Time it was taken               */
+  float position[3];
+  float velocity[3];
+};
+
+/**
+  * @brief  Delayed measurements of one sensor, in time order.
+  */
+struct PendingFifo
+{
+  Pending item[PENDING_LEN];
+  uint32_t head = 0U;
+  uint32_t tail = 0U;
+};
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t random_state;
+
+/* Private functions ---------------------------------------------------------*/
+static double Uniform(void)
+{
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return (random_state + 1.0) / 4294967297.0;
+}
+
+static double Gauss(void)
+{
+  double u = Uniform();
+  double v = Uniform();
+
+  return std::sqrt(-2.0 * std::log(u)) * std::cos(2.0 * M_PI * v);
+}
+
+static Quat Multiply(const Quat &a, const Quat &b)
+{
+  return { (a.w * b.w) - (a.x * b.x) - (a.y * b.y) - (a.z * b.z),
+           (a.w * b.x) + (a.x * b.w) + (a.y * b.z) - (a.z * b.y),
+           (a.w * b.y) - (a.x * b.z) + (a.y * b.w) + (a.z * b.x),
+           (a.w * b.z) + (a.x * b.y) - (a.y * b.x) + (a.z * b.w) };
+}
+
+/**
+  * @brief  Quaternion of a rotation vector.
+  */
+static Quat Exp(const double v[3])
+{
+  double angle = std::sqrt((v[0] * v[0]) + (v[1] * v[1]) + (v[2] * v[2]));
+  double s = (angle > 0.0) ? (std::sin(angle / 2.0) / angle) : 0.5;
+
+  return { std::cos(angle / 2.0), v[0] * s, v[1] * s, v[2] * s };
+}
+
+/**
+  * @brief  Rotation matrix of a unit quaternion, IMU axes into earth axes.
+  */
+static void Rotation(const Quat &q, double r[3][3])
+{
+  r[0][0] = 1.0 - (2.0 * ((q.y * q.y) + (q.z * q.z)));
+  r[0][1] = 2.0 * ((q.x * q.y) - (q.w * q.z));
+  r[0][2] = 2.0 * ((q.x * q.z) + (q.w * q.y));
+  r[1][0] = 2.0 * ((q.x * q.y) + (q.w * q.z));
+  r[1][1] = 1.0 - (2.0 * ((q.x * q.x) + (q.z * q.z)));
+  r[1][2] = 2.0 * ((q.y * q.z) - (q.w * q.x));
+  r[2][0] = 2.0 * ((q.x * q.z) - (q.w * q.y));
+  r[2][1] = 2.0 * ((q.y * q.z) + (q.w * q.x));
+  r[2][2] = 1.0 - (2.0 * ((q.x * q.x) + (q.y * q.y)));
+}
+
+/**
+  * @brief  Earth axes vector seen in the IMU axes, R' e.
+  */
+static void ToBody(const Quat &q, const double earth[3], double body[3])
+{
+  double r[3][3];
+
+  Rotation(q, r);
+  for (uint32_t i = 0U; i < 3U; i++)
+  {
+    body[i] = (r[0][i] * earth[0]) + (r[1][i] * earth[1]) + (r[2][i] * earth[2]);
+  }
+}
+
+/**
+  * @brief  Angle of the rotation between two attitudes, deg.
+  */
+static double Angle(const Quat &a, const float b[4])
+{
+  Quat conj = { a.w, -a.x, -a.y, -a.z };
+  double w = std::fabs(Multiply(conj, { b[0], b[1], b[2], b[3] }).w);
+
+  return 2.0 * std::acos((w < 1.0) ? w : 1.0) / DEG;
+}
+
+static void DenseProduct(const DenseTypeDef a, const DenseTypeDef b, DenseTypeDef c, bool transpose_b)
+{
+  for (uint32_t i = 0U; i < ESKF_STATES; i++)
+  {
+    for (uint32_t j = 0U; j < ESKF_STATES; j++)
+    {
+      double sum = 0.0;
+
+      for (uint32_t k = 0U; k < ESKF_STATES; k++)
+      {
+        sum += a[i][k] * (transpose_b ? b[j][k] : b[k][j]);
+      }
+      c[i][j] = sum;
+    }
+  }
+}
+
+/**
+  * @brief  Dense transition over a period, from its rotation vector phi,
+  *         its velocity change dv in the earth axes and the attitude r at
+  *         its end, exp(-[phi]x) exact.
+  */
+static void DenseTransition(const double phi[3], const double dv[3], const double r[3][3], double dt,
+                            DenseTypeDef f)
+{
+  double angle = std::sqrt((phi[0] * phi[0]) + (phi[1] * phi[1]) + (phi[2] * phi[2]));
+  double k[3] = { phi[0] / angle, phi[1] / angle, phi[2] / angle };
+  double s[3][3] = { { 0.0, -k[2], k[1] }, { k[2], 0.0, -k[0] }, { -k[1], k[0], 0.0 } };
+  double d[3][3] = { { 0.0, -dv[2], dv[1] }, { dv[2], 0.0, -dv[0] }, { -dv[1], dv[0], 0.0 } };
+
+  std::memset(f, 0, sizeof(DenseTypeDef));
+  for (uint32_t i = 0U; i < ESKF_STATES; i++)
+  {
+    f[i][i] = 1.0;
+  }
+  for (uint32_t i = 0U; i < 3U; i++)
+  {
+    for (uint32_t j = 0U; j < 3U; j++)
+    {
+      double ss = 0.0;
+      double dr = 0.0;
+
+      for (uint32_t n = 0U; n < 3U; n++)
+      {
+        ss += s[i][n] * s[n][j];
+        dr += d[i][n] * r[n][j];
+      }
+      /* Rodrigues, of the angle -|phi| */
+      f[i][j] = ((i == j) ? 1.0 : 0.0) - (std::sin(angle) * s[i][j]) + ((1.0 - std::cos(angle)) * ss);
+      f[3U + i][j] = -dr;
+      f[3U + i][12U + j] = -r[i][j] * dt;
+    }
+    f[i][9U + i] = -dt;
+    f[6U + i][3U + i] = dt;
+  }
+}
+
+static void Give(PendingFifo *fifo, uint32_t due, uint64_t timestamp, const double position[3],
+                 const double velocity[3])
+{
+  Pending *p = &fifo->item[fifo->head % PENDING_LEN];
+
+  p->due = due;
+  p->timestamp = timestamp;
+  for (uint32_t i = 0U; i < 3U; i++)
+  {
+    p->position[i] = (float)position[i];
+    p->velocity[i] = (float)velocity[i];
+  }
+  fifo->head++;
+}
+
+static const Pending *Due(PendingFifo *fifo, uint32_t n)
+{
+  const Pending *p = &fifo->item[fifo->tail % PENDING_LEN];
+
+  if ((fifo->head == fifo->tail) || (p->due > n))
+  {
+    return nullptr;
+  }
+  fifo->tail++;
+  return p;
+}
+
+/* Tests ---------------------------------------------------------------------*/
+static void Test_Matrix(void)
+{
+  Matrix<4, 7> a;
+  Matrix<7, 3> b;
+  Matrix<3, 7> bt;
+  Matrix<ESKF_STATES, ESKF_STATES> p;
+  Matrix<ESKF_STATES, ESKF_STATES> q;
+  Matrix<ESKF_STATES, ESKF_STATES> pq;
+  Matrix<ESKF_STATES, ESKF_STATES> pqt;
+  double worst = 0.0;
+
+  random_state = 5U;
+  for (uint32_t i = 0U; i < 7U; i++)
+  {
+    for (uint32_t j = 0U; j < 4U; j++)
+    {
+      a(j, i) = (float)((2.0 * Uniform()) - 1.0);
+    }
+    for (uint32_t j = 0U; j < 3U; j++)
+    {
+      b(i, j) = (float)((2.0 * Uniform()) - 1.0);
+      bt(j, i) = b(i, j);
+    }
+  }
+  Matrix<4, 3> c = a * b;
+  Matrix<4, 3> c2 = a.MulTransposed(bt);
+  Matrix<4, 3> c3 = (b.Transposed() * a.Transposed()).Transposed();
+
+  for (uint32_t i = 0U; i < 4U; i++)
+  {
+    for (uint32_t j = 0U; j < 3U; j++)
+    {
+      double sum = 0.0;
+
+      for (uint32_t k = 0U; k < 7U; k++)
+      {
+        sum += (double)a(i, k) * b(k, j);
+      }
+      worst = std::fmax(worst, std::fabs(sum - c(i, j)));
+      worst = std::fmax(worst, std::fabs(sum - c2(i, j)));
+      worst = std::fmax(worst, std::fabs(sum - c3(i, j)));
+    }
+  }
+  UNIT_CHECK(worst < 1e-6);
+
+  /* The in place products of the covariance size */
+  for (uint32_t i = 0U; i < ESKF_STATES; i++)
+  {
+    for (uint32_t j = 0U; j < ESKF_STATES; j++)
+    {
+      p(i, j) = (float)((2.0 * Uniform()) - 1.0);
+      q(i, j) = (float)((2.0 * Uniform()) - 1.0);
+    }
+  }
+  pq.SetProduct(p, q);
+  pqt.SetProductTransposed(p, q);
+  worst = 0.0;
+  for (uint32_t i = 0U; i < ESKF_STATES; i++)
+  {
+    for (uint32_t j = 0U; j < ESKF_STATES; j++)
+    {
+      double sum = 0.0;
+      double sum_t = 0.0;
+
+      for (uint32_t k = 0U; k < ESKF_STATES; k++)
+      {
+        sum += (double)p(i, k) * q(k, j);
+        sum_t += (double)p(i, k) * q(j, k);
+      }
+      worst = std::fmax(worst, std::fabs(sum - pq(i, j)));
+      worst = std::fmax(worst, std::fabs(sum_t - pqt(i, j)));
+    }
+  }
+  UNIT_CHECK(worst < 2e-6);
+  printf("  products: %.2g worst against double\n", worst);
+
+  /* Blocks, sums, scaling and the cross product matrix */
+  Matrix3 m = p.Block<3U, 3U>(6U, 9U);
+
+  UNIT_CHECK((m(0, 0) == p(6, 9)) && (m(2, 1) == p(8, 10)));
+  pq.SetBlock(12U, 3U, m);
+  UNIT_CHECK((pq(12, 3) == p(6, 9)) && (pq(14, 5) == p(8, 11)));
+  m = (m * 2.0f) - m;
+  UNIT_CHECK(m(1, 2) == p(7, 11));
+  UNIT_CHECK(Matrix3::Identity()(1, 1) == 1.0f && Matrix3::Identity()(1, 2) == 0.0f);
+  UNIT_CHECK(Matrix3::Diagonal(3.0f)(2, 2) == 3.0f);
+
+  Vector3 x;
+  Vector3 y;
+
+  x[0] = 1.0f;
+  x[1] = 2.0f;
+  x[2] = 3.0f;
+  y[0] = -2.0f;
+  y[1] = 0.5f;
+  y[2] = 4.0f;
+  Vector3 cross = Skew(x) * y;
+
+  UNIT_CHECK((cross[0] == 6.5f) && (cross[1] == -10.0f) && (cross[2] == 4.5f));
+}
+
+static void Test_Bench(void)
+{
+  Eskf_BenchTypeDef result = {};
+
+  /* Same covariance and transition through both paths, diagonal about 15 */
+  Mock_Reset();
+  Eskf_Bench(&result);
+  UNIT_CHECK(result.max_error < 1e-5f * (float)ESKF_STATES);
+  printf("  sparse against dense: %.2g\n", (double)result.max_error);
+}
+
+static void Test_Prediction(void)
+{
+  static DenseTypeDef p;
+  static DenseTypeDef f;
+  static DenseTypeDef fp;
+  static const double w[3] = { 0.7, -0.4, 1.1 };
+  static const double up[3] = { 0.0, 0.0, 1.0 };
+  const double init[5] = { ESKF_INIT_ATTITUDE, ESKF_INIT_VELOCITY, ESKF_INIT_POSITION, ESKF_INIT_GYRO_BIAS,
+                           ESKF_INIT_ACCEL_BIAS };
+  const double noise[5] = { ESKF_GYRO_NOISE, ESKF_ACCEL_NOISE, 0.0, ESKF_GYRO_BIAS_WALK, ESKF_ACCEL_BIAS_WALK };
+  double sample_dt = (double)SPACED_CYCLES / SystemCoreClock;
+  double dt = 8.0 * sample_dt;
+  double phi[3];
+  double dv[3] = { 0.0, 0.0, ESKF_GRAVITY * dt };
+  double worst = 0.0;
+  Quat q0 = { 0.9, 0.3, -0.2, 0.25 };
+  Quat q;
+  IMU_LoopSampleTypeDef sample;
+  uint32_t predictions;
+  uint32_t n;
+
+  /* Turning at a constant rate without accelerating, no measurement: only
+     the predictions change the covariance */
+  double norm = std::sqrt((q0.w * q0.w) + (q0.x * q0.x) + (q0.y * q0.y) + (q0.z * q0.z));
+
+  q0 = { q0.w / norm, q0.x / norm, q0.y / norm, q0.z / norm };
+  const float start[4] = { (float)q0.w, (float)q0.x, (float)q0.y, (float)q0.z };
+
+  Mock_Reset();
+  Eskf_Init((float)GYRO_DPS_PER_COUNT, (float)ACCEL_G_PER_COUNT);
+  Eskf_Start(start);
+  for (n = 0U; n < 4000U; n++)
+  {
+    double angle[3] = { w[0] * sample_dt * n, w[1] * sample_dt * n, w[2] * sample_dt * n };
+    double a[3];
+
+    ToBody(Multiply(q0, Exp(angle)), up, a);
+    sample.timestamp = START_CYCLES + ((uint64_t)n * SPACED_CYCLES);
+    for (uint32_t i = 0U; i < 3U; i++)
+    {
+      sample.gyro[i] = (float)(w[i] / (GYRO_DPS_PER_COUNT * DEG));
+      sample.accel[i] = (float)(a[i] / ACCEL_G_PER_COUNT);
+    }
+    Eskf_Push(&sample);
+    Eskf_Poll(1000000U);
+  }
+  predictions = Eskf_Stats()->predictions;
+  UNIT_CHECK(predictions > 400U);
+
+  /* The same predictions, dense and in double */
+  std::memset(p, 0, sizeof(p));
+  for (uint32_t i = 0U; i < ESKF_STATES; i++)
+  {
+    p[i][i] = init[i / 3U] * init[i / 3U];
+  }
+  q = q0;
+  for (uint32_t i = 0U; i < 3U; i++)
+  {
+    phi[i] = w[i] * dt;
+  }
+  for (n = 0U; n < predictions; n++)
+  {
+    double r[3][3];
+
+    q = Multiply(q, Exp(phi));
+    Rotation(q, r);
+    DenseTransition(phi, dv, r, dt, f);
+    DenseProduct(f, p, fp, false);
+    DenseProduct(fp, f, p, true);
+    for (uint32_t i = 0U; i < ESKF_STATES; i++)
+    {
+      p[i][i] += noise[i / 3U] * noise[i / 3U] * dt;
+    }
+  }
+  for (uint32_t i = 0U; i < ESKF_STATES; i++)
+  {
+    worst = std::fmax(worst, std::fabs((Eskf_Variance(i) / p[i][i]) - 1.0));
+  }
+  UNIT_CHECK(worst < 1e-3);
+  UNIT_CHECK(Eskf_Stats()->gaps == 1U);
+  printf("  %u predictions against dense double: %.2g relative\n", (unsigned)predictions, worst);
+}
+
+static void Test_Flight(void)
+{
+  static const double g[3] = { 0.5 * DEG, -0.3 * DEG, 0.2 * DEG };
+  static const double b[3] = { 0.2, -0.1, 0.15 };
+  PendingFifo gps;
+  PendingFifo baro;
+  IMU_LoopSampleTypeDef sample;
+  Quat truth = { std::cos(0.2), 0.6 * std::sin(0.2), 0.0, 0.8 * std::sin(0.2) };
+  double position_error = 0.0;
+  double velocity_error = 0.0;
+  double attitude_error = 0.0;
+  double position_max = 0.0;
+  uint32_t measured = 0U;
+  uint32_t given = 0U;
+  uint32_t n;
+
+  /* 3 minutes of 10 m sines on each axis from rest, turning, with gyro and
+     accelerometer biases and noise */
+  Mock_Reset();
+  random_state = 11U;
+  Eskf_Init((float)GYRO_DPS_PER_COUNT, (float)ACCEL_G_PER_COUNT);
+  const float start[4] = { (float)truth.w, (float)truth.x, (float)truth.y, (float)truth.z };
+
+  Eskf_Start(start);
+  for (n = 0U; n < (180U * LOOP_HZ); n++)
+  {
+    static const double amplitude[3] = { 10.0, 10.0, 2.0 };
+    static const double omega[3] = { 2.0 * M_PI / 10.0, 2.0 * M_PI / 14.0, 2.0 * M_PI / 8.0 };
+    double t = (double)n / LOOP_HZ;
+    double w[3] = { 0.5 * std::sin(2.0 * M_PI * 0.3 * t), 0.4 * std::sin((2.0 * M_PI * 0.21 * t) + 1.0),
+                    0.3 * std::cos(2.0 * M_PI * 0.13 * t) };
+    double position[3];
+    double velocity[3];
+    double force[3];
+    double body[3];
+    const Pending *m;
+
+    if (n != 0U)
+    {
+      double step[3] = { w[0] / LOOP_HZ, w[1] / LOOP_HZ, w[2] / LOOP_HZ };
+
+      truth = Multiply(truth, Exp(step));
+    }
+    for (uint32_t i = 0U; i < 3U; i++)
+    {
+      position[i] = amplitude[i] * (1.0 - std::cos(omega[i] * t));
+      velocity[i] = amplitude[i] * omega[i] * std::sin(omega[i] * t);
+      force[i] = amplitude[i] * omega[i] * omega[i] * std::cos(omega[i] * t);
+    }
+    force[2] += ESKF_GRAVITY;
+    ToBody(truth, force, body);
+
+    sample.timestamp = START_CYCLES + ((uint64_t)n * (SystemCoreClock / LOOP_HZ));
+    for (uint32_t i = 0U; i < 3U; i++)
+    {
+      sample.gyro[i] = (float)(((w[i] + g[i]) / (GYRO_DPS_PER_COUNT * DEG)) + (2.0 * Gauss()));
+      sample.accel[i] = (float)(((body[i] + b[i]) / ESKF_GRAVITY / ACCEL_G_PER_COUNT) + (10.0 * Gauss()));
+    }
+    Eskf_Push(&sample);
+
+    /* Measured now, given once late */
+    if ((n % GPS_DECIM) == 0U)
+    {
+      double p[3];
+      double v[3];
+
+      for (uint32_t i = 0U; i < 3U; i++)
+      {
+        p[i] = position[i] + (0.3 * Gauss());
+        v[i] = velocity[i] + (0.05 * Gauss());
+      }
+      Give(&gps, n + GPS_DELAY, sample.timestamp, p, v);
+    }
+    if ((n % BARO_DECIM) == 0U)
+    {
+      double p[3] = { 0.0, 0.0, position[2] + (0.3 * Gauss()) };
+
+      Give(&baro, n + BARO_DELAY, sample.timestamp, p, p);
+    }
+    while ((m = Due(&gps, n)) != nullptr)
+    {
+      UNIT_CHECK(Eskf_FusePosition(m->timestamp, m->position, 0.09f) == HAL_OK);
+      UNIT_CHECK(Eskf_FuseVelocity(m->timestamp, m->velocity, 0.0025f) == HAL_OK);
+      given += 6U;
+    }
+    while ((m = Due(&baro, n)) != nullptr)
+    {
+      UNIT_CHECK(Eskf_FuseHeight(m->timestamp, m->position[2], 0.09f) == HAL_OK);
+      given++;
+    }
+    Eskf_Poll(1000000U);
+
+    if (t >= 120.0)
+    {
+      const Eskf_StateTypeDef *state = Eskf_State();
+      double pe = 0.0;
+      double ve = 0.0;
+
+      for (uint32_t i = 0U; i < 3U; i++)
+      {
+        pe += (state->position[i] - position[i]) * (state->position[i] - position[i]);
+        ve += (state->velocity[i] - velocity[i]) * (state->velocity[i] - velocity[i]);
+      }
+      position_error += std::sqrt(pe);
+      velocity_error += std::sqrt(ve);
+      attitude_error += Angle(truth, state->q);
+      position_max = std::fmax(position_max, std::sqrt(pe));
+      measured++;
+    }
+  }
+
+  const Eskf_StateTypeDef *state = Eskf_State();
+  const Eskf_StatsTypeDef *stats = Eskf_Stats();
+  double gyro_bias = 0.0;
+  double accel_bias = 0.0;
+
+  for (uint32_t i = 0U; i < 3U; i++)
+  {
+    gyro_bias = std::fmax(gyro_bias, std::fabs(state->gyro_bias[i] - g[i]) / DEG);
+    accel_bias = std::fmax(accel_bias, std::fabs(state->accel_bias[i] - b[i]));
+  }
+  position_error /= measured;
+  velocity_error /= measured;
+  attitude_error /= measured;
+  printf("  position %.3f m (max %.3f), velocity %.3f m/s, attitude %.3f deg\n", position_error, position_max,
+         velocity_error, attitude_error);
+  printf("  bias error: gyro %.4f dps, accelerometer %.4f m/s^2\n", gyro_bias, accel_bias);
+
+  UNIT_CHECK(position_error < 0.2);
+  UNIT_CHECK(position_max < 0.5);
+  UNIT_CHECK(velocity_error < 0.05);
+  UNIT_CHECK(attitude_error < 0.3);
+  UNIT_CHECK(gyro_bias < 0.02);
+  UNIT_CHECK(accel_bias < 0.03);
+  UNIT_CHECK((stats->rejected == 0U) && (stats->dropped == 0U) && (stats->stale == 0U) && (stats->late == 0U));
+
+  /* All fused but those of the last ESKF_DELAY_US, which the filter has
+     not reached */
+  UNIT_CHECK(stats->fusions <= given);
+  UNIT_CHECK((given - stats->fusions) <= ((ESKF_DELAY_US / 100000U) * 6U) + (ESKF_DELAY_US / 20000U) + 1U);
+}
+
+static void Test_Stale(void)
+{
+  static const float level[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+  IMU_LoopSampleTypeDef sample = {};
+  float position[3] = { 0.0f, 0.0f, 0.0f };
+
+  Mock_Reset();
+  Eskf_Init((float)GYRO_DPS_PER_COUNT, (float)ACCEL_G_PER_COUNT);
+  UNIT_CHECK(Eskf_FuseHeight(START_CYCLES, 0.0f, 1.0f) == HAL_ERROR);
+  Eskf_Start(level);
+  sample.accel[2] = (float)(1.0 / ACCEL_G_PER_COUNT);
+  for (uint32_t n = 0U; n < LOOP_HZ; n++)
+  {
+    sample.timestamp = START_CYCLES + ((uint64_t)n * (SystemCoreClock / LOOP_HZ));
+    Eskf_Push(&sample);
+    Eskf_Poll(1000000U);
+  }
+
+  /* Older than the filter, ESKF_DELAY_US behind the IMU */
+  UNIT_CHECK(Eskf_FusePosition(sample.timestamp - Timing_UsToCycles(ESKF_DELAY_US + 10000U), position, 1.0f)
+             == HAL_ERROR);
+  UNIT_CHECK(Eskf_Stats()->stale == 1U);
+  UNIT_CHECK(Eskf_FusePosition(sample.timestamp - Timing_UsToCycles(ESKF_DELAY_US / 2U), position, 1.0f)
+             == HAL_OK);
+  UNIT_CHECK(Eskf_FuseHeight(sample.timestamp, 0.0f, 0.0f) == HAL_ERROR);
+}
+
+int main(void)
+{
+  UNIT_RUN(Test_Matrix);
+  UNIT_RUN(Test_Bench);
+  UNIT_RUN(Test_Prediction);
+  UNIT_RUN(Test_Flight);
+  UNIT_RUN(Test_Stale);
+  return Unit_Result();
+}
@@ -0,0 +1,358 @@
+/**
+  ******************************************************************************
+  * @file    test_fast_math.c
+  * @brief   Host tests of the fast math kernels: dense sweeps of every
+  *          kernel against the double precision libm, checked against the
+  *          worst errors documented in fast_math.h, then FastMath_Bench()
+  *          and a host timing of each kernel against its single precision
+  *          libm counterpart.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "fast_math.h"
+#include "mock_hal.h"
+#include "unit.h"
+#include <float.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+/** Worst errors documented in fast_math.h */
+#define SINCOS_ABS_BOUND      2e-7
+#define SINCOS_RANGE          1e4
+#define ATAN2_ABS_BOUND       5e-7
+#define ASIN_ABS_BOUND        5e-7
+#define INVSQRT_REL_BOUND     5e-6
+#define EXP_REL_BOUND         5e-7
+#define LOG2_ABS_BOUND        2e-7
+
+/** Inputs of the host timing loops, and passes over them */
+#define BENCH_SAMPLES         4096U
+#define BENCH_PASSES          200U
+
+/* Private types -------------------------------------------------------------*/
+typedef float (*UnaryTypeDef)(float x);
+
+/* Private variables ---------------------------------------------------------*/
+static float bench_a[BENCH_SAMPLES];
+static float bench_b[BENCH_SAMPLES];
+static volatile float sink;
+
+/* Private functions ---------------------------------------------------------*/
+static float FromBits(uint32_t u)
+{
+  float f;
+
+  memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+static uint32_t ToBits(float f)
+{
+  uint32_t u;
+
+  memcpy(&u, &f, sizeof(u));
+  return u;
+}
+
+/**
+  * @brief  Distance to the next float up, the resolution of a result.
+  */
+static double Ulp(float x)
+{
+  float a = fabsf(x);
+
+  return (double)FromBits(ToBits(a) + 1U) - (double)a;
+}
+
+static float LibmInvSqrt(float x)
+{
+  return 1.0f / sqrtf(x);
+}
+
+static float FastSin(float x)
+{
+  return FastMath_Sin(x);
+}
+
+static float FastCos(float x)
+{
+  return FastMath_Cos(x);
+}
+
+static float FastAsin(float x)
+{
+  return FastMath_Asin(x);
+}
+
+static float FastInvSqrt(float x)
+{
+  return FastMath_InvSqrt(x);
+}
+
+static float FastExp(float x)
+{
+  return FastMath_Exp(x);
+}
+
+static float FastLog2(float x)
+{
+  return FastMath_Log2(x);
+}
+
+/**
+  * @brief  Host time per call of a one operand kernel over bench_a.
+  * @retval Nanoseconds per call
+  */
+static double TimeUnary(UnaryTypeDef f)
+{
+  double start = Unit_Nanoseconds();
+  uint32_t pass;
+  uint32_t n;
+
+  for (pass = 0U; pass < BENCH_PASSES; pass++)
+  {
+    for (n = 0U; n < BENCH_SAMPLES; n++)
+    {
+      sink = f(bench_a[n]);
+    }
+  }
+  return (Unit_Nanoseconds() - start) / ((double)BENCH_PASSES * BENCH_SAMPLES);
+}
+
+/**
+  * @brief  Fill the timing inputs evenly over a range.
+  */
+static void Fill(float *x, float lo, float hi)
+{
+  uint32_t n;
+
+  for (n = 0U; n < BENCH_SAMPLES; n++)
+  {
+    x[(n * 97U) % BENCH_SAMPLES] = lo + (((hi - lo) * (float)n) / (float)(BENCH_SAMPLES - 1U));
+  }
+}
+
+static void PrintTime(const char *name, double fast_ns, double libm_ns)
+{
+  printf("  %-8s fast %6.2f ns, libm %6.2f ns, x%.1f\n", name, fast_ns, libm_ns, libm_ns / fast_ns);
+}
+
+/* Tests ---------------------------------------------------------------------*/
+static void Test_Round(void)
+{
+  UNIT_CHECK(FastMath_Round(0.0f) == 0);
+  UNIT_CHECK(FastMath_Round(0.49f) == 0);
+  UNIT_CHECK(FastMath_Round(0.5f) == 1);
+  UNIT_CHECK(FastMath_Round(-0.5f) == -1);
+  UNIT_CHECK(FastMath_Round(-1.49f) == -1);
+  UNIT_CHECK(FastMath_Round(2.5f) == 3);
+  UNIT_CHECK(FastMath_Round(-1e6f) == -1000000);
+}
+
+static void Test_SinCos(void)
+{
+  double worst = 0.0;
+  double worst_wide = 0.0;
+  uint32_t mismatches = 0U;
+  uint32_t n;
+
+  /* Every float of [-4 pi, 4 pi] with a fine stride, then the full range */
+  for (n = 0U; n <= 4000000U; n++)
+  {
+    float x = -4.0f * FAST_MATH_PI + ((8.0f * FAST_MATH_PI * (float)n) / 4000000.0f);
+    float s;
+    float c;
+
+    FastMath_SinCos(x, &s, &c);
+    worst = fmax(worst, fabs((double)s - sin((double)x)));
+    worst = fmax(worst, fabs((double)c - cos((double)x)));
+  }
+  for (n = 0U; n <= 2000000U; n++)
+  {
+    float x = (float)(-SINCOS_RANGE + ((2.0 * SINCOS_RANGE * n) / 2000000.0));
+    float s;
+    float c;
+
+    FastMath_SinCos(x, &s, &c);
+    worst_wide = fmax(worst_wide, fabs((double)s - sin((double)x)));
+    worst_wide = fmax(worst_wide, fabs((double)c - cos((double)x)));
+    mismatches += ((s != FastMath_Sin(x)) || (c != FastMath_Cos(x))) ? 1U : 0U;
+  }
+  UNIT_CHECK(mismatches == 0U);
+  UNIT_CHECK(worst < SINCOS_ABS_BOUND);
+  UNIT_CHECK(worst_wide < SINCOS_ABS_BOUND);
+  printf("  sincos: %.3g within 4 pi, %.3g within %g rad\n", worst, worst_wide, SINCOS_RANGE);
+}
+
+static void Test_Atan2(void)
+{
+  static const float radii[] = { 1e-30f, 1e-3f, 1.0f, 1e3f, 1e30f };
+  double worst = 0.0;
+  uint32_t i;
+  uint32_t n;
+
+  for (i = 0U; i < (sizeof(radii) / sizeof(radii[0])); i++)
+  {
+    for (n = 0U; n <= 1000000U; n++)
+    {
+      double angle = -M_PI + ((2.0 * M_PI * n) / 1000000.0);
+      float y = (float)(radii[i] * sin(angle));
+      float x = (float)(radii[i] * cos(angle));
+
+      double e = fabs((double)FastMath_Atan2(y, x) - atan2((double)y, (double)x));
+
+      /* y = -0 on the negative x axis gives pi, libm gives -pi: same angle */
+      worst = fmax(worst, (e > M_PI) ? ((2.0 * M_PI) - e) : e);
+    }
+  }
+  UNIT_CHECK(worst < ATAN2_ABS_BOUND);
+  UNIT_CHECK(FastMath_Atan2(0.0f, 0.0f) == 0.0f);
+  UNIT_NEAR(FastMath_Atan2(0.0f, -1.0f), M_PI, ATAN2_ABS_BOUND);
+  UNIT_NEAR(FastMath_Atan2(-1.0f, 0.0f), -M_PI / 2.0, ATAN2_ABS_BOUND);
+  printf("  atan2: %.3g\n", worst);
+}
+
+static void Test_Asin(void)
+{
+  double worst = 0.0;
+  uint32_t n;
+
+  for (n = 0U; n <= 4000000U; n++)
+  {
+    float x = -1.0f + ((2.0f * (float)n) / 4000000.0f);
+
+    worst = fmax(worst, fabs((double)FastMath_Asin(x) - asin((double)x)));
+  }
+  UNIT_CHECK(worst < ASIN_ABS_BOUND);
+  UNIT_NEAR(FastMath_Asin(1.5f), M_PI / 2.0, ASIN_ABS_BOUND);
+  UNIT_NEAR(FastMath_Asin(-1.5f), -M_PI / 2.0, ASIN_ABS_BOUND);
+  printf("  asin: %.3g\n", worst);
+}
+
+static void Test_Sqrt(void)
+{
+  double worst = 0.0;
+  uint32_t mismatches = 0U;
+  uint32_t u;
+
+  /* Every 61st normal float */
+  for (u = ToBits(FLT_MIN); u < ToBits(FLT_MAX); u += 61U)
+  {
+    float x = FromBits(u);
+
+    worst = fmax(worst, fabs(((double)FastMath_InvSqrt(x) * sqrt((double)x)) - 1.0));
+    mismatches += (FastMath_Sqrt(x) != (float)sqrt((double)x)) ? 1U : 0U;
+  }
+  UNIT_CHECK(worst < INVSQRT_REL_BOUND);
+  UNIT_CHECK(mismatches == 0U);
+  printf("  invsqrt: %.3g relative\n", worst);
+}
+
+static void Test_Exp(void)
+{
+  double worst = 0.0;
+  uint32_t n;
+
+  for (n = 0U; n <= 4000000U; n++)
+  {
+    float x = -87.0f + ((175.5f * (float)n) / 4000000.0f);
+
+    worst = fmax(worst, fabs(((double)FastMath_Exp(x) / exp((double)x)) - 1.0));
+  }
+  UNIT_CHECK(worst < EXP_REL_BOUND);
+  UNIT_CHECK(FastMath_Exp(-1000.0f) == FastMath_Exp(-87.0f));
+  UNIT_CHECK(FastMath_Exp(-1000.0f) > 0.0f);
+  UNIT_CHECK(isfinite(FastMath_Exp(1000.0f)));
+  UNIT_CHECK(FastMath_Exp(0.0f) == 1.0f);
+  printf("  exp: %.3g relative\n", worst);
+}
+
+static void Test_Log2(void)
+{
+  double worst = 0.0;
+  uint32_t u;
+
+  /* Every 61st normal float, bound plus one ulp of the result */
+  for (u = ToBits(FLT_MIN); u < ToBits(FLT_MAX); u += 61U)
+  {
+    float x = FromBits(u);
+    float r = FastMath_Log2(x);
+    double e = fabs((double)r - log2((double)x));
+
+    worst = fmax(worst, e - Ulp(r));
+  }
+  UNIT_CHECK(worst < LOG2_ABS_BOUND);
+  UNIT_CHECK(FastMath_Log2(1.0f) == 0.0f);
+  UNIT_CHECK(FastMath_Log2(1024.0f) == 10.0f);
+  printf("  log2: %.3g beyond one ulp\n", worst);
+}
+
+static void Test_Bench(void)
+{
+  static const double bounds[FAST_MATH_BENCH_COUNT] = {
+    SINCOS_ABS_BOUND, SINCOS_ABS_BOUND, ATAN2_ABS_BOUND, ASIN_ABS_BOUND,
+    FLT_EPSILON / 2.0, INVSQRT_REL_BOUND, EXP_REL_BOUND, LOG2_ABS_BOUND + (8.0 * FLT_EPSILON)
+  };
+  FastMath_BenchTypeDef results[FAST_MATH_BENCH_COUNT];
+  uint32_t i;
+
+  /* The mock DWT makes the cycle counts meaningless, the errors still hold */
+  Mock_Reset();
+  memset(results, 0, sizeof(results));
+  FastMath_Bench(results);
+  for (i = 0U; i < FAST_MATH_BENCH_COUNT; i++)
+  {
+    UNIT_CHECK(results[i].name != NULL);
+    UNIT_CHECK(results[i].max_error <= bounds[i]);
+  }
+}
+
+static void Test_HostTiming(void)
+{
+  uint32_t n;
+  double start;
+  double fast_ns;
+  double libm_ns;
+
+  Fill(bench_a, -10.0f, 10.0f);
+  PrintTime("sin", TimeUnary(FastSin), TimeUnary(sinf));
+  PrintTime("cos", TimeUnary(FastCos), TimeUnary(cosf));
+
+  Fill(bench_a, -1.0f, 1.0f);
+  Fill(bench_b, -1.0f, 1.0f);
+  bench_b[0] = 0.5f;
+  start = Unit_Nanoseconds();
+  for (n = 0U; n < (BENCH_PASSES * BENCH_SAMPLES); n++)
+  {
+    sink = FastMath_Atan2(bench_b[n % BENCH_SAMPLES], bench_a[(n * 7U) % BENCH_SAMPLES]);
+  }
+  fast_ns = (Unit_Nanoseconds() - start) / ((double)BENCH_PASSES * BENCH_SAMPLES);
+  start = Unit_Nanoseconds();
+  for (n = 0U; n < (BENCH_PASSES * BENCH_SAMPLES); n++)
+  {
+    sink = atan2f(bench_b[n % BENCH_SAMPLES], bench_a[(n * 7U) % BENCH_SAMPLES]);
+  }
+  libm_ns = (Unit_Nanoseconds() - start) / ((double)BENCH_PASSES * BENCH_SAMPLES);
+  PrintTime("atan2", fast_ns, libm_ns);
+  PrintTime("asin", TimeUnary(FastAsin), TimeUnary(asinf));
+
+  Fill(bench_a, 0.001f, 1000.0f);
+  PrintTime("invsqrt", TimeUnary(FastInvSqrt), TimeUnary(LibmInvSqrt));
+  PrintTime("log2", TimeUnary(FastLog2), TimeUnary(log2f));
+  Fill(bench_a, -20.0f, 20.0f);
+  PrintTime("exp", TimeUnary(FastExp), TimeUnary(expf));
+}
+
+int main(void)
+{
+  UNIT_RUN(Test_Round);
+  UNIT_RUN(Test_SinCos);
+  UNIT_RUN(Test_Atan2);
+  UNIT_RUN(Test_Asin);
+  UNIT_RUN(Test_Sqrt);
+  UNIT_RUN(Test_Exp);
+  UNIT_RUN(Test_Log2);
+  UNIT_RUN(Test_Bench);
+  UNIT_RUN(Test_HostTiming);
+  return Unit_Result();
+}
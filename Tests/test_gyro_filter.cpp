@@ -0,0 +1,253 @@
+/**
+  ******************************************************************************
+  * @file    test_gyro_filter.cpp
+  * @brief   Host tests of the Q15 biquad bank and of the fixed point gyro
+  *          chain, bit for bit against a plain reference of the direct form
+  *          I in 64-bit arithmetic. gyro_filter.cpp is built here with
+  *          GYRO_FILTER_FIXED and GYRO_FILTER_BENCH.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "gyro_filter.h"
+#include "biquad.hpp"
+#include "mock_hal.h"
+#include "unit.h"
+#include <cmath>
+
+/* Private define ------------------------------------------------------------*/
+#define MAX_STAGES            4U
+
+/* Private types -------------------------------------------------------------*/
+/**
+  * @brief  Reference cascade of one axis, coefficients in Q14.
+  */
+struct Reference
+{
+  uint32_t stages = 0U;
+  int32_t b0[MAX_STAGES] {};
+  int32_t b1[MAX_STAGES] {};
+  int32_t b2[MAX_STAGES] {};
+  int32_t a1[MAX_STAGES] {};
+  int32_t a2[MAX_STAGES] {};
+  int32_t x1[MAX_STAGES] {};
+  int32_t x2[MAX_STAGES] {};
+  int32_t y1[MAX_STAGES] {};
+  int32_t y2[MAX_STAGES] {};
+};
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t random_state = 88172645U;
+
+/* Private functions ---------------------------------------------------------*/
+static uint32_t Random(void)
+{
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state;
+}
+
+static int32_t ToQ14(float value)
+{
+  long q = std::lround((double)value * 16384.0);
+
+  return (int32_t)((q > 32767L) ? 32767L : ((q < -32768L) ? -32768L : q));
+}
+
+static int32_t Saturate(int64_t value)
+{
+  return (int32_t)((value > 32767) ? 32767 : ((value < -32768) ? -32768 : value));
+}
+
+static void ReferenceInit(Reference *ref, const BiquadCoeffs *coeffs, uint32_t stages)
+{
+  *ref = Reference();
+  ref->stages = stages;
+  for (uint32_t s = 0U; s < stages; s++)
+  {
+    ref->b0[s] = ToQ14(coeffs[s].b0);
+    ref->b1[s] = ToQ14(coeffs[s].b1);
+    ref->b2[s] = ToQ14(coeffs[s].b2);
+    ref->a1[s] = ToQ14(coeffs[s].a1);
+    ref->a2[s] = ToQ14(coeffs[s].a2);
+  }
+}
+
+/**
+  * @brief  y = (b0 x + b1 x1 + b2 x2 - a1 y1 - a2 y2) / 2^14, rounded half
+  *         up and saturated, per section.
+  */
+static int16_t ReferenceApply(Reference *ref, int16_t in)
+{
+  int32_t x = in;
+
+  for (uint32_t s = 0U; s < ref->stages; s++)
+  {
+    int64_t acc = ((int64_t)ref->b0[s] * x) + ((int64_t)ref->b1[s] * ref->x1[s]) + ((int64_t)ref->b2[s] * ref->x2[s])
+                  - ((int64_t)ref->a1[s] * ref->y1[s]) - ((int64_t)ref->a2[s] * ref->y2[s]);
+    int32_t y = Saturate((acc + 8192) >> 14);
+
+    ref->x2[s] = ref->x1[s];
+    ref->x1[s] = x;
+    ref->y2[s] = ref->y1[s];
+    ref->y1[s] = y;
+    x = y;
+  }
+  return (int16_t)x;
+}
+
+/**
+  * @brief  Test input: full scale noise, small noise, and saturating
+  *         square waves in turn.
+  */
+static int16_t Input(uint32_t n, uint32_t axis)
+{
+  switch ((n / 1000U) % 3U)
+  {
+    case 0U:
+      return (int16_t)Random();
+    case 1U:
+      return (int16_t)((int32_t)(Random() % 2001U) - 1000);
+    default:
+      return (((n / (7U + axis)) & 1U) != 0U) ? 32767 : -32768;
+  }
+}
+
+/* Tests ---------------------------------------------------------------------*/
+static void Test_Q14(void)
+{
+  UNIT_CHECK(BiquadQ14(0.5f) == 8192);
+  UNIT_CHECK(BiquadQ14(-2.0f) == -32768);
+  UNIT_CHECK(BiquadQ14(2.0f) == 32767);
+  UNIT_CHECK(BiquadQ14(3.0f / 32768.0f) == 2);
+  UNIT_CHECK(BiquadQ14(-3.0f / 32768.0f) == -2);
+  UNIT_CHECK(BiquadPack(-1, 2) == 0x0002FFFFU);
+
+  /* Feedback stored negated */
+  BiquadCoeffs c = BiquadLowpass(400.0f, 2000.0f, 0.7071f);
+  BiquadQ15Coeffs q = BiquadToQ15(c);
+
+  UNIT_CHECK((int16_t)(q.a12 & 0xFFFFU) == ToQ14(-c.a1));
+  UNIT_CHECK((int16_t)(q.a12 >> 16) == ToQ14(-c.a2));
+  UNIT_CHECK((int16_t)(q.b12 & 0xFFFFU) == ToQ14(c.b1));
+  UNIT_CHECK(q.b0 == ToQ14(c.b0));
+}
+
+static void Test_BankBitExact(void)
+{
+  static constexpr BiquadCoeffs stages[] =
+  {
+    BiquadPt1(250.0f, 2000.0f),
+    BiquadLowpass(400.0f, 2000.0f, 0.7071f),
+    BiquadNotch(150.0f, 2000.0f, 3.0f),
+    BiquadPt2(80.0f, 2000.0f),
+  };
+  BiquadBankQ15<4, 3> bank(stages);
+  Reference ref[3];
+  uint32_t mismatches = 0U;
+
+  for (uint32_t a = 0U; a < 3U; a++)
+  {
+    ReferenceInit(&ref[a], stages, 4U);
+  }
+  for (uint32_t n = 0U; n < 300000U; n++)
+  {
+    int16_t x[3];
+    int16_t expected[3];
+
+    for (uint32_t a = 0U; a < 3U; a++)
+    {
+      x[a] = Input(n, a);
+      expected[a] = ReferenceApply(&ref[a], x[a]);
+    }
+    bank.Apply(x);
+    for (uint32_t a = 0U; a < 3U; a++)
+    {
+      mismatches += (x[a] != expected[a]) ? 1U : 0U;
+    }
+  }
+  UNIT_CHECK(mismatches == 0U);
+
+  /* Reset clears the state: silence in, silence out */
+  bank.Reset();
+  int16_t zero[3] = { 0, 0, 0 };
+  bank.Apply(zero);
+  UNIT_CHECK((zero[0] == 0) && (zero[1] == 0) && (zero[2] == 0));
+}
+
+static void Test_FixedChain(void)
+{
+  static constexpr BiquadCoeffs stages[] =
+  {
+    BiquadPt1(GYRO_FILTER_PT1_HZ, GYRO_FILTER_RATE_HZ),
+    BiquadLowpass(GYRO_FILTER_LOWPASS_HZ, GYRO_FILTER_RATE_HZ, GYRO_FILTER_LOWPASS_Q),
+  };
+  Reference ref[3];
+  uint32_t mismatches = 0U;
+
+  Mock_Reset();
+  GyroFilter_Reset();
+  for (uint32_t a = 0U; a < 3U; a++)
+  {
+    ReferenceInit(&ref[a], stages, 2U);
+  }
+
+  /* Float loop samples, rounded half away from zero and saturated */
+  for (uint32_t n = 0U; n < 100000U; n++)
+  {
+    float gyro[3];
+
+    for (uint32_t a = 0U; a < 3U; a++)
+    {
+      gyro[a] = ((float)(int32_t)(Random() % 80001U) - 40000.0f) + ((float)(Random() % 4U) * 0.25f);
+    }
+    if ((n % 1000U) == 0U)
+    {
+      gyro[0] = 2.5f;
+      gyro[1] = -2.5f;
+      gyro[2] = -0.5f;
+    }
+
+    float expected[3];
+
+    for (uint32_t a = 0U; a < 3U; a++)
+    {
+      double v = (gyro[a] > 32767.0f) ? 32767.0 : ((gyro[a] < -32768.0f) ? -32768.0 : (double)gyro[a]);
+
+      expected[a] = (float)ReferenceApply(&ref[a], (int16_t)std::round(v));
+    }
+    GyroFilter_Apply(gyro);
+    for (uint32_t a = 0U; a < 3U; a++)
+    {
+      mismatches += (gyro[a] != expected[a]) ? 1U : 0U;
+    }
+  }
+  UNIT_CHECK(mismatches == 0U);
+  UNIT_CHECK(GyroFilter_Cycles()->count == 100000U);
+}
+
+static void Test_Bench(void)
+{
+  GyroFilter_BenchTypeDef result = {};
+  float gyro[3] = { 0.0f, 0.0f, 0.0f };
+
+  Mock_Reset();
+  GyroFilter_Bench(&result);
+
+  /* The Q15 chain follows the float one within the rounding to counts */
+  UNIT_CHECK(result.max_difference < 2.0f);
+  printf("  Q15 against float: %.2f counts at most\n", (double)result.max_difference);
+
+  /* The state is left cleared */
+  GyroFilter_Apply(gyro);
+  UNIT_CHECK((gyro[0] == 0.0f) && (gyro[1] == 0.0f) && (gyro[2] == 0.0f));
+}
+
+int main(void)
+{
+  UNIT_RUN(Test_Q14);
+  UNIT_RUN(Test_BankBitExact);
+  UNIT_RUN(Test_FixedChain);
+  UNIT_RUN(Test_Bench);
+  return Unit_Result();
+}
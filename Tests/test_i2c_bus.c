@@ -0,0 +1,700 @@
+/**
+  ******************************************************************************
+  * @file    test_i2c_bus.c
+  * @brief   Host tests of the I2C transaction engine: segment sequencing on
+  *          the sequential HAL API, queue order, error handling, watchdog
+  *          and bus recovery, scan lists against independent jobs, and a
+  *          host benchmark of the CPU time per job against the bus time a
+  *          blocking HAL_I2C_Mem_Read() waits out.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "i2c_bus.h"
+#include "mock_hal.h"
+#include "unit.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define BENCH_JOBS            200000U
+#define BENCH_IN_FLIGHT       4U        /*!< Jobs resubmitting themselves    */
+#define BENCH_SIZE            6U        /*!< Bytes per read, an IMU sample   */
+#define BENCH_BUS_HZ          400000U
+#define SCAN_ENTRIES          3U
+#define SCAN_SWEEPS           100000U
+#define SCAN_STOP_NS          1900U     /*!< STOP set up and bus free time   */
+
+/* Private variables ---------------------------------------------------------*/
+static I2C_HandleTypeDef hi2c;
+static I2C_HandleTypeDef hi2c_raw;
+static uint32_t bench_submitted;
+static I2C_ScanTypeDef scan;
+static I2C_JobTypeDef scan_jobs[SCAN_ENTRIES];
+static uint8_t scan_data[SCAN_ENTRIES][8];
+
+/** Baro ADC, HMC5883L and QMC5883L data: the reads of a sensor bus */
+static const I2C_ScanEntryTypeDef scan_entries[SCAN_ENTRIES] = {
+  { 0x77U, 0x00U, 3U, scan_data[0] },
+  { 0x1EU, 0x03U, 6U, scan_data[1] },
+  { 0x0DU, 0x00U, 6U, scan_data[2] },
+};
+static uint8_t device_reg;
+static uint8_t device_regs[256];
+static uint32_t device_nack_address;
+static uint32_t device_bus_hz;
+
+static I2C_JobTypeDef *done_jobs[8];
+static uint32_t done_count;
+static uint8_t done_recovery;
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Register file device: a transmit starting a frame sets the
+  *         register pointer then writes, a receive reads from the pointer.
+  *         NACKs one address. With device_bus_hz set, each segment lets its
+  *         bus time pass on the DWT.
+  */
+static uint32_t Device(const Mock_I2cSegmentTypeDef *segment)
+{
+  uint32_t i;
+
+  if (segment->address == device_nack_address)
+  {
+    return HAL_I2C_ERROR_AF;
+  }
+  for (i = 0U; i < segment->size; i++)
+  {
+    if (segment->read != 0U)
+    {
+      segment->data[i] = device_regs[device_reg++];
+    }
+    else if ((segment->option == I2C_FIRST_FRAME) || (segment->option == I2C_FIRST_AND_LAST_FRAME) ||
+             (segment->option == I2C_OTHER_FRAME))
+    {
+      device_reg = segment->data[i];
+    }
+    else
+    {
+      device_regs[device_reg++] = segment->data[i];
+    }
+  }
+  if (device_bus_hz != 0U)
+  {
+    /* START, address and data bytes with their ACK bit, then the STOP and
+     * the bus free time before the next START */
+    DWT->CYCCNT += (uint32_t)(((10U + (9U * (uint64_t)segment->size)) * SystemCoreClock) / device_bus_hz);
+    if ((segment->option == I2C_LAST_FRAME) || (segment->option == I2C_FIRST_AND_LAST_FRAME))
+    {
+      DWT->CYCCNT += (SCAN_STOP_NS * (SystemCoreClock / 1000000U)) / 1000U;
+    }
+  }
+  return HAL_I2C_ERROR_NONE;
+}
+
+static void JobDone(I2C_JobTypeDef *job)
+{
+  I2C_BusTypeDef *bus = (I2C_BusTypeDef *)job->context;
+
+  if (done_count < 8U)
+  {
+    done_jobs[done_count] = job;
+  }
+  done_count++;
+  done_recovery = bus->recovery;
+}
+
+/**
+  * @brief  Benchmark job completion: submit the job again from its callback,
+  *         as the sensor drivers chain their reads.
+  */
+static void BenchDone(I2C_JobTypeDef *job)
+{
+  if (bench_submitted < BENCH_JOBS)
+  {
+    bench_submitted++;
+    (void)I2C_Bus_Read(&i2c_bus1, job, 0x68U, 0x3BU, job->data, BENCH_SIZE, BenchDone, NULL);
+  }
+}
+
+/**
+  * @brief  Scan benchmark completion: queue the next sweep.
+  */
+static void ScanBenchDone(I2C_JobTypeDef *job)
+{
+  if (bench_submitted < SCAN_SWEEPS)
+  {
+    bench_submitted++;
+    (void)I2C_Bus_SubmitScan(&i2c_bus1, (I2C_ScanTypeDef *)job);
+  }
+}
+
+/**
+  * @brief  Same reads as one job per entry: the last one queues the next
+  *         sweep.
+  */
+static void JobsBenchDone(I2C_JobTypeDef *job)
+{
+  uint32_t i;
+
+  if ((job == &scan_jobs[SCAN_ENTRIES - 1U]) && (bench_submitted < SCAN_SWEEPS))
+  {
+    bench_submitted++;
+    for (i = 0U; i < SCAN_ENTRIES; i++)
+    {
+      (void)I2C_Bus_Read(&i2c_bus1, &scan_jobs[i], scan_entries[i].address, scan_entries[i].reg,
+                         scan_entries[i].data, scan_entries[i].size, JobsBenchDone, NULL);
+    }
+  }
+}
+
+/**
+  * @brief  Segments of the log ending with a STOP.
+  */
+static uint32_t CountStops(void)
+{
+  uint32_t stops = 0U;
+  uint32_t i;
+
+  for (i = 0U; (i < mock_hal.i2c_count) && (i < MOCK_I2C_LOG_LEN); i++)
+  {
+    stops += ((mock_hal.i2c_log[i].option == I2C_LAST_FRAME) ||
+              (mock_hal.i2c_log[i].option == I2C_FIRST_AND_LAST_FRAME)) ? 1U : 0U;
+  }
+  return stops;
+}
+
+static void Setup(void)
+{
+  uint32_t i;
+
+  Mock_Reset();
+  memset(&hi2c, 0, sizeof(hi2c));
+  hi2c.Instance = I2C1;
+  mock_hal.i2c_device = Device;
+  device_reg = 0U;
+  device_nack_address = 0xFFU;
+  device_bus_hz = 0U;
+  for (i = 0U; i < 256U; i++)
+  {
+    device_regs[i] = (uint8_t)(i ^ 0xA5U);
+  }
+  memset(done_jobs, 0, sizeof(done_jobs));
+  done_count = 0U;
+  done_recovery = 0xFFU;
+  memset(&i2c_bus1, 0, sizeof(i2c_bus1));
+  I2C_Bus_Init(&i2c_bus1, &hi2c);
+}
+
+/* Tests ---------------------------------------------------------------------*/
+static void Test_ReadSegments(void)
+{
+  I2C_JobTypeDef job = {0};
+  uint8_t data[6] = {0};
+  const Mock_I2cSegmentTypeDef *segment;
+
+  Setup();
+  UNIT_CHECK(I2C_Bus_Read(&i2c_bus1, &job, 0x68U, 0x3BU, data, 6U, JobDone, &i2c_bus1) == HAL_OK);
+  UNIT_CHECK(job.state == I2C_JOB_ACTIVE);
+
+  /* Register address alone, no STOP */
+  segment = Mock_I2cPending(&hi2c);
+  UNIT_CHECK(segment != NULL);
+  UNIT_CHECK(segment->read == 0U);
+  UNIT_CHECK(segment->address == 0x68U);
+  UNIT_CHECK(segment->size == 1U);
+  UNIT_CHECK(segment->data[0] == 0x3BU);
+  UNIT_CHECK(segment->option == I2C_FIRST_FRAME);
+  UNIT_CHECK(Mock_I2cRun(&hi2c) == 1U);
+
+  /* Data read with a repeated start, last byte NACKed and STOP */
+  segment = Mock_I2cPending(&hi2c);
+  UNIT_CHECK(segment != NULL);
+  UNIT_CHECK(segment->read == 1U);
+  UNIT_CHECK(segment->data == data);
+  UNIT_CHECK(segment->size == 6U);
+  UNIT_CHECK(segment->option == I2C_LAST_FRAME);
+  UNIT_CHECK(job.state == I2C_JOB_ACTIVE);
+  UNIT_CHECK(Mock_I2cRun(&hi2c) == 1U);
+
+  UNIT_CHECK(job.state == I2C_JOB_DONE);
+  UNIT_CHECK(job.error == HAL_I2C_ERROR_NONE);
+  UNIT_CHECK(done_count == 1U);
+  UNIT_CHECK(data[0] == (0x3BU ^ 0xA5U));
+  UNIT_CHECK(data[5] == (0x40U ^ 0xA5U));
+  UNIT_CHECK(Mock_I2cPending(&hi2c) == NULL);
+  UNIT_CHECK(i2c_bus1.stats.completed == 1U);
+  UNIT_CHECK(I2C_Bus_Pending(&i2c_bus1) == 0U);
+
+  /* No HAL call with the queue lock held, and the lock released */
+  UNIT_CHECK(mock_hal.basepri_calls == 0U);
+  UNIT_CHECK(mock_basepri == 0U);
+}
+
+static void Test_WriteAndCommand(void)
+{
+  I2C_JobTypeDef write = {0};
+  I2C_JobTypeDef command = {0};
+  uint8_t data[2] = { 0x12U, 0x34U };
+  const Mock_I2cSegmentTypeDef *segment;
+
+  Setup();
+  UNIT_CHECK(I2C_Bus_Write16(&i2c_bus1, &write, 0x29U, 0x010FU, data, 2U, JobDone, &i2c_bus1) == HAL_OK);
+  UNIT_CHECK(I2C_Bus_Command(&i2c_bus1, &command, 0x77U, 0x48U, JobDone, &i2c_bus1) == HAL_OK);
+
+  /* 16-bit register MSB first, then the data in the same direction */
+  segment = Mock_I2cPending(&hi2c);
+  UNIT_CHECK(segment->size == 2U);
+  UNIT_CHECK((segment->data[0] == 0x01U) && (segment->data[1] == 0x0FU));
+  UNIT_CHECK(segment->option == I2C_FIRST_FRAME);
+  UNIT_CHECK(Mock_I2cRun(&hi2c) == 1U);
+  segment = Mock_I2cPending(&hi2c);
+  UNIT_CHECK(segment->read == 0U);
+  UNIT_CHECK(segment->data == data);
+  UNIT_CHECK(segment->size == 2U);
+  UNIT_CHECK(segment->option == I2C_LAST_FRAME);
+  UNIT_CHECK(Mock_I2cRun(&hi2c) == 1U);
+  UNIT_CHECK(write.state == I2C_JOB_DONE);
+
+  /* The command is a single frame with its STOP */
+  segment = Mock_I2cPending(&hi2c);
+  UNIT_CHECK(segment->address == 0x77U);
+  UNIT_CHECK(segment->size == 1U);
+  UNIT_CHECK(segment->data[0] == 0x48U);
+  UNIT_CHECK(segment->option == I2C_FIRST_AND_LAST_FRAME);
+  UNIT_CHECK(Mock_I2cRun(&hi2c) == 1U);
+  UNIT_CHECK(command.state == I2C_JOB_DONE);
+  UNIT_CHECK(Mock_I2cPending(&hi2c) == NULL);
+  UNIT_CHECK(mock_hal.i2c_count == 3U);
+  UNIT_CHECK(mock_hal.basepri_calls == 0U);
+}
+
+static void Test_QueueOrder(void)
+{
+  I2C_JobTypeDef jobs[I2C_BUS_QUEUE_LEN + 2U];
+  uint8_t data[I2C_BUS_QUEUE_LEN + 2U];
+  uint32_t i;
+
+  Setup();
+  memset(jobs, 0, sizeof(jobs));
+  for (i = 0U; i < 3U; i++)
+  {
+    UNIT_CHECK(I2C_Bus_Read(&i2c_bus1, &jobs[i], 0x68U, (uint8_t)i, &data[i], 1U, JobDone, &i2c_bus1) == HAL_OK);
+  }
+  UNIT_CHECK(I2C_Bus_Pending(&i2c_bus1) == 3U);
+  UNIT_CHECK(jobs[0].state == I2C_JOB_ACTIVE);
+  UNIT_CHECK(jobs[1].state == I2C_JOB_QUEUED);
+
+  /* A pending job is not accepted twice */
+  UNIT_CHECK(I2C_Bus_Submit(&i2c_bus1, &jobs[1]) == HAL_BUSY);
+
+  UNIT_CHECK(Mock_I2cRunAll(&hi2c) == 6U);
+  UNIT_CHECK(done_count == 3U);
+  UNIT_CHECK((done_jobs[0] == &jobs[0]) && (done_jobs[1] == &jobs[1]) && (done_jobs[2] == &jobs[2]));
+  UNIT_CHECK(data[2] == (2U ^ 0xA5U));
+  UNIT_CHECK(i2c_bus1.stats.queue_peak == 2U);
+
+  /* One active job plus a full queue, the next one is refused */
+  for (i = 0U; i < (I2C_BUS_QUEUE_LEN + 2U); i++)
+  {
+    jobs[i].state = I2C_JOB_IDLE;
+    (void)I2C_Bus_Read(&i2c_bus1, &jobs[i], 0x68U, 0U, &data[i], 1U, NULL, NULL);
+  }
+  UNIT_CHECK(I2C_Bus_Pending(&i2c_bus1) == (I2C_BUS_QUEUE_LEN + 1U));
+  UNIT_CHECK(jobs[I2C_BUS_QUEUE_LEN + 1U].state == I2C_JOB_IDLE);
+  UNIT_CHECK(i2c_bus1.stats.rejected == 1U);
+  UNIT_CHECK(Mock_I2cRunAll(&hi2c) == (2U * (I2C_BUS_QUEUE_LEN + 1U)));
+  UNIT_CHECK(i2c_bus1.stats.completed == (3U + I2C_BUS_QUEUE_LEN + 1U));
+}
+
+static void Test_NackGoesOn(void)
+{
+  I2C_JobTypeDef first = {0};
+  I2C_JobTypeDef second = {0};
+  uint8_t data[2];
+
+  Setup();
+  device_nack_address = 0x1EU;
+  (void)I2C_Bus_Read(&i2c_bus1, &first, 0x1EU, 0x00U, &data[0], 1U, JobDone, &i2c_bus1);
+  (void)I2C_Bus_Read(&i2c_bus1, &second, 0x68U, 0x00U, &data[1], 1U, JobDone, &i2c_bus1);
+
+  UNIT_CHECK(Mock_I2cRun(&hi2c) == 1U);
+  UNIT_CHECK(first.state == I2C_JOB_ERROR);
+  UNIT_CHECK(first.error == HAL_I2C_ERROR_AF);
+  UNIT_CHECK(i2c_bus1.errors.af == 1U);
+  UNIT_CHECK(i2c_bus1.recovery == I2C_RECOVERY_IDLE);
+
+  /* The next job is already on the bus */
+  UNIT_CHECK(second.state == I2C_JOB_ACTIVE);
+  UNIT_CHECK(Mock_I2cRunAll(&hi2c) == 2U);
+  UNIT_CHECK(second.state == I2C_JOB_DONE);
+  UNIT_CHECK(i2c_bus1.stats.failed == 1U);
+  UNIT_CHECK(i2c_bus1.stats.completed == 1U);
+}
+
+static void Test_FatalErrorRecovers(void)
+{
+  I2C_JobTypeDef first = {0};
+  I2C_JobTypeDef second = {0};
+  uint8_t data[2];
+  uint32_t polls;
+
+  Setup();
+  I2C_Bus_SetRecoveryPins(&i2c_bus1, GPIOB, GPIO_PIN_8, GPIOB, GPIO_PIN_9);
+  (void)I2C_Bus_Read(&i2c_bus1, &first, 0x68U, 0x00U, &data[0], 1U, JobDone, &i2c_bus1);
+  (void)I2C_Bus_Read(&i2c_bus1, &second, 0x68U, 0x00U, &data[1], 1U, JobDone, &i2c_bus1);
+
+  Mock_I2cFail(&hi2c, HAL_I2C_ERROR_BERR);
+  UNIT_CHECK(first.state == I2C_JOB_ERROR);
+  UNIT_CHECK(i2c_bus1.errors.berr == 1U);
+
+  /* The recovery is started before the owner hears of the failure */
+  UNIT_CHECK(done_recovery == I2C_RECOVERY_PENDING);
+  UNIT_CHECK(second.state == I2C_JOB_QUEUED);
+  UNIT_CHECK(Mock_I2cPending(&hi2c) == NULL);
+
+  /* The slave holds SDA low for three SCL pulses */
+  mock_gpiob.IDR = 0U;
+  I2C_Bus_Poll(&i2c_bus1);
+  UNIT_CHECK(i2c_bus1.recovery == I2C_RECOVERY_CLOCKING);
+  UNIT_CHECK(mock_hal.i2c_deinit == 1U);
+  UNIT_CHECK(i2c_bus1.errors.stuck_slaves == 1U);
+  for (polls = 0U; (polls < 100U) && (i2c_bus1.recovery != I2C_RECOVERY_IDLE); polls++)
+  {
+    if (i2c_bus1.recovery_edges >= 6U)
+    {
+      mock_gpiob.IDR = GPIO_PIN_9;
+    }
+    Mock_AdvanceUs(I2C_BUS_RECOVERY_HALF_PERIOD_US);
+    I2C_Bus_Poll(&i2c_bus1);
+  }
+  UNIT_CHECK(i2c_bus1.recovery == I2C_RECOVERY_IDLE);
+  UNIT_CHECK(i2c_bus1.errors.recoveries == 1U);
+  UNIT_CHECK(mock_hal.i2c_init == 1U);
+  UNIT_CHECK((mock_gpiob.ODR & (GPIO_PIN_8 | GPIO_PIN_9)) == (GPIO_PIN_8 | GPIO_PIN_9));
+
+  /* The queue restarts with the recovery */
+  UNIT_CHECK(second.state == I2C_JOB_ACTIVE);
+  UNIT_CHECK(Mock_I2cRunAll(&hi2c) == 2U);
+  UNIT_CHECK(second.state == I2C_JOB_DONE);
+  UNIT_CHECK(mock_hal.basepri_calls == 0U);
+}
+
+static void Test_StartRefused(void)
+{
+  I2C_JobTypeDef first = {0};
+  I2C_JobTypeDef second = {0};
+  uint8_t data[2];
+
+  Setup();
+  mock_hal.i2c_status = HAL_ERROR;
+  mock_hal.i2c_status_error = HAL_I2C_ERROR_AF;
+  (void)I2C_Bus_Read(&i2c_bus1, &first, 0x68U, 0x00U, &data[0], 1U, JobDone, &i2c_bus1);
+  UNIT_CHECK(first.state == I2C_JOB_ERROR);
+  UNIT_CHECK(first.error == HAL_I2C_ERROR_AF);
+
+  (void)I2C_Bus_Read(&i2c_bus1, &second, 0x68U, 0x00U, &data[1], 1U, JobDone, &i2c_bus1);
+  UNIT_CHECK(Mock_I2cRunAll(&hi2c) == 2U);
+  UNIT_CHECK(second.state == I2C_JOB_DONE);
+}
+
+static void Test_JobTimeout(void)
+{
+  I2C_JobTypeDef job = {0};
+  uint8_t data[4];
+
+  Setup();
+  (void)I2C_Bus_Read(&i2c_bus1, &job, 0x68U, 0x00U, data, 4U, JobDone, &i2c_bus1);
+
+  Mock_AdvanceUs(I2C_BUS_TIMEOUT_BASE_US);
+  I2C_Bus_Poll(&i2c_bus1);
+  UNIT_CHECK(job.state == I2C_JOB_ACTIVE);
+
+  Mock_AdvanceUs(4U * I2C_BUS_TIMEOUT_BYTE_US);
+  I2C_Bus_Poll(&i2c_bus1);
+  UNIT_CHECK(job.state == I2C_JOB_ERROR);
+  UNIT_CHECK(job.error == HAL_I2C_ERROR_TIMEOUT);
+  UNIT_CHECK(i2c_bus1.errors.timeout == 1U);
+  UNIT_CHECK(i2c_bus1.recovery == I2C_RECOVERY_PENDING);
+  UNIT_CHECK(done_count == 1U);
+
+  /* A completion interrupt arriving late finds no job */
+  HAL_I2C_MasterTxCpltCallback(&hi2c);
+  UNIT_CHECK(done_count == 1U);
+  UNIT_CHECK(i2c_bus1.stats.completed == 0U);
+  UNIT_CHECK(i2c_bus1.stats.failed == 1U);
+
+  /* No recovery pins: the peripheral is only re-initialized */
+  I2C_Bus_Poll(&i2c_bus1);
+  I2C_Bus_Poll(&i2c_bus1);
+  UNIT_CHECK(i2c_bus1.recovery == I2C_RECOVERY_IDLE);
+  UNIT_CHECK(mock_hal.i2c_deinit == 1U);
+  UNIT_CHECK(mock_hal.i2c_init == 1U);
+}
+
+static void Test_BusStuckBusy(void)
+{
+  I2C_JobTypeDef job = {0};
+  uint8_t data;
+
+  Setup();
+  mock_i2c1.SR2 = I2C_SR2_BUSY;
+  (void)I2C_Bus_Read(&i2c_bus1, &job, 0x68U, 0x00U, &data, 1U, JobDone, &i2c_bus1);
+
+  /* Bounded wait: the job stays queued and nothing is started */
+  UNIT_CHECK(job.state == I2C_JOB_QUEUED);
+  UNIT_CHECK(mock_hal.i2c_count == 0U);
+  UNIT_CHECK(i2c_bus1.stall_start != 0U);
+
+  I2C_Bus_Poll(&i2c_bus1);
+  UNIT_CHECK(i2c_bus1.recovery == I2C_RECOVERY_IDLE);
+  Mock_AdvanceUs(I2C_BUS_TIMEOUT_BASE_US + 1U);
+  I2C_Bus_Poll(&i2c_bus1);
+  UNIT_CHECK(i2c_bus1.recovery == I2C_RECOVERY_PENDING);
+  UNIT_CHECK(i2c_bus1.errors.timeout == 1U);
+
+  /* The re-initialization frees the bus and the job runs */
+  mock_i2c1.SR2 = 0U;
+  I2C_Bus_Poll(&i2c_bus1);
+  I2C_Bus_Poll(&i2c_bus1);
+  UNIT_CHECK(i2c_bus1.recovery == I2C_RECOVERY_IDLE);
+  UNIT_CHECK(job.state == I2C_JOB_ACTIVE);
+  UNIT_CHECK(Mock_I2cRunAll(&hi2c) == 2U);
+  UNIT_CHECK(job.state == I2C_JOB_DONE);
+
+  /* A pending STOP also holds the start back */
+  mock_i2c1.CR1 = I2C_CR1_STOP;
+  job.state = I2C_JOB_IDLE;
+  (void)I2C_Bus_Read(&i2c_bus1, &job, 0x68U, 0x00U, &data, 1U, NULL, NULL);
+  UNIT_CHECK(job.state == I2C_JOB_QUEUED);
+  mock_i2c1.CR1 = 0U;
+  I2C_Bus_Poll(&i2c_bus1);
+  UNIT_CHECK(job.state == I2C_JOB_ACTIVE);
+}
+
+static void Test_Statistics(void)
+{
+  I2C_JobTypeDef job = {0};
+  uint8_t data[2];
+
+  Setup();
+  mock_hal.cycle_step = 0U;
+  (void)I2C_Bus_Utilization(&i2c_bus1);
+  (void)I2C_Bus_Read(&i2c_bus1, &job, 0x68U, 0x00U, data, 2U, NULL, NULL);
+  Mock_AdvanceUs(100U);
+  UNIT_CHECK(Mock_I2cRunAll(&hi2c) == 2U);
+  Mock_AdvanceUs(300U);
+
+  UNIT_CHECK(job.cycles == (100U * 168U));
+  UNIT_CHECK(i2c_bus1.stats.job_cycles.count == 1U);
+  UNIT_CHECK(i2c_bus1.stats.busy_cycles == (100U * 168U));
+  UNIT_CHECK(I2C_Bus_Utilization(&i2c_bus1) == 250U);
+  UNIT_CHECK(i2c_bus1.stats.submitted == 1U);
+  UNIT_CHECK(I2C_Bus_FromHandle(&hi2c) == &i2c_bus1);
+}
+
+static void Test_ScanSegments(void)
+{
+  static const uint32_t options[2U * SCAN_ENTRIES] = {
+    I2C_FIRST_FRAME, I2C_LAST_FRAME_NO_STOP,
+    I2C_OTHER_FRAME, I2C_LAST_FRAME_NO_STOP,
+    I2C_OTHER_FRAME, I2C_LAST_FRAME,
+  };
+  I2C_JobTypeDef next = {0};
+  uint8_t byte;
+  uint32_t i;
+
+  Setup();
+  memset(scan_data, 0, sizeof(scan_data));
+  I2C_Scan_Init(&scan, scan_entries, 0U, JobDone, &i2c_bus1);
+  UNIT_CHECK(I2C_Bus_SubmitScan(&i2c_bus1, &scan) == HAL_ERROR);
+  I2C_Scan_Init(&scan, scan_entries, SCAN_ENTRIES, JobDone, &i2c_bus1);
+  UNIT_CHECK(I2C_Bus_SubmitScan(&i2c_bus1, &scan) == HAL_OK);
+  UNIT_CHECK(I2C_Bus_SubmitScan(&i2c_bus1, &scan) == HAL_BUSY);
+  UNIT_CHECK(scan.job.size == (3U + 6U + 6U + SCAN_ENTRIES));
+
+  /* Register then data of each entry, one STOP after the last read; every
+   * read NACKs its last byte */
+  for (i = 0U; i < (2U * SCAN_ENTRIES); i++)
+  {
+    const Mock_I2cSegmentTypeDef *segment = Mock_I2cPending(&hi2c);
+    const I2C_ScanEntryTypeDef *entry = &scan_entries[i / 2U];
+
+    UNIT_CHECK(segment != NULL);
+    UNIT_CHECK(segment->address == entry->address);
+    UNIT_CHECK(segment->read == (i & 1U));
+    UNIT_CHECK(segment->option == options[i]);
+    UNIT_CHECK(segment->size == (((i & 1U) != 0U) ? entry->size : 1U));
+    UNIT_CHECK(((i & 1U) != 0U) ? (segment->data == entry->data) : (segment->data[0] == entry->reg));
+    UNIT_CHECK(done_count == 0U);
+    UNIT_CHECK(Mock_I2cRun(&hi2c) == 1U);
+  }
+  UNIT_CHECK(done_count == 1U);
+  UNIT_CHECK(done_jobs[0] == &scan.job);
+  UNIT_CHECK(scan.job.state == I2C_JOB_DONE);
+  UNIT_CHECK(scan.stats.sweeps == 1U);
+  UNIT_CHECK(i2c_bus1.stats.completed == 1U);
+  for (i = 0U; i < SCAN_ENTRIES; i++)
+  {
+    UNIT_CHECK(scan_data[i][0] == (scan_entries[i].reg ^ 0xA5U));
+    UNIT_CHECK(scan_data[i][scan_entries[i].size - 1U] ==
+               ((scan_entries[i].reg + scan_entries[i].size - 1U) ^ 0xA5U));
+  }
+
+  /* A NACK anywhere fails the whole sweep once, the queue goes on */
+  device_nack_address = scan_entries[1].address;
+  UNIT_CHECK(I2C_Bus_SubmitScan(&i2c_bus1, &scan) == HAL_OK);
+  (void)I2C_Bus_Read(&i2c_bus1, &next, 0x68U, 0x10U, &byte, 1U, JobDone, &i2c_bus1);
+  UNIT_CHECK(Mock_I2cRunAll(&hi2c) == 5U);
+  UNIT_CHECK(scan.job.state == I2C_JOB_ERROR);
+  UNIT_CHECK(scan.job.error == HAL_I2C_ERROR_AF);
+  UNIT_CHECK(scan.stats.failed == 1U);
+  UNIT_CHECK(next.state == I2C_JOB_DONE);
+  UNIT_CHECK(done_count == 3U);
+  UNIT_CHECK(i2c_bus1.recovery == I2C_RECOVERY_IDLE);
+}
+
+static void Test_ScanAgainstJobs(void)
+{
+  double start;
+  double scan_ns;
+  double jobs_ns;
+  uint64_t scan_cycles;
+  uint64_t jobs_cycles;
+  uint32_t segments;
+  uint32_t stops;
+  uint32_t i;
+
+  /* One sweep: interrupts, STOPs, queue round trips, callbacks and bus
+   * cycles measured by the engine, the DWT frozen between segments */
+  Setup();
+  mock_hal.cycle_step = 0U;
+  device_bus_hz = BENCH_BUS_HZ;
+  I2C_Scan_Init(&scan, scan_entries, SCAN_ENTRIES, JobDone, &i2c_bus1);
+  (void)I2C_Bus_SubmitScan(&i2c_bus1, &scan);
+  segments = Mock_I2cRunAll(&hi2c);
+  stops = CountStops();
+  scan_cycles = i2c_bus1.stats.busy_cycles;
+  UNIT_CHECK(segments == (2U * SCAN_ENTRIES));
+  UNIT_CHECK(stops == 1U);
+  UNIT_CHECK(i2c_bus1.stats.submitted == 1U);
+  UNIT_CHECK(done_count == 1U);
+  UNIT_CHECK(scan.stats.sweep_cycles.count == 1U);
+  UNIT_CHECK(scan.stats.sweep_cycles.max == scan_cycles);
+
+  Setup();
+  mock_hal.cycle_step = 0U;
+  device_bus_hz = BENCH_BUS_HZ;
+  memset(scan_jobs, 0, sizeof(scan_jobs));
+  for (i = 0U; i < SCAN_ENTRIES; i++)
+  {
+    (void)I2C_Bus_Read(&i2c_bus1, &scan_jobs[i], scan_entries[i].address, scan_entries[i].reg,
+                       scan_entries[i].data, scan_entries[i].size, JobDone, &i2c_bus1);
+  }
+  UNIT_CHECK(Mock_I2cRunAll(&hi2c) == segments);
+  UNIT_CHECK(CountStops() == SCAN_ENTRIES);
+  UNIT_CHECK(i2c_bus1.stats.submitted == SCAN_ENTRIES);
+  UNIT_CHECK(done_count == SCAN_ENTRIES);
+  jobs_cycles = i2c_bus1.stats.busy_cycles;
+
+  /* Same bits on the wire, one STOP and bus free time per extra job */
+  UNIT_CHECK((jobs_cycles - scan_cycles) == ((SCAN_ENTRIES - 1U) * ((SCAN_STOP_NS * 168U) / 1000U)));
+
+  /* Host CPU time of a sweep through both paths, mock HAL included: printed
+   * only, the mock costs as much as the engine */
+  Setup();
+  I2C_Scan_Init(&scan, scan_entries, SCAN_ENTRIES, ScanBenchDone, NULL);
+  bench_submitted = 1U;
+  start = Unit_Nanoseconds();
+  (void)I2C_Bus_SubmitScan(&i2c_bus1, &scan);
+  UNIT_CHECK(Mock_I2cRunAll(&hi2c) == (2U * SCAN_ENTRIES * SCAN_SWEEPS));
+  scan_ns = (Unit_Nanoseconds() - start) / SCAN_SWEEPS;
+  UNIT_CHECK(scan.stats.sweeps == SCAN_SWEEPS);
+
+  Setup();
+  memset(scan_jobs, 0, sizeof(scan_jobs));
+  bench_submitted = 1U;
+  start = Unit_Nanoseconds();
+  for (i = 0U; i < SCAN_ENTRIES; i++)
+  {
+    (void)I2C_Bus_Read(&i2c_bus1, &scan_jobs[i], scan_entries[i].address, scan_entries[i].reg,
+                       scan_entries[i].data, scan_entries[i].size, JobsBenchDone, NULL);
+  }
+  UNIT_CHECK(Mock_I2cRunAll(&hi2c) == (2U * SCAN_ENTRIES * SCAN_SWEEPS));
+  jobs_ns = (Unit_Nanoseconds() - start) / SCAN_SWEEPS;
+  UNIT_CHECK(i2c_bus1.stats.completed == (SCAN_ENTRIES * SCAN_SWEEPS));
+
+  printf("  %u reads: sweep %u interrupts, %u STOP, 1 callback, %.1f us of bus, %.0f ns of host CPU\n"
+         "           jobs  %u interrupts, %u STOP, %u callbacks, %.1f us of bus, %.0f ns of host CPU\n",
+         SCAN_ENTRIES, (unsigned)segments, (unsigned)stops, scan_cycles / 168.0, scan_ns,
+         (unsigned)segments, SCAN_ENTRIES, SCAN_ENTRIES, jobs_cycles / 168.0, jobs_ns);
+}
+
+static void Test_Bench(void)
+{
+  static uint8_t data[BENCH_IN_FLIGHT][BENCH_SIZE];
+  I2C_JobTypeDef jobs[BENCH_IN_FLIGHT];
+  double start;
+  double raw_ns;
+  double engine_ns;
+  double blocking_us;
+  uint32_t segments;
+  uint32_t i;
+
+  /* The same segments straight on the mock HAL, for a handle the engine does
+   * not manage: the cost of the mock itself */
+  Setup();
+  hi2c_raw.Instance = I2C2;
+  start = Unit_Nanoseconds();
+  for (i = 0U; i < BENCH_JOBS; i++)
+  {
+    uint8_t reg = 0x3BU;
+
+    (void)HAL_I2C_Master_Seq_Transmit_DMA(&hi2c_raw, 0x68U << 1, &reg, 1U, I2C_FIRST_FRAME);
+    (void)Mock_I2cRun(&hi2c_raw);
+    (void)HAL_I2C_Master_Seq_Receive_DMA(&hi2c_raw, 0x68U << 1, data[0], BENCH_SIZE, I2C_LAST_FRAME);
+    (void)Mock_I2cRun(&hi2c_raw);
+  }
+  raw_ns = (Unit_Nanoseconds() - start) / BENCH_JOBS;
+
+  /* Submit, completion interrupts and start of the next job by the engine */
+  Setup();
+  memset(jobs, 0, sizeof(jobs));
+  bench_submitted = BENCH_IN_FLIGHT;
+  start = Unit_Nanoseconds();
+  for (i = 0U; i < BENCH_IN_FLIGHT; i++)
+  {
+    (void)I2C_Bus_Read(&i2c_bus1, &jobs[i], 0x68U, 0x3BU, data[i], BENCH_SIZE, BenchDone, NULL);
+  }
+  segments = Mock_I2cRunAll(&hi2c);
+  engine_ns = ((Unit_Nanoseconds() - start) / BENCH_JOBS) - raw_ns;
+
+  UNIT_CHECK(segments == (2U * BENCH_JOBS));
+  UNIT_CHECK(i2c_bus1.stats.completed == BENCH_JOBS);
+  UNIT_CHECK(i2c_bus1.stats.queue_peak == BENCH_IN_FLIGHT);
+  UNIT_CHECK(data[BENCH_IN_FLIGHT - 1U][5] == (0x40U ^ 0xA5U));
+  UNIT_CHECK(mock_hal.basepri_calls == 0U);
+
+  /* Blocking read: START, address, register, repeated START, address, data
+   * and STOP, 9 clocks a byte, all of it with the CPU waiting */
+  blocking_us = (((3U + BENCH_SIZE) * 9U) + 3U) * 1e6 / BENCH_BUS_HZ;
+  UNIT_CHECK((engine_ns / 1000.0) < blocking_us);
+  printf("  %u byte read: engine %.0f ns of host CPU a job, mock HAL %.0f ns left out, 2 interrupts\n"
+         "  blocking HAL_I2C_Mem_Read() holds the CPU %.1f us at %u kHz (%.0f cycles at 168 MHz)\n",
+         BENCH_SIZE, engine_ns, raw_ns, blocking_us, BENCH_BUS_HZ / 1000U, blocking_us * 168.0);
+}
+
+int main(void)
+{
+  UNIT_RUN(Test_ReadSegments);
+  UNIT_RUN(Test_WriteAndCommand);
+  UNIT_RUN(Test_QueueOrder);
+  UNIT_RUN(Test_NackGoesOn);
+  UNIT_RUN(Test_FatalErrorRecovers);
+  UNIT_RUN(Test_StartRefused);
+  UNIT_RUN(Test_JobTimeout);
+  UNIT_RUN(Test_BusStuckBusy);
+  UNIT_RUN(Test_Statistics);
+  UNIT_RUN(Test_ScanSegments);
+  UNIT_RUN(Test_ScanAgainstJobs);
+  UNIT_RUN(Test_Bench);
+  return Unit_Result();
+}
@@ -0,0 +1,243 @@
+/**
+  ******************************************************************************
+  * @file    test_mag_cal.c
+  * @brief   Host tests of the online magnetometer calibration: a field of
+  *          known strength is turned in every direction, distorted by a
+  *          known hard-iron offset and soft-iron matrix, given noise and
+  *          quantized to HMC5883L counts, then streamed one sample at a time
+  *          through MagCal_Push() and MagCal_Poll(). The published offset
+  *          and correction must match the distortion, and every fitter step
+  *          must fit in the MagCal_Poll() budget.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "mag_cal.h"
+#include "mag.h"
+#include "mock_hal.h"
+#include "unit.h"
+
+/* Private define ------------------------------------------------------------*/
+#define FIELD_GAUSS       0.5       /*!< Earth field strength                */
+#define NOISE_GAUSS       0.002     /*!< Sensor noise, per axis              */
+#define SAMPLES           (60U * MAG_RATE_HZ)
+#define STEPS             (MAG_CAL_STEP_EIGEN + 1U)
+
+/* Private types -------------------------------------------------------------*/
+/**
+  * @brief  Host time of the fitter steps, one step per MagCal_Poll() call.
+  */
+typedef struct
+{
+  double best_ns;                /*!< Fastest run, the undisturbed cost */
+  double total_ns;
+  uint32_t count;
+} StepTimeTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t random_state = 2463534242U;
+
+/** Distortion applied to the true field: m = S h + b */
+static const double hard_iron[3] = { 0.12, -0.25, 0.08 };
+static const double soft_iron[3][3] = {
+  { 1.10, 0.06, -0.04 },
+  { 0.06, 0.92, 0.05 },
+  { -0.04, 0.05, 1.02 },
+};
+
+static StepTimeTypeDef step_time[STEPS];
+
+/* Private functions ---------------------------------------------------------*/
+static double Uniform(void)
+{
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return (random_state + 1.0) / 4294967297.0;
+}
+
+static double Gauss(void)
+{
+  double u = Uniform();
+  double v = Uniform();
+
+  return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+/**
+  * @brief  Distorted field in sensor counts for a random direction.
+  */
+static void Sample(int16_t field[3])
+{
+  double h[3];
+  double norm;
+  uint32_t i;
+
+  do
+  {
+    h[0] = Gauss();
+    h[1] = Gauss();
+    h[2] = Gauss();
+    norm = sqrt((h[0] * h[0]) + (h[1] * h[1]) + (h[2] * h[2]));
+  } while (norm < 1e-6);
+
+  for (i = 0U; i < 3U; i++)
+  {
+    double m = (soft_iron[i][0] * h[0]) + (soft_iron[i][1] * h[1]) + (soft_iron[i][2] * h[2]);
+
+    m = (FIELD_GAUSS * m / norm) + hard_iron[i] + (NOISE_GAUSS * Gauss());
+    field[i] = (int16_t)lround(m / MAG_HMC5883L_GAUSS_PER_LSB);
+  }
+}
+
+/**
+  * @brief  Expected correction: for a symmetric S the fit gives
+  *         W = cbrt(det S) inv(S), which keeps the mean field strength.
+  * @retval Expected field strength after the correction
+  */
+static double Expected(double w[3][3])
+{
+  const double (*s)[3] = soft_iron;
+  double inv[3][3];
+  double det;
+  double scale;
+  uint32_t i;
+  uint32_t j;
+
+  inv[0][0] = (s[1][1] * s[2][2]) - (s[1][2] * s[2][1]);
+  inv[0][1] = (s[0][2] * s[2][1]) - (s[0][1] * s[2][2]);
+  inv[0][2] = (s[0][1] * s[1][2]) - (s[0][2] * s[1][1]);
+  inv[1][0] = (s[1][2] * s[2][0]) - (s[1][0] * s[2][2]);
+  inv[1][1] = (s[0][0] * s[2][2]) - (s[0][2] * s[2][0]);
+  inv[1][2] = (s[0][2] * s[1][0]) - (s[0][0] * s[1][2]);
+  inv[2][0] = (s[1][0] * s[2][1]) - (s[1][1] * s[2][0]);
+  inv[2][1] = (s[0][1] * s[2][0]) - (s[0][0] * s[2][1]);
+  inv[2][2] = (s[0][0] * s[1][1]) - (s[0][1] * s[1][0]);
+  det = (s[0][0] * inv[0][0]) + (s[0][1] * inv[1][0]) + (s[0][2] * inv[2][0]);
+  scale = cbrt(det) / det;
+
+  for (i = 0U; i < 3U; i++)
+  {
+    for (j = 0U; j < 3U; j++)
+    {
+      w[i][j] = scale * inv[i][j];
+    }
+  }
+  return FIELD_GAUSS * cbrt(det);
+}
+
+/**
+  * @brief  Run the fitter one step per MagCal_Poll() call until the queue is
+  *         empty and no fit is in progress, timing each step. The mock DWT
+  *         advances on every read, so a budget of one cycle ends each call
+  *         after its first step.
+  * @retval Largest number of samples folded by one call
+  */
+static uint32_t Drain(MagCal_HandleTypeDef *cal)
+{
+  uint32_t most = 0U;
+
+  while ((cal->head != cal->tail) || (cal->step != MAG_CAL_STEP_ACCUMULATE))
+  {
+    uint8_t step = cal->step;
+    uint32_t tail = cal->tail;
+    double start = Unit_Nanoseconds();
+    double ns;
+
+    MagCal_Poll(cal, 1U);
+    ns = Unit_Nanoseconds() - start;
+
+    if ((step_time[step].count == 0U) || (ns < step_time[step].best_ns))
+    {
+      step_time[step].best_ns = ns;
+    }
+    step_time[step].total_ns += ns;
+    step_time[step].count++;
+    most = ((cal->tail - tail) > most) ? (cal->tail - tail) : most;
+  }
+  return most;
+}
+
+/* Tests ---------------------------------------------------------------------*/
+static void Test_Fit(void)
+{
+  static MagCal_HandleTypeDef cal;
+  double w[3][3];
+  double radius;
+  float out[3];
+  int16_t field[3];
+  double worst = 0.0;
+  uint32_t most = 0U;
+  uint32_t n;
+  uint32_t i;
+  uint32_t j;
+
+  Mock_Reset();
+  MagCal_Init(&cal, MAG_HMC5883L_GAUSS_PER_LSB);
+  for (n = 0U; n < SAMPLES; n++)
+  {
+    uint32_t folded;
+
+    Sample(field);
+    MagCal_Push(&cal, field);
+    folded = Drain(&cal);
+    most = (folded > most) ? folded : most;
+  }
+
+  UNIT_CHECK(cal.valid != 0U);
+  UNIT_CHECK(cal.stats.samples == SAMPLES);
+  UNIT_CHECK(cal.stats.dropped == 0U);
+  UNIT_CHECK(cal.stats.fits > 0U);
+  UNIT_CHECK(cal.stats.rejected == 0U);
+  UNIT_CHECK(cal.stats.rms < 0.01f);
+  UNIT_CHECK(most == 1U);
+
+  radius = Expected(w);
+  UNIT_NEAR(cal.radius, radius, 0.002);
+  for (i = 0U; i < 3U; i++)
+  {
+    UNIT_NEAR(cal.offset[i], hard_iron[i], 0.002);
+    for (j = 0U; j < 3U; j++)
+    {
+      UNIT_NEAR(cal.soft[i][j], w[i][j], 0.01);
+    }
+  }
+
+  /* The corrected field is back on a sphere */
+  for (n = 0U; n < 1000U; n++)
+  {
+    double norm;
+
+    Sample(field);
+    MagCal_Apply(&cal, field, out);
+    norm = sqrt((out[0] * out[0]) + (out[1] * out[1]) + (out[2] * out[2]));
+    worst = fmax(worst, fabs(norm - radius));
+  }
+  UNIT_CHECK(worst < 0.015);
+  printf("  fit: %lu fits, rms %.4f, radius %.4f G, sphere error %.1f mG worst\n",
+         (unsigned long)cal.stats.fits, cal.stats.rms, cal.radius, worst * 1000.0);
+}
+
+static void Test_StepCost(void)
+{
+  static const char *const names[STEPS] = { "accumulate", "recenter", "factor", "solve", "eigen" };
+  uint32_t i;
+
+  /* Every step must fit in one MagCal_Poll() budget. The host is several
+   * times faster than the F405: this is a loose bound, the target figure is
+   * in MagCal_StatsTypeDef::poll_cycles */
+  for (i = 0U; i < STEPS; i++)
+  {
+    UNIT_CHECK(step_time[i].count > 0U);
+    UNIT_CHECK(step_time[i].best_ns < (MAG_CAL_BUDGET_US * 1000.0));
+    printf("  %-10s %6lu runs, %7.1f ns best, %7.1f ns mean\n", names[i], (unsigned long)step_time[i].count,
+           step_time[i].best_ns, step_time[i].total_ns / step_time[i].count);
+  }
+  UNIT_CHECK(step_time[MAG_CAL_STEP_ACCUMULATE].count >= SAMPLES);
+}
+
+int main(void)
+{
+  UNIT_RUN(Test_Fit);
+  UNIT_RUN(Test_StepCost);
+  return Unit_Result();
+}
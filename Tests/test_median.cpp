@@ -0,0 +1,254 @@
+/**
+  ******************************************************************************
+  * @file    test_median.cpp
+  * @brief   Host tests of the streaming median window and the Hampel filter
+  *          against a full sort of the window on every sample, and of the
+  *          outlier rejection of the altitude sensors built on them.
+  *          outlier.cpp is built here with OUTLIER_BENCH.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "median.hpp"
+#include "outlier.h"
+#include "mock_hal.h"
+#include "unit.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t random_state = 123456789U;
+
+/* Private functions ---------------------------------------------------------*/
+static uint32_t Random(void)
+{
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state;
+}
+
+/**
+  * @brief  Median and MAD of the last samples by sorting copies.
+  */
+template <typename T>
+static void Reference(const std::vector<T> &window, T *median, T *mad)
+{
+  std::vector<T> sorted(window);
+
+  std::sort(sorted.begin(), sorted.end());
+  *median = sorted[sorted.size() / 2U];
+  for (T &v : sorted)
+  {
+    v = (v > *median) ? (v - *median) : (*median - v);
+  }
+  std::sort(sorted.begin(), sorted.end());
+  *mad = sorted[sorted.size() / 2U];
+}
+
+/**
+  * @brief  Compare a window with the sort on random samples of a range,
+  *         small ranges for many equal samples.
+  * @retval Mismatches
+  */
+template <typename T, uint32_t N>
+static uint32_t CheckWindow(uint32_t range, T offset)
+{
+  MedianWindow<T, N> window;
+  std::vector<T> history;
+  uint32_t mismatches = 0U;
+
+  window.Reset();
+  for (uint32_t n = 0U; n < 50000U; n++)
+  {
+    T x = (T)(offset + (T)(Random() % (range + 1U)));
+    T median;
+    T mad;
+
+    window.Push(x);
+    history.push_back(x);
+    if (history.size() > N)
+    {
+      history.erase(history.begin());
+    }
+    Reference(history, &median, &mad);
+    mismatches += (window.Median() != median) ? 1U : 0U;
+    if (window.Full())
+    {
+      mismatches += (window.Mad() != mad) ? 1U : 0U;
+    }
+    else
+    {
+      mismatches += (history.size() == N) ? 1U : 0U;
+    }
+  }
+  return mismatches;
+}
+
+/**
+  * @brief  Hampel decision by sorting, see HampelFilter::Apply().
+  */
+template <typename T>
+static bool ReferenceHampel(std::vector<T> &window, uint32_t length, float threshold, float min_sigma, T &x)
+{
+  T median;
+  T mad;
+  float sigma;
+
+  window.push_back(x);
+  if (window.size() > length)
+  {
+    window.erase(window.begin());
+  }
+  if (window.size() < length)
+  {
+    return false;
+  }
+  Reference(window, &median, &mad);
+  sigma = 1.4826f * (float)mad;
+  sigma = (sigma > min_sigma) ? sigma : min_sigma;
+  if (fabsf((float)x - (float)median) <= (threshold * sigma))
+  {
+    return false;
+  }
+  x = median;
+  return true;
+}
+
+/* Tests ---------------------------------------------------------------------*/
+static void Test_Window(void)
+{
+  UNIT_CHECK((CheckWindow<int32_t, 3>(5U, -2)) == 0U);
+  UNIT_CHECK((CheckWindow<int32_t, 9>(20U, 101300)) == 0U);
+  UNIT_CHECK((CheckWindow<int32_t, 9>(0x7FFFFFFFU, -0x3FFFFFFF)) == 0U);
+  UNIT_CHECK((CheckWindow<uint16_t, 7>(3U, 0U)) == 0U);
+  UNIT_CHECK((CheckWindow<uint16_t, 15>(60000U, 0U)) == 0U);
+  UNIT_CHECK((CheckWindow<float, 9>(1000U, -500.0f)) == 0U);
+  UNIT_CHECK((CheckWindow<int32_t, 31>(1U, 0)) == 0U);
+}
+
+static void Test_HampelAgainstSort(void)
+{
+  HampelFilter<int32_t, 9> filter(3.0f, 2.0f);
+  std::vector<int32_t> window;
+  uint32_t mismatches = 0U;
+  uint32_t replaced = 0U;
+
+  for (uint32_t n = 0U; n < 100000U; n++)
+  {
+    int32_t x = 101325 + (int32_t)(Random() % 5U) - 2;
+    int32_t y;
+    bool a;
+    bool b;
+
+    if ((Random() % 16U) == 0U)
+    {
+      x += (int32_t)(Random() % 512U) - 256;
+    }
+    y = x;
+    a = filter.Apply(x);
+    b = ReferenceHampel(window, 9U, 3.0f, 2.0f, y);
+    mismatches += ((a != b) || (x != y)) ? 1U : 0U;
+    replaced += a ? 1U : 0U;
+  }
+  UNIT_CHECK(mismatches == 0U);
+  UNIT_CHECK(replaced > 1000U);
+}
+
+static void Test_HampelBehaviour(void)
+{
+  HampelFilter<int32_t, 9> filter(3.0f, 2.0f);
+  int32_t x;
+  uint32_t n;
+
+  /* Nothing is replaced before the window is full */
+  for (n = 0U; n < 8U; n++)
+  {
+    x = (n == 4U) ? 5000 : 1000;
+    UNIT_CHECK(!filter.Apply(x));
+  }
+
+  /* A burst of N / 2 spikes is removed */
+  for (n = 0U; n < 20U; n++)
+  {
+    x = 1000 + (int32_t)(n & 1U);
+    (void)filter.Apply(x);
+  }
+  for (n = 0U; n < 4U; n++)
+  {
+    x = 1500;
+    UNIT_CHECK(filter.Apply(x));
+    UNIT_CHECK((x == 1000) || (x == 1001));
+  }
+
+  /* A step passes once it holds the majority of the window */
+  for (n = 0U; n < 20U; n++)
+  {
+    x = 1000;
+    (void)filter.Apply(x);
+  }
+  for (n = 0U; n < 9U; n++)
+  {
+    x = 1200;
+    (void)filter.Apply(x);
+    UNIT_CHECK(x == ((n < 4U) ? 1000 : 1200));
+  }
+
+  /* The deviation floor keeps a quantization step through a flat window */
+  for (n = 0U; n < 20U; n++)
+  {
+    x = 1000;
+    (void)filter.Apply(x);
+  }
+  x = 1006;
+  UNIT_CHECK(!filter.Apply(x) && (x == 1006));
+  x = 1007;
+  UNIT_CHECK(filter.Apply(x) && (x == 1000));
+}
+
+static void Test_Streams(void)
+{
+  MS5611_SampleTypeDef baro = {};
+  VL53L1X_SampleTypeDef range = {};
+  uint32_t n;
+
+  Mock_Reset();
+  Outlier_Reset();
+  for (n = 0U; n < 40U; n++)
+  {
+    baro.pressure = (n == 30U) ? 101000 : 101325;
+    UNIT_CHECK(Outlier_Baro(&baro) == ((n == 30U) ? 1U : 0U));
+    UNIT_CHECK(baro.pressure == 101325);
+  }
+
+  /* Invalid ranges pass unchanged and stay out of the window */
+  for (n = 0U; n < 40U; n++)
+  {
+    range.valid = ((n % 5U) != 4U) ? 1U : 0U;
+    range.range_mm = (range.valid != 0U) ? ((n == 31U) ? 8000U : 1200U) : 0U;
+    UNIT_CHECK(Outlier_Range(&range) == ((n == 31U) ? 1U : 0U));
+    UNIT_CHECK(range.range_mm == ((range.valid != 0U) ? 1200U : 0U));
+  }
+  UNIT_CHECK(Outlier_Stats()->baro.samples == 40U);
+  UNIT_CHECK(Outlier_Stats()->baro.outliers == 1U);
+  UNIT_CHECK(Outlier_Stats()->range.samples == 32U);
+  UNIT_CHECK(Outlier_Stats()->range.outliers == 1U);
+}
+
+static void Test_Bench(void)
+{
+  Outlier_BenchTypeDef result = {};
+
+  Outlier_Bench(&result);
+  UNIT_CHECK(result.mismatches == 0U);
+}
+
+int main(void)
+{
+  UNIT_RUN(Test_Window);
+  UNIT_RUN(Test_HampelAgainstSort);
+  UNIT_RUN(Test_HampelBehaviour);
+  UNIT_RUN(Test_Streams);
+  UNIT_RUN(Test_Bench);
+  return Unit_Result();
+}
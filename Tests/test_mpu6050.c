@@ -0,0 +1,361 @@
+/**
+  ******************************************************************************
+  * @file    test_mpu6050.c
+  * @brief   Host tests of the MPU-6050 FIFO driver against a simulated
+  *          device: bring-up, steady drains, a partial FIFO, a backlog split
+  *          over several bursts, a misaligned count and an overflowed FIFO.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "mpu6050.h"
+#include "sample_ring.h"
+#include "mock_hal.h"
+#include "unit.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define PERIOD_US             (1000000U / MPU6050_ODR_HZ)
+
+/* Private types -------------------------------------------------------------*/
+/**
+  * @brief  Simulated device: register file and FIFO.
+  */
+typedef struct
+{
+  uint8_t regs[256];
+  uint8_t reg;                           /*!< Register pointer           */
+  uint8_t fifo[MPU6050_FIFO_SIZE];
+  uint32_t fifo_head;                    /*!< Bytes written              */
+  uint32_t fifo_tail;                    /*!< Bytes read                 */
+  uint32_t written;                      /*!< Samples generated          */
+  uint32_t resets;                       /*!< FIFO_RST writes            */
+} DeviceTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static I2C_HandleTypeDef hi2c;
+static DeviceTypeDef device;
+static uint64_t edge_stamps[4096];
+
+/* Private functions ---------------------------------------------------------*/
+static int16_t SampleAccel(uint32_t n, uint32_t axis)
+{
+  return (int16_t)((n * 7U) + axis);
+}
+
+static int16_t SampleGyro(uint32_t n, uint32_t axis)
+{
+  return (int16_t)(-(int32_t)(n * 7U) - (int32_t)axis - 1000);
+}
+
+static uint32_t FifoCount(void)
+{
+  return device.fifo_head - device.fifo_tail;
+}
+
+static void FifoByte(uint8_t value)
+{
+  if (FifoCount() < MPU6050_FIFO_SIZE)
+  {
+    device.fifo[device.fifo_head % MPU6050_FIFO_SIZE] = value;
+    device.fifo_head++;
+  }
+}
+
+static uint32_t Device(const Mock_I2cSegmentTypeDef *segment)
+{
+  uint32_t i;
+
+  if (segment->address != MPU6050_ADDRESS)
+  {
+    return HAL_I2C_ERROR_AF;
+  }
+  if ((segment->read == 0U) && (segment->option == I2C_FIRST_FRAME))
+  {
+    device.reg = segment->data[0];
+    return HAL_I2C_ERROR_NONE;
+  }
+  for (i = 0U; i < segment->size; i++)
+  {
+    if (segment->read == 0U)
+    {
+      device.regs[device.reg] = segment->data[i];
+      if ((device.reg == MPU6050_REG_USER_CTRL) && ((segment->data[i] & 0x04U) != 0U))
+      {
+        device.fifo_tail = device.fifo_head;
+        device.resets++;
+      }
+      device.reg++;
+    }
+    else if (device.reg == MPU6050_REG_FIFO_R_W)
+    {
+      /* FIFO reads do not move the register pointer */
+      segment->data[i] = (FifoCount() > 0U) ? device.fifo[device.fifo_tail++ % MPU6050_FIFO_SIZE] : 0xFFU;
+    }
+    else if (device.reg == MPU6050_REG_FIFO_COUNTH)
+    {
+      segment->data[i] = (uint8_t)(FifoCount() >> 8);
+      device.reg++;
+    }
+    else if (device.reg == (MPU6050_REG_FIFO_COUNTH + 1U))
+    {
+      segment->data[i] = (uint8_t)FifoCount();
+      device.reg++;
+    }
+    else
+    {
+      segment->data[i] = device.regs[device.reg++];
+    }
+  }
+  return HAL_I2C_ERROR_NONE;
+}
+
+/**
+  * @brief  One sample period: the device writes a sample into its FIFO and
+  *         pulses INT, the EXTI latches the edge.
+  */
+static void DeviceSample(uint8_t pin)
+{
+  uint32_t n = device.written;
+  uint32_t i;
+
+  Mock_AdvanceUs(PERIOD_US);
+  for (i = 0U; i < 3U; i++)
+  {
+    FifoByte((uint8_t)((uint16_t)SampleAccel(n, i) >> 8));
+    FifoByte((uint8_t)SampleAccel(n, i));
+  }
+  for (i = 0U; i < 3U; i++)
+  {
+    FifoByte((uint8_t)((uint16_t)SampleGyro(n, i) >> 8));
+    FifoByte((uint8_t)SampleGyro(n, i));
+  }
+  edge_stamps[n] = Timing_Cycles64();
+  if (pin != 0U)
+  {
+    MPU6050_DataReady(&hmpu6050);
+  }
+  device.written++;
+}
+
+static void Drain(void)
+{
+  UNIT_CHECK(MPU6050_Drain(&hmpu6050) != NULL);
+  (void)Mock_I2cRunAll(&hi2c);
+}
+
+/**
+  * @brief  Pop the ring and check the samples are the next ones expected.
+  * @param  first Number of the first sample expected
+  * @param  count Samples expected
+  * @param  stamped 1 when the timestamps must be the data-ready edges
+  */
+static void CheckSamples(uint32_t first, uint32_t count, uint8_t stamped)
+{
+  IMU_SampleTypeDef sample;
+  uint32_t n;
+  uint32_t i;
+
+  for (n = first; n < (first + count); n++)
+  {
+    UNIT_CHECK(ImuRing_Pop(&sample) == 1U);
+    for (i = 0U; i < 3U; i++)
+    {
+      UNIT_CHECK(sample.accel[i] == SampleAccel(n, i));
+      UNIT_CHECK(sample.gyro[i] == SampleGyro(n, i));
+    }
+    if (stamped != 0U)
+    {
+      UNIT_CHECK(sample.timestamp == edge_stamps[n]);
+    }
+    else
+    {
+      /* Dated from the period, within half a period of the edge */
+      UNIT_NEAR((double)sample.timestamp, (double)edge_stamps[n], (double)hmpu6050.period_cycles / 2.0);
+    }
+  }
+  UNIT_CHECK(ImuRing_Count() == 0U);
+}
+
+static void Setup(void)
+{
+  IMU_SampleTypeDef sample;
+
+  Mock_Reset();
+  mock_hal.cycle_step = 0U;
+  mock_hal.i2c_device = Device;
+  memset(&device, 0, sizeof(device));
+  device.regs[MPU6050_REG_WHO_AM_I] = 0x68U;
+  memset(&hi2c, 0, sizeof(hi2c));
+  hi2c.Instance = I2C1;
+  memset(&i2c_bus1, 0, sizeof(i2c_bus1));
+  I2C_Bus_Init(&i2c_bus1, &hi2c);
+  while (ImuRing_Pop(&sample) != 0U)
+  {
+  }
+
+  memset(&hmpu6050, 0, sizeof(hmpu6050));
+  MPU6050_Init(&hmpu6050, &i2c_bus1, MPU6050_ADDRESS);
+  MPU6050_Poll(&hmpu6050);
+  (void)Mock_I2cRunAll(&hi2c);
+  Mock_AdvanceUs(100000U);
+  MPU6050_Poll(&hmpu6050);
+  (void)Mock_I2cRunAll(&hi2c);
+}
+
+/* Tests ---------------------------------------------------------------------*/
+static void Test_BringUp(void)
+{
+  Setup();
+  UNIT_CHECK(hmpu6050.state == MPU6050_STATE_RUN);
+  UNIT_CHECK(device.regs[MPU6050_REG_SMPLRT_DIV] == MPU6050_SMPLRT_DIV);
+  UNIT_CHECK(device.regs[MPU6050_REG_GYRO_CONFIG] == 0x18U);
+  UNIT_CHECK(device.regs[MPU6050_REG_ACCEL_CONFIG] == 0x10U);
+  UNIT_CHECK(device.regs[MPU6050_REG_FIFO_EN] == 0x78U);
+  UNIT_CHECK(device.regs[MPU6050_REG_USER_CTRL] == 0x40U);
+  UNIT_CHECK(device.resets == 1U);
+  UNIT_CHECK(i2c_bus1.stats.failed == 0U);
+}
+
+static void Test_SteadyDrains(void)
+{
+  uint32_t batch;
+  uint32_t i;
+
+  Setup();
+  for (batch = 0U; batch < 20U; batch++)
+  {
+    for (i = 0U; i < MPU6050_DRAIN_SAMPLES; i++)
+    {
+      DeviceSample(1U);
+    }
+    Drain();
+    CheckSamples(batch * MPU6050_DRAIN_SAMPLES, MPU6050_DRAIN_SAMPLES, 1U);
+  }
+  UNIT_CHECK(hmpu6050.stats.samples == (20U * MPU6050_DRAIN_SAMPLES));
+  UNIT_CHECK(hmpu6050.stats.bursts == 20U);
+  UNIT_CHECK(hmpu6050.stats.fifo_overflows == 0U);
+
+  /* Two transactions per drain: FIFO count, then one burst */
+  UNIT_CHECK(i2c_bus1.stats.completed == (13U + (2U * 20U)));
+  UNIT_CHECK(hmpu6050.period_cycles == (PERIOD_US * 168U));
+}
+
+static void Test_PartialFifo(void)
+{
+  Setup();
+  DeviceSample(1U);
+  DeviceSample(1U);
+  Drain();
+  CheckSamples(0U, 2U, 1U);
+
+  /* An empty FIFO reads the count only */
+  Drain();
+  UNIT_CHECK(hmpu6050.stats.bursts == 1U);
+  UNIT_CHECK(hmpu6050.stats.drains == 2U);
+  CheckSamples(2U, 0U, 1U);
+
+  DeviceSample(1U);
+  Drain();
+  CheckSamples(2U, 1U, 1U);
+}
+
+static void Test_BacklogSplit(void)
+{
+  uint32_t i;
+
+  Setup();
+  for (i = 0U; i < 11U; i++)
+  {
+    DeviceSample(1U);
+  }
+
+  /* A burst carries at most MPU6050_MAX_BATCH samples, whole ones */
+  Drain();
+  UNIT_CHECK(hmpu6050.job.size == (MPU6050_MAX_BATCH * MPU6050_FIFO_SAMPLE_SIZE));
+  CheckSamples(0U, MPU6050_MAX_BATCH, 1U);
+  UNIT_CHECK(FifoCount() == (3U * MPU6050_FIFO_SAMPLE_SIZE));
+
+  /* The rest follows with the next drain, still dated by its own edges */
+  DeviceSample(1U);
+  Drain();
+  CheckSamples(MPU6050_MAX_BATCH, 4U, 1U);
+  UNIT_CHECK(hmpu6050.stats.bursts == 2U);
+  UNIT_CHECK(hmpu6050.stats.fifo_overflows == 0U);
+}
+
+static void Test_MisalignedCount(void)
+{
+  Setup();
+  DeviceSample(1U);
+  DeviceSample(1U);
+
+  /* Half a sample more, as after a lost byte */
+  FifoByte(0x55U);
+  Drain();
+  UNIT_CHECK(hmpu6050.stats.fifo_overflows == 1U);
+  UNIT_CHECK(hmpu6050.stats.bursts == 0U);
+  UNIT_CHECK(device.resets == 2U);
+  UNIT_CHECK(FifoCount() == 0U);
+  UNIT_CHECK(ImuRing_Count() == 0U);
+
+  /* The FIFO restarts clean */
+  DeviceSample(1U);
+  DeviceSample(1U);
+  Drain();
+  CheckSamples(2U, 2U, 1U);
+}
+
+static void Test_Overflow(void)
+{
+  uint32_t i;
+
+  Setup();
+  for (i = 0U; i < 90U; i++)
+  {
+    DeviceSample(1U);
+  }
+  UNIT_CHECK(FifoCount() == MPU6050_FIFO_SIZE);
+
+  Drain();
+  UNIT_CHECK(hmpu6050.stats.fifo_overflows == 1U);
+  UNIT_CHECK(hmpu6050.stats.bursts == 0U);
+  UNIT_CHECK(FifoCount() == 0U);
+  UNIT_CHECK(ImuRing_Count() == 0U);
+
+  for (i = 0U; i < MPU6050_DRAIN_SAMPLES; i++)
+  {
+    DeviceSample(1U);
+  }
+  Drain();
+  CheckSamples(90U, MPU6050_DRAIN_SAMPLES, 1U);
+}
+
+static void Test_SilentPin(void)
+{
+  uint32_t i;
+
+  Setup();
+  for (i = 0U; i < MPU6050_DRAIN_SAMPLES; i++)
+  {
+    DeviceSample(0U);
+  }
+
+  /* The newest sample is taken to be half a period old at count time */
+  Mock_AdvanceUs(PERIOD_US / 4U);
+  Drain();
+  CheckSamples(0U, MPU6050_DRAIN_SAMPLES, 0U);
+  UNIT_CHECK(hmpu6050.stats.nominal_stamped == MPU6050_DRAIN_SAMPLES);
+  UNIT_CHECK(hmpu6050.stats.drdy_stamped == 0U);
+}
+
+int main(void)
+{
+  UNIT_RUN(Test_BringUp);
+  UNIT_RUN(Test_SteadyDrains);
+  UNIT_RUN(Test_PartialFifo);
+  UNIT_RUN(Test_BacklogSplit);
+  UNIT_RUN(Test_MisalignedCount);
+  UNIT_RUN(Test_Overflow);
+  UNIT_RUN(Test_SilentPin);
+  return Unit_Result();
+}
@@ -0,0 +1,82 @@
+/**
+  ******************************************************************************
+  * @file    test_ms5611.c
+  * @brief   Host tests of the MS5611 conversions: the compensation against
+  *          the datasheet example and hand worked second order cases below
+  *          20 degC and -15 degC, and MS5611_Height() against the exact
+  *          barometric formula in double precision.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "ms5611.h"
+#include "mock_hal.h"
+#include "unit.h"
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  Height above the reference pressure, standard atmosphere, m.
+  */
+static double Height(double pressure, double reference)
+{
+  return 44330.8 * (1.0 - pow(pressure / reference, 0.190263));
+}
+
+/* Tests ---------------------------------------------------------------------*/
+static void Test_Compensate(void)
+{
+  static const uint16_t prom[MS5611_PROM_WORDS] = { 0U, 40127U, 36924U, 23317U, 23282U, 33464U, 28312U, 0U };
+  int32_t pressure;
+  int32_t temperature;
+
+  /* Datasheet example: 20.07 degC, 1000.09 mbar */
+  MS5611_Compensate(prom, 9085466U, 8569150U, &pressure, &temperature);
+  UNIT_CHECK(temperature == 2007);
+  UNIT_CHECK(pressure == 100009);
+
+  /* Cold, 10.66 degC: dT = -266784, first order TEMP = 1099, T2 = 33,
+   * OFF = 2371325755 - OFF2 2029502, SENS = 1290582307 - SENS2 1014751 */
+  MS5611_Compensate(prom, 8900000U, 8300000U, &pressure, &temperature);
+  UNIT_CHECK(temperature == 1066);
+  UNIT_CHECK(pressure == 94709);
+
+  /* Very cold, -25.71 degC: dT = -1166784, first order TEMP = -1938,
+   * T2 = 633, OFF = 2207624193 - OFF2 40112518 (of which 7 * 438^2),
+   * SENS = 1208608479 - SENS2 20439947 (of which 11 * 438^2 / 2) */
+  MS5611_Compensate(prom, 8500000U, 7400000U, &pressure, &temperature);
+  UNIT_CHECK(temperature == -2571);
+  UNIT_CHECK(pressure == 80818);
+}
+
+static void Test_Height(void)
+{
+  static const int32_t references[] = { 101325, 95000, 85000 };
+  double worst = 0.0;
+  uint32_t i;
+  int32_t p;
+
+  /* Sea level to 3000 m above it, every Pa */
+  for (i = 0U; i < 3U; i++)
+  {
+    float previous = 1e9f;
+
+    for (p = 70000; p <= 108000; p++)
+    {
+      float h = MS5611_Height(p, references[i]);
+      double e = fabs(h - Height(p, references[i]));
+
+      worst = (e > worst) ? e : worst;
+      UNIT_CHECK(h <= previous);
+      previous = h;
+    }
+    UNIT_NEAR(MS5611_Height(references[i], references[i]), 0.0, 1e-3);
+  }
+  UNIT_CHECK(worst < 0.01);
+  printf("  height: %.1f mm worst against pow()\n", worst * 1000.0);
+}
+
+int main(void)
+{
+  UNIT_RUN(Test_Compensate);
+  UNIT_RUN(Test_Height);
+  return Unit_Result();
+}
@@ -0,0 +1,371 @@
+/**
+  ******************************************************************************
+  * @file    test_spi_imu.c
+  * @brief   Host tests of the SPI1 IMU driver against register models of an
+  *          MPU-6000 and an ICM-42688: identification, reset and
+  *          configuration traffic, then the data-ready DMA bursts into
+  *          Imu2Ring, a busy edge, a DMA error and an unknown device.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "spi_imu.h"
+#include "sample_ring.h"
+#include "mock_hal.h"
+#include "unit.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define FRAME_LOG_LEN         64U
+
+/* Private types -------------------------------------------------------------*/
+/**
+  * @brief  Register layout of a modelled part, independent of the driver's.
+  */
+typedef struct
+{
+  uint8_t whoami;
+  uint8_t reset_reg;
+  uint8_t reset_value;
+  uint8_t burst_reg;                     /*!< First output register      */
+  uint8_t accel_reg;                     /*!< ACCEL_X high byte          */
+  uint8_t gyro_reg;                      /*!< GYRO_X high byte           */
+  const uint8_t (*config)[2];            /*!< Writes expected after reset */
+  uint32_t config_count;
+} ModelTypeDef;
+
+/**
+  * @brief  One chip select frame seen by the device.
+  */
+typedef struct
+{
+  uint8_t reg;
+  uint8_t read;
+  uint8_t value;                         /*!< First data byte written    */
+  uint32_t cr1;                          /*!< SPI1->CR1 at the frame     */
+  uint32_t cycles;                       /*!< Cycle time of the frame    */
+} FrameTypeDef;
+
+/**
+  * @brief  Simulated device.
+  */
+typedef struct
+{
+  const ModelTypeDef *model;
+  uint8_t regs[256];
+  uint8_t reg;                           /*!< Register pointer           */
+  uint8_t read;                          /*!< Frame direction            */
+  uint32_t resets;
+  uint64_t reset_cycles;                 /*!< Cycle time of the last reset */
+  FrameTypeDef frames[FRAME_LOG_LEN];
+  uint32_t frame_count;
+} DeviceTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static const uint8_t mpu6000_config[][2] =
+{
+  { 0x6BU, 0x01U }, { 0x6AU, 0x10U }, { 0x19U, 0x00U }, { 0x1AU, 0x00U },
+  { 0x1BU, 0x18U }, { 0x1CU, 0x10U }, { 0x37U, 0x10U }, { 0x38U, 0x01U },
+};
+
+static const uint8_t icm42688_config[][2] =
+{
+  { 0x4FU, 0x03U }, { 0x50U, 0x23U }, { 0x14U, 0x03U },
+  { 0x64U, 0x60U }, { 0x65U, 0x08U }, { 0x4EU, 0x0FU },
+};
+
+static const ModelTypeDef mpu6000 = { 0x68U, 0x6BU, 0x80U, 0x3BU, 0x3BU, 0x43U, mpu6000_config, 8U };
+static const ModelTypeDef icm20602 = { 0x12U, 0x6BU, 0x80U, 0x3BU, 0x3BU, 0x43U, mpu6000_config, 8U };
+static const ModelTypeDef icm42688 = { 0x47U, 0x11U, 0x01U, 0x1DU, 0x1FU, 0x25U, icm42688_config, 6U };
+static const ModelTypeDef unknown = { 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, NULL, 0U };
+
+static DeviceTypeDef device;
+
+/* Private functions ---------------------------------------------------------*/
+static int16_t SampleAccel(uint32_t n, uint32_t axis)
+{
+  return (int16_t)((n * 911U) + (axis * 3U) - 20000U);
+}
+
+static int16_t SampleGyro(uint32_t n, uint32_t axis)
+{
+  return (int16_t)(-(int32_t)(n * 577U) + (int32_t)axis);
+}
+
+static uint8_t Device(uint8_t mosi, uint32_t index)
+{
+  uint8_t miso = 0x00U;
+
+  if (index == 0U)
+  {
+    device.reg = mosi & 0x7FU;
+    device.read = mosi & 0x80U;
+    if (device.frame_count < FRAME_LOG_LEN)
+    {
+      FrameTypeDef *frame = &device.frames[device.frame_count];
+
+      frame->reg = device.reg;
+      frame->read = (device.read != 0U) ? 1U : 0U;
+      frame->cr1 = SPI1->CR1;
+      frame->cycles = Timing_Cycles();
+    }
+    device.frame_count++;
+    return miso;
+  }
+
+  if (device.read != 0U)
+  {
+    miso = device.regs[device.reg];
+  }
+  else
+  {
+    if ((index == 1U) && (device.frame_count <= FRAME_LOG_LEN))
+    {
+      device.frames[device.frame_count - 1U].value = mosi;
+    }
+    device.regs[device.reg] = mosi;
+    if ((device.reg == device.model->reset_reg) && (mosi == device.model->reset_value))
+    {
+      device.resets++;
+      device.reset_cycles = Timing_Cycles64();
+    }
+  }
+  device.reg++;
+  return miso;
+}
+
+/**
+  * @brief  Latch sample n into the output registers.
+  */
+static void DeviceSample(uint32_t n)
+{
+  uint32_t i;
+
+  for (i = 0U; i < 3U; i++)
+  {
+    device.regs[device.model->accel_reg + (2U * i)] = (uint8_t)((uint16_t)SampleAccel(n, i) >> 8);
+    device.regs[device.model->accel_reg + (2U * i) + 1U] = (uint8_t)SampleAccel(n, i);
+    device.regs[device.model->gyro_reg + (2U * i)] = (uint8_t)((uint16_t)SampleGyro(n, i) >> 8);
+    device.regs[device.model->gyro_reg + (2U * i) + 1U] = (uint8_t)SampleGyro(n, i);
+  }
+}
+
+static void Setup(const ModelTypeDef *model)
+{
+  IMU_SampleTypeDef sample;
+
+  Mock_Reset();
+  mock_hal.cycle_step = 0U;
+  mock_hal.spi_device = Device;
+  memset(&device, 0, sizeof(device));
+  device.model = model;
+  device.regs[0x75U] = model->whoami;
+  while (Imu2Ring_Pop(&sample) != 0U)
+  {
+  }
+  memset(&hspi_imu, 0, sizeof(hspi_imu));
+  SPI_IMU_Init(&hspi_imu);
+}
+
+/**
+  * @brief  Run the setup to RUN, checking the register traffic.
+  */
+static void BringUp(const ModelTypeDef *model)
+{
+  uint32_t i;
+
+  Setup(model);
+
+  /* Nothing before the power-up delay */
+  SPI_IMU_Poll(&hspi_imu);
+  UNIT_CHECK(device.frame_count == 0U);
+  Mock_AdvanceUs(SPI_IMU_RESET_DELAY_US);
+
+  /* WHO_AM_I, then the soft reset */
+  SPI_IMU_Poll(&hspi_imu);
+  UNIT_CHECK(hspi_imu.whoami == model->whoami);
+  UNIT_CHECK(hspi_imu.state == SPI_IMU_STATE_WAIT_RESET);
+  UNIT_CHECK(device.frame_count == 2U);
+  UNIT_CHECK((device.frames[0].reg == 0x75U) && (device.frames[0].read == 1U));
+  UNIT_CHECK((device.frames[1].reg == model->reset_reg) && (device.frames[1].read == 0U));
+  UNIT_CHECK(device.resets == 1U);
+
+  /* No access while the device reboots */
+  Mock_AdvanceUs(SPI_IMU_RESET_DELAY_US / 2U);
+  SPI_IMU_Poll(&hspi_imu);
+  SPI_IMU_Poll(&hspi_imu);
+  UNIT_CHECK(hspi_imu.state == SPI_IMU_STATE_WAIT_RESET);
+  UNIT_CHECK(device.frame_count == 2U);
+  Mock_AdvanceUs(SPI_IMU_RESET_DELAY_US / 2U);
+  SPI_IMU_Poll(&hspi_imu);
+  SPI_IMU_Poll(&hspi_imu);
+  UNIT_CHECK(hspi_imu.state == SPI_IMU_STATE_RUN);
+
+  /* The configuration, in order, one register per frame */
+  UNIT_CHECK(device.frame_count == (2U + model->config_count));
+  for (i = 0U; i < model->config_count; i++)
+  {
+    const FrameTypeDef *frame = &device.frames[2U + i];
+
+    UNIT_CHECK((frame->reg == model->config[i][0]) && (frame->value == model->config[i][1]));
+    UNIT_CHECK(frame->read == 0U);
+    UNIT_CHECK((frame->cycles - (uint32_t)device.reset_cycles) >= Timing_UsToCycles(SPI_IMU_RESET_DELAY_US));
+  }
+
+  /* Setup at the slow clock, mode 3 */
+  for (i = 0U; i < device.frame_count; i++)
+  {
+    UNIT_CHECK((device.frames[i].cr1 & SPI_CR1_BR) == SPI_IMU_BR_SETUP);
+    UNIT_CHECK((device.frames[i].cr1 & (SPI_CR1_CPOL | SPI_CR1_CPHA | SPI_CR1_MSTR | SPI_CR1_SPE)) ==
+               (SPI_CR1_CPOL | SPI_CR1_CPHA | SPI_CR1_MSTR | SPI_CR1_SPE));
+  }
+  UNIT_CHECK(device.resets == 1U);
+  UNIT_CHECK(mock_hal.basepri_calls == 0U);
+}
+
+/**
+  * @brief  One data-ready edge and its burst.
+  * @retval Cycle time of the edge
+  */
+static uint64_t Burst(uint32_t n)
+{
+  uint64_t edge;
+
+  Mock_AdvanceUs(1000000U / SPI_IMU_ODR_HZ);
+  DeviceSample(n);
+  edge = Timing_Cycles64();
+  SPI_IMU_DataReady(&hspi_imu);
+  UNIT_CHECK(hspi_imu.busy == 1U);
+  UNIT_CHECK(Mock_SpiDmaRun() == 1U);
+  UNIT_CHECK(hspi_imu.busy == 0U);
+
+  /* Chip select high and the DMA requests off again */
+  UNIT_CHECK(IMU2_CS_GPIO_Port->BSRR == IMU2_CS_Pin);
+  UNIT_CHECK((SPI1->CR2 & (SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN)) == 0U);
+  return edge;
+}
+
+static void CheckSample(uint32_t n, uint64_t edge)
+{
+  IMU_SampleTypeDef sample;
+  uint32_t i;
+
+  UNIT_CHECK(Imu2Ring_Pop(&sample) == 1U);
+  UNIT_CHECK(sample.timestamp == edge);
+  for (i = 0U; i < 3U; i++)
+  {
+    UNIT_CHECK(sample.accel[i] == SampleAccel(n, i));
+    UNIT_CHECK(sample.gyro[i] == SampleGyro(n, i));
+  }
+}
+
+static void RunBursts(const ModelTypeDef *model)
+{
+  uint32_t frames;
+  uint32_t n;
+
+  BringUp(model);
+  frames = device.frame_count;
+  for (n = 0U; n < 40U; n++)
+  {
+    uint64_t edge = Burst(n);
+
+    CheckSample(n, edge);
+  }
+  UNIT_CHECK(Imu2Ring_Count() == 0U);
+  UNIT_CHECK(hspi_imu.stats.samples == 40U);
+
+  /* One read frame per sample, from the first output register */
+  UNIT_CHECK(device.frame_count == (frames + 40U));
+  UNIT_CHECK(device.frames[frames].read == 1U);
+  UNIT_CHECK(device.frames[frames].reg == model->burst_reg);
+  UNIT_CHECK((device.frames[frames].cr1 & SPI_CR1_BR) == SPI_IMU_BR_RUN);
+}
+
+/* Tests ---------------------------------------------------------------------*/
+static void Test_Mpu6000(void)
+{
+  RunBursts(&mpu6000);
+}
+
+static void Test_Icm20602(void)
+{
+  /* Same family as the MPU-6000, other identifier */
+  RunBursts(&icm20602);
+}
+
+static void Test_Icm42688(void)
+{
+  RunBursts(&icm42688);
+}
+
+static void Test_BusyEdge(void)
+{
+  uint64_t edge;
+
+  BringUp(&mpu6000);
+  DeviceSample(0U);
+  edge = Timing_Cycles64();
+  SPI_IMU_DataReady(&hspi_imu);
+
+  /* An edge during the burst is dropped, the burst keeps its own stamp */
+  Mock_AdvanceUs(10U);
+  SPI_IMU_DataReady(&hspi_imu);
+  UNIT_CHECK(hspi_imu.stats.busy == 1U);
+  UNIT_CHECK(mock_hal.dma_count == 2U);
+  UNIT_CHECK(Mock_SpiDmaRun() == 1U);
+  CheckSample(0U, edge);
+  UNIT_CHECK(Imu2Ring_Count() == 0U);
+}
+
+static void Test_DmaError(void)
+{
+  uint64_t edge;
+
+  BringUp(&mpu6000);
+  SPI_IMU_DataReady(&hspi_imu);
+  hdma_spi1_tx.XferErrorCallback(&hdma_spi1_tx);
+  UNIT_CHECK(hspi_imu.stats.dma_errors == 1U);
+  UNIT_CHECK(mock_hal.dma_aborts == 2U);
+  UNIT_CHECK(hspi_imu.busy == 0U);
+  UNIT_CHECK(IMU2_CS_GPIO_Port->BSRR == IMU2_CS_Pin);
+  UNIT_CHECK((SPI1->CR2 & (SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN)) == 0U);
+  UNIT_CHECK(Imu2Ring_Count() == 0U);
+
+  /* The next edge starts afresh */
+  mock_hal.dma_count = 0U;
+  edge = Burst(1U);
+  CheckSample(1U, edge);
+}
+
+static void Test_Unknown(void)
+{
+  uint32_t i;
+
+  Setup(&unknown);
+  for (i = 0U; i < 10U; i++)
+  {
+    Mock_AdvanceUs(SPI_IMU_RESET_DELAY_US);
+    SPI_IMU_Poll(&hspi_imu);
+  }
+
+  /* Five attempts, only WHO_AM_I reads, no reset */
+  UNIT_CHECK(hspi_imu.state == SPI_IMU_STATE_ERROR);
+  UNIT_CHECK(device.frame_count == 5U);
+  for (i = 0U; i < device.frame_count; i++)
+  {
+    UNIT_CHECK((device.frames[i].reg == 0x75U) && (device.frames[i].read == 1U));
+  }
+  SPI_IMU_DataReady(&hspi_imu);
+  UNIT_CHECK(mock_hal.dma_count == 0U);
+}
+
+int main(void)
+{
+  UNIT_RUN(Test_Mpu6000);
+  UNIT_RUN(Test_Icm20602);
+  UNIT_RUN(Test_Icm42688);
+  UNIT_RUN(Test_BusyEdge);
+  UNIT_RUN(Test_DmaError);
+  UNIT_RUN(Test_Unknown);
+  return Unit_Result();
+}
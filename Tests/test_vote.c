@@ -0,0 +1,295 @@
+/**
+  ******************************************************************************
+  * @file    test_vote.c
+  * @brief   Host tests of the dual IMU voter by fault injection: two noisy
+  *          2 kHz streams of a known rate profile, then one of them stuck,
+  *          noisy, biased or silent from t = 1 s, under both policies.
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "vote.h"
+#include "mock_hal.h"
+#include "unit.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define STREAM_HZ             2000U
+#define DURATION_S            3.0
+#define FAULT_S               1.0
+#define SETTLE_S              0.2       /*!< Error measured from fault + this */
+#define START_CYCLES          1000000U
+
+/** Injected faults */
+#define BIAS_COUNTS           150.0f    /*!< 9 dps at +-2000 dps             */
+#define NOISE_COUNTS          300.0     /*!< Standard deviation              */
+
+/* Private types -------------------------------------------------------------*/
+typedef enum
+{
+  FAULT_NONE = 0U,
+  FAULT_STUCK,
+  FAULT_NOISY,
+  FAULT_BIAS,
+  FAULT_DROP
+} FaultTypeDef;
+
+/**
+  * @brief  Outcome of one scenario.
+  */
+typedef struct
+{
+  double rms_error;                      /*!< Output gyro X error after the fault, counts */
+  double max_step;                       /*!< Largest output to output error change,
+                                              once the fault is flagged            */
+  double detect_ms;                      /*!< Fault flagged after, -1 when never       */
+  uint32_t outputs;
+  Vote_HandleTypeDef vote;               /*!< Voter state at the end        */
+} ResultTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t random_state;
+
+/* Private functions ---------------------------------------------------------*/
+static double Uniform(void)
+{
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return (random_state + 1.0) / 4294967297.0;
+}
+
+static double Gauss(void)
+{
+  double u = Uniform();
+  double v = Uniform();
+
+  return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+/**
+  * @brief  True rate, counts: 200 dps sines of a few Hz.
+  */
+static double Truth(double t, uint32_t axis)
+{
+  return 16.4 * 200.0 * sin(2.0 * M_PI * (1.3 + axis) * t);
+}
+
+/**
+  * @brief  Run the two interleaved streams through the voter.
+  * @param  policy Voter policy
+  * @param  fault Fault injected from FAULT_S
+  * @param  bad Faulty stream
+  * @param  offset Constant difference of stream 1, counts
+  */
+static ResultTypeDef Scenario(Vote_PolicyTypeDef policy, FaultTypeDef fault, uint32_t bad, float offset)
+{
+  static Vote_HandleTypeDef vote;
+  ResultTypeDef result = { 0.0, 0.0, -1.0, 0U, { 0U } };
+  IMU_LoopSampleTypeDef last[VOTE_IMUS];
+  IMU_LoopSampleTypeDef sample;
+  IMU_LoopSampleTypeDef out;
+  double previous = 0.0;
+  uint32_t errors = 0U;
+  uint8_t produced;
+  uint8_t flagged;
+  uint8_t previous_flagged = 0U;
+  uint32_t step;
+  uint32_t k;
+
+  Vote_Init(&vote, policy);
+  random_state = 2463534242U;
+  memset(last, 0, sizeof(last));
+
+  for (step = 0U; step < (uint32_t)(DURATION_S * 2.0 * STREAM_HZ); step++)
+  {
+    uint32_t imu = step & 1U;
+    double t = step / (2.0 * STREAM_HZ);
+    uint64_t now = (uint64_t)(t * SystemCoreClock) + START_CYCLES;
+    uint8_t faulty = ((imu == bad) && (fault != FAULT_NONE) && (t > FAULT_S)) ? 1U : 0U;
+
+    sample.timestamp = now;
+    for (k = 0U; k < 3U; k++)
+    {
+      sample.gyro[k] = (float)(Truth(t, k) + Gauss()) + ((imu == 1U) ? offset : 0.0f);
+      sample.accel[k] = (float)(4096.0 + (5.0 * Gauss()));
+    }
+    if (faulty != 0U)
+    {
+      for (k = 0U; k < 3U; k++)
+      {
+        sample.gyro[k] += (fault == FAULT_NOISY) ? (float)(NOISE_COUNTS * Gauss()) : 0.0f;
+        sample.gyro[k] += (fault == FAULT_BIAS) ? BIAS_COUNTS : 0.0f;
+      }
+      if (fault == FAULT_STUCK)
+      {
+        /* Frozen output, fresh timestamps */
+        memcpy(sample.gyro, last[imu].gyro, sizeof(sample.gyro));
+        memcpy(sample.accel, last[imu].accel, sizeof(sample.accel));
+      }
+    }
+    if ((faulty == 0U) || (fault != FAULT_DROP))
+    {
+      if ((faulty == 0U) || (fault != FAULT_STUCK))
+      {
+        last[imu] = sample;
+      }
+      Vote_Push(&vote, imu, &sample);
+    }
+
+    flagged = ((t <= FAULT_S) || (result.detect_ms >= 0.0)) ? 1U : 0U;
+    produced = Vote_Run(&vote, now, &out);
+    if ((result.detect_ms < 0.0) && (t > FAULT_S) &&
+        ((vote.imu[bad].faults != 0U) || (vote.inconsistent != 0U)))
+    {
+      result.detect_ms = (t - FAULT_S) * 1000.0;
+    }
+    if (produced != 0U)
+    {
+      double error = out.gyro[0] - Truth((out.timestamp - START_CYCLES) / (double)SystemCoreClock, 0U);
+
+      /* Outputs taken before the fault is flagged carry it, unavoidably */
+      if ((result.outputs != 0U) && (flagged != 0U) && (previous_flagged != 0U) &&
+          (fabs(error - previous) > result.max_step))
+      {
+        result.max_step = fabs(error - previous);
+      }
+      if (t > (FAULT_S + SETTLE_S))
+      {
+        result.rms_error += error * error;
+        errors++;
+      }
+      previous = error;
+      previous_flagged = flagged;
+      result.outputs++;
+    }
+  }
+  result.rms_error = sqrt(result.rms_error / errors);
+  result.vote = vote;
+  return result;
+}
+
+/* Tests ---------------------------------------------------------------------*/
+static void Test_NoFault(void)
+{
+  ResultTypeDef blend = Scenario(VOTE_POLICY_BLEND, FAULT_NONE, 0U, 0.0f);
+  ResultTypeDef select = Scenario(VOTE_POLICY_SELECT, FAULT_NONE, 0U, 0.0f);
+
+  UNIT_CHECK(blend.detect_ms < 0.0);
+  UNIT_CHECK(select.detect_ms < 0.0);
+  UNIT_CHECK(blend.outputs == (uint32_t)(DURATION_S * STREAM_HZ));
+  UNIT_CHECK(select.outputs == (uint32_t)(DURATION_S * STREAM_HZ));
+  UNIT_CHECK((blend.vote.active == 3U) && (select.vote.active == 1U));
+  UNIT_CHECK((blend.vote.stats.switches == 0U) && (select.vote.stats.switches == 0U));
+
+  /* Blending two equal streams averages their noise */
+  UNIT_CHECK(select.rms_error < 1.5);
+  UNIT_CHECK(blend.rms_error < (0.8 * select.rms_error));
+}
+
+/**
+  * @brief  A fault flagged on the stream, failover to the other one without
+  *         a step and output accuracy kept.
+  */
+static void CheckFailover(FaultTypeDef fault, uint8_t flag, double detect_ms)
+{
+  uint32_t policy;
+  uint32_t bad;
+
+  for (policy = 0U; policy < 2U; policy++)
+  {
+    for (bad = 0U; bad < VOTE_IMUS; bad++)
+    {
+      ResultTypeDef r = Scenario((Vote_PolicyTypeDef)policy, fault, bad, 0.0f);
+
+      UNIT_CHECK((r.detect_ms >= 0.0) && (r.detect_ms <= detect_ms));
+      UNIT_CHECK((r.vote.imu[bad].faults & flag) != 0U);
+      UNIT_CHECK(r.vote.imu[1U - bad].faults == 0U);
+      UNIT_CHECK(r.vote.primary == (1U - bad));
+      UNIT_CHECK(r.vote.active == (1U << (1U - bad)));
+      UNIT_CHECK(r.vote.stats.switches == ((bad != 0U) ? 0U : 1U));
+      UNIT_CHECK(r.rms_error < 1.5);
+      UNIT_CHECK(r.max_step < 10.0);
+
+      /* A silent primary costs the outputs of the stale timeout only */
+      UNIT_CHECK(r.outputs >= ((uint32_t)(DURATION_S * STREAM_HZ) - (2U * VOTE_TIMEOUT_US * STREAM_HZ / 1000000U)));
+    }
+  }
+}
+
+static void Test_Stuck(void)
+{
+  CheckFailover(FAULT_STUCK, VOTE_FAULT_STUCK, 1000.0 * (VOTE_STUCK_SAMPLES + 1U) / STREAM_HZ);
+}
+
+static void Test_Noisy(void)
+{
+  CheckFailover(FAULT_NOISY, VOTE_FAULT_NOISY, 5.0);
+}
+
+static void Test_Dropped(void)
+{
+  CheckFailover(FAULT_DROP, VOTE_FAULT_STALE, (VOTE_TIMEOUT_US / 1000.0) + 1.0);
+}
+
+static void Test_BiasSecondary(void)
+{
+  uint32_t policy;
+
+  /* Flagged as an inconsistency, the primary alone is used */
+  for (policy = 0U; policy < 2U; policy++)
+  {
+    ResultTypeDef r = Scenario((Vote_PolicyTypeDef)policy, FAULT_BIAS, 1U, 0.0f);
+
+    UNIT_CHECK((r.detect_ms >= 0.0) && (r.detect_ms < 20.0));
+    UNIT_CHECK(r.vote.inconsistent == 1U);
+    UNIT_CHECK(r.vote.stats.inconsistencies == 1U);
+    UNIT_CHECK((r.vote.primary == 0U) && (r.vote.active == 1U));
+    UNIT_CHECK(r.rms_error < 1.5);
+  }
+}
+
+static void Test_BiasPrimary(void)
+{
+  uint32_t policy;
+
+  /* Two streams cannot tell which one is biased: with no fault history to
+     break the tie the primary is kept, and so is its bias */
+  for (policy = 0U; policy < 2U; policy++)
+  {
+    ResultTypeDef r = Scenario((Vote_PolicyTypeDef)policy, FAULT_BIAS, 0U, 0.0f);
+
+    UNIT_CHECK((r.detect_ms >= 0.0) && (r.detect_ms < 20.0));
+    UNIT_CHECK(r.vote.inconsistent == 1U);
+    UNIT_CHECK((r.vote.primary == 0U) && (r.vote.active == 1U));
+    UNIT_CHECK(r.vote.stats.switches == 0U);
+    UNIT_NEAR(r.rms_error, BIAS_COUNTS, 2.0);
+  }
+}
+
+static void Test_HandoverOffset(void)
+{
+  uint32_t policy;
+
+  /* Streams 30 counts apart: losing one shifts the output to the other
+     through the decaying offset, not in one step */
+  for (policy = 0U; policy < 2U; policy++)
+  {
+    ResultTypeDef r = Scenario((Vote_PolicyTypeDef)policy, FAULT_STUCK, 0U, 30.0f);
+
+    UNIT_CHECK(r.vote.primary == 1U);
+    UNIT_CHECK(r.max_step < 10.0);
+    UNIT_NEAR(r.rms_error, 30.0, 2.0);
+  }
+}
+
+int main(void)
+{
+  UNIT_RUN(Test_NoFault);
+  UNIT_RUN(Test_Stuck);
+  UNIT_RUN(Test_Noisy);
+  UNIT_RUN(Test_Dropped);
+  UNIT_RUN(Test_BiasSecondary);
+  UNIT_RUN(Test_BiasPrimary);
+  UNIT_RUN(Test_HandoverOffset);
+  return Unit_Result();
+}
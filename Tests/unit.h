@@ -0,0 +1,80 @@
+/**
+  ******************************************************************************
+  * @file    unit.h
+  * @brief   This file contains the checks shared by the host unit tests. A
+  *          test executable returns non zero when any check failed.
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __UNIT_H__
+#define __UNIT_H__
+
+/* Includes ------------------------------------------------------------------*/
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+/* Private variables ---------------------------------------------------------*/
+static unsigned int unit_checks;
+static unsigned int unit_failures;
+
+/* Exported macro ------------------------------------------------------------*/
+#define UNIT_CHECK(cond)                                                         \
+  do                                                                             \
+  {                                                                              \
+    unit_checks++;                                                               \
+    if (!(cond))                                                                 \
+    {                                                                            \
+      unit_failures++;                                                           \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);            \
+    }                                                                            \
+  } while (0)
+
+#define UNIT_NEAR(value, expected, tolerance)                                    \
+  do                                                                             \
+  {                                                                              \
+    double unit_v = (double)(value);                                             \
+    double unit_e = (double)(expected);                                          \
+    unit_checks++;                                                               \
+    if (!(fabs(unit_v - unit_e) <= (double)(tolerance)))                         \
+    {                                                                            \
+      unit_failures++;                                                           \
+      printf("%s:%d: %s = %.9g, expected %.9g +- %.3g\n", __FILE__, __LINE__,    \
+             #value, unit_v, unit_e, (double)(tolerance));                       \
+    }                                                                            \
+  } while (0)
+
+#define UNIT_RUN(test)                                                           \
+  do                                                                             \
+  {                                                                              \
+    unsigned int unit_before = unit_failures;                                    \
+    test();                                                                      \
+    printf("%-40s %s\n", #test, (unit_failures == unit_before) ? "ok" : "FAILED"); \
+  } while (0)
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Print the summary of the executable.
+  * @retval Exit code: 0 when every check passed
+  */
+static inline int Unit_Result(void)
+{
+  printf("%u checks, %u failed\n", unit_checks, unit_failures);
+  return (unit_failures == 0U) ? 0 : 1;
+}
+
+/**
+  * @brief  Monotonic host time for the benchmarks. Host timings only compare
+  *         implementations with each other, the target figures come from the
+  *         DWT counter.
+  * @retval Time in nanoseconds
+  */
+static inline double Unit_Nanoseconds(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((double)now.tv_sec * 1e9) + (double)now.tv_nsec;
+}
+
+#endif /* __UNIT_H__ */